@@ -0,0 +1,172 @@
+/**
+ * This file contains a load test for the parse server. Several clients send
+ * procedurally generated cabinet fronts to a running server and the client
+ * side latency and the throughput are reported as a JSON line.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "parser/server.h"
+#include "parser/synthetic.h"
+
+/**
+ * Returns the p-th percentile (nearest rank) of the samples
+ */
+double percentile(std::vector<double> samples, double p)
+{
+    if (samples.size() == 0)
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const size_t rank = static_cast<size_t>(std::ceil(p/100.0*samples.size()));
+    return samples[std::max(static_cast<size_t>(1), rank) - 1];
+}
+
+/**
+ * Prints the usage
+ */
+void printUsage()
+{
+    std::cout << "Usage: loadtest [socket] [--clients n] [--requests n] [--parts n] [--scenes n] [--seed s]" << std::endl;
+    std::cout << "Start the server first: $ bin/cli serve [socket]" << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc < 2)
+    {
+        printUsage();
+        return 1;
+    }
+
+    const std::string socketPath(argv[1]);
+    int numClients = 4;
+    int numRequests = 10;
+    int numParts = 8;
+    int numScenes = 8;
+    unsigned int seed = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (i + 1 < argc && arg == "--clients")
+        {
+            numClients = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--requests")
+        {
+            numRequests = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--parts")
+        {
+            numParts = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--scenes")
+        {
+            numScenes = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--seed")
+        {
+            seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    // The scenes are generated up front such that the clients only measure
+    // the server
+    parser::SyntheticSceneGenerator generator(seed);
+    std::vector<cv::Mat> images(std::max(1, numScenes)), depthImages(images.size());
+    std::vector<parser::Segmentation> segmentations(images.size());
+    for (size_t s = 0; s < images.size(); s++)
+    {
+        generator.generate(numParts, images[s], segmentations[s], depthImages[s]);
+    }
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    std::vector<double> serverTimes;
+    int numErrors = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    for (int c = 0; c < numClients; c++)
+    {
+        clients.push_back(std::thread([&, c]()
+        {
+            parser::ParseClient client;
+            if (!client.connect(socketPath))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::cout << "Client " << c << " could not connect to " << socketPath << std::endl;
+                numErrors += numRequests;
+                return;
+            }
+
+            for (int r = 0; r < numRequests; r++)
+            {
+                const size_t s = (c*numRequests + r) % images.size();
+
+                std::vector<parser::Part> parts;
+                std::vector< std::pair<std::string, double> > timings;
+                std::string error;
+
+                const auto requestStart = std::chrono::steady_clock::now();
+                const bool success = client.parse(images[s], depthImages[s], segmentations[s].regionOfInterest, parts, timings, error);
+                const double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - requestStart).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!success)
+                {
+                    std::cout << "Request failed: " << error << std::endl;
+                    numErrors++;
+                    if (!client.connect(socketPath))
+                    {
+                        numErrors += numRequests - r - 1;
+                        return;
+                    }
+                    continue;
+                }
+
+                latencies.push_back(latency);
+                for (size_t t = 0; t < timings.size(); t++)
+                {
+                    if (timings[t].first == "total")
+                    {
+                        serverTimes.push_back(timings[t].second);
+                    }
+                }
+            }
+        }));
+    }
+
+    for (size_t c = 0; c < clients.size(); c++)
+    {
+        clients[c].join();
+    }
+
+    const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "{\"clients\":" << numClients
+              << ",\"requests\":" << latencies.size()
+              << ",\"errors\":" << numErrors
+              << ",\"duration\":" << duration
+              << ",\"throughput\":" << (duration > 0 ? latencies.size()/duration : 0)
+              << ",\"latency_median\":" << percentile(latencies, 50)
+              << ",\"latency_p95\":" << percentile(latencies, 95)
+              << ",\"server_total_median\":" << percentile(serverTimes, 50)
+              << "}" << std::endl;
+
+    return numErrors > 0 ? 2 : 0;
+}
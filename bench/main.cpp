@@ -0,0 +1,209 @@
+/**
+ * This file contains the benchmark of the parse pipeline. The benchmark runs
+ * on procedurally generated cabinet fronts and reports the latency of the
+ * individual stages as JSON lines.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "parser/parser.h"
+#include "parser/synthetic.h"
+
+/**
+ * The stages that are reported. Every stage is the sum of one or more
+ * instrumentation stages.
+ */
+static const int NUM_STAGES = 6;
+static const char* stageNames[NUM_STAGES] = {
+    "edge_detection", "line_detector", "rectangle_detector", "select_parts", "annealing", "total"
+};
+static const char* stageTimers[NUM_STAGES][2] = {
+    {"forest_rgb", "forest_depth"}, {"lines", 0}, {"rectangles", 0}, {"select_parts", 0}, {"annealing", 0}, {"total", 0}
+};
+
+/**
+ * Returns the p-th percentile (nearest rank) of the samples
+ */
+double percentile(std::vector<double> samples, double p)
+{
+    if (samples.size() == 0)
+    {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const size_t rank = static_cast<size_t>(std::ceil(p/100.0*samples.size()));
+    return samples[std::max(static_cast<size_t>(1), rank) - 1];
+}
+
+/**
+ * Returns the mean of the samples
+ */
+double mean(const std::vector<double> & samples)
+{
+    double sum = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        sum += samples[i];
+    }
+    return samples.size() > 0 ? sum/samples.size() : 0;
+}
+
+/**
+ * Parses a comma separated list of integers
+ */
+std::vector<int> parseList(const std::string & str)
+{
+    std::vector<int> result;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        result.push_back(std::stoi(item));
+    }
+    return result;
+}
+
+/**
+ * Prints the usage
+ */
+void printUsage()
+{
+    std::cout << "Usage: benchmark [--parts 4,8,16] [--scenes n] [--warmup n] [--seed s] [--output file] [--verbose]" << std::endl;
+    std::cout << "Run the benchmark in the directory that contains the trained models." << std::endl;
+}
+
+int main(int argc, const char** argv)
+{
+    std::vector<int> complexities = {4, 8, 16, 32};
+    int numScenes = 20;
+    int numWarmup = 1;
+    unsigned int seed = 0;
+    std::string outputFile;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--verbose")
+        {
+            verbose = true;
+        }
+        else if (i + 1 < argc && arg == "--parts")
+        {
+            complexities = parseList(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--scenes")
+        {
+            numScenes = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--warmup")
+        {
+            numWarmup = std::stoi(argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--seed")
+        {
+            seed = static_cast<unsigned int>(std::stoul(argv[++i]));
+        }
+        else if (i + 1 < argc && arg == "--output")
+        {
+            outputFile = argv[++i];
+        }
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!outputFile.empty())
+    {
+        file.open(outputFile);
+        if (!file.is_open())
+        {
+            std::cout << "Could not open " << outputFile << std::endl;
+            return 1;
+        }
+    }
+    std::ostream & out = outputFile.empty() ? std::cout : file;
+
+    // The pipeline is very chatty. Unless requested, we mute it during parsing
+    std::stringstream sink;
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+
+    parser::CabinetParser parser;
+    parser.getInstrumentation().setEnabled(true);
+
+    for (size_t c = 0; c < complexities.size(); c++)
+    {
+        const int numParts = complexities[c];
+
+        // Every complexity gets its own reproducible set of scenes
+        parser::SyntheticSceneGenerator generator(seed + static_cast<unsigned int>(numParts));
+
+        std::vector< std::vector<double> > samples(NUM_STAGES);
+        std::map<std::string, std::vector<double> > counters;
+
+        for (int s = 0; s < numWarmup + numScenes; s++)
+        {
+            cv::Mat image, imageDepth;
+            parser::Segmentation segmentation;
+            generator.generate(numParts, image, segmentation, imageDepth);
+
+            std::vector<parser::Part> parts;
+            if (!verbose)
+            {
+                std::cout.rdbuf(sink.rdbuf());
+            }
+            parser.parse(image, imageDepth, segmentation.regionOfInterest, parts);
+            std::cout.rdbuf(coutBuffer);
+            sink.str("");
+
+            if (s < numWarmup)
+            {
+                continue;
+            }
+
+            const parser::Instrumentation & instrumentation = parser.getInstrumentation();
+            for (int t = 0; t < NUM_STAGES; t++)
+            {
+                double time = 0;
+                for (int k = 0; k < 2 && stageTimers[t][k] != 0; k++)
+                {
+                    time += instrumentation.getTime(stageTimers[t][k]);
+                }
+                samples[t].push_back(time);
+            }
+
+            counters["proposals"].push_back(instrumentation.getCounter("proposals"));
+            counters["hypotheses"].push_back(instrumentation.getCounter("hypotheses"));
+            counters["sa_iterations"].push_back(instrumentation.getCounter("sa_iterations"));
+            counters["detected_parts"].push_back(parts.size());
+        }
+
+        for (int t = 0; t < NUM_STAGES; t++)
+        {
+            out << "{\"parts\":" << numParts
+                << ",\"stage\":\"" << stageNames[t] << "\""
+                << ",\"samples\":" << samples[t].size()
+                << ",\"median\":" << percentile(samples[t], 50)
+                << ",\"p95\":" << percentile(samples[t], 95)
+                << ",\"mean\":" << mean(samples[t])
+                << "}" << std::endl;
+        }
+
+        out << "{\"parts\":" << numParts << ",\"counters\":{";
+        for (std::map<std::string, std::vector<double> >::const_iterator it = counters.begin(); it != counters.end(); ++it)
+        {
+            out << (it == counters.begin() ? "" : ",") << "\"" << it->first << "\":" << mean(it->second);
+        }
+        out << "}}" << std::endl;
+    }
+
+    return 0;
+}
@@ -4,8 +4,19 @@
 
 #include <iostream>
 #include <chrono>
+#include <random>
+#include <algorithm>
 
 #include "parser/parser.h"
+#include "parser/parse_cache.h"
+#include "parser/parse_record.h"
+#include "parser/server.h"
+#include "parser/util.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
 
 /**
  * Trains the pipeline on the data in the specified directory.
@@ -22,6 +33,21 @@ int parse(int argc, const char** argv);
  */
 int test(int argc, const char** argv);
 
+/**
+ * Exports the quantized edge detector models
+ */
+int quantizeEdgeDetector(int argc, const char** argv);
+
+/**
+ * Exports the compressed edge detector models
+ */
+int compressEdgeDetector(int argc, const char** argv);
+
+/**
+ * Converts the edge detector models to the flat format
+ */
+int convertEdgeDetector(int argc, const char** argv);
+
 /**
  * Exports some visualizations
  */
@@ -47,6 +73,71 @@ int visualizeParseGraph(int argc, const char** argv);
  */
 int exportAppearanceDescriptors(int argc, const char** argv);
 
+/**
+ * Inspects and verifies the parse result cache
+ */
+int cache(int argc, const char** argv);
+
+/**
+ * Serves parse requests over a Unix domain socket
+ */
+int serve(int argc, const char** argv);
+
+/**
+ * Computes precision/recall statistics for threshold grids from stored 
+ * parse records
+ */
+int sweep(int argc, const char** argv);
+
+/**
+ * Reduces the trained shape prior SVMs to a linear model file
+ */
+int exportShapePrior(int argc, const char** argv);
+
+/**
+ * Handles the options starting at first: "--stats [file]" enables the 
+ * instrumentation, "--cache [directory]" enables the parse result cache and
+ * "--records [directory]" stores the parse records of the test images.
+ * Returns false if there are unknown arguments. 
+ */
+bool parseStatsOption(int argc, const char** argv, int first, parser::CabinetParser & parser, parser::ParseCache & cache)
+{
+    for (int i = first; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+        
+        const std::string option(argv[i]);
+        if (option == "--stats")
+        {
+            parser.getInstrumentation().setEnabled(true);
+            parser.getInstrumentation().setOutputFile(argv[i + 1]);
+        }
+        else if (option == "--cache")
+        {
+            if (!cache.open(argv[i + 1]))
+            {
+                return false;
+            }
+            parser.setCache(&cache);
+        }
+        else if (option == "--records")
+        {
+            if (!parser.setRecordDirectory(argv[i + 1]))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 int main(int argc, const char** argv)
 {
     // There must be at least one argument
@@ -76,6 +167,18 @@ int main(int argc, const char** argv)
     {
         return test(argc, argv);
     }
+    else if (function == "quantizeEdgeDetector")
+    {
+        return quantizeEdgeDetector(argc, argv);
+    }
+    else if (function == "compressEdgeDetector")
+    {
+        return compressEdgeDetector(argc, argv);
+    }
+    else if (function == "convertEdgeDetector")
+    {
+        return convertEdgeDetector(argc, argv);
+    }
     else if (function == "createGeneralEdgeDetectorSet")
     {
         return createGeneralEdgeDetectorSet(argc, argv);
@@ -96,6 +199,22 @@ int main(int argc, const char** argv)
     {
         return exportAppearanceDescriptors(argc, argv);
     }
+    else if (function == "cache")
+    {
+        return cache(argc, argv);
+    }
+    else if (function == "serve")
+    {
+        return serve(argc, argv);
+    }
+    else if (function == "sweep")
+    {
+        return sweep(argc, argv);
+    }
+    else if (function == "exportShapePrior")
+    {
+        return exportShapePrior(argc, argv);
+    }
     else
     {
         std::cout << "Unknown function." << std::endl;
@@ -122,30 +241,92 @@ int train(int argc, const char** argv)
 }
 
 int test(int argc, const char** argv)
+{
+    parser::CabinetParser parser;
+    parser::ParseCache cache;
+    
+    // There must be a directory
+    if (argc < 3 || !parseStatsOption(argc, argv, 3, parser, cache))
+    {
+        std::cout << "Please specify a directory: $ bin test [directory] [--stats file] [--cache directory] [--records directory]" << std::endl;
+        return 1;
+    }
+    
+    std::string directory(argv[2]);
+    
+    parser.test(directory);
+    
+    if (parser.getInstrumentation().isEnabled())
+    {
+        parser.getInstrumentation().reportAll();
+    }
+    
+    return 0;
+}
+
+int quantizeEdgeDetector(int argc, const char** argv)
 {
     // There must be a directory
     if (argc != 3)
     {
-        std::cout << "Please specify a directory: $ bin test [directory]" << std::endl;
+        std::cout << "Please specify a validation directory: $ bin quantizeEdgeDetector [directory]" << std::endl;
         return 1;
     }
     
     std::string directory(argv[2]);
     
     parser::CabinetParser parser;
-    parser.test(directory);
+    parser.quantizeEdgeDetector(directory);
     
     return 0;
 }
 
+int compressEdgeDetector(int argc, const char** argv)
+{
+    // There must be a directory
+    if (argc < 3 || argc > 4)
+    {
+        std::cout << "Please specify a validation directory: $ bin compressEdgeDetector [directory] [number of trees]" << std::endl;
+        return 1;
+    }
+    
+    std::string directory(argv[2]);
+    const int numTrees = argc == 4 ? std::stoi(argv[3]) : 24;
+    if (numTrees <= 0)
+    {
+        std::cout << "The number of trees must be positive" << std::endl;
+        return 1;
+    }
+    
+    parser::CabinetParser parser;
+    parser.compressEdgeDetector(directory, numTrees);
+    
+    return 0;
+}
+
+int convertEdgeDetector(int argc, const char** argv)
+{
+    if (argc != 2)
+    {
+        std::cout << "This function takes no arguments: $ bin convertEdgeDetector" << std::endl;
+        return 1;
+    }
+    
+    parser::CabinetParser parser;
+    return parser.convertEdgeDetector() ? 0 : 1;
+}
+
 #include "parser/energy.h"
 
 int parse(int argc, const char** argv)
 {
+    parser::CabinetParser parser;
+    parser::ParseCache cache;
+    
     // You have to specify a directory and a number
-    if (argc != 4)
+    if (argc < 4 || !parseStatsOption(argc, argv, 4, parser, cache))
     {
-        std::cout << "Please specify a directory and an image number: $ bin train [directory] [number]" << std::endl;
+        std::cout << "Please specify a directory and an image number: $ bin parse [directory] [number] [--stats file] [--cache directory]" << std::endl;
         return 1;
     }
     
@@ -164,11 +345,11 @@ int parse(int argc, const char** argv)
     parser::Segmentation segmentation;
     segmentation.readAnnotationFile(auxFile);
     
-    parser::CabinetParser parser;
-    
     // Parse the image
     std::vector<parser::Part> result;
     parser.parse(image, imageD, segmentation.regionOfInterest, result);
+    parser.getInstrumentation().setCounter("parts", result.size());
+    parser.getInstrumentation().emitRecord(number);
     
     cv::Mat demo;
     parser.visualizeSegmentation(image, segmentation.regionOfInterest, result, demo);
@@ -322,3 +503,340 @@ int exportAppearanceDescriptors(int argc, const char** argv)
     
     return 0;
 }
+
+/**
+ * Returns the fraction of parts that have a counterpart with the same label 
+ * and an IoU of at least 0.5 in the other result, relative to the larger 
+ * result. Two empty results match perfectly.
+ */
+float matchParts(const std::vector<parser::Part> & cached, const std::vector<parser::Part> & fresh)
+{
+    if (cached.size() == 0 && fresh.size() == 0)
+    {
+        return 1.0f;
+    }
+    
+    int numMatched = 0;
+    std::vector<bool> used(fresh.size(), false);
+    for (size_t i = 0; i < cached.size(); i++)
+    {
+        for (size_t j = 0; j < fresh.size(); j++)
+        {
+            if (!used[j] && cached[i].label == fresh[j].label && parser::RectangleUtil::calcIOU(cached[i].rect, fresh[j].rect) >= 0.5f)
+            {
+                used[j] = true;
+                numMatched++;
+                break;
+            }
+        }
+    }
+    return numMatched/static_cast<float>(std::max(cached.size(), fresh.size()));
+}
+
+int cache(int argc, const char** argv)
+{
+    const std::string usage = "Please specify a command: $ bin cache stats [cache directory] or $ bin cache verify [cache directory] [image directory] [--sample n]";
+    if (argc < 4)
+    {
+        std::cout << usage << std::endl;
+        return 1;
+    }
+    
+    const std::string command(argv[2]);
+    parser::ParseCache cache;
+    if (!cache.open(argv[3]))
+    {
+        return 1;
+    }
+    
+    std::vector<std::string> keys;
+    cache.listKeys(keys);
+    
+    if (command == "stats")
+    {
+        std::cout << keys.size() << " entries in " << cache.getDirectory() << std::endl;
+        return 0;
+    }
+    
+    if (command != "verify" || (argc != 5 && !(argc == 7 && std::string(argv[5]) == "--sample")))
+    {
+        std::cout << usage << std::endl;
+        return 1;
+    }
+    
+    const std::string directory(argv[4]);
+    const int sampleSize = argc == 7 ? std::stoi(argv[6]) : 10;
+    
+    // The entries are addressed by content, hence we have to recompute the
+    // keys of the images in order to find them
+    parser::CabinetParser parser;
+    std::vector< std::tuple<cv::Mat, parser::Segmentation, cv::Mat> > images;
+    parser.loadImage(directory, images);
+    
+    std::vector< std::pair<size_t, std::string> > candidates;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const std::string key = parser::ParseCache::computeKey(
+                std::get<0>(images[i]), 
+                std::get<2>(images[i]), 
+                std::get<1>(images[i]).regionOfInterest, 
+                parser.getModelFingerprint());
+        if (cache.contains(key))
+        {
+            candidates.push_back(std::make_pair(i, key));
+        }
+    }
+    
+    std::cout << candidates.size() << " of " << images.size() << " images are cached, " 
+            << keys.size() << " entries in total" << std::endl;
+    
+    // Re-parse a deterministic sample without the cache. The annealing is 
+    // randomly seeded, hence two parses of the same image rarely agree 
+    // exactly. An entry is only reported as stale if less than this fraction
+    // of the parts agree.
+    const float minMatchScore = 0.5f;
+    
+    std::mt19937 g(0);
+    std::shuffle(candidates.begin(), candidates.end(), g);
+    candidates.resize(std::min(candidates.size(), static_cast<size_t>(std::max(sampleSize, 0))));
+    
+    int numStale = 0;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        const size_t i = candidates[c].first;
+        
+        std::vector<parser::Part> cached;
+        if (!cache.lookup(candidates[c].second, cached))
+        {
+            continue;
+        }
+        
+        std::vector<parser::Part> fresh;
+        parser.parse(std::get<0>(images[i]), std::get<2>(images[i]), std::get<1>(images[i]).regionOfInterest, fresh);
+        
+        const float score = matchParts(cached, fresh);
+        if (score < minMatchScore)
+        {
+            std::cout << "Stale entry " << candidates[c].second << " for image " << std::get<1>(images[i]).id 
+                    << ": " << cached.size() << " cached parts, " << fresh.size() << " parsed parts, " 
+                    << score << " agree" << std::endl;
+            numStale++;
+        }
+    }
+    
+    std::cout << numStale << " of " << candidates.size() << " verified entries are stale" << std::endl;
+    
+    return numStale > 0 ? 4 : 0;
+}
+
+/**
+ * The running server, stopped on SIGINT and SIGTERM
+ */
+static parser::ParseServer* runningServer = 0;
+
+static void stopServer(int)
+{
+    if (runningServer != 0)
+    {
+        runningServer->stop();
+    }
+}
+
+int serve(int argc, const char** argv)
+{
+    if (argc < 3 || argc % 2 != 1)
+    {
+        std::cout << "Please specify a socket: $ bin serve [socket] [--workers n] [--threads n] [--queue n]" << std::endl;
+        return 1;
+    }
+    
+    const std::string socketPath(argv[2]);
+    
+    // The models are loaded once and shared by all workers
+    parser::CabinetParser parser;
+    parser.loadModels();
+    
+    parser::ParseServer server(parser);
+    for (int i = 3; i < argc; i += 2)
+    {
+        const std::string option(argv[i]);
+        if (option == "--workers")
+        {
+            server.model.numWorkers = std::atoi(argv[i + 1]);
+        }
+        else if (option == "--threads")
+        {
+            server.model.numThreadsPerWorker = std::atoi(argv[i + 1]);
+        }
+        else if (option == "--queue")
+        {
+            server.model.maxPendingConnections = std::atoi(argv[i + 1]);
+        }
+        else
+        {
+            std::cout << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+    
+    if (!server.listen(socketPath))
+    {
+        return 1;
+    }
+    
+    runningServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    std::signal(SIGPIPE, SIG_IGN);
+    
+    std::cout << "Listening on " << socketPath << " with " << server.model.numWorkers << " workers" << std::endl;
+    server.run();
+    runningServer = 0;
+    
+    std::cout << server.getNumRequests() << " requests served, " << server.getNumErrors() << " failed, " 
+            << server.getNumRejected() << " connections rejected" << std::endl;
+    
+    return 0;
+}
+
+/**
+ * Parses a comma separated list of thresholds. Returns false if the list is
+ * empty or invalid.
+ */
+bool parseThresholds(const std::string & list, std::vector<float> & thresholds)
+{
+    thresholds.clear();
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        try
+        {
+            thresholds.push_back(std::stof(item));
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return thresholds.size() > 0;
+}
+
+/**
+ * Returns the thresholds first, first + step, ... up to last
+ */
+std::vector<float> thresholdRange(float first, float last, float step)
+{
+    std::vector<float> thresholds;
+    for (int i = 0; first + i*step <= last + 1e-4f; i++)
+    {
+        thresholds.push_back(first + i*step);
+    }
+    return thresholds;
+}
+
+int sweep(int argc, const char** argv)
+{
+    const std::string usage = "Please specify a record directory: $ bin sweep [directory] [--acceptance a,b,...] [--posterior a,b,...] [--pruning a,b,...] [--output file]";
+    if (argc < 3 || argc % 2 != 1)
+    {
+        std::cout << usage << std::endl;
+        return 1;
+    }
+    
+    std::vector<float> acceptanceThresholds = thresholdRange(0.5f, 0.9f, 0.05f);
+    std::vector<float> posteriorThresholds = thresholdRange(0.0f, 0.9f, 0.1f);
+    std::vector<float> pruningThresholds(1, 0.0f);
+    std::string outputFile;
+    
+    for (int i = 3; i < argc; i += 2)
+    {
+        const std::string option(argv[i]);
+        bool valid = true;
+        if (option == "--acceptance")
+        {
+            valid = parseThresholds(argv[i + 1], acceptanceThresholds);
+        }
+        else if (option == "--posterior")
+        {
+            valid = parseThresholds(argv[i + 1], posteriorThresholds);
+        }
+        else if (option == "--pruning")
+        {
+            valid = parseThresholds(argv[i + 1], pruningThresholds);
+        }
+        else if (option == "--output")
+        {
+            outputFile = argv[i + 1];
+        }
+        else
+        {
+            valid = false;
+        }
+        
+        if (!valid)
+        {
+            std::cout << usage << std::endl;
+            return 1;
+        }
+    }
+    
+    const auto start = std::chrono::steady_clock::now();
+    
+    parser::ParseRecordEvaluator evaluator;
+    if (evaluator.addDirectory(argv[2]) <= 0)
+    {
+        std::cout << "No parse records found in " << argv[2] << std::endl;
+        return 1;
+    }
+    
+    std::vector<parser::PrecisionRecallPoint> points;
+    evaluator.sweep(acceptanceThresholds, posteriorThresholds, pruningThresholds, points);
+    
+    const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    if (outputFile.empty())
+    {
+        for (size_t p = 0; p < points.size(); p++)
+        {
+            points[p].writeJson(std::cout);
+        }
+    }
+    else
+    {
+        std::ofstream os(outputFile);
+        if (!os.is_open())
+        {
+            std::cout << "Could not open " << outputFile << std::endl;
+            return 1;
+        }
+        for (size_t p = 0; p < points.size(); p++)
+        {
+            points[p].writeJson(os);
+        }
+    }
+    
+    std::cerr << points.size() << " threshold combinations on " << evaluator.size() << " records in " << duration << "s" << std::endl;
+    
+    return 0;
+}
+
+int exportShapePrior(int argc, const char** argv)
+{
+    if (argc > 3)
+    {
+        std::cout << "Please specify an output file: $ bin exportShapePrior [file]" << std::endl;
+        return 1;
+    }
+    
+    const std::string file = argc == 3 ? argv[2] : "shapePrior.dat";
+    
+    parser::CabinetParser parser;
+    if (!parser.exportShapePrior(file))
+    {
+        std::cout << "Could not export the shape prior to " << file << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
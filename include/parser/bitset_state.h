@@ -0,0 +1,276 @@
+#ifndef PARSER_BITSET_STATE_H
+#define PARSER_BITSET_STATE_H
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <algorithm>
+
+namespace parser {
+
+    /**
+     * This is an annealing state over a fixed set of hypotheses. Membership
+     * is stored in a bitset, the selected hypotheses additionally in a dense
+     * list such that the state can be iterated like a MCMCParserStateType.
+     * Insert, remove and contains are O(1). Copying between states of the
+     * same capacity does not allocate. The state maintains a 64 bit Zobrist
+     * hash that is updated incrementally and can be used for memoization.
+     */
+    class MCMCParserBitsetState {
+    public:
+        MCMCParserBitsetState() : numHypotheses(0), hash(0) {}
+
+        /**
+         * Creates an empty state over the given number of hypotheses
+         */
+        explicit MCMCParserBitsetState(int _numHypotheses) : numHypotheses(0), hash(0)
+        {
+            reset(_numHypotheses);
+        }
+
+        MCMCParserBitsetState(const MCMCParserBitsetState & other) : numHypotheses(0), hash(0)
+        {
+            copyFrom(other);
+        }
+
+        MCMCParserBitsetState & operator=(const MCMCParserBitsetState & other)
+        {
+            copyFrom(other);
+            return *this;
+        }
+
+        /**
+         * Clears the state and sets the number of hypotheses. This is the
+         * only function that allocates memory.
+         */
+        void reset(int _numHypotheses)
+        {
+            numHypotheses = _numHypotheses;
+            words.assign((numHypotheses + 63)/64, 0);
+            positions.resize(numHypotheses);
+            active.clear();
+            active.reserve(numHypotheses);
+            hash = 0;
+        }
+
+        /**
+         * Returns the number of hypotheses
+         */
+        int capacity() const
+        {
+            return numHypotheses;
+        }
+
+        /**
+         * Returns the number of selected hypotheses
+         */
+        size_t size() const
+        {
+            return active.size();
+        }
+
+        /**
+         * Returns the i-th selected hypothesis (in no particular order)
+         */
+        int operator[](size_t i) const
+        {
+            return active[i];
+        }
+
+        /**
+         * Returns an iterator over the selected hypotheses
+         */
+        std::vector<int>::const_iterator begin() const
+        {
+            return active.begin();
+        }
+
+        /**
+         * Returns the end iterator of the selected hypotheses
+         */
+        std::vector<int>::const_iterator end() const
+        {
+            return active.end();
+        }
+
+        /**
+         * Returns true if the hypothesis is selected
+         */
+        bool contains(int h) const
+        {
+            assert(h >= 0 && h < numHypotheses);
+            return (words[h >> 6] >> (h & 63)) & 1;
+        }
+
+        /**
+         * Selects a hypothesis. Returns false if it was already selected.
+         */
+        bool insert(int h)
+        {
+            if (contains(h))
+            {
+                return false;
+            }
+
+            words[h >> 6] |= static_cast<uint64_t>(1) << (h & 63);
+            positions[h] = static_cast<int>(active.size());
+            active.push_back(h);
+            hash ^= key(h);
+            return true;
+        }
+
+        /**
+         * Deselects a hypothesis. Returns false if it was not selected.
+         */
+        bool remove(int h)
+        {
+            if (!contains(h))
+            {
+                return false;
+            }
+
+            words[h >> 6] &= ~(static_cast<uint64_t>(1) << (h & 63));
+
+            // Move the last entry of the list into the gap
+            const int position = positions[h];
+            const int last = active.back();
+            active[position] = last;
+            positions[last] = position;
+            active.pop_back();
+            hash ^= key(h);
+            return true;
+        }
+
+        /**
+         * Deselects all hypotheses in O(size())
+         */
+        void clear()
+        {
+            for (size_t i = 0; i < active.size(); i++)
+            {
+                words[active[i] >> 6] = 0;
+            }
+            active.clear();
+            hash = 0;
+        }
+
+        /**
+         * Copies the other state. No memory is allocated if both states have
+         * the same capacity.
+         */
+        void copyFrom(const MCMCParserBitsetState & other)
+        {
+            if (this == &other)
+            {
+                return;
+            }
+            if (numHypotheses != other.numHypotheses)
+            {
+                reset(other.numHypotheses);
+            }
+
+            std::copy(other.words.begin(), other.words.end(), words.begin());
+            active.assign(other.active.begin(), other.active.end());
+
+            // Positions of deselected hypotheses are never read, hence only
+            // the selected ones are updated
+            for (size_t i = 0; i < active.size(); i++)
+            {
+                positions[active[i]] = static_cast<int>(i);
+            }
+            hash = other.hash;
+        }
+
+        /**
+         * Swaps the contents with another state in O(1)
+         */
+        void swap(MCMCParserBitsetState & other)
+        {
+            std::swap(numHypotheses, other.numHypotheses);
+            words.swap(other.words);
+            positions.swap(other.positions);
+            active.swap(other.active);
+            std::swap(hash, other.hash);
+        }
+
+        /**
+         * Returns the 64 bit hash of the selected set. Equal sets have equal
+         * hashes regardless of the order of insertion.
+         */
+        uint64_t getHash() const
+        {
+            return hash;
+        }
+
+        /**
+         * Returns true if both states select the same hypotheses
+         */
+        bool operator==(const MCMCParserBitsetState & other) const
+        {
+            return hash == other.hash && active.size() == other.active.size() && words == other.words;
+        }
+
+        /**
+         * Returns the raw bitset words
+         */
+        const std::vector<uint64_t> & getWords() const
+        {
+            return words;
+        }
+
+        /**
+         * Sets the state from a list of hypotheses. Duplicates are ignored.
+         */
+        void assign(const std::vector<int> & hypotheses)
+        {
+            clear();
+            for (size_t i = 0; i < hypotheses.size(); i++)
+            {
+                insert(hypotheses[i]);
+            }
+        }
+
+        /**
+         * Writes the selected hypotheses to a list
+         */
+        void toVector(std::vector<int> & hypotheses) const
+        {
+            hypotheses.assign(active.begin(), active.end());
+        }
+
+        /**
+         * Returns the Zobrist key of a hypothesis (splitmix64 of the index)
+         */
+        static uint64_t key(int h)
+        {
+            uint64_t z = static_cast<uint64_t>(h) + 0x9E3779B97F4A7C15ull;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+    private:
+        /**
+         * The number of hypotheses
+         */
+        int numHypotheses;
+        /**
+         * The membership bits
+         */
+        std::vector<uint64_t> words;
+        /**
+         * The position of every selected hypothesis in the active list
+         */
+        std::vector<int> positions;
+        /**
+         * The selected hypotheses
+         */
+        std::vector<int> active;
+        /**
+         * The Zobrist hash of the selected set
+         */
+        uint64_t hash;
+    };
+}
+
+#endif
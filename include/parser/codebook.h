@@ -0,0 +1,183 @@
+#ifndef PARSER_CODEBOOK_H
+#define PARSER_CODEBOOK_H
+
+/**
+ * This file contains the batched appearance scoring. A descriptor x is
+ * reconstructed from the atoms (columns) C of a codebook with latent
+ * weights pi >= 0, sum(pi) <= 1, that minimize |x - C pi|. All descriptors
+ * of an image are stacked into one matrix such that the products with the
+ * codebook are a single matrix multiplication.
+ */
+
+#include <vector>
+#include <Eigen/Dense>
+
+namespace parser {
+
+    /**
+     * Computes latent weights and reconstruction errors for many
+     * descriptors at once
+     */
+    class CodebookScorer {
+    public:
+        /**
+         * The parameters of this class
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() : maxIterations(1000), tolerance(1e-6f), chunkSize(256) {}
+
+            /**
+             * The maximum number of projected gradient iterations
+             */
+            int maxIterations;
+            /**
+             * The iterations stop once no weight changes by more than this
+             */
+            float tolerance;
+            /**
+             * The number of descriptors that are stacked and scored 
+             * together. This bounds the memory of the stacked descriptors.
+             */
+            int chunkSize;
+        };
+
+        /**
+         * Default constructor
+         */
+        CodebookScorer() : model() {}
+
+        /**
+         * Solves min 1/2 pi^T G pi - b^T pi s.t. pi >= 0, sum(pi) <= 1 for
+         * every column b of products. gram is the K x K matrix C^T C and
+         * products is the K x N matrix C^T X. The result is K x N.
+         */
+        void solveLatentVariables(  const Eigen::MatrixXf & gram,
+                                    const Eigen::MatrixXf & products,
+                                    Eigen::MatrixXf & pis) const;
+
+        /**
+         * Same as solveLatentVariables, but starts from the given K x N 
+         * weights (e.g. the solution for the previous codebook)
+         */
+        void refineLatentVariables( const Eigen::MatrixXf & gram,
+                                    const Eigen::MatrixXf & products,
+                                    Eigen::MatrixXf & pis) const;
+
+        /**
+         * Computes the latent weights of all descriptors (columns of a
+         * D x N matrix) for a D x K codebook
+         */
+        void determineLatentVariables(  const Eigen::MatrixXf & codebook,
+                                        const Eigen::MatrixXf & descriptors,
+                                        Eigen::MatrixXf & pis) const;
+
+        /**
+         * Computes the RMS reconstruction error of all descriptors for a
+         * single codebook
+         */
+        void calcErrors(const Eigen::MatrixXf & codebook,
+                        const Eigen::MatrixXf & descriptors,
+                        Eigen::VectorXf & errors) const;
+
+        /**
+         * Computes the N x L matrix of reconstruction errors for the first
+         * L codebooks
+         */
+        void calcErrors(const std::vector<Eigen::MatrixXf> & codebooks,
+                        int numLabels,
+                        const Eigen::MatrixXf & descriptors,
+                        Eigen::MatrixXf & errors) const;
+
+        /**
+         * Projects a vector onto the set {pi >= 0, sum(pi) <= 1}
+         */
+        static void project(Eigen::Ref<Eigen::VectorXf> pi);
+
+        /**
+         * The parameter model
+         */
+        Model model;
+    };
+
+    /**
+     * Learns a codebook C >= 0 that minimizes |X - C Pi| over the 
+     * codebook and the latent weights of the training descriptors by 
+     * alternating between the two
+     */
+    class CodebookLearner {
+    public:
+        /**
+         * The parameters of this class
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() : runs(3), maxIterations(100), maxUpdateIterations(500), tolerance(1e-4f), seed(0) {}
+
+            /**
+             * The number of runs from different random codebooks
+             */
+            int runs;
+            /**
+             * The maximum number of alternations per run
+             */
+            int maxIterations;
+            /**
+             * The maximum number of projected gradient iterations of a 
+             * codebook update
+             */
+            int maxUpdateIterations;
+            /**
+             * A run stops once the error changes by less than this fraction
+             */
+            float tolerance;
+            /**
+             * The seed of the random initializations
+             */
+            unsigned int seed;
+        };
+
+        /**
+         * Default constructor
+         */
+        CodebookLearner() : model() {}
+
+        /**
+         * Learns a D x K codebook for the D x N descriptors. The runs are 
+         * performed in parallel. Returns the error |X - C Pi| of the best 
+         * codebook.
+         */
+        float learn(const Eigen::MatrixXf & descriptors, int K, Eigen::MatrixXf & codebook) const;
+
+        /**
+         * Performs a single run starting from the given codebook and returns
+         * the error of the best codebook
+         */
+        float learnRun(const Eigen::MatrixXf & descriptors, Eigen::MatrixXf & codebook) const;
+
+        /**
+         * Solves min |X - C Pi| s.t. C >= 0 for fixed weights starting from
+         * the given codebook
+         */
+        void updateCodebook(const Eigen::MatrixXf & descriptors,
+                            const Eigen::MatrixXf & pis,
+                            Eigen::MatrixXf & codebook) const;
+
+        /**
+         * The parameter model
+         */
+        Model model;
+        /**
+         * Determines the latent weights
+         */
+        CodebookScorer scorer;
+    };
+}
+
+#endif
@@ -100,6 +100,136 @@ namespace parser {
         Model model;
     };
     
+    /**
+     * Detects horizontal and vertical lines in a rectified edge image. The
+     * result equals running LineDetector for both orientations with an
+     * increasing minimum length until there are at most maxLines lines. The
+     * hough accumulator is built once and only for the angles that can pass
+     * the axis alignment test. Lines at other angles that only clip a corner
+     * of the image over a few pixels are not detected.
+     */
+    class AxisAlignedLineDetector {
+    public:
+        /**
+         * The parameters of this class
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model () :  epsilon(1.5),
+                        minLength(30),
+                        lengthStep(10),
+                        maxLines(30),
+                        hough (0.5, CV_PI/180, 20, 2, 13) {}
+            
+            /**
+             * The maximum deviation of the end points orthogonal to the axis
+             */
+            double epsilon;
+            /**
+             * The initial minimum number of votes of a line
+             */
+            double minLength;
+            /**
+             * The increment of the minimum number of votes
+             */
+            double lengthStep;
+            /**
+             * The maximum number of horizontal and vertical lines
+             */
+            int maxLines;
+            /**
+             * The discretization of the hough transform (rho and theta)
+             */
+            OpenCVModels::Hough hough;
+        };
+        
+        /**
+         * Default constructor
+         */
+        AxisAlignedLineDetector() : model() {}
+        
+        /**
+         * Detects the horizontal and vertical lines in a binary edge image.
+         * Returns the minimum length that has been used.
+         */
+        double detectLines( const cv::Mat & image,
+                            std::vector<LineSegment> & resultH,
+                            std::vector<LineSegment> & resultV) const;
+        
+        /**
+         * The parameter model
+         */
+        Model model;
+    };
+    
+    /**
+     * Decides in constant time whether all border pixels of an axis aligned
+     * rectangle are supported by edges, i.e. whether their distance to the
+     * nearest edge is at most a threshold. Every row and column stores the
+     * prefix counts of the supported pixels, hence a rectangle is checked
+     * with four differences of prefix counts regardless of its size.
+     */
+    class BorderSupportIndex {
+    public:
+        /**
+         * Creates an empty index
+         */
+        BorderSupportIndex() : rows(0), cols(0) {}
+        
+        /**
+         * Builds the index from a distance transform (CV_32FC1)
+         */
+        void build(const cv::Mat & distanceTransform, float threshold);
+        
+        /**
+         * Returns true if the borders of the rectangle are supported. The
+         * borders are sampled in steps of one pixel starting at the top left
+         * corner. Borders that leave the image are not supported.
+         */
+        bool isSupported(const Rectangle & r) const;
+        
+        /**
+         * Returns the acceptance predicate for the rectangle detector. The
+         * index must outlive the predicate.
+         */
+        std::function<bool(const Rectangle &)> getPredicate() const
+        {
+            return [this](const Rectangle & r) -> bool {
+                return isSupported(r);
+            };
+        }
+    
+    private:
+        /**
+         * Returns true if the n pixels starting at (x, y) in a row are
+         * supported
+         */
+        bool isRowSupported(int y, int x, int n) const;
+        
+        /**
+         * Returns true if the n pixels starting at (x, y) in a column are
+         * supported
+         */
+        bool isColumnSupported(int x, int y, int n) const;
+        
+        /**
+         * The image size
+         */
+        int rows;
+        int cols;
+        /**
+         * The prefix counts of every row (cols + 1 entries per row)
+         */
+        std::vector<int> rowCounts;
+        /**
+         * The prefix counts of every column (rows + 1 entries per column)
+         */
+        std::vector<int> columnCounts;
+    };
+    
     /**
      * Detects rectangles in an image
      */
@@ -136,6 +266,11 @@ namespace parser {
          */
         RectangleDetector() : model() {}
         
+        /**
+         * Creates a detector with the given parameters
+         */
+        RectangleDetector(const Model & _model) : model(_model) {}
+        
         /**
          * Detects rectangles in an image. The result is a list of rectangles
          * and their projections to the unit rectangle.
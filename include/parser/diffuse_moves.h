@@ -5,6 +5,9 @@
 #include <opencv2/opencv.hpp>
 #include "rjmcmc_sa.h"
 #include "parser.h"
+#include "hypothesis_table.h"
+#include "similarity_index.h"
+#include "sampling.h"
 
 namespace parser
 {
@@ -21,7 +24,7 @@ namespace parser
     */
     class MCMCParserCallback : public SACallback {
     public:
-        MCMCParserCallback(const std::vector<Part> & parts) : parts(parts) {}
+        MCMCParserCallback(const PartHypothesisTable & hypotheses) : hypotheses(&hypotheses) {}
 
         /**
         * The function that is called
@@ -36,9 +39,9 @@ namespace parser
 
     private:
         /**
-        * The list of parts
+        * The part hypotheses
         */
-        std::vector<Part> parts;
+        const PartHypothesisTable* hypotheses;
     };
 
 
@@ -47,8 +50,8 @@ namespace parser
     */
     class MCMCParserExchangeMove : public SAMove {
     public:
-        MCMCParserExchangeMove(std::vector<Part> partHypotheses) : partHypotheses(partHypotheses),
-            g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, partHypotheses.size()-1) {}
+        MCMCParserExchangeMove(const PartHypothesisTable & hypotheses) : hypotheses(&hypotheses),
+            g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, hypotheses.size()-1) {}
 
         /**
         * Computes the move
@@ -58,6 +61,16 @@ namespace parser
             MCMCParserStateType & newState,
             float & logAcceptRatio
                 );
+        
+        /**
+        * Computes the move on a bitset state. The replacing part is never
+        * part of the state already.
+        */
+        void move(
+            const MCMCParserBitsetState & state,
+            MCMCParserBitsetState & newState,
+            float & logAcceptRatio
+                );
 
     private:
         /**
@@ -74,9 +87,9 @@ namespace parser
         std::uniform_int_distribution<int> dist;
 
         /**
-        * This is the vector of parts
+        * The part hypotheses
         */
-        std::vector<Part> partHypotheses;
+        const PartHypothesisTable* hypotheses;
 
 
     };
@@ -86,9 +99,18 @@ namespace parser
      */
     class MCMCParserDDExchangeMove : public SAMove {
     public:
-        MCMCParserDDExchangeMove(std::vector<Part> partHypotheses, Eigen::MatrixXi overlapPairs70) : overlapPairs70(overlapPairs70),
-            numProposals(partHypotheses.size()), partHypotheses(partHypotheses), rouletteDist(0, 1),
-            g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, partHypotheses.size()-1) {}
+        MCMCParserDDExchangeMove(const PartHypothesisTable & hypotheses, const SimilarityIndex & similarityIndex) : similarityIndex(&similarityIndex),
+            numProposals(hypotheses.size()), hypotheses(&hypotheses), rouletteDist(0, 1),
+            g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, hypotheses.size()-1)
+        {
+            // least posterior parts must be selected more frequently
+            std::vector<float> weights(hypotheses.size());
+            for (int h = 0; h < hypotheses.size(); h++)
+            {
+                weights[h] = std::max(0.0f, 1.0f - hypotheses.getPosterior(h));
+            }
+            roulette.reset(weights);
+        }
 
         /**
          * Computes the move
@@ -98,14 +120,29 @@ namespace parser
             MCMCParserStateType & newState,
             float & logAcceptRatio
                 );
-        /*
-         * Find structurally similar rectangles for exchange
-         **/
-        int computeSimilarRects(const int rectIDx, std::vector<int> & similarRects);
+        
+        /**
+         * Computes the move on a bitset state
+         */
+        void move(
+            const MCMCParserBitsetState & state,
+            MCMCParserBitsetState & newState,
+            float & logAcceptRatio
+                );
         /*
          * Weighted sampling strategy
          **/
-        int computeRussianRoulette(const MCMCParserStateType state);
+        int computeRussianRoulette(const MCMCParserStateType & state);
+        
+        /**
+         * Puts the parts of the initial state into the roulette
+         */
+        void begin(const MCMCParserStateType & state);
+        
+        /**
+         * Updates the roulette with the parts that were born or died
+         */
+        void accepted(const std::vector<int> & born, const std::vector<int> & died);
 
     private:
         /**
@@ -125,17 +162,21 @@ namespace parser
          */
         std::uniform_real_distribution<float> rouletteDist;
         /**
-         * This is rectangle parts
+         * The part hypotheses
          */
-        std::vector<Part> partHypotheses;
+        const PartHypothesisTable* hypotheses;
         /**
          * This is the number of proposals
          */
         int numProposals;
         /**
-         * This is the matrix with overlap>70% proposals and < 100%
+         * The proposals with overlap>70% and < 100% for every proposal
+         */
+        const SimilarityIndex* similarityIndex;
+        /**
+         * Weighted sampling of the parts in the state
          */
-        Eigen::MatrixXi overlapPairs70;
+        StateWeightSampler roulette;
 
     };
 
@@ -191,8 +232,8 @@ namespace parser
      */
     class MCMCParserLabelDiffuseMove : public SAMove {
     public:
-        MCMCParserLabelDiffuseMove(std::vector<Part> parts) :
-            partHypotheses(parts), g(std::chrono::high_resolution_clock::now().time_since_epoch().count()) {}
+        MCMCParserLabelDiffuseMove(const PartHypothesisTable & hypotheses) :
+            hypotheses(&hypotheses), g(std::chrono::high_resolution_clock::now().time_since_epoch().count()) {}
 
         /**
          * Computes the move
@@ -215,7 +256,7 @@ namespace parser
         /*
          * the weighted and labelled rectangles
         */
-        std::vector<Part> partHypotheses;
+        const PartHypothesisTable* hypotheses;
     };
 
 
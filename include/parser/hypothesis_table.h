@@ -0,0 +1,295 @@
+#ifndef PARSER_HYPOTHESIS_TABLE_H
+#define PARSER_HYPOTHESIS_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+#include "parser.h"
+
+namespace parser {
+
+    /**
+     * This is a columnar table of labelled part hypotheses. Every hypothesis
+     * refers to a rectangle. The rectangle geometry (corners, bounds, mean
+     * depth and projection profiles) is stored once per rectangle, hence the
+     * three labelled hypotheses h*3+l of a rectangle share it. The profiles
+     * of all rectangles live in a single arena.
+     *
+     * Consumers refer to hypotheses by their index (the same index that is
+     * used in the annealing state) instead of holding copies of Part objects.
+     */
+    class PartHypothesisTable {
+    public:
+        /**
+         * A hypothesis is referred to by its index
+         */
+        typedef int Handle;
+
+        /**
+         * A read only view on a profile in the arena
+         */
+        class ProfileView {
+        public:
+            ProfileView(const int* first, const int* last) : first(first), last(last) {}
+
+            const int* begin() const
+            {
+                return first;
+            }
+
+            const int* end() const
+            {
+                return last;
+            }
+
+            size_t size() const
+            {
+                return static_cast<size_t>(last - first);
+            }
+
+            int operator[](size_t i) const
+            {
+                return first[i];
+            }
+
+        private:
+            const int* first;
+            const int* last;
+        };
+
+        PartHypothesisTable()
+        {
+            clear();
+        }
+
+        /**
+         * Removes all hypotheses and rectangles
+         */
+        void clear();
+
+        /**
+         * Reserves memory for the given number of rectangles with the given
+         * number of labels each
+         */
+        void reserve(int numRectangles, int numLabels);
+
+        /**
+         * Adds the geometry of a rectangle and returns its index
+         */
+        int addRectangle(   const Rectangle & rect,
+                            float meanDepth,
+                            const std::vector<int> & projProf,
+                            const std::vector<int> & projProfTyp);
+
+        /**
+         * Adds a labelled hypothesis of a previously added rectangle
+         */
+        Handle addHypothesis(   int rectangle,
+                                int label,
+                                float likelihood,
+                                float shapePrior,
+                                float posterior);
+
+        /**
+         * Adds a part. The geometry of the last rectangle is reused if the
+         * part has the same geometry.
+         */
+        Handle add(const Part & part);
+
+        /**
+         * Replaces the content of the table by the given parts
+         */
+        void assign(const std::vector<Part> & parts);
+
+        /**
+         * Returns the number of hypotheses
+         */
+        int size() const
+        {
+            return static_cast<int>(labels.size());
+        }
+
+        /**
+         * Returns the number of distinct rectangles
+         */
+        int getNumRectangles() const
+        {
+            return static_cast<int>(meanDepths.size());
+        }
+
+        /**
+         * Returns the rectangle index of a hypothesis
+         */
+        int getRectangleIndex(Handle h) const
+        {
+            return rectangles[h];
+        }
+
+        int getLabel(Handle h) const
+        {
+            return labels[h];
+        }
+
+        float getPosterior(Handle h) const
+        {
+            return posteriors[h];
+        }
+
+        float getLikelihood(Handle h) const
+        {
+            return likelihoods[h];
+        }
+
+        float getShapePrior(Handle h) const
+        {
+            return shapePriors[h];
+        }
+
+        float getMeanDepth(Handle h) const
+        {
+            return meanDepths[rectangles[h]];
+        }
+
+        float getMinX(Handle h) const
+        {
+            return bounds[4*rectangles[h]];
+        }
+
+        float getMinY(Handle h) const
+        {
+            return bounds[4*rectangles[h] + 1];
+        }
+
+        float getMaxX(Handle h) const
+        {
+            return bounds[4*rectangles[h] + 2];
+        }
+
+        float getMaxY(Handle h) const
+        {
+            return bounds[4*rectangles[h] + 3];
+        }
+
+        /**
+         * Returns the width of the axis aligned bounding box
+         */
+        float getWidth(Handle h) const
+        {
+            return getMaxX(h) - getMinX(h);
+        }
+
+        /**
+         * Returns the height of the axis aligned bounding box
+         */
+        float getHeight(Handle h) const
+        {
+            return getMaxY(h) - getMinY(h);
+        }
+
+        /**
+         * Returns the rectangle of a hypothesis
+         */
+        Rectangle getRectangle(Handle h) const;
+
+        /**
+         * Returns the edge projection profile of a hypothesis
+         */
+        ProfileView getProjProf(Handle h) const
+        {
+            const int r = rectangles[h];
+            return ProfileView(profileArena.data() + profileOffsets[2*r], profileArena.data() + profileOffsets[2*r + 1]);
+        }
+
+        /**
+         * Returns the typical edge projection profile of a hypothesis
+         */
+        ProfileView getProjProfTyp(Handle h) const
+        {
+            const int r = rectangles[h];
+            return ProfileView(profileArena.data() + profileOffsets[2*r + 1], profileArena.data() + profileOffsets[2*r + 2]);
+        }
+
+        /**
+         * Returns the posterior column
+         */
+        const std::vector<float> & getPosteriors() const
+        {
+            return posteriors;
+        }
+
+        /**
+         * Returns the label column
+         */
+        const std::vector<int> & getLabels() const
+        {
+            return labels;
+        }
+
+        /**
+         * Materializes a single hypothesis as a part
+         */
+        void getPart(Handle h, Part & part) const;
+
+        /**
+         * Materializes all hypotheses as parts
+         */
+        void toParts(std::vector<Part> & parts) const;
+
+        /**
+         * Returns the number of bytes occupied by the columns
+         */
+        size_t getMemorySize() const;
+
+    private:
+        /**
+         * Returns true if the part has the same geometry as the given
+         * rectangle
+         */
+        bool hasGeometry(int r, const Part & part) const;
+
+        /**
+         * Per hypothesis: the rectangle index
+         */
+        std::vector<int> rectangles;
+        /**
+         * Per hypothesis: the class label
+         */
+        std::vector<int> labels;
+        /**
+         * Per hypothesis: the visual weight p(P|I)
+         */
+        std::vector<float> posteriors;
+        /**
+         * Per hypothesis: the appearance likelihood
+         */
+        std::vector<float> likelihoods;
+        /**
+         * Per hypothesis: the shape prior probability
+         */
+        std::vector<float> shapePriors;
+        /**
+         * Per rectangle: the four corners (x0,y0,...,x3,y3)
+         */
+        std::vector<float> corners;
+        /**
+         * Per rectangle: the bounds (minX,minY,maxX,maxY)
+         */
+        std::vector<float> bounds;
+        /**
+         * Per rectangle: the mean depth
+         */
+        std::vector<float> meanDepths;
+        /**
+         * Per rectangle: the start of projProf, the start of projProfTyp and
+         * (as the start of the next rectangle) the end of projProfTyp in the
+         * arena
+         */
+        std::vector<int> profileOffsets;
+        /**
+         * The profiles of all rectangles
+         */
+        std::vector<int> profileArena;
+    };
+}
+
+#endif
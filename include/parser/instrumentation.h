@@ -0,0 +1,224 @@
+#ifndef PARSER_INSTRUMENTATION_H
+#define PARSER_INSTRUMENTATION_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <utility>
+
+#include "Stopwatch.h"
+
+namespace parser {
+
+    /**
+     * The timings and counters that were collected while parsing a single
+     * image.
+     */
+    class InstrumentationRecord {
+    public:
+        /**
+         * The identifier of the image (e.g. the file name)
+         */
+        std::string id;
+        /**
+         * The accumulated time per stage in seconds in the order in which the
+         * stages were first entered
+         */
+        std::vector< std::pair<std::string, double> > timings;
+        /**
+         * The counters in the order in which they were first set
+         */
+        std::vector< std::pair<std::string, double> > counters;
+
+        /**
+         * Clears the record
+         */
+        void clear()
+        {
+            id.clear();
+            timings.clear();
+            counters.clear();
+        }
+    };
+
+    /**
+     * Collects per stage timings and counters of the parse pipeline. The
+     * instrumentation is always compiled in, but does nothing unless it is
+     * enabled at runtime. Timings are taken using a Stopwatch, which also
+     * keeps min/max/average statistics over all images.
+     */
+    class Instrumentation {
+    public:
+        Instrumentation();
+
+        /**
+         * Enables or disables the instrumentation
+         */
+        void setEnabled(bool _enabled)
+        {
+            enabled = _enabled;
+        }
+
+        /**
+         * Returns true if the instrumentation is enabled
+         */
+        bool isEnabled() const
+        {
+            return enabled;
+        }
+
+        /**
+         * Sets a file to which the records are appended as JSON lines. If no
+         * file is set, the records are written to std::cout.
+         */
+        void setOutputFile(const std::string & filename);
+
+        /**
+         * Starts a new record. This clears all timings and counters of the
+         * previous image.
+         */
+        void beginRecord();
+
+        /**
+         * Starts the timer of a stage
+         */
+        void startStage(const std::string & stage);
+
+        /**
+         * Stops the timer of a stage and adds the elapsed time to the record
+         */
+        void stopStage(const std::string & stage);
+
+        /**
+         * Sets a counter
+         */
+        void setCounter(const std::string & name, double value);
+
+        /**
+         * Adds a value to a counter
+         */
+        void addCounter(const std::string & name, double value = 1);
+
+        /**
+         * Adds the timings and counters of another record (e.g. of a parser
+         * that ran in parallel) to the current record
+         */
+        void addRecord(const InstrumentationRecord & other);
+
+        /**
+         * Returns the accumulated time of a stage in the current record in
+         * seconds, or 0 if the stage was not entered.
+         */
+        double getTime(const std::string & stage) const;
+
+        /**
+         * Returns the value of a counter in the current record, or 0 if it
+         * was not set.
+         */
+        double getCounter(const std::string & name) const;
+
+        /**
+         * Returns the current record
+         */
+        const InstrumentationRecord & getRecord() const
+        {
+            return record;
+        }
+
+        /**
+         * Writes the current record as single line JSON object
+         */
+        void writeRecord(std::ostream & os) const;
+
+        /**
+         * Sets the identifier of the current record and writes it to the
+         * output file (or std::cout).
+         */
+        void emitRecord(const std::string & id);
+
+        /**
+         * Prints the statistics over all images
+         */
+        void reportAll(std::ostream & os = std::cout);
+
+    private:
+        /**
+         * The stopwatch is not copyable
+         */
+        Instrumentation(const Instrumentation &);
+        Instrumentation & operator=(const Instrumentation &);
+
+        /**
+         * Whether the instrumentation is enabled
+         */
+        bool enabled;
+        /**
+         * The current record
+         */
+        InstrumentationRecord record;
+        /**
+         * The stopwatch that takes the times
+         */
+        Stopwatch stopwatch;
+        /**
+         * The file the records are written to
+         */
+        std::ofstream output;
+        /**
+         * Guards the record and the stopwatch
+         */
+        mutable std::mutex mutex;
+    };
+
+    /**
+     * Measures the time of a stage for as long as it is in scope.
+     */
+    class ScopedTimer {
+    public:
+        ScopedTimer(Instrumentation & instrumentation, const std::string & stage) :
+                instrumentation(instrumentation),
+                stage(stage),
+                running(instrumentation.isEnabled())
+        {
+            if (running)
+            {
+                instrumentation.startStage(stage);
+            }
+        }
+
+        ~ScopedTimer()
+        {
+            stop();
+        }
+
+        /**
+         * Stops the timer before the end of the scope
+         */
+        void stop()
+        {
+            if (running)
+            {
+                instrumentation.stopStage(stage);
+                running = false;
+            }
+        }
+
+    private:
+        /**
+         * The instrumentation the time is reported to
+         */
+        Instrumentation & instrumentation;
+        /**
+         * The name of the stage
+         */
+        std::string stage;
+        /**
+         * Whether the timer is running
+         */
+        bool running;
+    };
+}
+
+#endif
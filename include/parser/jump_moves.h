@@ -5,6 +5,8 @@
 #include <opencv2/opencv.hpp>
 #include "rjmcmc_sa.h"
 #include "parser.h"
+#include "hypothesis_table.h"
+#include "sampling.h"
 
 namespace parser
 {
@@ -174,9 +176,9 @@ namespace parser
      */
     class MCMCParserBirthMove : public SAMove {
     public:
-        MCMCParserBirthMove(std::vector<Part> partHypotheses, Eigen::MatrixXi overlapPairs, int numRectClusters)
-            : numProposals(partHypotheses.size()), overlapPairs(overlapPairs), numClusters(numRectClusters),
-              g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, partHypotheses.size() - 1) {}
+        MCMCParserBirthMove(const PartHypothesisTable & hypotheses, Eigen::MatrixXi overlapPairs, int numRectClusters)
+            : numProposals(hypotheses.size()), overlapPairs(overlapPairs), hypotheses(&hypotheses), numClusters(numRectClusters),
+              g(std::chrono::high_resolution_clock::now().time_since_epoch().count()), dist(0, hypotheses.size() - 1) {}
 
         /**
          * Computes the move
@@ -186,6 +188,15 @@ namespace parser
             MCMCParserStateType & newState,
             float & logAcceptRatio
                  );
+        
+        /**
+         * Computes the move on a bitset state
+         */
+        void move(
+            const MCMCParserBitsetState & state,
+            MCMCParserBitsetState & newState,
+            float & logAcceptRatio
+                 );
 
     private:
         /**
@@ -209,9 +220,9 @@ namespace parser
          */
         Eigen::MatrixXi overlapPairs;
         /**
-         * This is a vector of rectangle proposal parts
+         * The part hypotheses
          */
-        std::vector<Part> partHypotheses;
+        const PartHypothesisTable* hypotheses;
         /**
          * Number of non redundant Rectangles in the proposal pool
          */
@@ -225,9 +236,17 @@ namespace parser
      */
     class MCMCParserDeathMove : public SAMove {
     public:
-        MCMCParserDeathMove(std::vector<Part> partHypotheses, Eigen::MatrixXi overlapPairs, int numRectClusters) : partHypotheses(partHypotheses), numProposals(partHypotheses.size()),
+        MCMCParserDeathMove(const PartHypothesisTable & hypotheses, Eigen::MatrixXi overlapPairs, int numRectClusters) : hypotheses(&hypotheses), numProposals(hypotheses.size()),
             overlapPairs(overlapPairs), g(std::chrono::high_resolution_clock::now().time_since_epoch().count()),
-            dist(0, partHypotheses.size() - 1), numClusters(numRectClusters) {}
+            dist(0, hypotheses.size() - 1), numClusters(numRectClusters), rouletteDist(0, 1)
+        {
+            std::vector<float> weights(hypotheses.size());
+            for (int h = 0; h < hypotheses.size(); h++)
+            {
+                weights[h] = std::max(0.0f, 1.0f - hypotheses.getPosterior(h));
+            }
+            roulette.reset(weights);
+        }
 
         /**
          * Computes the move
@@ -237,10 +256,29 @@ namespace parser
             MCMCParserStateType & newState,
             float & logAcceptRatio
                  );
+        
+        /**
+         * Computes the move on a bitset state
+         */
+        void move(
+            const MCMCParserBitsetState & state,
+            MCMCParserBitsetState & newState,
+            float & logAcceptRatio
+                 );
         int computeDissimilarity(
             const MCMCParserStateType & state,
                 std::vector<int> & disRectsNum
                 );
+        
+        /**
+         * Puts the parts of the initial state into the roulette
+         */
+        void begin(const MCMCParserStateType & state);
+        
+        /**
+         * Updates the roulette with the parts that were born or died
+         */
+        void accepted(const std::vector<int> & born, const std::vector<int> & died);
 
     private:
         /**
@@ -268,13 +306,17 @@ namespace parser
          */
         Eigen::MatrixXi overlapPairs;
         /**
-         * This is a vector of rectangle proposal parts
+         * The part hypotheses
          */
-        std::vector<Part> partHypotheses;
+        const PartHypothesisTable* hypotheses;
         /**
          * The number of rectangle clusters in the proposal pool
          */
         int numClusters;
+        /**
+         * Weighted sampling of the parts in the state
+         */
+        StateWeightSampler roulette;
 
     };
     
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <map>
+#include <sstream>
+#include <cstdint>
+#include <stdexcept>
 #include <opencv2/opencv.hpp>
 
 /**
@@ -136,6 +140,11 @@ namespace parser {
          */
         class Model : public  AbstractDistribution<T,O,D>::Model {
         public:
+            /**
+             * The default constructor
+             */
+            Model() : normalization(0) {}
+            
             /**
              * Saves the model using the open CV cv::FileStorage object. 
              * The model is stored with the given prefix. 
@@ -147,6 +156,7 @@ namespace parser {
             {
                 _fs << _prefix + "h" << h;
                 _fs << _prefix + "points" << cv::Mat(points);
+                _fs << _prefix + "normalization" << normalization;
             }
 
             /**
@@ -165,6 +175,8 @@ namespace parser {
                 {
                     points.push_back(_points.at<Vec>(i,0));
                 }
+                // Models that have been saved without the constant read 0
+                _fs[_prefix + "normalization"] >> normalization;
             }
             
 
@@ -234,6 +246,15 @@ namespace parser {
                 {
                     h.at<float>(i,0) = std::max(5e-2f, h.at<float>(i,0));
                 }
+                
+                // The distribution evaluates the regularized bandwidth
+                double bandwidth[D];
+                for (int i = 0; i < D; i++)
+                {
+                    bandwidth[i] = regularizeBandwidth(h.at<float>(i,0));
+                }
+                const double integral = integrateUnitBox(points, bandwidth);
+                normalization = integral > 0 ? 1./integral : 1.;
             }
             
             /**
@@ -244,6 +265,11 @@ namespace parser {
              * The list of points
              */
             std::vector<Vec> points;
+            /**
+             * The constant that normalizes the distribution to integrate to 
+             * one over the unit box. 0 if it has not been computed.
+             */
+            double normalization;
         };
         
         KernelDistribution() {}
@@ -262,7 +288,7 @@ namespace parser {
                 // Enforce some regularization
                 for (int i = 0; i < D; i++)
                 {
-                    model.h.template at<float>(i,0) = std::max(1e-1f, model.h.template at<float>(i,0));
+                    model.h.template at<float>(i,0) = regularizeBandwidth(model.h.template at<float>(i,0));
                 }
                 // Precompute the normalization constants
                 normalizationConstant = 1./(_model.points.size());
@@ -297,6 +323,171 @@ namespace parser {
             return res*normalizationConstant;
         }
         
+        /**
+         * Evaluates the pdf on the lattice _origin + (i*_spacing[0], 
+         * j*_spacing[1]) with _size.width x _size.height nodes. The samples 
+         * are linearly binned onto a finer lattice which is then convolved 
+         * with the separable kernel, hence the costs do not depend on the 
+         * number of samples. Only available for D = 2. 
+         * 
+         * @param _origin The lattice node (0,0)
+         * @param _spacing The distance between neighboring nodes
+         * @param _size The number of nodes in each direction
+         * @param _result The values at the nodes, _result(j,i) is node (i,j)
+         * @param _tolerance The admissible error relative to the largest 
+         *                   possible value N*normalizationConstant
+         * @return An upper bound on the absolute difference to eval
+         */
+        O evalGrid(const Vec & _origin, const Vec & _spacing, const cv::Size & _size, cv::Mat & _result, O _tolerance = 1e-2) const
+        {
+            static_assert(D == 2, "Lattice evaluation is only implemented for D = 2");
+            
+            _result = cv::Mat::zeros(_size.height, _size.width, CV_64FC1);
+            if (model.points.size() == 0)
+            {
+                return 0;
+            }
+            
+            // 90% of the tolerance are spent on the binning and 10% on the 
+            // truncation of the kernel. Linear binning at spacing delta 
+            // changes every kernel value by at most delta^2/(8h^2) and the 
+            // kernel is truncated at c standard deviations.
+            const double binningError = 0.9*_tolerance/D;
+            const double cutoff = std::sqrt(-2*std::log(0.1*_tolerance/D));
+            
+            const int nodes[2] = {_size.width, _size.height};
+            int oversampling[2], radius[2], fineNodes[2];
+            double fineSpacing[2], fineOrigin[2];
+            double bound = D*std::exp(-cutoff*cutoff/2);
+            std::vector<double> kernels[2];
+            for (int d = 0; d < 2; d++)
+            {
+                const double h = model.h.template at<float>(d,0);
+                oversampling[d] = std::max(1, static_cast<int>(std::ceil(_spacing[d]/(h*std::sqrt(8*binningError)))));
+                fineSpacing[d] = _spacing[d]/static_cast<double>(oversampling[d]);
+                radius[d] = static_cast<int>(std::ceil(cutoff*h/fineSpacing[d]));
+                fineNodes[d] = (nodes[d] - 1)*oversampling[d] + 1 + 2*radius[d];
+                fineOrigin[d] = _origin[d] - radius[d]*fineSpacing[d];
+                bound += fineSpacing[d]*fineSpacing[d]/(8*h*h);
+                
+                kernels[d].resize(2*radius[d] + 1);
+                for (int j = -radius[d]; j <= radius[d]; j++)
+                {
+                    const double t = j*fineSpacing[d]/h;
+                    kernels[d][j + radius[d]] = std::exp(-0.5*t*t);
+                }
+            }
+            
+            // Distribute every sample over its four neighboring nodes. Samples
+            // beyond the margin are further than c standard deviations away 
+            // from all nodes.
+            cv::Mat bins = cv::Mat::zeros(fineNodes[1], fineNodes[0], CV_64FC1);
+            for (size_t i = 0; i < model.points.size(); i++)
+            {
+                const double u = (model.points[i][0] - fineOrigin[0])/fineSpacing[0];
+                const double v = (model.points[i][1] - fineOrigin[1])/fineSpacing[1];
+                const int x = static_cast<int>(std::floor(u));
+                const int y = static_cast<int>(std::floor(v));
+                if (x < 0 || y < 0 || x + 1 >= fineNodes[0] || y + 1 >= fineNodes[1])
+                {
+                    continue;
+                }
+                const double fx = u - x;
+                const double fy = v - y;
+                bins.at<double>(y, x) += (1 - fx)*(1 - fy);
+                bins.at<double>(y, x + 1) += fx*(1 - fy);
+                bins.at<double>(y + 1, x) += (1 - fx)*fy;
+                bins.at<double>(y + 1, x + 1) += fx*fy;
+            }
+            
+            // Convolve along x, keeping only the columns of the lattice, and
+            // then along y, keeping only the rows of the lattice
+            cv::Mat columns, transposed, rows;
+            convolveRows(bins, kernels[0], radius[0], oversampling[0], nodes[0], columns, 
+                    useFFT(fineNodes[0], kernels[0].size(), nodes[0]));
+            cv::transpose(columns, transposed);
+            convolveRows(transposed, kernels[1], radius[1], oversampling[1], nodes[1], rows, 
+                    useFFT(fineNodes[1], kernels[1].size(), nodes[1]));
+            cv::transpose(rows, _result);
+            _result *= normalizationConstant;
+            
+            return bound*model.points.size()*normalizationConstant;
+        }
+        
+        /**
+         * Convolves every row of _in with the symmetric _kernel and stores the
+         * outputs at the columns _start + k*_step, k = 0 ... _count-1. 
+         * Entries outside of _in are treated as zeros. The convolution is 
+         * either computed directly or by multiplying the spectra.
+         */
+        static void convolveRows(const cv::Mat & _in, const std::vector<double> & _kernel, int _start, int _step, int _count, cv::Mat & _out, bool _fft)
+        {
+            const int radius = static_cast<int>(_kernel.size()/2);
+            _out = cv::Mat::zeros(_in.rows, _count, CV_64FC1);
+            
+            if (_fft)
+            {
+                // The padding avoids wrap around
+                const int size = cv::getOptimalDFTSize(_in.cols + radius);
+                cv::Mat padded = cv::Mat::zeros(_in.rows, size, CV_64FC1);
+                for (int y = 0; y < _in.rows; y++)
+                {
+                    for (int x = 0; x < _in.cols; x++)
+                    {
+                        padded.at<double>(y, x) = _in.at<double>(y, x);
+                    }
+                }
+                cv::Mat kernel = cv::Mat::zeros(1, size, CV_64FC1);
+                for (int j = -radius; j <= radius; j++)
+                {
+                    kernel.at<double>(0, (j + size) % size) = _kernel[j + radius];
+                }
+                
+                cv::Mat spectrum, kernelSpectrum, convolved;
+                cv::dft(padded, spectrum, cv::DFT_ROWS);
+                cv::dft(kernel, kernelSpectrum, cv::DFT_ROWS);
+                cv::mulSpectrums(spectrum, cv::repeat(kernelSpectrum, _in.rows, 1), spectrum, cv::DFT_ROWS);
+                cv::idft(spectrum, convolved, cv::DFT_ROWS | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+                
+                for (int y = 0; y < _in.rows; y++)
+                {
+                    for (int k = 0; k < _count; k++)
+                    {
+                        _out.at<double>(y, k) = convolved.at<double>(y, _start + k*_step);
+                    }
+                }
+            }
+            else
+            {
+                for (int y = 0; y < _in.rows; y++)
+                {
+                    const double* row = _in.ptr<double>(y);
+                    for (int k = 0; k < _count; k++)
+                    {
+                        const int center = _start + k*_step;
+                        const int first = std::max(-radius, center - _in.cols + 1);
+                        const int last = std::min(radius, center);
+                        double sum = 0;
+                        for (int j = first; j <= last; j++)
+                        {
+                            sum += row[center - j]*_kernel[j + radius];
+                        }
+                        _out.at<double>(y, k) = sum;
+                    }
+                }
+            }
+        }
+        
+        /**
+         * Returns true if a row of the given length is convolved faster using
+         * the spectra than directly at _count output positions
+         */
+        static bool useFFT(int _length, size_t _kernelSize, int _count)
+        {
+            const int size = cv::getOptimalDFTSize(_length + static_cast<int>(_kernelSize/2));
+            return static_cast<double>(_count)*_kernelSize > 2.0*size*std::log2(static_cast<double>(size)) + size;
+        }
+        
         /**
          * Evaluates the kernel at two given points
          * 
@@ -340,7 +531,58 @@ namespace parser {
         }
         
         /**
-         * Normalizes the distribution to integrate to one
+         * Normalizes the distribution to integrate to one over the unit box. 
+         * The constant is taken from the model if it has been computed 
+         * during the estimation or loaded with the model. 
+         */
+        void normalizeUnitBox()
+        {
+            if (model.normalization <= 0)
+            {
+                double bandwidth[D];
+                for (int i = 0; i < D; i++)
+                {
+                    bandwidth[i] = model.h.template at<float>(i,0);
+                }
+                const double integral = integrateUnitBox(model.points, bandwidth);
+                model.normalization = integral > 0 ? 1./integral : 1.;
+            }
+            normalizationConstant = model.normalization;
+        }
+        
+        /**
+         * Computes the integral of the unnormalized kernel sum over the unit
+         * box in closed form. The Gaussian kernel factorizes, hence the 
+         * integral of every kernel is a product of erf differences. 
+         */
+        static double integrateUnitBox(const std::vector<Vec> & _points, const double* _h)
+        {
+            double integral = 0;
+            for (size_t i = 0; i < _points.size(); i++)
+            {
+                double product = 1;
+                for (int d = 0; d < D; d++)
+                {
+                    const double scale = _h[d]*std::sqrt(2.);
+                    product *= _h[d]*std::sqrt(M_PI/2.)*(std::erf((1 - _points[i][d])/scale) - std::erf(-_points[i][d]/scale));
+                }
+                integral += product;
+            }
+            return integral;
+        }
+        
+        /**
+         * Returns the bandwidth that is used for the evaluation
+         */
+        static float regularizeBandwidth(float _h)
+        {
+            return std::max(1e-1f, _h);
+        }
+        
+        /**
+         * Normalizes the distribution to integrate to one. The integral is 
+         * estimated by random sampling, see normalizeUnitBox for the exact 
+         * integral. 
          */
         void normalizeMCMC()
         {
@@ -543,13 +785,30 @@ namespace parser {
         /**
          * Default constructor
          */
-        ConditionalDistribution(const Model & _model) : model(_model)
+        ConditionalDistribution(const Model & _model) : denseLength(0), model(_model)
         {
-            // Create the distributions
+            // Create the distributions and index them by their packed keys
+            std::vector<uint64_t> keys;
+            std::vector< std::vector<int> > conditions;
             for (typename std::map<std::string, TModel>::iterator itr = model.models.begin(); itr != model.models.end(); ++itr)
             {
-                TDist d(itr->second);
-                distributions[itr->first] = d;
+                std::vector<int> condition;
+                parseHash(itr->first, condition);
+                
+                uint64_t key;
+                if (!packKey(condition, key))
+                {
+                    throw std::out_of_range("Condition cannot be packed: " + itr->first);
+                }
+                keys.push_back(key);
+                conditions.push_back(condition);
+                distributions.push_back(TDist(itr->second));
+            }
+            
+            createDenseIndex(conditions);
+            if (dense.size() == 0)
+            {
+                createHashTable(keys);
             }
         }
         
@@ -568,6 +827,43 @@ namespace parser {
             _result = ss.str();
         }
         
+        /**
+         * Reads the conditions from a hash that has been created by createHash
+         */
+        static void parseHash(const std::string & _hash, std::vector<int> & _conditions)
+        {
+            std::stringstream ss(_hash);
+            std::string value;
+            while (std::getline(ss, value, '_'))
+            {
+                _conditions.push_back(std::stoi(value));
+            }
+        }
+        
+        /**
+         * Packs up to 4 conditions with values in [-2^14, 2^14) into a key. 
+         * The lowest 4 bits hold the number of conditions. Returns false if 
+         * the conditions cannot be packed. 
+         */
+        static bool packKey(const std::vector<int> & _conditions, uint64_t & _key)
+        {
+            if (_conditions.size() > 4)
+            {
+                return false;
+            }
+            _key = _conditions.size();
+            for (size_t i = 0; i < _conditions.size(); i++)
+            {
+                const int value = _conditions[i] + (1 << 14);
+                if (value < 0 || value >= (1 << 15))
+                {
+                    return false;
+                }
+                _key |= static_cast<uint64_t>(value) << (4 + 15*i);
+            }
+            return true;
+        }
+        
         /**
          * Returns the value of the query point under the given condition
          * 
@@ -576,12 +872,8 @@ namespace parser {
          */
         virtual O eval(const Vec & _x, const std::vector<int> & _condition) const
         {
-            // Get the hash
-            std::string hash;
-            createHash(hash, _condition);
-            
             // Get the distribution and evaluate it
-            const double res = distributions.at(hash).eval(_x);
+            const double res = getDistribution(_condition).eval(_x);
             return res;
         }
         
@@ -590,23 +882,171 @@ namespace parser {
          */
         const TDist & getDistribution(const std::vector<int> & _condition) const
         {
-            std::string hash;
-            createHash(hash, _condition);
-            return distributions.at(hash);
+            return distributions[find(_condition)];
         }
         
         TDist & getDistribution(const std::vector<int> & _condition)
         {
-            std::string hash;
-            createHash(hash, _condition);
-            return distributions.at(hash);
+            return distributions[find(_condition)];
         }
         
     private:
+        /**
+         * Uses a dense array if all conditions have the same length and the
+         * box spanned by their values is small
+         */
+        void createDenseIndex(const std::vector< std::vector<int> > & _conditions)
+        {
+            if (_conditions.size() == 0)
+            {
+                return;
+            }
+            
+            const size_t length = _conditions[0].size();
+            std::vector<int> minimum(_conditions[0]), extent(length);
+            std::vector<int> maximum(_conditions[0]);
+            for (size_t c = 0; c < _conditions.size(); c++)
+            {
+                if (_conditions[c].size() != length)
+                {
+                    return;
+                }
+                for (size_t i = 0; i < length; i++)
+                {
+                    minimum[i] = std::min(minimum[i], _conditions[c][i]);
+                    maximum[i] = std::max(maximum[i], _conditions[c][i]);
+                }
+            }
+            
+            int64_t size = 1;
+            for (size_t i = 0; i < length; i++)
+            {
+                extent[i] = maximum[i] - minimum[i] + 1;
+                size *= extent[i];
+                if (size > 4096)
+                {
+                    return;
+                }
+            }
+            
+            denseLength = static_cast<int>(length);
+            denseMinimum = minimum;
+            denseExtent = extent;
+            dense.assign(size, -1);
+            for (size_t c = 0; c < _conditions.size(); c++)
+            {
+                dense[getDenseIndex(_conditions[c])] = static_cast<int>(c);
+            }
+        }
+        
+        /**
+         * Returns the position of the conditions in the dense array or -1 if
+         * they are outside of it
+         */
+        int getDenseIndex(const std::vector<int> & _condition) const
+        {
+            if (static_cast<int>(_condition.size()) != denseLength)
+            {
+                return -1;
+            }
+            int index = 0;
+            for (int i = 0; i < denseLength; i++)
+            {
+                const int offset = _condition[i] - denseMinimum[i];
+                if (offset < 0 || offset >= denseExtent[i])
+                {
+                    return -1;
+                }
+                index = index*denseExtent[i] + offset;
+            }
+            return index;
+        }
+        
+        /**
+         * Creates the open addressing table with linear probing
+         */
+        void createHashTable(const std::vector<uint64_t> & _keys)
+        {
+            size_t capacity = 8;
+            while (capacity < 2*_keys.size())
+            {
+                capacity *= 2;
+            }
+            tableKeys.assign(capacity, 0);
+            tableSlots.assign(capacity, -1);
+            for (size_t k = 0; k < _keys.size(); k++)
+            {
+                size_t i = mixKey(_keys[k]) & (capacity - 1);
+                while (tableSlots[i] != -1)
+                {
+                    i = (i + 1) & (capacity - 1);
+                }
+                tableKeys[i] = _keys[k];
+                tableSlots[i] = static_cast<int>(k);
+            }
+        }
+        
+        /**
+         * Scrambles the bits of a key (splitmix64 finalizer)
+         */
+        static uint64_t mixKey(uint64_t _key)
+        {
+            _key = (_key ^ (_key >> 30))*0xbf58476d1ce4e5b9ULL;
+            _key = (_key ^ (_key >> 27))*0x94d049bb133111ebULL;
+            return _key ^ (_key >> 31);
+        }
+        
+        /**
+         * Returns the index of the distribution for the given conditions. 
+         * Throws std::out_of_range if there is none. 
+         */
+        int find(const std::vector<int> & _condition) const
+        {
+            if (dense.size() > 0)
+            {
+                const int index = getDenseIndex(_condition);
+                if (index >= 0 && dense[index] >= 0)
+                {
+                    return dense[index];
+                }
+            }
+            else
+            {
+                uint64_t key;
+                if (tableSlots.size() > 0 && packKey(_condition, key))
+                {
+                    const size_t mask = tableSlots.size() - 1;
+                    for (size_t i = mixKey(key) & mask; tableSlots[i] != -1; i = (i + 1) & mask)
+                    {
+                        if (tableKeys[i] == key)
+                        {
+                            return tableSlots[i];
+                        }
+                    }
+                }
+            }
+            throw std::out_of_range("Unknown condition");
+        }
+        
         /**
          * The distributions
          */
-        std::map<std::string, TDist> distributions;
+        std::vector<TDist> distributions;
+        /**
+         * The dense index: The number of conditions, the smallest value and 
+         * the number of values of every condition and the distribution of 
+         * every cell (-1 if there is none). Empty if the hash table is used. 
+         */
+        int denseLength;
+        std::vector<int> denseMinimum;
+        std::vector<int> denseExtent;
+        std::vector<int> dense;
+        /**
+         * The hash table: The packed keys and the distributions (-1 for empty
+         * slots)
+         */
+        std::vector<uint64_t> tableKeys;
+        std::vector<int> tableSlots;
         /**
          * The model for this distribution
          */
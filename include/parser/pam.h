@@ -0,0 +1,86 @@
+#ifndef PARSER_PAM_H
+#define PARSER_PAM_H
+
+/**
+ * This file contains the partitioning around medoids (PAM) clustering. It
+ * selects K of N objects (the medoids) such that the sum of the distances of
+ * all objects to their closest medoid is minimal. Only the distances between
+ * the objects are needed, e.g. the disagreements between the trees of a
+ * forest.
+ */
+
+#include <vector>
+#include <Eigen/Dense>
+
+namespace parser {
+
+    /**
+     * Computes the medoids with the greedy BUILD initialization followed by
+     * swaps. The change of the objective of swapping a medoid with a non
+     * medoid is computed for all K medoids at once from the distances to the
+     * closest and second closest medoid, hence a pass over all candidates
+     * costs O(N^2) instead of O(K N^2) times the cost of reassigning.
+     */
+    class KMedoids {
+    public:
+        /**
+         * The parameters of this class
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() : maxIterations(100), tolerance(1e-6f) {}
+
+            /**
+             * The maximum number of passes over all swap candidates
+             */
+            int maxIterations;
+            /**
+             * A swap is only performed if it decreases the objective by more
+             * than this fraction
+             */
+            float tolerance;
+        };
+
+        /**
+         * Default constructor
+         */
+        KMedoids() : model() {}
+
+        /**
+         * Clusters the objects of the symmetric N x N distance matrix into K
+         * clusters. The medoids are sorted by object index. Returns the sum
+         * of the distances to the closest medoids.
+         */
+        float cluster(const Eigen::MatrixXf & distances, int K, std::vector<int> & medoids) const;
+
+        /**
+         * Greedily adds the object that decreases the objective the most
+         * until there are K medoids
+         */
+        void build(const Eigen::MatrixXf & distances, int K, std::vector<int> & medoids) const;
+
+        /**
+         * Improves the medoids by swaps until no swap improves the objective.
+         * Returns the objective.
+         */
+        float swap(const Eigen::MatrixXf & distances, std::vector<int> & medoids) const;
+
+        /**
+         * Computes the index (into medoids) of the closest medoid of every
+         * object and returns the objective
+         */
+        static float computeAssignments(const Eigen::MatrixXf & distances,
+                                        const std::vector<int> & medoids,
+                                        std::vector<int> & assignments);
+
+        /**
+         * The parameter model
+         */
+        Model model;
+    };
+}
+
+#endif
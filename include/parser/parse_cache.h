@@ -0,0 +1,204 @@
+#ifndef PARSER_PARSE_CACHE_H
+#define PARSER_PARSE_CACHE_H
+
+/**
+ * This file contains a persistent cache for parse results. Entries are
+ * addressed by a hash of the input images, the region of interest and a
+ * fingerprint of the models and parameters.
+ */
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#include "parser.h"
+#include "serialization.h"
+
+namespace parser {
+
+    /**
+     * This is an on-disk cache for parse results. Every entry is stored in
+     * its own file in the cache directory. The last write time of an entry
+     * is its last use, entries that have not been used for the longest time
+     * are evicted first when the cache exceeds its bounds. The recency and
+     * the sizes of the entries are kept in an index that is built when the
+     * cache is opened, hence storing an entry does not scan the directory.
+     * Entries are written to a temporary file and renamed, hence several 
+     * processes can share a cache directory. Entries of other processes are
+     * only seen by the index after reopening the cache.
+     */
+    class ParseCache {
+    public:
+        ParseCache() :  maxEntries(10000),
+                        maxBytes(256*1024*1024),
+                        totalBytes(0),
+                        numHits(0),
+                        numMisses(0),
+                        numEvictions(0) {}
+
+        /**
+         * Opens the cache in the given directory and builds the index of the
+         * entries. The directory is created if it does not exist. Returns 
+         * false on failure.
+         */
+        bool open(const std::string & directory);
+
+        /**
+         * Returns true if the cache has been opened
+         */
+        bool isOpen() const
+        {
+            return !directory.empty();
+        }
+
+        /**
+         * Returns the cache directory
+         */
+        const std::string & getDirectory() const
+        {
+            return directory;
+        }
+
+        /**
+         * Sets the maximum number of entries
+         */
+        void setMaxEntries(size_t _maxEntries)
+        {
+            maxEntries = _maxEntries;
+        }
+
+        size_t getMaxEntries() const
+        {
+            return maxEntries;
+        }
+
+        /**
+         * Sets the maximum size of all entries in bytes
+         */
+        void setMaxBytes(uint64_t _maxBytes)
+        {
+            maxBytes = _maxBytes;
+        }
+
+        uint64_t getMaxBytes() const
+        {
+            return maxBytes;
+        }
+
+        /**
+         * Computes the key of a parse request
+         */
+        static std::string computeKey(  const cv::Mat & image,
+                                        const cv::Mat & imageDepth,
+                                        const Rectangle & region,
+                                        const std::string & fingerprint);
+
+        /**
+         * Looks up an entry. On a hit, the entry is marked as recently used.
+         */
+        bool lookup(const std::string & key, std::vector<Part> & parts);
+
+        /**
+         * Returns true if there is an entry for the key. This does not
+         * change the counters or the recency.
+         */
+        bool contains(const std::string & key) const;
+
+        /**
+         * Stores an entry and evicts old entries if necessary
+         */
+        void store(const std::string & key, const std::vector<Part> & parts);
+
+        /**
+         * Evicts the least recently used entries until the cache is within its
+         * bounds
+         */
+        void evict();
+
+        /**
+         * Lists the keys of all entries
+         */
+        void listKeys(std::vector<std::string> & keys) const;
+
+        size_t getNumHits() const
+        {
+            return numHits;
+        }
+
+        size_t getNumMisses() const
+        {
+            return numMisses;
+        }
+
+        size_t getNumEvictions() const
+        {
+            return numEvictions;
+        }
+
+        /**
+         * Writes an entry file. Returns false on failure.
+         */
+        static bool writeEntry(const std::string & file, const std::string & key, const std::vector<Part> & parts);
+
+        /**
+         * Reads an entry file. Returns false if the file is missing,
+         * corrupted or belongs to a different key.
+         */
+        static bool readEntry(const std::string & file, const std::string & key, std::vector<Part> & parts);
+
+    private:
+        /**
+         * An entry of the index
+         */
+        struct IndexEntry {
+            std::string key;
+            uint64_t size;
+        };
+        
+        /**
+         * Returns the file of an entry
+         */
+        std::string getEntryFile(const std::string & key) const;
+
+        /**
+         * Makes an entry the most recently used one. The entry is added if
+         * it is not in the index.
+         */
+        void touch(const std::string & key, uint64_t size);
+
+        /**
+         * Removes an entry from the index
+         */
+        void forget(const std::string & key);
+
+        /**
+         * The cache directory
+         */
+        std::string directory;
+        /**
+         * The bounds
+         */
+        size_t maxEntries;
+        uint64_t maxBytes;
+        /**
+         * The entries, least recently used first, and their positions by key
+         */
+        std::list<IndexEntry> recency;
+        std::unordered_map<std::string, std::list<IndexEntry>::iterator> index;
+        /**
+         * The size of all entries in the index
+         */
+        uint64_t totalBytes;
+        /**
+         * The counters
+         */
+        size_t numHits;
+        size_t numMisses;
+        size_t numEvictions;
+    };
+}
+
+#endif
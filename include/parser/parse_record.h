@@ -0,0 +1,222 @@
+#ifndef PARSER_PARSE_RECORD_H
+#define PARSER_PARSE_RECORD_H
+
+/**
+ * This file contains the intermediate results of a parse that are stored by
+ * the test path. Precision/recall curves for arbitrary thresholds can be
+ * recomputed from the stored results without parsing the images again.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "parser.h"
+
+namespace parser {
+
+    /**
+     * The proposals, their posteriors and the best annealing state of a
+     * single image together with the ground truth. All rectangles are in
+     * rectified coordinates.
+     */
+    class ParseRecord {
+    public:
+        /**
+         * Removes all data
+         */
+        void clear();
+
+        /**
+         * Writes the record in a compact binary form. Returns false on
+         * failure.
+         */
+        static bool write(const std::string & file, const ParseRecord & record);
+
+        /**
+         * Reads a record. Returns false if the file does not exist or is
+         * corrupted.
+         */
+        static bool read(const std::string & file, ParseRecord & record);
+
+        /**
+         * The image identifier
+         */
+        std::string id;
+        /**
+         * The proposal rectangles after augmentation
+         */
+        std::vector<Rectangle> rectangles;
+        /**
+         * The hypotheses: Rectangle index, label and posterior
+         */
+        std::vector<int> hypothesisRectangles;
+        std::vector<int> hypothesisLabels;
+        std::vector<float> hypothesisPosteriors;
+        /**
+         * The hypotheses of the best annealing state
+         */
+        std::vector<int> bestState;
+        /**
+         * The ground truth parts and their labels
+         */
+        std::vector<Rectangle> groundTruth;
+        std::vector<int> groundTruthLabels;
+    };
+
+    /**
+     * The matching statistics for one combination of thresholds
+     */
+    class PrecisionRecallPoint {
+    public:
+        PrecisionRecallPoint() :    acceptanceThreshold(0),
+                                    posteriorThreshold(0),
+                                    pruningThreshold(0),
+                                    numGroundTruth(0),
+                                    numDetected(0),
+                                    numTrueDetected(0),
+                                    numFound(0),
+                                    numLabelCorrect(0),
+                                    numProposals(0),
+                                    numProposalsFound(0) {}
+
+        float getPrecision() const
+        {
+            return numDetected > 0 ? numTrueDetected/static_cast<float>(numDetected) : 0;
+        }
+
+        float getRecall() const
+        {
+            return numGroundTruth > 0 ? numFound/static_cast<float>(numGroundTruth) : 0;
+        }
+
+        float getF1() const
+        {
+            const float precision = getPrecision();
+            const float recall = getRecall();
+            return precision + recall > 0 ? 2*precision*recall/(precision + recall) : 0;
+        }
+
+        /**
+         * Returns the fraction of found ground truth parts with the correct
+         * label
+         */
+        float getLabelAccuracy() const
+        {
+            return numFound > 0 ? numLabelCorrect/static_cast<float>(numFound) : 0;
+        }
+
+        /**
+         * Returns the fraction of ground truth parts that are matched by a
+         * proposal that survives the pruning
+         */
+        float getProposalRecall() const
+        {
+            return numGroundTruth > 0 ? numProposalsFound/static_cast<float>(numGroundTruth) : 0;
+        }
+
+        /**
+         * Writes the point as a JSON line
+         */
+        void writeJson(std::ostream & os) const;
+
+        /**
+         * The minimum IOU of a match
+         */
+        float acceptanceThreshold;
+        /**
+         * Selected parts with a smaller posterior are discarded
+         */
+        float posteriorThreshold;
+        /**
+         * Proposals whose best posterior is smaller are pruned
+         */
+        float pruningThreshold;
+        /**
+         * The counts over all images
+         */
+        int numGroundTruth;
+        int numDetected;
+        int numTrueDetected;
+        int numFound;
+        int numLabelCorrect;
+        int numProposals;
+        int numProposalsFound;
+    };
+
+    /**
+     * Computes precision/recall statistics from stored parse records. The
+     * overlaps between the proposals and the ground truth are computed once
+     * when a record is added, hence evaluating a threshold combination only
+     * compares numbers.
+     */
+    class ParseRecordEvaluator {
+    public:
+        /**
+         * Adds a record
+         */
+        void add(const ParseRecord & record);
+
+        /**
+         * Adds all records (*.record) in a directory. Returns the number of
+         * records that have been added or -1 if the directory does not
+         * exist. Corrupted records are skipped.
+         */
+        int addDirectory(const std::string & directory);
+
+        /**
+         * Returns the number of records
+         */
+        int size() const
+        {
+            return static_cast<int>(entries.size());
+        }
+
+        /**
+         * Computes the statistics for a single combination of thresholds
+         */
+        void evaluate(float acceptanceThreshold, float posteriorThreshold, float pruningThreshold, PrecisionRecallPoint & point) const;
+
+        /**
+         * Computes the statistics for all combinations of the given
+         * thresholds
+         */
+        void sweep( const std::vector<float> & acceptanceThresholds,
+                    const std::vector<float> & posteriorThresholds,
+                    const std::vector<float> & pruningThresholds,
+                    std::vector<PrecisionRecallPoint> & points) const;
+
+    private:
+        /**
+         * The precomputed data of a single record
+         */
+        class Entry {
+        public:
+            /**
+             * The IOU of every proposal (row) with every ground truth part
+             */
+            std::vector<float> overlaps;
+            /**
+             * The best posterior of every proposal
+             */
+            std::vector<float> maxPosteriors;
+            /**
+             * The rectangle, label and posterior of the selected parts
+             */
+            std::vector<int> selectedRectangles;
+            std::vector<int> selectedLabels;
+            std::vector<float> selectedPosteriors;
+            /**
+             * The ground truth labels
+             */
+            std::vector<int> groundTruthLabels;
+        };
+
+        /**
+         * The entries
+         */
+        std::vector<Entry> entries;
+    };
+}
+
+#endif
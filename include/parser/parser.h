@@ -24,6 +24,8 @@
 #include "processing.h"
 #include "libforest/libforest.h"
 #include "energy.h"
+#include "instrumentation.h"
+#include "shape_prior.h"
 #include <vector>
 #include <utility>
 #include <Eigen/Sparse>
@@ -92,6 +94,42 @@
 #define MAX_UPDATE_ITER 2500
 #define NUM_INNER_LOOPS 1000
 
+/**
+ * Adaptive cooling: The temperature follows a target acceptance rate curve
+ * (Lam-style) instead of the geometric schedule. The optimization stops if
+ * the best energy improves by less than PLATEAU_TOLERANCE (relative) within 
+ * PLATEAU_ITER temperature steps. This is opt-in as it has not been 
+ * evaluated against the geometric schedule on the test sets yet. 
+ * SA_TIME_BUDGET is a wall clock budget in seconds (0 = unlimited).
+ */
+#define ADAPTIVE_COOLING 0
+#define ADAPTIVE_COOLING_GAIN 0.5f
+#define PLATEAU_ITER 100
+#define PLATEAU_TOLERANCE 1e-4f
+#define SA_TIME_BUDGET 0
+
+/**
+ * Run the default architecture on a bitset state (O(1) membership, no 
+ * allocations in the inner loop). Only the exchange, birth and death moves
+ * are supported natively; split, merge and update moves require the list 
+ * state and are disabled.
+ */
+#define BITSET_STATE 0
+
+/**
+ * Detect the horizontal and vertical lines with a single hough accumulator
+ * that is restricted to the angles close to the axes. The minimum line length
+ * is chosen from the sorted peaks instead of re-running the transform. 
+ */
+#define AXIS_ALIGNED_LINES 1
+
+/**
+ * Check the edge support of rectangle proposals with prefix counts over the
+ * rows and columns of the thresholded distance transform instead of tracing
+ * the borders pixel by pixel
+ */
+#define BORDER_SUPPORT_INDEX 1
+
 
 
 /**
@@ -178,7 +216,42 @@
  * The number of channels used for the edge detector
  */
 #define EDGE_DETECTOR_CHANNELS 4
+/**
+ * If this is true, the edge detector forests stop evaluating trees per pixel
+ * once the decision is settled
+ */
+#define EDGE_DETECTOR_EARLY_EXIT 1
+/**
+ * Confidence margin (accumulated log posterior) for the early exit. 0 means
+ * that the result is identical to evaluating all trees
+ */
+#define EDGE_DETECTOR_EARLY_EXIT_MARGIN 0.0f
+/**
+ * If this is true, the edge detector uses the quantized forests (see 
+ * quantizeEdgeDetector) instead of the float models
+ */
+#define EDGE_DETECTOR_QUANTIZED 0
+/**
+ * If this is true, the edge detector uses the reduced forests (see 
+ * compressEdgeDetector) instead of the full models
+ */
+#define EDGE_DETECTOR_COMPRESSED 0
+/**
+ * If this is true, the edge detector forests are memory mapped from the flat
+ * files (see convertEdgeDetector) instead of being deserialized. Parsers in 
+ * different processes then share one copy of the models.
+ */
+#define EDGE_DETECTOR_MAPPED 0
 typedef cv::Vec<float, EDGE_DETECTOR_CHANNELS> EdgeDetectorVec;
+#if EDGE_DETECTOR_QUANTIZED && EDGE_DETECTOR_MAPPED
+#error "The quantized edge detector cannot be mapped"
+#elif EDGE_DETECTOR_QUANTIZED
+typedef libf::QuantizedRandomForest EdgeDetectorForest;
+#elif EDGE_DETECTOR_MAPPED
+typedef libf::MappedRandomForest EdgeDetectorForest;
+#else
+typedef libf::RandomForest<libf::DecisionTree> EdgeDetectorForest;
+#endif
 
 /**
  * Depth Rectification boundary jitter
@@ -329,19 +402,85 @@ namespace parser {
         std::vector<int> projProfTyp;
     };
     
+    /**
+     * The models that score the part hypotheses in selectParts: the 
+     * appearance codebooks, the statistics of the training set and the shape
+     * prior
+     */
+    class SelectionModels {
+    public:
+        /**
+         * The appearance codebooks per label
+         */
+        std::vector<Eigen::MatrixXf> codebooks;
+        /**
+         * The maximum mean depth in the training set
+         */
+        float maxDepth;
+        /**
+         * The maximum ratio of the angles between the diagonals
+         */
+        float maxAngleRatio;
+        /**
+         * The maximum aspect ratio
+         */
+        float maxAspRatio;
+        /**
+         * The maximum ratio of depth and width
+         */
+        float maxDWAspRatio;
+        /**
+         * The maximum ratio of depth and height
+         */
+        float maxDHAspRatio;
+        /**
+         * The number of parts per label
+         */
+        int partCount[3];
+        /**
+         * The linear shape prior
+         */
+        LinearShapePrior shapePrior;
+    };
+    
+    class SimulatedAnnealing;
+    class ParseCache;
+    class SequenceState;
+    class ParseRecord;
+    
     /**
      * This class parses an image and returns the segmentation.
      */
 
     class CabinetParser {
     public:
+        CabinetParser() : cache(0), parseRecord(0) {}
 
         /**
-         * Computes the segmentation of the image given the region of interest
+         * Computes the segmentation of the image given the region of interest.
+         * If a cache is set, the result is looked up before and stored after
+         * parsing.
          */
 
         void parse(const cv::Mat & image, const cv::Mat & imageDepth, const Rectangle & region, std::vector<Part> & parts);
         
+        /**
+         * Computes the segmentations of several regions of interest in the 
+         * same image, e.g. of all cabinets in a kitchen. The models are loaded
+         * once and the regions are parsed concurrently. results[r] is the 
+         * segmentation of regions[r]. 
+         */
+        void parse(const cv::Mat & image, const cv::Mat & imageDepth, const std::vector<Rectangle> & regions, std::vector< std::vector<Part> > & results);
+        
+        /**
+         * Computes the segmentation of a frame of an RGB-D sequence. The 
+         * proposals and the segmentation of the last frame are warped to the
+         * current frame and used to seed the rectangle detector and to warm 
+         * start the annealing. On large changes the full pipeline is run. 
+         * The cache is not used in this mode. 
+         */
+        void parseSequenceFrame(const cv::Mat & image, const cv::Mat & imageDepth, const Rectangle & region, SequenceState & sequence, std::vector<Part> & parts);
+        
         /**
          * Trains the parser on the given data.
          */
@@ -455,7 +594,7 @@ namespace parser {
         /**
          * One time computation of all proposal based matrices
          */
-        void computeProposalMatrices(const std::vector<Rectangle> proposals, const float imageArea, Eigen::MatrixXi & overlapPairs, Eigen::MatrixXi & overlapPairs50,
+        void computeProposalMatrices(const std::vector<Rectangle> proposals, const float imageArea, Eigen::MatrixXi & overlapPairs,
                 std::vector<float> & areas, Eigen::MatrixXf & overlapArea, Eigen::MatrixXi & widthMergeable, Eigen::MatrixXi & heightMergeable);
         /**
          * Loads annotated images from a directory.
@@ -472,6 +611,41 @@ namespace parser {
          */
         void trainEdgeDetector(const std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat > > & images);
         
+        /**
+         * Exports quantized versions of the trained edge detecting forests. The
+         * feature ranges are taken from the patches of 80% of the given 
+         * images, the change in accuracy is reported on the remaining ones.
+         */
+        void quantizeEdgeDetector(const std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat > > & images);
+        
+        /**
+         * Exports quantized versions of the trained edge detecting forests 
+         * using the images of a given directory as validation set. 
+         */
+        void quantizeEdgeDetector(const std::string & directory);
+        
+        /**
+         * Reduces the trained edge detecting forests to numTrees trees each.
+         * The trees are compared by their disagreement on pixels of the 
+         * given images and the medoids of the trees are kept. Writes the 
+         * reduced forests and a report of the accuracy versus the number 
+         * of trees. 
+         */
+        void compressEdgeDetector(const std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat > > & images, int numTrees);
+        
+        /**
+         * Reduces the trained edge detecting forests using the images of a 
+         * given directory as validation set. 
+         */
+        void compressEdgeDetector(const std::string & directory, int numTrees);
+        
+        /**
+         * Converts the trained edge detecting forests to the flat format 
+         * that can be memory mapped (see EDGE_DETECTOR_MAPPED). Returns 
+         * false on failure.
+         */
+        bool convertEdgeDetector();
+        
         /**
          * Tests the edge detecting forest on a set of images and their annotations. 
          */
@@ -497,6 +671,12 @@ namespace parser {
          */
         void trainSVM(cv::Mat & trainDataSVM, int partCount[3]);
         
+        /**
+         * Reduces the trained linear SVMs of the shape prior to a weight 
+         * matrix and writes it to file. Returns false on failure.
+         */
+        bool exportShapePrior(const std::string & file);
+        
         /**
          * Applies the learned edge detector to the multi channel image
          */
@@ -527,9 +707,20 @@ namespace parser {
         void detectRectangles(const cv::Mat & image, const cv::Mat & cannyEdges, std::vector<Rectangle> & result);
         
         /**
-         * Selects a subset of the hypotheses rectangles are parts.
+         * Detects rectangles starting from a set of seed rectangles (e.g. the
+         * proposals of the last frame of a sequence). The seeds that are 
+         * supported by the edges are kept and numSamples further line 
+         * combinations are sampled. Returns the number of kept seeds.
          */
-        void selectParts(const cv::Mat & mcImage, const cv::Mat & depthImage, const cv::Mat & edgeImage, std::vector<Rectangle> & hypotheses, std::vector<Part> & result);
+        int detectRectangles(const cv::Mat & image, const cv::Mat & cannyEdges, const std::vector<Rectangle> & seeds, int numSamples, std::vector<Rectangle> & result);
+        
+        /**
+         * Selects a subset of the hypotheses rectangles are parts. If initial
+         * parts are given, the annealing starts from the matching hypotheses
+         * at the given temperature instead of from scratch.
+         */
+        void selectParts(const cv::Mat & mcImage, const cv::Mat & depthImage, const cv::Mat & edgeImage, std::vector<Rectangle> & hypotheses, std::vector<Part> & result,
+                const std::vector<Part>* initialParts = 0, float startTemperature = MAX_TEMP);
         
         /**
          * Extracts the discretized kernel distributions for the appearance.
@@ -678,6 +869,127 @@ namespace parser {
         };
         
         Parameters parameters;
+        
+        /**
+         * Returns the per stage timings and counters of the last parsed image
+         */
+        Instrumentation & getInstrumentation()
+        {
+            return instrumentation;
+        }
+        
+        /**
+         * Sets the parse result cache. The cache is not owned by the parser,
+         * pass 0 to disable caching.
+         */
+        void setCache(ParseCache* _cache)
+        {
+            cache = _cache;
+        }
+        
+        ParseCache* getCache() const
+        {
+            return cache;
+        }
+        
+        /**
+         * Sets the record that is filled with the proposals, posteriors and
+         * the best state by the next call to selectParts. The record is not
+         * owned by the parser, pass 0 to disable recording.
+         */
+        void setParseRecord(ParseRecord* _parseRecord)
+        {
+            parseRecord = _parseRecord;
+        }
+        
+        ParseRecord* getParseRecord() const
+        {
+            return parseRecord;
+        }
+        
+        /**
+         * If set, evaluateSegmentation stores a parse record for every image
+         * in this directory. The cache is bypassed while recording. The 
+         * directory is created if necessary, returns false if this fails.
+         */
+        bool setRecordDirectory(const std::string & directory);
+        
+        /**
+         * Returns a fingerprint of the models in the working directory and of
+         * the parameters. Cache entries are only valid for the same 
+         * fingerprint.
+         */
+        const std::string & getModelFingerprint();
+        
+        /**
+         * Loads the edge detectors and the selection models such that they 
+         * stay in memory for all subsequent calls to parse (e.g. in a long 
+         * running server)
+         */
+        void loadModels();
+        
+        /**
+         * Uses the loaded models and the parameters of another parser. The 
+         * models are shared and not copied.
+         */
+        void shareModels(const CabinetParser & other);
+        
+    private:
+        /**
+         * Runs the pipeline on a single region of interest. If a sequence 
+         * state is given, the last frame is reused if possible and the state
+         * is updated.
+         */
+        void parseRegion(const cv::Mat & image, const cv::Mat & imageDepth, const Rectangle & region, std::vector<Part> & parts, SequenceState* sequence = 0);
+        
+        /**
+         * Loads the edge detector for the color (depthFlag = 0) or the depth
+         * image (depthFlag = 1)
+         */
+        static std::shared_ptr<EdgeDetectorForest> loadEdgeDetector(int depthFlag);
+        
+        /**
+         * Loads the codebooks, the training parameters and the shape prior 
+         * from the working directory
+         */
+        static std::shared_ptr<const SelectionModels> loadSelectionModels();
+        
+        /**
+         * Stores the iteration count and the acceptance rates of an 
+         * optimization in the instrumentation record
+         */
+        void recordAnnealingStatistics(const SimulatedAnnealing & sa, const std::string & prefix);
+        
+        /**
+         * Collects timings and counters if enabled
+         */
+        Instrumentation instrumentation;
+        /**
+         * The parse result cache or 0
+         */
+        ParseCache* cache;
+        /**
+         * The record that is filled by selectParts or 0
+         */
+        ParseRecord* parseRecord;
+        /**
+         * The directory for parse records or empty
+         */
+        std::string recordDirectory;
+        /**
+         * The fingerprint of the models, computed on first use
+         */
+        std::string modelFingerprint;
+        /**
+         * Preloaded edge detectors that are shared between the parsers of a 
+         * batch. If not set, applyEdgeDetector loads the models from disk. 
+         */
+        std::shared_ptr<EdgeDetectorForest> edgeDetectors[2];
+        /**
+         * Preloaded selection models that are shared in the same way. If not
+         * set, selectParts loads them on first use.
+         */
+        std::shared_ptr<const SelectionModels> selectionModels;
     };
 }
 #endif
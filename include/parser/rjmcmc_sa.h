@@ -8,6 +8,9 @@
 #include <iomanip>
 #include <chrono>
 #include "parser.h"
+#include "bitset_state.h"
+#include "hypothesis_table.h"
+#include "sampling.h"
 
 namespace parser {
 
@@ -18,12 +21,25 @@ namespace parser {
      */
     class SACoolingSchedule {
     public:
+        virtual ~SACoolingSchedule() {}
+        
         /**
          * Calculates the next temperature based on the iteration and the 
          * current temperature. 
          */
         virtual float calcTemperature(int iteration, float temperature) const = 0;
         
+        /**
+         * Reports the acceptance rate of the moves at the given iteration. 
+         * Adaptive schedules use it to determine the next temperature.
+         */
+        virtual void update(int, float) {}
+        
+        /**
+         * Resets the schedule before a new optimization
+         */
+        virtual void reset() {}
+        
         /**
          * Returns the start temperature
          */
@@ -40,7 +56,7 @@ namespace parser {
     /**
      * This is a geometric cooling schedule: t_k+1 = t_k * alpha.
      */
-    class GeometricCoolingSchedule { // : public SACoolingSchedule {
+    class GeometricCoolingSchedule : public SACoolingSchedule {
     public:
         GeometricCoolingSchedule() : startTemperature(100), endTemperature(1), alpha(0.8f) {}
 
@@ -117,6 +133,158 @@ namespace parser {
     };
 
 
+
+    /**
+     * This is an adaptive cooling schedule in the spirit of Lam and Delosme.
+     * The temperature is steered such that the acceptance rate of the moves
+     * follows the target curve
+     *   1.0 -> 0.44  during the first 15% of the iterations,
+     *   0.44         up to 65% of the iterations,
+     *   0.44 -> 0    during the remaining iterations.
+     * If too many moves are accepted, the schedule cools faster than the 
+     * geometric base schedule, if too few are accepted, it cools slower or 
+     * reheats. After maxIterations the end temperature is returned. 
+     */
+    class AdaptiveCoolingSchedule : public SACoolingSchedule {
+    public:
+        AdaptiveCoolingSchedule() : startTemperature(100), endTemperature(1e-2), maxIterations(2000), gain(0.5f), 
+                minAlpha(0.9f), maxAlpha(1.05f), acceptanceRate(0), hasAcceptanceRate(false) {}
+        
+        /**
+         * Sets the start temperature
+         */
+        void setStartTemperature(float temp)
+        {
+            startTemperature = temp;
+        }
+        
+        /**
+         * Returns the start temperature
+         */
+        float getStartTemperature() const
+        {
+            return startTemperature;
+        }
+        
+        /**
+         * Sets the end temperature
+         */
+        void setEndTemperature(float temp)
+        {
+            endTemperature = temp;
+        }
+        
+        /**
+         * Returns the end temperature
+         */
+        float getEndTemperature() const
+        {
+            return endTemperature;
+        }
+        
+        /**
+         * Sets the maximum number of iterations. The target acceptance curve
+         * is stretched over this many iterations.
+         */
+        void setMaxIterations(int _maxIterations)
+        {
+            maxIterations = _maxIterations;
+        }
+        
+        /**
+         * Returns the maximum number of iterations
+         */
+        int getMaxIterations() const
+        {
+            return maxIterations;
+        }
+        
+        /**
+         * Sets the gain of the acceptance rate feedback
+         */
+        void setGain(float _gain)
+        {
+            gain = _gain;
+        }
+        
+        /**
+         * Returns the gain
+         */
+        float getGain() const
+        {
+            return gain;
+        }
+        
+        /**
+         * Sets the bounds of the factor the temperature is multiplied with
+         * in a single iteration
+         */
+        void setAlphaBounds(float _minAlpha, float _maxAlpha)
+        {
+            minAlpha = _minAlpha;
+            maxAlpha = _maxAlpha;
+        }
+        
+        /**
+         * Returns the target acceptance rate at the given iteration
+         */
+        float getTargetAcceptanceRate(int iteration) const;
+        
+        /**
+         * Calculates the next temperature based on the iteration, the current
+         * temperature and the last reported acceptance rate.
+         */
+        float calcTemperature(int iteration, float temperature) const;
+        
+        /**
+         * Stores the acceptance rate of the last iteration
+         */
+        void update(int, float rate)
+        {
+            acceptanceRate = rate;
+            hasAcceptanceRate = true;
+        }
+        
+        /**
+         * Forgets the last acceptance rate
+         */
+        void reset()
+        {
+            acceptanceRate = 0;
+            hasAcceptanceRate = false;
+        }
+        
+    private:
+        /**
+         * The start temperature
+         */
+        float startTemperature;
+        /**
+         * The end temperature
+         */
+        float endTemperature;
+        /**
+         * The maximum number of iterations
+         */
+        int maxIterations;
+        /**
+         * The gain of the acceptance rate feedback
+         */
+        float gain;
+        /**
+         * The bounds of the temperature factor per iteration
+         */
+        float minAlpha;
+        float maxAlpha;
+        /**
+         * The acceptance rate of the last iteration
+         */
+        float acceptanceRate;
+        /**
+         * Whether an acceptance rate was reported since the last reset
+         */
+        bool hasAcceptanceRate;
+    };
     
     /**
      * This is the interface one has to implement for a callback function for
@@ -128,6 +296,18 @@ namespace parser {
          * The function that is called
          */
         virtual int callback(const MCMCParserStateType & state, float energy, const MCMCParserStateType & bestState, float bestEnergy, int iteration, float temperature) = 0;
+        
+        /**
+         * The function that is called by the bitset optimization. By default
+         * the states are converted to lists.
+         */
+        virtual int callback(const MCMCParserBitsetState & state, float energy, const MCMCParserBitsetState & bestState, float bestEnergy, int iteration, float temperature)
+        {
+            MCMCParserStateType stateList, bestStateList;
+            state.toVector(stateList);
+            bestState.toVector(bestStateList);
+            return callback(stateList, energy, bestStateList, bestEnergy, iteration, temperature);
+        }
     };
 
 
@@ -142,6 +322,66 @@ namespace parser {
          * Computes the move
          */
         virtual void move(const MCMCParserStateType & state, MCMCParserStateType & newState, float & improvement) = 0;
+        
+        /**
+         * Computes the move on a bitset state. By default the state is 
+         * converted to a list, moved and converted back. Moves that are used
+         * in the bitset optimization should override this.
+         */
+        virtual void move(const MCMCParserBitsetState & state, MCMCParserBitsetState & newState, float & improvement)
+        {
+            MCMCParserStateType stateList, newStateList;
+            state.toVector(stateList);
+            move(stateList, newStateList, improvement);
+            newState.copyFrom(state);
+            newState.assign(newStateList);
+        }
+        
+        /**
+         * Is called with the initial state before an optimization starts
+         */
+        virtual void begin(const MCMCParserStateType &) {}
+        
+        /**
+         * Is called whenever a move of any type has been accepted with the 
+         * hypotheses that were born and the ones that died. Moves that keep
+         * statistics of the state update them here instead of looking at the
+         * whole state on every proposal.
+         */
+        virtual void accepted(const std::vector<int> &, const std::vector<int> &) {}
+        
+        /**
+         * Returns the hypotheses that the last proposal added to the state
+         */
+        const std::vector<int> & getBornParts() const
+        {
+            return bornParts;
+        }
+        
+        /**
+         * Returns the hypotheses that the last proposal removed from the state
+         */
+        const std::vector<int> & getDiedParts() const
+        {
+            return diedParts;
+        }
+        
+        /**
+         * Forgets the hypotheses reported by the last proposal
+         */
+        void clearChange()
+        {
+            bornParts.clear();
+            diedParts.clear();
+        }
+        
+    protected:
+        /**
+         * The hypotheses that the last proposal added to and removed from the
+         * state. Moves that change which hypotheses are selected fill them in
+         * move, hence accepted moves never have to diff whole states.
+         */
+        std::vector<int> bornParts, diedParts;
     };
 
 
@@ -165,14 +405,14 @@ namespace parser {
     */
     class MCMCParserEnergy {
     public:
-        MCMCParserEnergy() {}
+        MCMCParserEnergy() : hypotheses(0) {}
         MCMCParserEnergy(
-            const std::vector<Part> & parts,
+            const PartHypothesisTable & hypotheses,
             const std::vector<float> & rectAreas,
             const Eigen::MatrixXi & overlapPairs,
             const Eigen::MatrixXf & overlapArea,
             const cv::Mat & image
-                ): parts(parts), areas(rectAreas), overlapConflicts(overlapPairs), overlaps(overlapArea), image(image){}
+                ): hypotheses(&hypotheses), areas(rectAreas), overlapConflicts(overlapPairs), overlaps(overlapArea), image(image){}
 
     /**
      * Computes the energy
@@ -184,6 +424,29 @@ namespace parser {
                  const Eigen::MatrixXf & overlapArea,
                  std::vector<Part>& parts
                  );
+    
+    /**
+     * Computes the energy of a bitset state
+     */
+    float energy(const MCMCParserBitsetState & state,
+                 std::vector<float>& moveProbabilities,
+                 const std::vector<float> & areas,
+                 const Eigen::MatrixXi & overlapPairs,
+                 const Eigen::MatrixXf & overlapArea,
+                 std::vector<Part>& parts
+                 );
+    
+    /**
+     * Computes the energy for both state representations
+     */
+    template <class StateType>
+    float computeEnergy(const StateType & state,
+                 std::vector<float>& moveProbabilities,
+                 const std::vector<float> & areas,
+                 const Eigen::MatrixXi & overlapPairs,
+                 const Eigen::MatrixXf & overlapArea,
+                 std::vector<Part>& parts
+                 );
     /**
      * To update the move probabilities in each state
      */
@@ -193,7 +456,7 @@ namespace parser {
      * Energy to trim weird shaped structures
      */
 
-    int computeFormFactorEnergy(const MCMCParserStateType & state);
+    int computeFormFactorEnergy(const MCMCParserStateType & state, const std::vector<Part> & parts);
 
     /**
      * Factorial computation
@@ -238,7 +501,7 @@ namespace parser {
     /**
      * This are all part hypotheses
      */
-    std::vector<Part> parts;
+    const PartHypothesisTable* hypotheses;
     /**
      * The image
      */
@@ -269,11 +532,24 @@ namespace parser {
     class SimulatedAnnealing {
     public:
         SimulatedAnnealing(std::vector<Part> & parts, std::vector<Rectangle> & proposals, const cv::Mat & gradMag,
-                           std::vector<float> & areas, Eigen::MatrixXi & overlapPairs, Eigen::MatrixXi & overlapPairs70,
+                           std::vector<float> & areas, Eigen::MatrixXi & overlapPairs,
                            Eigen::MatrixXf & overlapArea, cv::Mat cannyEdges
 
         ) : gradMag(gradMag), partHypotheses(parts), areas(areas), proposals(proposals), numInnerLoops(500),
-            maxNoUpdateIterations(5000), overlapPairs(overlapPairs), overlapPairs70(overlapPairs70), overlapArea(overlapArea), cannyEdges(cannyEdges) {};
+            maxNoUpdateIterations(5000), customCoolingSchedule(0), plateauIterations(0), plateauTolerance(0), timeBudget(0), 
+            overlapPairs(overlapPairs), overlapArea(overlapArea), cannyEdges(cannyEdges),
+            numIterations(0), terminationReason(TERMINATION_TEMPERATURE) {};
+        
+        /**
+         * The reasons why the optimization terminated
+         */
+        enum TerminationReason {
+            TERMINATION_TEMPERATURE = 0,
+            TERMINATION_NO_UPDATE,
+            TERMINATION_PLATEAU,
+            TERMINATION_TIME_BUDGET,
+            TERMINATION_CALLBACK
+        };
 
         /**
          * Adds a move
@@ -292,6 +568,16 @@ namespace parser {
             coolingSchedule = schedule;
         }
         
+        /**
+         * Sets a cooling schedule that is used instead of the geometric 
+         * schedule. The schedule is not copied and must outlive the 
+         * optimization. Pass 0 to use the geometric schedule again.
+         */
+        void setCoolingSchedule(SACoolingSchedule* schedule)
+        {
+            customCoolingSchedule = schedule;
+        }
+        
         /**
          * Returns the cooling schedule
          */
@@ -357,10 +643,97 @@ namespace parser {
             return maxNoUpdateIterations;
         }
 
+        /**
+         * Enables the plateau detection: If the best energy improves by less
+         * than tolerance*|energy| within the given number of iterations of 
+         * the outer loop, the optimization is terminated. 0 iterations 
+         * disable the plateau detection.
+         */
+        void setPlateauDetection(int iterations, float tolerance)
+        {
+            plateauIterations = iterations;
+            plateauTolerance = tolerance;
+        }
+        
+        /**
+         * Returns the plateau length in iterations
+         */
+        int getPlateauIterations() const
+        {
+            return plateauIterations;
+        }
+        
+        /**
+         * Returns the plateau tolerance
+         */
+        float getPlateauTolerance() const
+        {
+            return plateauTolerance;
+        }
+        
+        /**
+         * Sets the wall clock budget of the optimization in seconds. 0 
+         * disables the budget.
+         */
+        void setTimeBudget(float seconds)
+        {
+            timeBudget = seconds;
+        }
+        
+        /**
+         * Returns the wall clock budget in seconds
+         */
+        float getTimeBudget() const
+        {
+            return timeBudget;
+        }
+        
+        /**
+         * Returns why the last optimization terminated
+         */
+        TerminationReason getTerminationReason() const
+        {
+            return terminationReason;
+        }
+        
         /**
          * Optimizes the error function for a given initialization. 
          */
         float optimize(MCMCParserStateType & state);
+        
+        /**
+         * Optimizes the error function on a bitset state. Only the state is
+         * changed by the moves, i.e. the split, merge and update moves 
+         * which modify the proposal matrices are not supported. The state
+         * must have the capacity of the number of part hypotheses.
+         */
+        float optimize(MCMCParserBitsetState & state);
+        
+        /**
+         * Returns the number of temperature steps of the last optimization
+         */
+        int getNumIterations() const
+        {
+            return numIterations;
+        }
+        
+        /**
+         * Returns the number of proposed moves per move type of the last 
+         * optimization
+         */
+        const std::vector<int> & getNumProposedMoves() const
+        {
+            return numProposedMoves;
+        }
+        
+        /**
+         * Returns the number of accepted moves per move type of the last 
+         * optimization
+         */
+        const std::vector<int> & getNumAcceptedMoves() const
+        {
+            return numAcceptedMoves;
+        }
         /**
          * To display the params in console:debug purpose
          */
@@ -372,7 +745,8 @@ namespace parser {
         void plotMarkovChainState(const MCMCParserStateType state, const std::vector<Part> partHypotheses);
 
         /**
-         * Selecting the type of move
+         * Selecting the type of move. The alias table is rebuilt whenever the
+         * move probabilities have been changed by the energy function.
          */
         int selectRJMCMCMoveType(const float u);
 
@@ -449,6 +823,50 @@ namespace parser {
                                                                 const float imageArea);
 
     private:
+        /**
+         * Checks the plateau, no update and time budget criteria after an
+         * iteration of the outer loop and sets the termination reason.
+         */
+        bool checkTermination(int iteration, int noUpdateIterations, float bestEnergy, float & plateauEnergy, 
+                              int & plateauStart, const std::chrono::steady_clock::time_point & startTime);
+        
+        /**
+         * Tells all moves the initial state of an optimization
+         */
+        void beginMoves(const MCMCParserStateType & state);
+        
+        /**
+         * Runs the move and takes over the parts it reports as born and died
+         */
+        template <class StateType>
+        void proposeMove(int m, const StateType & state, StateType & newState, float & logAcceptRatio)
+        {
+            moves[m]->clearChange();
+            moves[m]->move(state, newState, logAcceptRatio);
+            bornParts = moves[m]->getBornParts();
+            diedParts = moves[m]->getDiedParts();
+        }
+        
+        /**
+         * Tells all moves which parts were born and which died in the last
+         * accepted proposal
+         */
+        void notifyMoves();
+        
+        /**
+         * Drops the reported parts that do not change the bitset state when
+         * it is replaced by newState (e.g. a birth of a selected part).
+         * Returns false if no change is left.
+         */
+        bool filterChange(const MCMCParserBitsetState & state, const MCMCParserBitsetState & newState);
+        
+        /**
+         * Sets the probabilities of the moves that the bitset state does not
+         * support to 0. The energy function adapts the probabilities, so 
+         * this has to be repeated after every evaluation.
+         */
+        void disableListMoves();
+        
         /**
          * These are the registered moves
          */
@@ -457,10 +875,24 @@ namespace parser {
          * The probability for choosing this move
          */
         std::vector<float> moveProbabilities;
+        /**
+         * The alias table for sampling the move type and the probabilities
+         * it was built from
+         */
+        AliasTable moveTable;
+        std::vector<float> moveTableProbabilities;
+        /**
+         * The parts that were born and died in the last proposal
+         */
+        std::vector<int> bornParts, diedParts;
         /**
          * The cooling schedule that determines the temperature
          */
         GeometricCoolingSchedule coolingSchedule;
+        /**
+         * If set, this schedule is used instead of the geometric schedule
+         */
+        SACoolingSchedule* customCoolingSchedule;
         /**
          * The error function
          */
@@ -479,9 +911,21 @@ namespace parser {
          */
         int maxNoUpdateIterations;
         /**
-         * The rectangle parts
+         * If the best energy improves by less than plateauTolerance*|energy|
+         * within this many iterations of the outer loop, optimization is
+         * terminated. 0 disables the plateau detection.
+         */
+        int plateauIterations;
+        float plateauTolerance;
+        /**
+         * The wall clock budget in seconds. 0 disables the budget.
+         */
+        float timeBudget;
+        /**
+         * The rectangle parts of the caller. Split and merge append the new
+         * hypotheses to them.
          */
-        std::vector<Part> partHypotheses;
+        std::vector<Part> & partHypotheses;
         /**
          * The rectangle proposals
          */
@@ -494,10 +938,6 @@ namespace parser {
          * The binary matrix indicating pairs with overlap greater that a threshold
          */
         Eigen::MatrixXi overlapPairs;
-        /**
-         * The binary matrix indicating pairs with overlap greater that a 70%
-         */
-        Eigen::MatrixXi overlapPairs70;
         /**
          * The matrix indicating exact overlap between any two rectangles
          */
@@ -510,6 +950,22 @@ namespace parser {
          * Canny edge Image
          */
         cv::Mat cannyEdges;
+        /**
+         * The number of temperature steps of the last optimization
+         */
+        int numIterations;
+        /**
+         * The number of proposed moves per move type
+         */
+        std::vector<int> numProposedMoves;
+        /**
+         * The number of accepted moves per move type
+         */
+        std::vector<int> numAcceptedMoves;
+        /**
+         * Why the last optimization terminated
+         */
+        TerminationReason terminationReason;
 
     };
 
@@ -0,0 +1,410 @@
+#ifndef PARSER_SAMPLING_H
+#define PARSER_SAMPLING_H
+
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+namespace parser {
+
+    /**
+     * This is Walker's alias method for sampling from a fixed discrete
+     * distribution. Building the table takes O(n), every draw takes O(1) and
+     * consumes a single uniform number.
+     */
+    class AliasTable {
+    public:
+        AliasTable() {}
+
+        /**
+         * Builds the table from non-negative weights that do not need to be
+         * normalized. If all weights are zero, the distribution is uniform.
+         */
+        void build(const std::vector<float> & weights)
+        {
+            const int n = static_cast<int>(weights.size());
+            probabilities.assign(n, 1.0f);
+            aliases.resize(n);
+            for (int i = 0; i < n; i++)
+            {
+                aliases[i] = i;
+            }
+
+            double total = 0;
+            for (int i = 0; i < n; i++)
+            {
+                assert(weights[i] >= 0);
+                total += weights[i];
+            }
+            if (total <= 0)
+            {
+                return;
+            }
+
+            // Scale the weights such that the mean is 1 and distribute the
+            // mass of the large entries to the small ones
+            std::vector<double> scaled(n);
+            std::vector<int> small, large;
+            small.reserve(n);
+            large.reserve(n);
+            for (int i = 0; i < n; i++)
+            {
+                scaled[i] = weights[i]*n/total;
+                if (scaled[i] < 1)
+                {
+                    small.push_back(i);
+                }
+                else
+                {
+                    large.push_back(i);
+                }
+            }
+
+            while (!small.empty() && !large.empty())
+            {
+                const int s = small.back();
+                const int l = large.back();
+                small.pop_back();
+
+                probabilities[s] = static_cast<float>(scaled[s]);
+                aliases[s] = l;
+
+                scaled[l] -= 1 - scaled[s];
+                if (scaled[l] < 1)
+                {
+                    large.pop_back();
+                    small.push_back(l);
+                }
+            }
+
+            // The remaining entries are 1 up to rounding errors
+            for (size_t i = 0; i < small.size(); i++)
+            {
+                probabilities[small[i]] = 1.0f;
+            }
+            for (size_t i = 0; i < large.size(); i++)
+            {
+                probabilities[large[i]] = 1.0f;
+            }
+        }
+
+        /**
+         * Returns the number of entries
+         */
+        int size() const
+        {
+            return static_cast<int>(probabilities.size());
+        }
+
+        /**
+         * Draws an index given a uniform number u in [0,1)
+         */
+        int sample(float u) const
+        {
+            assert(size() > 0);
+
+            const float x = u*size();
+            const int i = std::min(static_cast<int>(x), size() - 1);
+            return (x - i < probabilities[i]) ? i : aliases[i];
+        }
+
+    private:
+        /**
+         * The probability of keeping an entry
+         */
+        std::vector<float> probabilities;
+        /**
+         * The entry that is chosen otherwise
+         */
+        std::vector<int> aliases;
+    };
+
+    /**
+     * This is a Fenwick tree (binary indexed tree) over non-negative weights
+     * for sampling from a distribution that changes over time. Updating a
+     * weight and drawing an index both take O(log n).
+     */
+    class FenwickSampler {
+    public:
+        FenwickSampler() : highestBit(0) {}
+
+        /**
+         * Sets the number of entries. All weights are zero.
+         */
+        void reset(int n)
+        {
+            weights.assign(n, 0);
+            tree.assign(n + 1, 0);
+            highestBit = 1;
+            while (highestBit*2 <= n)
+            {
+                highestBit *= 2;
+            }
+        }
+
+        /**
+         * Returns the number of entries
+         */
+        int size() const
+        {
+            return static_cast<int>(weights.size());
+        }
+
+        /**
+         * Returns the weight of an entry
+         */
+        double get(int i) const
+        {
+            return weights[i];
+        }
+
+        /**
+         * Sets the weight of an entry
+         */
+        void set(int i, double weight)
+        {
+            assert(i >= 0 && i < size() && weight >= 0);
+
+            const double delta = weight - weights[i];
+            weights[i] = weight;
+            for (int k = i + 1; k <= size(); k += k & (-k))
+            {
+                tree[k] += delta;
+            }
+        }
+
+        /**
+         * Returns the sum of the weights of the entries 0 to i-1
+         */
+        double prefixSum(int i) const
+        {
+            double sum = 0;
+            for (int k = i; k > 0; k -= k & (-k))
+            {
+                sum += tree[k];
+            }
+            return sum;
+        }
+
+        /**
+         * Returns the sum of all weights
+         */
+        double total() const
+        {
+            return prefixSum(size());
+        }
+
+        /**
+         * Draws an index given a uniform number u in [0,1). Returns -1 if all
+         * weights are zero.
+         */
+        int sample(float u) const
+        {
+            const double sum = total();
+            if (sum <= 0)
+            {
+                return -1;
+            }
+
+            // Find the first entry whose prefix sum exceeds the target
+            double target = u*sum;
+            int position = 0;
+            for (int step = highestBit; step > 0; step /= 2)
+            {
+                if (position + step <= size() && tree[position + step] <= target)
+                {
+                    position += step;
+                    target -= tree[position];
+                }
+            }
+
+            // Rounding errors might push us past the last positive weight
+            while (position >= size() || weights[position] <= 0)
+            {
+                position = (position >= size() ? size() : position) - 1;
+                if (position < 0)
+                {
+                    return -1;
+                }
+            }
+            return position;
+        }
+
+    private:
+        /**
+         * The weights
+         */
+        std::vector<double> weights;
+        /**
+         * The partial sums
+         */
+        std::vector<double> tree;
+        /**
+         * The highest power of two not larger than the number of entries
+         */
+        int highestBit;
+    };
+
+    /**
+     * Samples a part of an annealing state with probability proportional to
+     * a fixed weight per hypothesis. The sampler is told about the parts 
+     * that are born or die, hence every accepted move costs O(log n) and 
+     * drawing does not look at the state.
+     */
+    class StateWeightSampler {
+    public:
+        StateWeightSampler() {}
+
+        /**
+         * Sets the weight of every hypothesis and empties the state
+         */
+        void reset(const std::vector<float> & _hypothesisWeights)
+        {
+            hypothesisWeights = _hypothesisWeights;
+            const int n = static_cast<int>(hypothesisWeights.size());
+            tree.reset(n);
+            counts.assign(n, 0);
+            positions.assign(n, -1);
+            statePositions.assign(n, -1);
+            members.clear();
+        }
+
+        /**
+         * Replaces the state by the given one (MCMCParserStateType or 
+         * MCMCParserBitsetState). This is only needed at the beginning of an
+         * optimization.
+         */
+        template <class StateType>
+        void assign(const StateType & state)
+        {
+            for (size_t i = 0; i < members.size(); i++)
+            {
+                tree.set(members[i], 0);
+                counts[members[i]] = 0;
+                positions[members[i]] = -1;
+            }
+            members.clear();
+
+            for (size_t i = 0; i < state.size(); i++)
+            {
+                insert(state[i]);
+            }
+        }
+
+        /**
+         * Adds a part to the state. Hypotheses that were created during the
+         * optimization (e.g. by splits) have no weight.
+         */
+        void insert(int h)
+        {
+            if (h < 0 || h >= static_cast<int>(counts.size()))
+            {
+                return;
+            }
+            if (counts[h]++ == 0)
+            {
+                tree.set(h, hypothesisWeights[h]);
+                positions[h] = static_cast<int>(members.size());
+                members.push_back(h);
+            }
+        }
+
+        /**
+         * Removes a part from the state
+         */
+        void remove(int h)
+        {
+            if (h < 0 || h >= static_cast<int>(counts.size()) || counts[h] == 0)
+            {
+                return;
+            }
+            if (--counts[h] == 0)
+            {
+                tree.set(h, 0);
+
+                // Move the last member into the gap
+                const int last = members.back();
+                members[positions[h]] = last;
+                positions[last] = positions[h];
+                positions[h] = -1;
+                members.pop_back();
+            }
+        }
+
+        /**
+         * Returns the hypothesis of the sampled part or -1 if all parts have
+         * zero weight
+         */
+        int sample(float u) const
+        {
+            return tree.sample(u);
+        }
+
+        /**
+         * Returns the position of hypothesis h in the list state or -1. The
+         * positions of all parts are remembered whenever the state is
+         * searched, hence this only searches again after h was added or
+         * shifted by an erase.
+         */
+        int locate(const std::vector<int> & state, int h)
+        {
+            if (h < 0 || h >= static_cast<int>(statePositions.size()))
+            {
+                return -1;
+            }
+
+            const int cached = statePositions[h];
+            if (cached >= 0 && cached < static_cast<int>(state.size()) && state[cached] == h)
+            {
+                return cached;
+            }
+
+            int position = -1;
+            for (size_t i = 0; i < state.size(); i++)
+            {
+                if (state[i] >= 0 && state[i] < static_cast<int>(statePositions.size()))
+                {
+                    statePositions[state[i]] = static_cast<int>(i);
+                }
+                if (state[i] == h && position < 0)
+                {
+                    position = static_cast<int>(i);
+                }
+            }
+            if (position >= 0)
+            {
+                statePositions[h] = position;
+            }
+            return position;
+        }
+
+    private:
+        /**
+         * The weight of every hypothesis
+         */
+        std::vector<float> hypothesisWeights;
+        /**
+         * The weights of the parts in the state
+         */
+        FenwickSampler tree;
+        /**
+         * How often every hypothesis is in the state
+         */
+        std::vector<int> counts;
+        /**
+         * The position of every hypothesis in members or -1
+         */
+        std::vector<int> positions;
+        /**
+         * The position in the list state where every hypothesis was found
+         * last or -1
+         */
+        std::vector<int> statePositions;
+        /**
+         * The hypotheses in the tree
+         */
+        std::vector<int> members;
+    };
+}
+
+#endif
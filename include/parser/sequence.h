@@ -0,0 +1,172 @@
+#ifndef PARSER_SEQUENCE_H
+#define PARSER_SEQUENCE_H
+
+/**
+ * This file contains the per stream state for parsing RGB-D sequences.
+ * Consecutive frames of a handheld sweep show the same cabinet under small
+ * camera motion, hence the proposals and the segmentation of the last frame
+ * are good initializations for the next one.
+ */
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "parser.h"
+
+namespace parser {
+
+    /**
+     * Carries the results of the last frame of a sequence over to the next
+     * frame (see CabinetParser::parseSequenceFrame). All rectangles are
+     * stored in the rectified coordinates of the frame they belong to. The
+     * region of interest is assumed to follow the cabinet, hence the
+     * rectified frames are related by the homography between the rectified
+     * regions of interest.
+     */
+    class SequenceState {
+    public:
+        /**
+         * The parameters that decide when the last frame is reused
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() :   maxRegionMotion(0.1f),
+                        maxEdgeChange(0.35f),
+                        minTrackedProposals(0.5f),
+                        keyframeInterval(30),
+                        numSamples(20000),
+                        warmStartTemperature(1.0f) {}
+
+            /**
+             * The maximum displacement of a corner of the region of interest
+             * relative to its diagonal
+             */
+            float maxRegionMotion;
+            /**
+             * The maximum fraction of edge pixels that have no counterpart in
+             * the warped edge image of the last frame
+             */
+            float maxEdgeChange;
+            /**
+             * The minimum fraction of the warped proposals that must still be
+             * supported by the edges
+             */
+            float minTrackedProposals;
+            /**
+             * Every keyframeInterval frames the full pipeline is run in order
+             * to avoid drift
+             */
+            int keyframeInterval;
+            /**
+             * The number of samples of the rectangle detector if it is seeded
+             * with the tracked proposals
+             */
+            int numSamples;
+            /**
+             * The start temperature of the annealing if it is initialized
+             * with the last segmentation
+             */
+            float warmStartTemperature;
+        };
+
+        SequenceState() : numFrames(0), numWarmFrames(0), framesSinceKeyframe(0) {}
+
+        /**
+         * Forgets the last frame, e.g. when a new sweep starts
+         */
+        void reset();
+
+        /**
+         * Returns true if there is a last frame
+         */
+        bool isValid() const
+        {
+            return numFrames > 0;
+        }
+
+        /**
+         * Returns the largest displacement of a corner of the region of
+         * interest since the last frame relative to the diagonal of the
+         * region
+         */
+        float computeRegionMotion(const Rectangle & currentRegion) const;
+
+        /**
+         * Computes the homography from the rectified last frame to the
+         * rectified current frame
+         */
+        void computeFrameHomography(const Rectangle & currentRegion, int rectifiedSize, cv::Mat & homography) const;
+
+        /**
+         * Decides whether the current frame can reuse the last one. If so,
+         * the tracked proposals are returned in rectified coordinates of the
+         * current frame. The caller still has to check the proposals against
+         * the current edges.
+         */
+        bool canWarmStart(  const Rectangle & currentRegion,
+                            const cv::Mat & currentEdgeImage,
+                            int rectifiedSize,
+                            std::vector<Rectangle> & trackedProposals,
+                            std::vector<Part> & trackedParts) const;
+
+        /**
+         * Stores the results of the current frame
+         */
+        void update(const Rectangle & currentRegion,
+                    const cv::Mat & currentEdgeImage,
+                    const std::vector<Rectangle> & currentProposals,
+                    const std::vector<Part> & currentParts,
+                    bool warm);
+
+        /**
+         * Maps axis aligned rectangles through a homography. The results are
+         * axis aligned again.
+         */
+        static void warpRectangles(const cv::Mat & homography, const std::vector<Rectangle> & in, std::vector<Rectangle> & out);
+
+        /**
+         * Returns the fraction of edge pixels in both images that have no
+         * counterpart within a small distance in the other image after the
+         * previous image has been warped by the homography
+         */
+        static float computeEdgeChange(const cv::Mat & previous, const cv::Mat & current, const cv::Mat & homography);
+
+        /**
+         * The parameters
+         */
+        Model model;
+        /**
+         * The region of interest of the last frame
+         */
+        Rectangle region;
+        /**
+         * The rectified edge image of the last frame
+         */
+        cv::Mat edgeImage;
+        /**
+         * The detected proposals of the last frame (before augmentation)
+         */
+        std::vector<Rectangle> proposals;
+        /**
+         * The segmentation of the last frame
+         */
+        std::vector<Part> parts;
+        /**
+         * The number of parsed frames
+         */
+        int numFrames;
+        /**
+         * The number of frames that reused the last frame
+         */
+        int numWarmFrames;
+        /**
+         * The number of frames since the pipeline has been run from scratch
+         */
+        int framesSinceKeyframe;
+    };
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PARSER_SERIALIZATION_H
+#define PARSER_SERIALIZATION_H
+
+/**
+ * This file contains the helpers for the binary formats of the parser (the
+ * parse cache, the parse records, the shape priors and the server protocol).
+ * Values are stored in native byte order. Files start with a four byte magic
+ * and a version and end with a 64 bit FNV-1a checksum of everything before.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <opencv2/opencv.hpp>
+
+#include "parser.h"
+
+namespace parser {
+
+    /**
+     * Incremental 64 bit FNV-1a hash
+     */
+    class ContentHasher {
+    public:
+        ContentHasher() : state(14695981039346656037ull) {}
+
+        /**
+         * Hashes raw bytes
+         */
+        void update(const void* data, size_t size)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++)
+            {
+                state ^= bytes[i];
+                state *= 1099511628211ull;
+            }
+        }
+
+        /**
+         * Hashes a string including its length
+         */
+        void update(const std::string & str)
+        {
+            updateValue(static_cast<uint64_t>(str.size()));
+            update(str.data(), str.size());
+        }
+
+        /**
+         * Hashes the type, the size and the pixels of an image
+         */
+        void update(const cv::Mat & mat);
+
+        /**
+         * Hashes the bytes of a plain value
+         */
+        template <class T>
+        void updateValue(const T & value)
+        {
+            update(&value, sizeof(T));
+        }
+
+        /**
+         * Returns the hash as 16 hex digits
+         */
+        std::string getHex() const;
+
+        uint64_t getHash() const
+        {
+            return state;
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    /**
+     * Appends the bytes of a plain value to a buffer
+     */
+    template <class T>
+    inline void appendValue(std::string & buffer, const T & value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * Reads a plain value from a buffer. Returns false if the buffer is too
+     * short.
+     */
+    template <class T>
+    inline bool readValue(const std::string & buffer, size_t & offset, T & value)
+    {
+        if (offset > buffer.size() || sizeof(T) > buffer.size() - offset)
+        {
+            return false;
+        }
+        std::memcpy(&value, buffer.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    /**
+     * Appends the corners of a rectangle as 8 floats
+     */
+    void appendRectangle(std::string & buffer, const Rectangle & rect);
+
+    /**
+     * Reads the corners of a rectangle written by appendRectangle
+     */
+    bool readRectangle(const std::string & buffer, size_t & offset, Rectangle & rect);
+
+    /**
+     * Starts a file with the magic and the version
+     */
+    void beginFile(std::string & buffer, const char (&magic)[4], uint32_t version);
+
+    /**
+     * Appends the checksum and writes the file. The buffer must have been
+     * started by beginFile.
+     */
+    bool finishFile(const std::string & file, std::string & buffer);
+
+    /**
+     * Reads a file written by finishFile. Returns false if the file cannot be
+     * read, is truncated or corrupted, or has another magic or version. On
+     * success the checksum is removed from the buffer and offset points
+     * behind the version.
+     */
+    bool readFile(const std::string & file, const char (&magic)[4], uint32_t version, std::string & buffer, size_t & offset);
+}
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef PARSER_SERVER_H
+#define PARSER_SERVER_H
+
+/**
+ * This file contains a long running parse server. The server keeps the
+ * models in memory and accepts parse requests over a Unix domain socket.
+ *
+ * Every message is a frame consisting of the payload length (uint32), the
+ * message type (uint8) and the payload. All values are in host byte order
+ * as client and server run on the same machine.
+ *
+ * Request:  region of interest (8 floats), RGB image, depth image. Images are
+ *           sent as rows, cols, type (3 int32) followed by the pixel data.
+ * Response: number of parts (uint32), per part the corners (8 floats), the
+ *           label (int32) and the posterior (float). Then the number of
+ *           timings (uint32) and per timing the name (uint16 length and
+ *           characters) and the time in seconds (double).
+ * Error:    the error message
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "parser.h"
+
+namespace parser {
+
+    /**
+     * Encodes and decodes the messages of the parse server
+     */
+    class ParseProtocol {
+    public:
+        /**
+         * The message types
+         */
+        static const uint8_t MESSAGE_PARSE_REQUEST = 1;
+        static const uint8_t MESSAGE_PARSE_RESPONSE = 2;
+        static const uint8_t MESSAGE_ERROR = 3;
+
+        /**
+         * Frames with larger payloads are rejected
+         */
+        static const uint32_t MAX_PAYLOAD_SIZE = 64*1024*1024;
+
+        /**
+         * Writes a frame to the socket. Returns false if the connection is
+         * broken.
+         */
+        static bool writeFrame(int fd, uint8_t type, const std::string & payload);
+
+        /**
+         * Reads a frame from the socket. Returns false if the connection has
+         * been closed or the frame is invalid.
+         */
+        static bool readFrame(int fd, uint8_t & type, std::string & payload);
+
+        /**
+         * Encodes a parse request
+         */
+        static void encodeRequest(const cv::Mat & image, const cv::Mat & imageDepth, const Rectangle & region, std::string & payload);
+
+        /**
+         * Decodes a parse request. Returns false if the payload is malformed.
+         */
+        static bool decodeRequest(const std::string & payload, cv::Mat & image, cv::Mat & imageDepth, Rectangle & region);
+
+        /**
+         * Encodes the parts and the timings of a parse response
+         */
+        static void encodeResponse(const std::vector<Part> & parts, const std::vector< std::pair<std::string, double> > & timings, std::string & payload);
+
+        /**
+         * Decodes a parse response. Returns false if the payload is malformed.
+         */
+        static bool decodeResponse(const std::string & payload, std::vector<Part> & parts, std::vector< std::pair<std::string, double> > & timings);
+    };
+
+    /**
+     * Serves parse requests over a Unix domain socket. Connections are
+     * handled by a fixed number of workers, each with its own parser that
+     * shares the models of the given parser. A connection may send any number
+     * of requests. If more connections are waiting than the queue can hold,
+     * new connections are rejected with an error message.
+     */
+    class ParseServer {
+    public:
+        /**
+         * The parameters of the server
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() : numWorkers(4), numThreadsPerWorker(0), maxPendingConnections(64) {}
+
+            /**
+             * The number of connections that are served concurrently
+             */
+            int numWorkers;
+            /**
+             * The number of OpenMP threads of every worker. If 0, the 
+             * processors are divided among the workers such that concurrent
+             * requests do not oversubscribe the machine.
+             */
+            int numThreadsPerWorker;
+            /**
+             * The maximum number of accepted connections that wait for a
+             * worker
+             */
+            int maxPendingConnections;
+        };
+
+        /**
+         * Creates a server that uses the models and parameters of the given
+         * parser. The parser must outlive the server. Call loadModels on the
+         * parser first such that the edge detectors and the selection models
+         * are loaded once and stay resident; otherwise every worker loads 
+         * its own copy on first use.
+         */
+        ParseServer(const CabinetParser & _parser) : parser(_parser), listenFd(-1), stopped(false), numRequests(0), numErrors(0), numRejected(0) {}
+
+        ~ParseServer();
+
+        /**
+         * Binds the socket. An existing socket file is replaced. Returns
+         * false on failure.
+         */
+        bool listen(const std::string & socketPath);
+
+        /**
+         * Accepts connections until stop is called
+         */
+        void run();
+
+        /**
+         * Stops the server. Can be called from a signal handler or another
+         * thread.
+         */
+        void stop()
+        {
+            stopped = true;
+        }
+
+        /**
+         * Returns the number of served requests
+         */
+        int getNumRequests() const
+        {
+            return numRequests;
+        }
+
+        /**
+         * Returns the number of requests that failed
+         */
+        int getNumErrors() const
+        {
+            return numErrors;
+        }
+
+        /**
+         * Returns the number of rejected connections
+         */
+        int getNumRejected() const
+        {
+            return numRejected;
+        }
+
+        /**
+         * The parameters
+         */
+        Model model;
+
+    private:
+        /**
+         * Serves the queued connections
+         */
+        void work();
+
+        /**
+         * Serves the requests of a single connection until it is closed
+         */
+        void serveConnection(CabinetParser & worker, int fd);
+
+        /**
+         * The parser whose models are used
+         */
+        const CabinetParser & parser;
+        /**
+         * The listening socket
+         */
+        int listenFd;
+        /**
+         * The path of the socket file
+         */
+        std::string socketPath;
+        /**
+         * The accepted connections that wait for a worker
+         */
+        std::deque<int> pending;
+        std::mutex mutex;
+        std::condition_variable condition;
+        /**
+         * Set if the server shall stop
+         */
+        std::atomic<bool> stopped;
+        /**
+         * Statistics
+         */
+        std::atomic<int> numRequests;
+        std::atomic<int> numErrors;
+        std::atomic<int> numRejected;
+    };
+
+    /**
+     * A client of the parse server
+     */
+    class ParseClient {
+    public:
+        ParseClient() : fd(-1) {}
+
+        ~ParseClient()
+        {
+            close();
+        }
+
+        /**
+         * Connects to the server. Returns false on failure.
+         */
+        bool connect(const std::string & socketPath);
+
+        /**
+         * Closes the connection
+         */
+        void close();
+
+        /**
+         * Sends a parse request and waits for the response. Returns false if
+         * the request failed, the reason is returned in error.
+         */
+        bool parse(const cv::Mat & image,
+                   const cv::Mat & imageDepth,
+                   const Rectangle & region,
+                   std::vector<Part> & parts,
+                   std::vector< std::pair<std::string, double> > & timings,
+                   std::string & error);
+
+    private:
+        /**
+         * The socket
+         */
+        int fd;
+    };
+}
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef PARSER_SHAPE_PRIOR_H
+#define PARSER_SHAPE_PRIOR_H
+
+/**
+ * This file contains the linear shape prior. The shape priors are trained as
+ * linear one-vs-all SVMs whose decision value is a dot product, hence the
+ * priors of all hypotheses and labels are a single matrix product.
+ */
+
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <opencv2/opencv.hpp>
+
+namespace parser {
+
+    /**
+     * Evaluates the decision values w_l^T x + b_l of one linear SVM per label
+     * and maps them to prior probabilities with a sigmoid
+     */
+    class LinearShapePrior {
+    public:
+        /**
+         * Creates an empty prior
+         */
+        LinearShapePrior() {}
+
+        /**
+         * Reduces a trained linear SVM to its weight vector and bias. The
+         * decision value is affine, hence the bias is the value at 0 and the
+         * weights are the differences at the unit vectors.
+         */
+        static void reduceSVM(const CvSVM & svm, Eigen::VectorXf & weights, float & bias);
+
+        /**
+         * Loads the SVMs of all labels (one file per label) and reduces them.
+         * Returns false if a file cannot be loaded or the SVMs have different
+         * dimensions.
+         */
+        bool loadSVMs(const std::vector<std::string> & files);
+
+        /**
+         * Writes the weights and biases in a compact binary form. Returns
+         * false on failure.
+         */
+        bool save(const std::string & file) const;
+
+        /**
+         * Reads a prior that has been written by save. Returns false if the
+         * file does not exist or is corrupted.
+         */
+        bool load(const std::string & file);
+
+        /**
+         * Returns the number of features
+         */
+        int getNumFeatures() const
+        {
+            return static_cast<int>(weights.rows());
+        }
+
+        /**
+         * Returns the number of labels
+         */
+        int getNumLabels() const
+        {
+            return static_cast<int>(weights.cols());
+        }
+
+        /**
+         * Computes the N x L decision values for the N x F feature matrix
+         */
+        void computeDecisionValues(const Eigen::MatrixXf & features, Eigen::MatrixXf & values) const;
+
+        /**
+         * Computes the N x L prior probabilities 1 - 1/(1 + exp(-s*d)) where
+         * d is the decision value and s the steepness
+         */
+        void computePriors(const Eigen::MatrixXf & features, float steepness, Eigen::MatrixXf & priors) const;
+
+        /**
+         * The F x L weights, one column per label
+         */
+        Eigen::MatrixXf weights;
+        /**
+         * The biases of the labels
+         */
+        Eigen::VectorXf biases;
+    };
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef PARSER_SIMILARITY_INDEX_H
+#define PARSER_SIMILARITY_INDEX_H
+
+#include <vector>
+#include <cassert>
+#include "hypothesis_table.h"
+
+namespace parser {
+
+    /**
+     * This is a neighbor index over the part hypotheses. For every hypothesis
+     * it stores the list of structurally similar hypotheses in compressed
+     * sparse row format. Two hypotheses are similar if the intersection of
+     * their rectangles relative to the smaller rectangle lies strictly
+     * between minOverlap and maxOverlap. Every hypothesis is similar to
+     * itself.
+     *
+     * The index is built with a uniform grid over the rectangle bounds such
+     * that only rectangles sharing a grid cell are compared.
+     */
+    class SimilarityIndex {
+    public:
+        SimilarityIndex() : offsets(1, 0) {}
+
+        /**
+         * Builds the index. Hypotheses of the same rectangle with different
+         * labels are perfect matches and hence not similar to each other.
+         */
+        void build(const PartHypothesisTable & hypotheses, float minOverlap, float maxOverlap);
+
+        /**
+         * Returns the number of hypotheses
+         */
+        int size() const
+        {
+            return static_cast<int>(offsets.size()) - 1;
+        }
+
+        /**
+         * Returns the number of hypotheses similar to h
+         */
+        int getNumNeighbors(int h) const
+        {
+            assert(h >= 0 && h < size());
+            return offsets[h + 1] - offsets[h];
+        }
+
+        /**
+         * Returns the k-th hypothesis similar to h
+         */
+        int getNeighbor(int h, int k) const
+        {
+            assert(k >= 0 && k < getNumNeighbors(h));
+            return neighbors[offsets[h] + k];
+        }
+
+        /**
+         * Returns the total number of stored neighbors
+         */
+        int getNumEntries() const
+        {
+            return static_cast<int>(neighbors.size());
+        }
+
+        /**
+         * Returns the overlap score of two axis aligned rectangles given by
+         * their bounds (minX, minY, maxX, maxY), i.e. the area of the
+         * intersection divided by the smaller area.
+         */
+        static float calcOverlapScore(const float* bounds1, const float* bounds2);
+
+    private:
+        /**
+         * The start of the neighbor list of every hypothesis
+         */
+        std::vector<int> offsets;
+        /**
+         * The concatenated neighbor lists
+         */
+        std::vector<int> neighbors;
+    };
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef PARSER_SYNTHETIC_H
+#define PARSER_SYNTHETIC_H
+
+/**
+ * This file contains a procedural generator for cabinet fronts. It is used to
+ * benchmark the pipeline without access to the annotated data sets.
+ */
+
+#include "parser.h"
+
+#include <random>
+#include <opencv2/opencv.hpp>
+
+namespace parser {
+    /**
+     * Generates random cabinet fronts consisting of doors, drawers and
+     * shelves. Every scene is rendered into an RGB image and an 8 bit depth
+     * image (in the same format as the depth PNGs of the data sets) together
+     * with the matching ground truth segmentation.
+     */
+    class SyntheticSceneGenerator {
+    public:
+        /**
+         * The parameters of the generator
+         */
+        class Model {
+        public:
+            /**
+             * The default constructor
+             */
+            Model() :   imageWidth(640),
+                        imageHeight(480),
+                        minROISize(0.6),
+                        maxROISize(0.85),
+                        perspective(0.05),
+                        frameWidth(0.02),
+                        shelfProbability(0.15),
+                        noise(6) {}
+
+            /**
+             * The size of the generated images
+             */
+            int imageWidth;
+            int imageHeight;
+            /**
+             * The range of the size of the cabinet relative to the image size
+             */
+            double minROISize;
+            double maxROISize;
+            /**
+             * The maximum displacement of the cabinet corners relative to the
+             * cabinet size. This simulates the perspective distortion.
+             */
+            double perspective;
+            /**
+             * The width of the carcass frame around the parts relative to the
+             * cabinet size
+             */
+            double frameWidth;
+            /**
+             * The probability that a part is an open shelf
+             */
+            double shelfProbability;
+            /**
+             * The standard deviation of the pixel noise
+             */
+            double noise;
+        };
+
+        /**
+         * Creates a generator with the given seed
+         */
+        SyntheticSceneGenerator(unsigned int seed = 0) : model(), g(seed) {}
+
+        /**
+         * Generates a cabinet front with the given number of parts
+         */
+        void generate(  int numParts,
+                        cv::Mat & image,
+                        Segmentation & segmentation,
+                        cv::Mat & imageDepth);
+
+        /**
+         * Generates a sequence of frames that show the same cabinet front
+         * under small camera motion. The corners of the region of interest 
+         * move by at most motion times the size of the region per frame.
+         */
+        void generateSequence(  int numParts,
+                                int numFrames,
+                                double motion,
+                                std::vector<cv::Mat> & images,
+                                std::vector<Segmentation> & segmentations,
+                                std::vector<cv::Mat> & depthImages);
+
+        /**
+         * Generates the layout of the parts on the unit square. Columns are
+         * filled from left to right with parts stacked from top to bottom.
+         */
+        void generateLayout(int numParts,
+                            std::vector<Rectangle> & parts,
+                            std::vector<int> & labels);
+
+        /**
+         * The parameter model
+         */
+        Model model;
+
+    private:
+        /**
+         * Chooses the corners of the cabinet in the image
+         */
+        void chooseRegionOfInterest(std::vector<cv::Point2f> & roiCorners);
+
+        /**
+         * Renders a cabinet front with the given corners
+         */
+        void renderScene(   int numParts,
+                            const std::vector<cv::Point2f> & roiCorners,
+                            cv::Mat & image,
+                            Segmentation & segmentation,
+                            cv::Mat & imageDepth);
+
+        /**
+         * Renders a single part with the given front color into the RGB and 
+         * depth image
+         */
+        void renderPart(const cv::Mat & homography,
+                        const Rectangle & part,
+                        int label,
+                        const cv::Scalar & color,
+                        cv::Mat & image,
+                        cv::Mat & imageDepth);
+
+        /**
+         * The random number generator
+         */
+        std::mt19937 g;
+    };
+}
+
+#endif
@@ -11,12 +11,16 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
 #include <Eigen/Dense>
 #include <boost/static_assert.hpp>
 #include <boost/type_traits.hpp>
 
 #include "tree.h"
 #include "io.h"
+#include "util.h"
 
 namespace libf {
     /**
@@ -213,8 +217,133 @@ namespace libf {
          */
         BOOST_STATIC_ASSERT((boost::is_base_of<AbstractClassifier, TreeType>::value));
         
+        RandomForest() : earlyExit(false), earlyExitMargin(0) {}
+        
         virtual ~RandomForest() {}
         
+        /**
+         * Make the data set classification from the base class visible. 
+         */
+        using AbstractForestClassifier<TreeType>::classify;
+        
+        /**
+         * Assigns an integer class label to some data point. If early exit is
+         * enabled, the trees are evaluated anytime style. 
+         */
+        virtual int classify(const DataPoint & x) const
+        {
+            if (earlyExit)
+            {
+                return classifyEarlyExit(x);
+            }
+            return AbstractForestClassifier<TreeType>::classify(x);
+        }
+        
+        /**
+         * Enables the anytime evaluation mode for classify. The trees are then
+         * evaluated in their fixed order and the evaluation stops as soon as
+         * the remaining trees cannot change the decision anymore, or as soon
+         * as the accumulated log posterior of the leading class exceeds the
+         * one of the runner up by the given margin. A margin of 0 disables the
+         * confidence criterion such that the decision is the same as the one
+         * obtained from all trees.
+         * 
+         * This must be called after the ensemble is complete. 
+         * 
+         * @param margin The confidence margin in accumulated log posterior
+         */
+        void enableEarlyExit(float margin = 0)
+        {
+            earlyExit = true;
+            earlyExitMargin = margin;
+            computeRemainingMarginBounds();
+        }
+        
+        /**
+         * Disables the anytime evaluation mode. 
+         */
+        void disableEarlyExit()
+        {
+            earlyExit = false;
+        }
+        
+        /**
+         * Returns true if the anytime evaluation mode is enabled. 
+         */
+        bool isEarlyExitEnabled() const
+        {
+            return earlyExit;
+        }
+        
+        /**
+         * Classifies a data point by evaluating as few trees as possible. 
+         * Every tree can shift the difference between the accumulated log 
+         * posteriors of two classes by at most the spread of its leaf 
+         * histograms. Once the leading class is ahead of the runner up by more
+         * than the sum of these spreads over the remaining trees, the argmax
+         * is settled. 
+         * 
+         * The forest keeps no statistics, hence this can be called from many
+         * threads. Callers that want the average number of evaluated trees 
+         * aggregate numTrees themselves.
+         * 
+         * @param x The data point to classify
+         * @param numTrees If not null, the number of evaluated trees is stored here
+         * @return The class label
+         */
+        int classifyEarlyExit(const DataPoint & x, int* numTrees = 0) const
+        {
+            BOOST_ASSERT_MSG(this->getSize() > 0, "Cannot classify a point from an empty ensemble.");
+            BOOST_ASSERT_MSG(static_cast<int>(remainingMargin.size()) == this->getSize() + 1, "Call enableEarlyExit after the ensemble is complete.");
+            
+            std::vector<float> probabilities;
+            this->getTree(0)->classLogPosterior(x, probabilities);
+            
+            int t = 1;
+            for (; t < this->getSize(); t++)
+            {
+                // Find the leading class and the runner up
+                float best = -std::numeric_limits<float>::infinity();
+                float second = -std::numeric_limits<float>::infinity();
+                for (size_t c = 0; c < probabilities.size(); c++)
+                {
+                    if (probabilities[c] > best)
+                    {
+                        second = best;
+                        best = probabilities[c];
+                    }
+                    else if (probabilities[c] > second)
+                    {
+                        second = probabilities[c];
+                    }
+                }
+                
+                const float lead = best - second;
+                if (lead > remainingMargin[t] || (earlyExitMargin > 0 && lead >= earlyExitMargin))
+                {
+                    break;
+                }
+                
+                // Evaluate the next tree
+                const int leafNode = this->getTree(t)->findLeafNode(x);
+                const std::vector<float> & hist = this->getTree(t)->getNodeData(leafNode).histogram;
+                
+                BOOST_ASSERT(hist.size() == probabilities.size());
+                
+                for (size_t c = 0; c < hist.size(); c++)
+                {
+                    probabilities[c] += hist[c];
+                }
+            }
+            
+            if (numTrees != 0)
+            {
+                *numTrees = t;
+            }
+            
+            return static_cast<int>(Util::argMax(probabilities));
+        }
+        
         virtual float getVotesFor1(const DataPoint & x) const
         {
             float votes = 0;
@@ -258,8 +387,499 @@ namespace libf {
                 }
             }
         }
+        
+    private:
+        /**
+         * Computes for every tree index t the maximum amount by which the trees
+         * t, t+1, ... can change the difference between the accumulated log 
+         * posteriors of any two classes. 
+         */
+        void computeRemainingMarginBounds()
+        {
+            const int T = this->getSize();
+            remainingMargin.assign(T + 1, 0);
+            
+            for (int t = T - 1; t >= 0; t--)
+            {
+                auto tree = this->getTree(t);
+                
+                // Determine the largest spread over all leaf histograms
+                float spread = 0;
+                for (int node = 0; node < tree->getNumNodes(); node++)
+                {
+                    if (!tree->getNodeConfig(node).isLeafNode())
+                    {
+                        continue;
+                    }
+                    
+                    const std::vector<float> & hist = tree->getNodeData(node).histogram;
+                    if (hist.size() == 0)
+                    {
+                        continue;
+                    }
+                    
+                    const float maxValue = *std::max_element(hist.begin(), hist.end());
+                    const float minValue = *std::min_element(hist.begin(), hist.end());
+                    spread = std::max(spread, maxValue - minValue);
+                }
+                
+                remainingMargin[t] = remainingMargin[t + 1] + spread;
+            }
+        }
+        
+        /**
+         * Whether classify uses the anytime evaluation
+         */
+        bool earlyExit;
+        /**
+         * The confidence margin for the anytime evaluation
+         */
+        float earlyExitMargin;
+        /**
+         * remainingMargin[t] bounds the change the trees t, t+1, ... can cause
+         */
+        std::vector<float> remainingMargin;
     };
     
+    /**
+     * This is a compact, quantized representation of a random forest of axis
+     * aligned decision trees. The nodes of all trees are stored in a single
+     * array. Each node uses a 16 bit feature index and a 16 bit threshold 
+     * that is quantized to the value range of its feature. The leaf 
+     * posteriors are stored as 8 bit probabilities. 
+     */
+    class QuantizedRandomForest : public AbstractClassifier {
+    public:
+        typedef std::shared_ptr<QuantizedRandomForest> ptr;
+        
+        /**
+         * The version of the file format. Files start with the magic "LFQF"
+         * followed by the version.
+         */
+        static const uint32_t VERSION = 1;
+        
+        /**
+         * Marks the child field of a node as a leaf index
+         */
+        static const uint32_t LEAF_FLAG = 0x80000000u;
+        
+        /**
+         * A single node. For split nodes, child is the index of the left child
+         * and the right child is located at child + 1. For leaf nodes, child
+         * is the index of the leaf posterior ored with LEAF_FLAG. 
+         */
+        struct Node {
+            uint16_t feature;
+            uint16_t threshold;
+            uint32_t child;
+        };
+        
+        QuantizedRandomForest() : numClasses(0) {}
+        
+        virtual ~QuantizedRandomForest() {}
+        
+        /**
+         * Quantizes a trained random forest. The value range of every feature
+         * is taken from the given data storage. Thresholds outside of this
+         * range are clamped to it. 
+         * 
+         * @param forest The trained forest
+         * @param storage Data that covers the value range of the features
+         */
+        void quantize(const RandomForest<DecisionTree> & forest, AbstractDataStorage::ptr storage);
+        
+        /**
+         * Quantizes a trained random forest. The value range of every feature
+         * is given explicitly. 
+         * 
+         * @param forest The trained forest
+         * @param minValues The minimum value per feature
+         * @param maxValues The maximum value per feature
+         */
+        void quantize(const RandomForest<DecisionTree> & forest, const std::vector<float> & minValues, const std::vector<float> & maxValues);
+        
+        /**
+         * Returns the class log posterior log(p(c | x)). The probabilities are
+         * not normalized. 
+         */
+        virtual void classLogPosterior(const DataPoint & x, std::vector<float> & probabilities) const;
+        
+        /**
+         * Returns the number of trees
+         */
+        int getSize() const
+        {
+            return static_cast<int>(roots.size());
+        }
+        
+        /**
+         * Returns the number of classes
+         */
+        int getNumClasses() const
+        {
+            return numClasses;
+        }
+        
+        /**
+         * Returns the total number of nodes
+         */
+        int getNumNodes() const
+        {
+            return static_cast<int>(nodes.size());
+        }
+        
+        /**
+         * Returns the number of bytes used by the model
+         */
+        size_t getMemorySize() const;
+        
+        /**
+         * Reads the forest from a stream. Throws an IOException if the 
+         * stream does not contain a valid forest, e.g. if a node refers to a
+         * node, leaf or feature that does not exist. The forest is unchanged
+         * in this case.
+         * 
+         * @param stream The stream to read the forest from
+         */
+        virtual void read(std::istream & stream);
+        
+        /**
+         * Writes the forest to a stream
+         * 
+         * @param stream The stream to write the forest to.
+         */
+        virtual void write(std::ostream & stream) const;
+        
+    private:
+        /**
+         * Returns the leaf of the given tree the data point falls into
+         */
+        uint32_t findLeaf(int tree, const DataPoint & x) const
+        {
+            uint32_t node = roots[tree];
+            while (!(nodes[node].child & LEAF_FLAG))
+            {
+                const Node & n = nodes[node];
+                const float threshold = featureMin[n.feature] + n.threshold*featureStep[n.feature];
+                node = n.child + (x(n.feature) < threshold ? 0 : 1);
+            }
+            return nodes[node].child & ~LEAF_FLAG;
+        }
+        
+        /**
+         * Initializes the lookup table from 8 bit probabilities to log 
+         * probabilities
+         */
+        void computeLogTable();
+        
+        /**
+         * The number of classes
+         */
+        int numClasses;
+        /**
+         * The root node index of every tree
+         */
+        std::vector<uint32_t> roots;
+        /**
+         * The nodes of all trees
+         */
+        std::vector<Node> nodes;
+        /**
+         * The quantized leaf posteriors (numClasses entries per leaf)
+         */
+        std::vector<uint8_t> leafPosteriors;
+        /**
+         * The lower bound of the value range of every feature
+         */
+        std::vector<float> featureMin;
+        /**
+         * The quantization step of every feature
+         */
+        std::vector<float> featureStep;
+        /**
+         * Maps an 8 bit probability to its logarithm
+         */
+        float logTable[256];
+    };
+
+    /**
+     * This is a random forest of axis aligned decision trees in a flat binary
+     * format that is evaluated in place. The file can be memory mapped read
+     * only, hence loading does not copy the model and processes that map the
+     * same file share its pages.
+     *
+     * The file consists of a header followed by four sections, each starting
+     * at a multiple of ALIGNMENT bytes: the root node of every tree, the
+     * nodes of all trees, the leaf log posteriors (numClasses floats per
+     * leaf) and the bounds for the early exit evaluation. All values are
+     * stored in the byte order of the machine that wrote the file. The
+     * header carries an FNV-1a checksum of the whole file.
+     */
+    class MappedRandomForest : public AbstractClassifier {
+    public:
+        typedef std::shared_ptr<MappedRandomForest> ptr;
+
+        /**
+         * The version of the file format
+         */
+        static const uint32_t VERSION = 1;
+
+        /**
+         * The alignment of the sections in bytes
+         */
+        static const uint32_t ALIGNMENT = 64;
+
+        /**
+         * Marks the child field of a node as a leaf index
+         */
+        static const uint32_t LEAF_FLAG = 0x80000000u;
+
+        /**
+         * The file header
+         */
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t headerSize;
+            /**
+             * 0x01020304 in the byte order of the writer
+             */
+            uint32_t byteOrder;
+            uint32_t alignment;
+            uint32_t numTrees;
+            uint32_t numClasses;
+            uint32_t numNodes;
+            uint32_t numLeaves;
+            uint32_t reserved;
+            /**
+             * The byte offsets of the sections
+             */
+            uint64_t rootsOffset;
+            uint64_t nodesOffset;
+            uint64_t leavesOffset;
+            uint64_t marginsOffset;
+            uint64_t fileSize;
+            /**
+             * The checksum of the file with this field set to 0
+             */
+            uint64_t checksum;
+        };
+
+        /**
+         * A single node. For split nodes, child is the index of the left child
+         * and the right child is located at child + 1. Children are always
+         * stored after their parent. For leaf nodes, child is the index of the
+         * leaf posterior ored with LEAF_FLAG.
+         */
+        struct Node {
+            uint32_t feature;
+            float threshold;
+            uint32_t child;
+        };
+
+        MappedRandomForest();
+
+        virtual ~MappedRandomForest();
+
+        /**
+         * Converts a trained random forest. The result yields the same log
+         * posteriors as the forest.
+         *
+         * @param forest The trained forest
+         */
+        void build(const RandomForest<DecisionTree> & forest);
+
+        /**
+         * Maps a file read only. Throws an IOException if the file cannot be
+         * mapped or is not a valid model.
+         *
+         * @param filename The file to map
+         * @param verify If true, the checksum and the node indices are
+         * validated. This reads the whole file. Only skip it for files that
+         * are known to be intact.
+         */
+        void map(const std::string & filename, bool verify = true);
+
+        /**
+         * Returns true if the model is a mapped file
+         */
+        bool isMapped() const
+        {
+            return mapping != 0;
+        }
+
+        /**
+         * Returns the class log posterior log(p(c | x)). The probabilities are
+         * not normalized.
+         */
+        virtual void classLogPosterior(const DataPoint & x, std::vector<float> & probabilities) const;
+
+        /**
+         * Assigns an integer class label to some data point. Uses the early
+         * exit evaluation if it is enabled.
+         */
+        virtual int classify(const DataPoint & x) const
+        {
+            if (earlyExit)
+            {
+                return classifyEarlyExit(x);
+            }
+            return AbstractClassifier::classify(x);
+        }
+        using AbstractClassifier::classify;
+
+        /**
+         * Enables the early exit evaluation (see RandomForest::enableEarlyExit).
+         * The bounds are stored in the file.
+         *
+         * @param margin The confidence margin in accumulated log posterior
+         */
+        void enableEarlyExit(float margin = 0)
+        {
+            earlyExit = true;
+            earlyExitMargin = margin;
+        }
+
+        /**
+         * Disables the early exit evaluation
+         */
+        void disableEarlyExit()
+        {
+            earlyExit = false;
+        }
+
+        /**
+         * Classifies a data point by evaluating as few trees as possible (see
+         * RandomForest::classifyEarlyExit).
+         *
+         * @param x The data point to classify
+         * @param numTrees If not null, the number of evaluated trees is stored here
+         * @return The class label
+         */
+        int classifyEarlyExit(const DataPoint & x, int* numTrees = 0) const;
+
+        /**
+         * Returns the number of trees
+         */
+        int getSize() const
+        {
+            return header != 0 ? static_cast<int>(header->numTrees) : 0;
+        }
+
+        /**
+         * Returns the number of classes
+         */
+        int getNumClasses() const
+        {
+            return header != 0 ? static_cast<int>(header->numClasses) : 0;
+        }
+
+        /**
+         * Returns the total number of nodes
+         */
+        int getNumNodes() const
+        {
+            return header != 0 ? static_cast<int>(header->numNodes) : 0;
+        }
+
+        /**
+         * Returns the number of bytes of the model file
+         */
+        size_t getMemorySize() const
+        {
+            return size;
+        }
+
+        /**
+         * Reads the model from a stream into memory and validates it. Throws
+         * an IOException if the model is not valid.
+         *
+         * @param stream The stream to read the forest from
+         */
+        virtual void read(std::istream & stream);
+
+        /**
+         * Writes the model file to a stream
+         *
+         * @param stream The stream to write the forest to.
+         */
+        virtual void write(std::ostream & stream) const;
+
+        /**
+         * Computes the checksum of a model file. The checksum field of the
+         * header counts as 0.
+         */
+        static uint64_t computeChecksum(const char* data, size_t size);
+
+    private:
+        /**
+         * The model cannot be copied as it may own a mapping
+         */
+        MappedRandomForest(const MappedRandomForest & other) = delete;
+        MappedRandomForest & operator=(const MappedRandomForest & other) = delete;
+
+        /**
+         * Validates the model file in memory and sets up the section pointers
+         */
+        void attach(const char* data, size_t size, bool verify);
+
+        /**
+         * Releases the mapping or the buffer
+         */
+        void release();
+
+        /**
+         * Returns the leaf posterior of the given tree the data point falls
+         * into
+         */
+        const float* findLeaf(int tree, const DataPoint & x) const
+        {
+            uint32_t node = roots[tree];
+            while (!(nodes[node].child & LEAF_FLAG))
+            {
+                const Node & n = nodes[node];
+                node = n.child + (x(n.feature) < n.threshold ? 0 : 1);
+            }
+            return leaves + (nodes[node].child & ~LEAF_FLAG)*header->numClasses;
+        }
+
+        /**
+         * The model file in memory
+         */
+        const char* data;
+        /**
+         * The size of the model file
+         */
+        size_t size;
+        /**
+         * The mapped memory or 0 if the model is not mapped
+         */
+        void* mapping;
+        /**
+         * The memory of models that are not mapped
+         */
+        std::vector<uint64_t> buffer;
+        /**
+         * The sections
+         */
+        const Header* header;
+        const uint32_t* roots;
+        const Node* nodes;
+        const float* leaves;
+        /**
+         * margins[t] bounds the change the trees t, t+1, ... can cause
+         */
+        const float* margins;
+        /**
+         * Whether classify uses the early exit evaluation
+         */
+        bool earlyExit;
+        /**
+         * The confidence margin for the early exit evaluation
+         */
+        float earlyExitMargin;
+    };
+
     /**
      * This is a specialization for online random forests. It will be removed
      * once the learning process is refactored. 
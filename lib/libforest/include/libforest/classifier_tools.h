@@ -61,6 +61,50 @@ namespace libf {
         void measureAndPrint(AbstractClassifier::ptr classifier, AbstractDataStorage::ptr storage) const;
     };
     
+    /**
+     * Compares a forest to its quantized counterpart on a validation set.
+     */
+    class QuantizationTool {
+    public:
+        /**
+         * The result of the comparison
+         */
+        struct Result {
+            /**
+             * The accuracy of the original forest
+             */
+            float accuracy;
+            /**
+             * The accuracy of the quantized forest
+             */
+            float quantizedAccuracy;
+            /**
+             * The fraction of points on which both forests agree
+             */
+            float agreement;
+            /**
+             * The model sizes in bytes
+             */
+            size_t size;
+            size_t quantizedSize;
+        };
+        
+        /**
+         * Measures the accuracies and the agreement
+         */
+        void measure(const RandomForest<DecisionTree> & forest, const QuantizedRandomForest & quantized, AbstractDataStorage::ptr storage, Result & result) const;
+        
+        /**
+         * Prints the accuracy delta
+         */
+        void print(const Result & result) const;
+        
+        /**
+         * Prints and measures the accuracy delta. 
+         */
+        void measureAndPrint(const RandomForest<DecisionTree> & forest, const QuantizedRandomForest & quantized, AbstractDataStorage::ptr storage) const;
+    };
+    
     /**
      * Measures the correlation between the the trees of an ensemble by using
      * the hamming distance on their results. 
@@ -6,6 +6,14 @@
 #include <iostream>
 #include <string>
 #include <cmath>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace libf;
 
@@ -33,3 +41,732 @@ int AbstractClassifier::classify(const DataPoint & x) const
     
     return Util::argMax(posterior);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+/// QuantizedRandomForest
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Writes a vector of POD values to a stream in one block
+ */
+template <class T>
+inline void writeBlock(std::ostream & stream, const std::vector<T> & v)
+{
+    writeBinary(stream, static_cast<int>(v.size()));
+    if (v.size() > 0)
+    {
+        stream.write(reinterpret_cast<const char*>(v.data()), sizeof(T)*v.size());
+    }
+}
+
+/**
+ * Reads a vector of POD values from a stream in one block. Returns false if 
+ * the size is invalid or the stream ends early.
+ */
+template <class T>
+inline bool readBlock(std::istream & stream, std::vector<T> & v)
+{
+    int N;
+    readBinary(stream, N);
+    if (!stream || N < 0)
+    {
+        return false;
+    }
+    
+    // Do not trust the size before allocating if we know the remaining size
+    const std::streampos position = stream.tellg();
+    if (position != std::streampos(-1))
+    {
+        stream.seekg(0, std::ios::end);
+        const std::streamoff remaining = stream.tellg() - position;
+        stream.seekg(position);
+        if (static_cast<uint64_t>(N)*sizeof(T) > static_cast<uint64_t>(remaining))
+        {
+            return false;
+        }
+    }
+    
+    v.resize(N);
+    if (N > 0)
+    {
+        stream.read(reinterpret_cast<char*>(v.data()), sizeof(T)*N);
+    }
+    return static_cast<bool>(stream);
+}
+
+void QuantizedRandomForest::quantize(const RandomForest<DecisionTree> & forest, AbstractDataStorage::ptr storage)
+{
+    BOOST_ASSERT_MSG(storage->getSize() > 0, "Cannot determine the feature range from an empty data set.");
+    
+    const int D = storage->getDimensionality();
+    std::vector<float> minValues(D, std::numeric_limits<float>::max());
+    std::vector<float> maxValues(D, -std::numeric_limits<float>::max());
+    
+    for (int n = 0; n < storage->getSize(); n++)
+    {
+        const DataPoint & x = storage->getDataPoint(n);
+        for (int d = 0; d < D; d++)
+        {
+            minValues[d] = std::min(minValues[d], x(d));
+            maxValues[d] = std::max(maxValues[d], x(d));
+        }
+    }
+    
+    quantize(forest, minValues, maxValues);
+}
+
+void QuantizedRandomForest::quantize(const RandomForest<DecisionTree> & forest, const std::vector<float> & minValues, const std::vector<float> & maxValues)
+{
+    BOOST_ASSERT_MSG(forest.getSize() > 0, "Cannot quantize an empty ensemble.");
+    BOOST_ASSERT_MSG(minValues.size() == maxValues.size(), "Invalid feature range.");
+    BOOST_ASSERT_MSG(minValues.size() <= 0xFFFF, "Too many features for 16 bit feature indices.");
+    
+    // Set up the feature ranges
+    const int D = static_cast<int>(minValues.size());
+    featureMin.resize(D);
+    featureStep.resize(D);
+    for (int d = 0; d < D; d++)
+    {
+        featureMin[d] = minValues[d];
+        featureStep[d] = std::max(0.0f, maxValues[d] - minValues[d])/65535.0f;
+        
+        // A constant feature still needs a step such that a threshold above
+        // its value dequantizes above it and keeps the split direction
+        if (featureStep[d] <= 0)
+        {
+            featureStep[d] = std::max(std::abs(minValues[d]), std::numeric_limits<float>::min())*std::numeric_limits<float>::epsilon();
+        }
+    }
+    
+    roots.clear();
+    nodes.clear();
+    leafPosteriors.clear();
+    numClasses = 0;
+    
+    for (int t = 0; t < forest.getSize(); t++)
+    {
+        DecisionTree::ptr tree = forest.getTree(t);
+        
+        // The trees already store the right child next to the left child, so
+        // we can keep their layout and only shift the indices
+        const uint32_t offset = static_cast<uint32_t>(nodes.size());
+        roots.push_back(offset);
+        
+        for (int node = 0; node < tree->getNumNodes(); node++)
+        {
+            const AxisAlignedSplitTreeNodeConfig & config = tree->getNodeConfig(node);
+            Node n;
+            
+            if (config.isLeafNode())
+            {
+                const std::vector<float> & hist = tree->getNodeData(node).histogram;
+                
+                if (numClasses == 0)
+                {
+                    numClasses = static_cast<int>(hist.size());
+                }
+                BOOST_ASSERT_MSG(static_cast<int>(hist.size()) == numClasses, "Inconsistent number of classes.");
+                
+                // The histograms hold log probabilities
+                const float maxValue = *std::max_element(hist.begin(), hist.end());
+                float sum = 0;
+                for (size_t c = 0; c < hist.size(); c++)
+                {
+                    sum += std::exp(hist[c] - maxValue);
+                }
+                
+                n.feature = 0;
+                n.threshold = 0;
+                n.child = static_cast<uint32_t>(leafPosteriors.size()/numClasses) | LEAF_FLAG;
+                
+                for (size_t c = 0; c < hist.size(); c++)
+                {
+                    const float p = std::exp(hist[c] - maxValue)/sum;
+                    leafPosteriors.push_back(static_cast<uint8_t>(std::round(p*255)));
+                }
+            }
+            else
+            {
+                const int feature = config.getSplitFeature();
+                BOOST_ASSERT_MSG(feature < D, "The feature range does not cover all split features.");
+                
+                // Round down such that the dequantized threshold never 
+                // exceeds the original one. Only values within one step below
+                // the threshold can change sides.
+                float q = 0;
+                if (featureStep[feature] > 0)
+                {
+                    q = std::floor((config.getThreshold() - featureMin[feature])/featureStep[feature]);
+                }
+                
+                n.feature = static_cast<uint16_t>(feature);
+                n.threshold = static_cast<uint16_t>(std::min(65535.0f, std::max(0.0f, q)));
+                n.child = offset + static_cast<uint32_t>(config.getLeftChild());
+            }
+            
+            nodes.push_back(n);
+        }
+    }
+    
+    computeLogTable();
+}
+
+void QuantizedRandomForest::computeLogTable()
+{
+    // Empty bins get half a quantization step in order to avoid -inf
+    logTable[0] = std::log(0.5f/255.0f);
+    for (int q = 1; q < 256; q++)
+    {
+        logTable[q] = std::log(q/255.0f);
+    }
+}
+
+void QuantizedRandomForest::classLogPosterior(const DataPoint & x, std::vector<float> & probabilities) const
+{
+    BOOST_ASSERT_MSG(getSize() > 0, "Cannot classify a point from an empty ensemble.");
+    
+    probabilities.assign(numClasses, 0);
+    
+    for (int t = 0; t < getSize(); t++)
+    {
+        const uint8_t* posterior = &leafPosteriors[findLeaf(t, x)*numClasses];
+        for (int c = 0; c < numClasses; c++)
+        {
+            probabilities[c] += logTable[posterior[c]];
+        }
+    }
+}
+
+size_t QuantizedRandomForest::getMemorySize() const
+{
+    return  roots.size()*sizeof(uint32_t) + 
+            nodes.size()*sizeof(Node) + 
+            leafPosteriors.size()*sizeof(uint8_t) + 
+            (featureMin.size() + featureStep.size())*sizeof(float);
+}
+
+void QuantizedRandomForest::read(std::istream & stream)
+{
+    char magic[4];
+    uint32_t version = 0;
+    stream.read(magic, sizeof(magic));
+    readBinary(stream, version);
+    if (!stream || std::memcmp(magic, "LFQF", 4) != 0)
+    {
+        throw IOException("Not a quantized model file.");
+    }
+    if (version != VERSION)
+    {
+        throw IOException("Unsupported model file version.");
+    }
+    
+    // Read everything before replacing the current model
+    int _numClasses;
+    std::vector<uint32_t> _roots;
+    std::vector<Node> _nodes;
+    std::vector<uint8_t> _leafPosteriors;
+    std::vector<float> _featureMin, _featureStep;
+    readBinary(stream, _numClasses);
+    if (!stream || 
+        !readBlock(stream, _roots) || 
+        !readBlock(stream, _nodes) || 
+        !readBlock(stream, _leafPosteriors) || 
+        !readBlock(stream, _featureMin) || 
+        !readBlock(stream, _featureStep))
+    {
+        throw IOException("The model file is truncated.");
+    }
+    
+    if (_numClasses <= 0 || _leafPosteriors.size() % _numClasses != 0 || _featureMin.size() != _featureStep.size())
+    {
+        throw IOException("Corrupted model file.");
+    }
+    
+    // Every child must come after its parent such that findLeaf terminates
+    const uint32_t numNodes = static_cast<uint32_t>(_nodes.size());
+    const uint32_t numLeaves = static_cast<uint32_t>(_leafPosteriors.size()/_numClasses);
+    for (size_t t = 0; t < _roots.size(); t++)
+    {
+        if (_roots[t] >= numNodes)
+        {
+            throw IOException("Corrupted model file.");
+        }
+    }
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        const Node & n = _nodes[node];
+        if (n.child & LEAF_FLAG)
+        {
+            if ((n.child & ~LEAF_FLAG) >= numLeaves)
+            {
+                throw IOException("Corrupted model file.");
+            }
+        }
+        else if (n.feature >= _featureMin.size() || n.child <= node || n.child >= numNodes - 1)
+        {
+            throw IOException("Corrupted model file.");
+        }
+    }
+    
+    numClasses = _numClasses;
+    roots.swap(_roots);
+    nodes.swap(_nodes);
+    leafPosteriors.swap(_leafPosteriors);
+    featureMin.swap(_featureMin);
+    featureStep.swap(_featureStep);
+    
+    computeLogTable();
+}
+
+void QuantizedRandomForest::write(std::ostream & stream) const
+{
+    const uint32_t version = VERSION;
+    stream.write("LFQF", 4);
+    writeBinary(stream, version);
+    writeBinary(stream, numClasses);
+    writeBlock(stream, roots);
+    writeBlock(stream, nodes);
+    writeBlock(stream, leafPosteriors);
+    writeBlock(stream, featureMin);
+    writeBlock(stream, featureStep);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// MappedRandomForest
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Rounds an offset up to the next multiple of the alignment
+ */
+inline uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1)/alignment*alignment;
+}
+
+/**
+ * Returns true if a section of count elements lies within the file and is
+ * aligned
+ */
+inline bool isValidSection(const MappedRandomForest::Header & header, uint64_t offset, uint64_t count, uint64_t elementSize)
+{
+    return  offset % header.alignment == 0 &&
+            offset >= header.headerSize &&
+            offset <= header.fileSize &&
+            count*elementSize <= header.fileSize - offset;
+}
+
+/**
+ * Returns the size of a file whose sections follow each other as written by
+ * build, i.e. the largest file size the counts of the header allow. Returns
+ * 0 for an invalid alignment or counts.
+ */
+inline uint64_t calcLayoutSize(const MappedRandomForest::Header & header)
+{
+    const uint64_t numLeafValues = static_cast<uint64_t>(header.numLeaves)*header.numClasses;
+    if (header.alignment < sizeof(uint32_t) || header.alignment % sizeof(uint32_t) != 0 || 
+            header.numNodes >= MappedRandomForest::LEAF_FLAG || header.numLeaves >= MappedRandomForest::LEAF_FLAG ||
+            numLeafValues > std::numeric_limits<uint64_t>::max()/(2*sizeof(float)))
+    {
+        return 0;
+    }
+    
+    uint64_t size = alignOffset(sizeof(MappedRandomForest::Header), header.alignment) + sizeof(uint32_t)*static_cast<uint64_t>(header.numTrees);
+    size = alignOffset(size, header.alignment) + sizeof(MappedRandomForest::Node)*static_cast<uint64_t>(header.numNodes);
+    size = alignOffset(size, header.alignment) + sizeof(float)*numLeafValues;
+    size = alignOffset(size, header.alignment) + sizeof(float)*(static_cast<uint64_t>(header.numTrees) + 1);
+    return size;
+}
+
+/**
+ * Continues an FNV-1a hash over a range of bytes
+ */
+inline uint64_t hashBytes(uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+MappedRandomForest::MappedRandomForest() : 
+        data(0), 
+        size(0), 
+        mapping(0), 
+        header(0), 
+        roots(0), 
+        nodes(0), 
+        leaves(0), 
+        margins(0), 
+        earlyExit(false), 
+        earlyExitMargin(0) {}
+
+MappedRandomForest::~MappedRandomForest()
+{
+    release();
+}
+
+void MappedRandomForest::release()
+{
+    if (mapping != 0)
+    {
+        munmap(mapping, size);
+        mapping = 0;
+    }
+    buffer.clear();
+    
+    data = 0;
+    size = 0;
+    header = 0;
+    roots = 0;
+    nodes = 0;
+    leaves = 0;
+    margins = 0;
+}
+
+uint64_t MappedRandomForest::computeChecksum(const char* data, size_t size)
+{
+    const size_t checksumOffset = offsetof(Header, checksum);
+    const char zeros[sizeof(uint64_t)] = {0};
+    
+    uint64_t hash = 14695981039346656037ull;
+    if (size < checksumOffset + sizeof(uint64_t))
+    {
+        return hashBytes(hash, data, size);
+    }
+    hash = hashBytes(hash, data, checksumOffset);
+    hash = hashBytes(hash, zeros, sizeof(zeros));
+    return hashBytes(hash, data + checksumOffset + sizeof(uint64_t), size - checksumOffset - sizeof(uint64_t));
+}
+
+void MappedRandomForest::build(const RandomForest<DecisionTree> & forest)
+{
+    BOOST_ASSERT_MSG(forest.getSize() > 0, "Cannot convert an empty ensemble.");
+    
+    // Determine the section sizes
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "LFMF", 4);
+    h.version = VERSION;
+    h.headerSize = sizeof(Header);
+    h.byteOrder = 0x01020304u;
+    h.alignment = ALIGNMENT;
+    h.numTrees = static_cast<uint32_t>(forest.getSize());
+    
+    for (int t = 0; t < forest.getSize(); t++)
+    {
+        DecisionTree::ptr tree = forest.getTree(t);
+        h.numNodes += static_cast<uint32_t>(tree->getNumNodes());
+        
+        for (int node = 0; node < tree->getNumNodes(); node++)
+        {
+            if (tree->getNodeConfig(node).isLeafNode())
+            {
+                if (h.numClasses == 0)
+                {
+                    h.numClasses = static_cast<uint32_t>(tree->getNodeData(node).histogram.size());
+                }
+                BOOST_ASSERT_MSG(tree->getNodeData(node).histogram.size() == h.numClasses, "Inconsistent number of classes.");
+                h.numLeaves++;
+            }
+        }
+    }
+    BOOST_ASSERT_MSG(h.numNodes < LEAF_FLAG && h.numLeaves < LEAF_FLAG, "Too many nodes.");
+    
+    h.rootsOffset = alignOffset(sizeof(Header), ALIGNMENT);
+    h.nodesOffset = alignOffset(h.rootsOffset + sizeof(uint32_t)*h.numTrees, ALIGNMENT);
+    h.leavesOffset = alignOffset(h.nodesOffset + sizeof(Node)*h.numNodes, ALIGNMENT);
+    h.marginsOffset = alignOffset(h.leavesOffset + sizeof(float)*h.numLeaves*h.numClasses, ALIGNMENT);
+    h.fileSize = h.marginsOffset + sizeof(float)*(h.numTrees + 1);
+    
+    std::vector<uint64_t> file((h.fileSize + sizeof(uint64_t) - 1)/sizeof(uint64_t), 0);
+    char* out = reinterpret_cast<char*>(file.data());
+    uint32_t* outRoots = reinterpret_cast<uint32_t*>(out + h.rootsOffset);
+    Node* outNodes = reinterpret_cast<Node*>(out + h.nodesOffset);
+    float* outLeaves = reinterpret_cast<float*>(out + h.leavesOffset);
+    float* outMargins = reinterpret_cast<float*>(out + h.marginsOffset);
+    
+    // The trees already store the right child next to the left child and
+    // the children after their parent, so we can keep their layout and only
+    // shift the indices
+    uint32_t numNodes = 0;
+    uint32_t numLeaves = 0;
+    std::vector<float> spreads(h.numTrees, 0);
+    for (int t = 0; t < forest.getSize(); t++)
+    {
+        DecisionTree::ptr tree = forest.getTree(t);
+        const uint32_t offset = numNodes;
+        outRoots[t] = offset;
+        
+        for (int node = 0; node < tree->getNumNodes(); node++)
+        {
+            const AxisAlignedSplitTreeNodeConfig & config = tree->getNodeConfig(node);
+            Node & n = outNodes[offset + node];
+            
+            if (config.isLeafNode())
+            {
+                const std::vector<float> & hist = tree->getNodeData(node).histogram;
+                std::copy(hist.begin(), hist.end(), outLeaves + static_cast<size_t>(numLeaves)*h.numClasses);
+                
+                n.feature = 0;
+                n.threshold = 0;
+                n.child = numLeaves | LEAF_FLAG;
+                numLeaves++;
+                
+                if (hist.size() > 0)
+                {
+                    const float maxValue = *std::max_element(hist.begin(), hist.end());
+                    const float minValue = *std::min_element(hist.begin(), hist.end());
+                    spreads[t] = std::max(spreads[t], maxValue - minValue);
+                }
+            }
+            else
+            {
+                n.feature = static_cast<uint32_t>(config.getSplitFeature());
+                n.threshold = config.getThreshold();
+                n.child = offset + static_cast<uint32_t>(config.getLeftChild());
+            }
+        }
+        numNodes += static_cast<uint32_t>(tree->getNumNodes());
+    }
+    
+    // Compute the early exit bounds
+    outMargins[h.numTrees] = 0;
+    for (int t = static_cast<int>(h.numTrees) - 1; t >= 0; t--)
+    {
+        outMargins[t] = outMargins[t + 1] + spreads[t];
+    }
+    
+    std::memcpy(out, &h, sizeof(h));
+    h.checksum = computeChecksum(out, h.fileSize);
+    std::memcpy(out, &h, sizeof(h));
+    
+    release();
+    buffer.swap(file);
+    attach(reinterpret_cast<const char*>(buffer.data()), h.fileSize, false);
+}
+
+void MappedRandomForest::map(const std::string & filename, bool verify)
+{
+    release();
+    
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw IOException("Could not open file.");
+    }
+    
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        close(fd);
+        throw IOException("The model file is truncated.");
+    }
+    
+    // The mapping stays valid after closing the file
+    void* memory = mmap(0, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        throw IOException("Could not map file.");
+    }
+    
+    mapping = memory;
+    size = static_cast<size_t>(status.st_size);
+    try
+    {
+        attach(static_cast<const char*>(memory), size, verify);
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+void MappedRandomForest::attach(const char* _data, size_t _size, bool verify)
+{
+    data = _data;
+    size = _size;
+    
+    if (size < sizeof(Header))
+    {
+        throw IOException("The model file is truncated.");
+    }
+    const Header* h = reinterpret_cast<const Header*>(data);
+    
+    if (std::memcmp(h->magic, "LFMF", 4) != 0)
+    {
+        throw IOException("Not a model file.");
+    }
+    if (h->version != VERSION || h->headerSize != sizeof(Header))
+    {
+        throw IOException("Unsupported model file version.");
+    }
+    if (h->byteOrder != 0x01020304u)
+    {
+        throw IOException("The model file has a different byte order.");
+    }
+    if (h->fileSize != size)
+    {
+        throw IOException("The model file is truncated.");
+    }
+    if (h->alignment < sizeof(uint32_t) || h->alignment % sizeof(uint32_t) != 0 || 
+            h->numTrees == 0 || h->numClasses == 0 || h->numNodes >= LEAF_FLAG || h->numLeaves >= LEAF_FLAG ||
+            !isValidSection(*h, h->rootsOffset, h->numTrees, sizeof(uint32_t)) ||
+            !isValidSection(*h, h->nodesOffset, h->numNodes, sizeof(Node)) ||
+            !isValidSection(*h, h->leavesOffset, static_cast<uint64_t>(h->numLeaves)*h->numClasses, sizeof(float)) ||
+            !isValidSection(*h, h->marginsOffset, static_cast<uint64_t>(h->numTrees) + 1, sizeof(float)))
+    {
+        throw IOException("Corrupted model file.");
+    }
+    
+    const uint32_t* _roots = reinterpret_cast<const uint32_t*>(data + h->rootsOffset);
+    const Node* _nodes = reinterpret_cast<const Node*>(data + h->nodesOffset);
+    
+    if (verify)
+    {
+        if (computeChecksum(data, size) != h->checksum)
+        {
+            throw IOException("The model file checksum does not match.");
+        }
+        
+        // Every traversal has to end in a valid leaf
+        for (uint32_t t = 0; t < h->numTrees; t++)
+        {
+            if (_roots[t] >= h->numNodes)
+            {
+                throw IOException("Corrupted model file.");
+            }
+        }
+        for (uint32_t node = 0; node < h->numNodes; node++)
+        {
+            const uint32_t child = _nodes[node].child;
+            const bool valid = (child & LEAF_FLAG) ? 
+                    (child & ~LEAF_FLAG) < h->numLeaves : 
+                    (child > node && child + 1 < h->numNodes);
+            if (!valid)
+            {
+                throw IOException("Corrupted model file.");
+            }
+        }
+    }
+    
+    header = h;
+    roots = _roots;
+    nodes = _nodes;
+    leaves = reinterpret_cast<const float*>(data + h->leavesOffset);
+    margins = reinterpret_cast<const float*>(data + h->marginsOffset);
+}
+
+void MappedRandomForest::classLogPosterior(const DataPoint & x, std::vector<float> & probabilities) const
+{
+    BOOST_ASSERT_MSG(getSize() > 0, "Cannot classify a point from an empty ensemble.");
+    
+    const int C = getNumClasses();
+    probabilities.assign(C, 0);
+    
+    for (int t = 0; t < getSize(); t++)
+    {
+        const float* posterior = findLeaf(t, x);
+        for (int c = 0; c < C; c++)
+        {
+            probabilities[c] += posterior[c];
+        }
+    }
+}
+
+int MappedRandomForest::classifyEarlyExit(const DataPoint & x, int* numTrees) const
+{
+    BOOST_ASSERT_MSG(getSize() > 0, "Cannot classify a point from an empty ensemble.");
+    
+    const int C = getNumClasses();
+    const float* posterior = findLeaf(0, x);
+    std::vector<float> probabilities(posterior, posterior + C);
+    
+    int t = 1;
+    for (; t < getSize(); t++)
+    {
+        // Find the leading class and the runner up
+        float best = -std::numeric_limits<float>::infinity();
+        float second = -std::numeric_limits<float>::infinity();
+        for (int c = 0; c < C; c++)
+        {
+            if (probabilities[c] > best)
+            {
+                second = best;
+                best = probabilities[c];
+            }
+            else if (probabilities[c] > second)
+            {
+                second = probabilities[c];
+            }
+        }
+        
+        const float lead = best - second;
+        if (lead > margins[t] || (earlyExitMargin > 0 && lead >= earlyExitMargin))
+        {
+            break;
+        }
+        
+        posterior = findLeaf(t, x);
+        for (int c = 0; c < C; c++)
+        {
+            probabilities[c] += posterior[c];
+        }
+    }
+    
+    if (numTrees != 0)
+    {
+        *numTrees = t;
+    }
+    
+    return static_cast<int>(Util::argMax(probabilities));
+}
+
+void MappedRandomForest::read(std::istream & stream)
+{
+    release();
+    
+    Header h;
+    stream.read(reinterpret_cast<char*>(&h), sizeof(h));
+    if (stream.gcount() != static_cast<std::streamsize>(sizeof(h)))
+    {
+        throw IOException("The model file is truncated.");
+    }
+    if (std::memcmp(h.magic, "LFMF", 4) != 0 || h.byteOrder != 0x01020304u || h.fileSize < sizeof(h))
+    {
+        throw IOException("Not a model file.");
+    }
+    // The size is checked against the counts before allocating the file
+    if (h.fileSize > calcLayoutSize(h))
+    {
+        throw IOException("Corrupted model file.");
+    }
+    
+    std::vector<uint64_t> file((h.fileSize + sizeof(uint64_t) - 1)/sizeof(uint64_t));
+    char* out = reinterpret_cast<char*>(file.data());
+    std::memcpy(out, &h, sizeof(h));
+    stream.read(out + sizeof(h), h.fileSize - sizeof(h));
+    if (stream.gcount() != static_cast<std::streamsize>(h.fileSize - sizeof(h)))
+    {
+        throw IOException("The model file is truncated.");
+    }
+    
+    buffer.swap(file);
+    try
+    {
+        attach(reinterpret_cast<const char*>(buffer.data()), h.fileSize, true);
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+void MappedRandomForest::write(std::ostream & stream) const
+{
+    stream.write(data, size);
+}
@@ -194,6 +194,69 @@ void ConfusionMatrixTool::measureAndPrint(AbstractClassifier::ptr classifier, Ab
     print(result);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// QuantizationTool
+////////////////////////////////////////////////////////////////////////////////
+
+void QuantizationTool::measure(const RandomForest<DecisionTree> & forest, const QuantizedRandomForest & quantized, AbstractDataStorage::ptr storage, Result & result) const
+{
+    int correct = 0;
+    int quantizedCorrect = 0;
+    int agree = 0;
+    
+    for (int i = 0; i < storage->getSize(); i++)
+    {
+        const int label = forest.classify(storage->getDataPoint(i));
+        const int quantizedLabel = quantized.classify(storage->getDataPoint(i));
+        
+        if (label == storage->getClassLabel(i))
+        {
+            correct++;
+        }
+        if (quantizedLabel == storage->getClassLabel(i))
+        {
+            quantizedCorrect++;
+        }
+        if (label == quantizedLabel)
+        {
+            agree++;
+        }
+    }
+    
+    const float N = static_cast<float>(std::max(1, storage->getSize()));
+    result.accuracy = correct/N;
+    result.quantizedAccuracy = quantizedCorrect/N;
+    result.agreement = agree/N;
+    
+    // Estimate the size of the original model
+    result.size = 0;
+    for (int t = 0; t < forest.getSize(); t++)
+    {
+        DecisionTree::ptr tree = forest.getTree(t);
+        for (int node = 0; node < tree->getNumNodes(); node++)
+        {
+            result.size += sizeof(AxisAlignedSplitTreeNodeConfig) + sizeof(TreeClassifierNodeData);
+            result.size += tree->getNodeData(node).histogram.size()*sizeof(float);
+        }
+    }
+    result.quantizedSize = quantized.getMemorySize();
+}
+
+void QuantizationTool::print(const Result & result) const
+{
+    printf("Accuracy:           %2.2f%%\n", result.accuracy*100);
+    printf("Quantized accuracy: %2.2f%% (Delta: %+2.2f%%)\n", result.quantizedAccuracy*100, (result.quantizedAccuracy - result.accuracy)*100);
+    printf("Agreement:          %2.2f%%\n", result.agreement*100);
+    printf("Model size:         %zu bytes -> %zu bytes\n", result.size, result.quantizedSize);
+}
+
+void QuantizationTool::measureAndPrint(const RandomForest<DecisionTree> & forest, const QuantizedRandomForest & quantized, AbstractDataStorage::ptr storage) const
+{
+    Result result;
+    measure(forest, quantized, storage, result);
+    print(result);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// CorrelationTool
 ////////////////////////////////////////////////////////////////////////////////
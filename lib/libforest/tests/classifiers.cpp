@@ -0,0 +1,402 @@
+
+#include <random>
+#include <cmath>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstddef>
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "libforest/classifier.h"
+
+using namespace libf;
+
+/**
+ * Creates a forest of stumps. Every stump splits at feature 0 and threshold 0
+ * and its leaves carry the given log posteriors.
+ */
+static void createStumpForest(int numTrees, float p, RandomForest<DecisionTree> & forest)
+{
+    std::mt19937 g(42);
+    std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+
+    for (int t = 0; t < numTrees; t++)
+    {
+        DecisionTree::ptr tree = std::make_shared<DecisionTree>();
+        tree->addNode();
+        tree->splitNode(0);
+        tree->getNodeConfig(0).setSplitFeature(0);
+        tree->getNodeConfig(0).setThreshold(0);
+
+        // Most trees vote class 1 on the left and class 0 on the right
+        const float q = p + jitter(g);
+        const bool flip = (t % 4 == 3);
+        tree->getNodeData(1).histogram = {std::log(flip ? q : 1 - q), std::log(flip ? 1 - q : q)};
+        tree->getNodeData(2).histogram = {std::log(flip ? 1 - q : q), std::log(flip ? q : 1 - q)};
+
+        forest.addTree(tree);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Unit tests for the class "RandomForest"
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Tests if the early exit evaluation without confidence margin yields the same
+ * decision as the full evaluation.
+ */
+TEST(RandomForest, classifyEarlyExit_sameDecision)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(96, 0.8f, forest);
+
+    std::vector<int> fullResults;
+    DataPoint x(1);
+    for (int i = -5; i <= 5; i++)
+    {
+        x(0) = static_cast<float>(i);
+        fullResults.push_back(forest.classify(x));
+    }
+
+    forest.enableEarlyExit();
+    for (int i = -5; i <= 5; i++)
+    {
+        x(0) = static_cast<float>(i);
+        ASSERT_EQ(fullResults[i + 5], forest.classify(x));
+    }
+}
+
+/**
+ * Tests if the early exit evaluation actually skips trees.
+ */
+TEST(RandomForest, classifyEarlyExit_numTrees)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(96, 0.8f, forest);
+
+    forest.enableEarlyExit();
+
+    DataPoint x(1);
+    x(0) = -1;
+    int numTrees = 0;
+    forest.classifyEarlyExit(x, &numTrees);
+
+    ASSERT_GT(numTrees, 0);
+    ASSERT_LT(numTrees, 96);
+}
+
+/**
+ * Tests if a confidence margin reduces the number of evaluated trees.
+ */
+TEST(RandomForest, classifyEarlyExit_margin)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(96, 0.8f, forest);
+
+    DataPoint x(1);
+    x(0) = -1;
+
+    int exactTrees = 0;
+    forest.enableEarlyExit();
+    forest.classifyEarlyExit(x, &exactTrees);
+
+    int marginTrees = 0;
+    forest.enableEarlyExit(5.0f);
+    const int label = forest.classifyEarlyExit(x, &marginTrees);
+
+    ASSERT_EQ(label, 1);
+    ASSERT_LT(marginTrees, exactTrees);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Unit tests for the class "QuantizedRandomForest"
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Tests if the quantized forest yields the same decisions as the original 
+ * forest.
+ */
+TEST(QuantizedRandomForest, classify_sameDecision)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(16, 0.8f, forest);
+
+    QuantizedRandomForest quantized;
+    quantized.quantize(forest, std::vector<float>({-255}), std::vector<float>({255}));
+
+    ASSERT_EQ(quantized.getSize(), 16);
+    ASSERT_EQ(quantized.getNumClasses(), 2);
+
+    DataPoint x(1);
+    for (int i = -5; i <= 5; i++)
+    {
+        x(0) = static_cast<float>(i);
+        ASSERT_EQ(forest.classify(x), quantized.classify(x));
+    }
+}
+
+/**
+ * Tests if a feature without range keeps the split direction of its value.
+ */
+TEST(QuantizedRandomForest, classify_constantFeature)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(16, 0.8f, forest);
+
+    const float values[] = {-1000, -1, 0, 1, 1000};
+    for (size_t i = 0; i < sizeof(values)/sizeof(float); i++)
+    {
+        QuantizedRandomForest quantized;
+        quantized.quantize(forest, std::vector<float>({values[i]}), std::vector<float>({values[i]}));
+
+        DataPoint x(1);
+        x(0) = values[i];
+        ASSERT_EQ(forest.classify(x), quantized.classify(x));
+    }
+}
+
+/**
+ * Tests if the quantized forest can be written and read again.
+ */
+TEST(QuantizedRandomForest, readWrite)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(16, 0.8f, forest);
+
+    QuantizedRandomForest quantized;
+    quantized.quantize(forest, std::vector<float>({-255}), std::vector<float>({255}));
+
+    std::stringstream stream;
+    quantized.write(stream);
+
+    QuantizedRandomForest loaded;
+    loaded.read(stream);
+
+    ASSERT_EQ(loaded.getNumNodes(), quantized.getNumNodes());
+    ASSERT_EQ(loaded.getMemorySize(), quantized.getMemorySize());
+
+    DataPoint x(1);
+    x(0) = -1;
+    std::vector<float> p1, p2;
+    quantized.classLogPosterior(x, p1);
+    loaded.classLogPosterior(x, p2);
+    for (size_t c = 0; c < p1.size(); c++)
+    {
+        ASSERT_FLOAT_EQ(p1[c], p2[c]);
+    }
+}
+
+/**
+ * Tests if invalid files are rejected and leave the forest unchanged.
+ */
+TEST(QuantizedRandomForest, readInvalid)
+{
+    RandomForest<DecisionTree> forest;
+    createStumpForest(4, 0.8f, forest);
+
+    QuantizedRandomForest quantized;
+    quantized.quantize(forest, std::vector<float>({-255}), std::vector<float>({255}));
+
+    std::stringstream stream;
+    quantized.write(stream);
+    const std::string valid = stream.str();
+
+    // Not a quantized forest
+    std::string invalid = valid;
+    invalid[0] = 'X';
+    QuantizedRandomForest loaded;
+    std::stringstream magic(invalid);
+    ASSERT_THROW(loaded.read(magic), IOException);
+    ASSERT_EQ(loaded.getSize(), 0);
+
+    // Truncated
+    std::stringstream truncated(valid.substr(0, valid.size() - 2));
+    ASSERT_THROW(loaded.read(truncated), IOException);
+
+    // The root of the first tree is a split node whose children are out of 
+    // range. The nodes follow the magic, the version, the number of classes,
+    // the roots and the number of nodes.
+    const size_t nodeOffset = 4 + sizeof(uint32_t) + sizeof(int) + sizeof(int) + 4*sizeof(uint32_t) + sizeof(int);
+    invalid = valid;
+    const uint32_t child = 1000;
+    std::copy(reinterpret_cast<const char*>(&child), reinterpret_cast<const char*>(&child) + sizeof(child), 
+              invalid.begin() + nodeOffset + offsetof(QuantizedRandomForest::Node, child));
+    std::stringstream corrupted(invalid);
+    ASSERT_THROW(loaded.read(corrupted), IOException);
+    ASSERT_EQ(loaded.getSize(), 0);
+
+    std::stringstream restored(valid);
+    loaded.read(restored);
+    ASSERT_EQ(loaded.getSize(), 4);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Unit tests for the class "MappedRandomForest"
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Creates a forest of trees with two levels. The root splits at feature 0 and
+ * its left child at feature 1.
+ */
+static void createTwoLevelForest(int numTrees, RandomForest<DecisionTree> & forest)
+{
+    std::mt19937 g(7);
+    std::uniform_real_distribution<float> threshold(-2, 2);
+    std::uniform_real_distribution<float> p(0.05f, 0.95f);
+
+    for (int t = 0; t < numTrees; t++)
+    {
+        DecisionTree::ptr tree = std::make_shared<DecisionTree>();
+        tree->addNode();
+        tree->splitNode(0);
+        tree->getNodeConfig(0).setSplitFeature(0);
+        tree->getNodeConfig(0).setThreshold(threshold(g));
+        tree->splitNode(1);
+        tree->getNodeConfig(1).setSplitFeature(1);
+        tree->getNodeConfig(1).setThreshold(threshold(g));
+
+        for (int leaf = 2; leaf <= 4; leaf++)
+        {
+            const float q = p(g);
+            tree->getNodeData(leaf).histogram = {std::log(q), std::log(1 - q)};
+        }
+
+        forest.addTree(tree);
+    }
+}
+
+/**
+ * Asserts that both classifiers yield the same log posteriors on a grid
+ */
+static void assertSamePosteriors(const AbstractClassifier & a, const AbstractClassifier & b)
+{
+    DataPoint x(2);
+    std::vector<float> p1, p2;
+    for (int i = -6; i <= 6; i++)
+    {
+        for (int j = -6; j <= 6; j++)
+        {
+            x(0) = i/3.0f;
+            x(1) = j/3.0f;
+            a.classLogPosterior(x, p1);
+            b.classLogPosterior(x, p2);
+            ASSERT_EQ(p1.size(), p2.size());
+            for (size_t c = 0; c < p1.size(); c++)
+            {
+                ASSERT_FLOAT_EQ(p1[c], p2[c]);
+            }
+            ASSERT_EQ(a.classify(x), b.classify(x));
+        }
+    }
+}
+
+/**
+ * Tests if the converted forest yields the same posteriors and the same early
+ * exit decisions as the original forest.
+ */
+TEST(MappedRandomForest, build_samePosteriors)
+{
+    RandomForest<DecisionTree> forest;
+    createTwoLevelForest(24, forest);
+
+    MappedRandomForest mapped;
+    mapped.build(forest);
+
+    ASSERT_EQ(mapped.getSize(), 24);
+    ASSERT_EQ(mapped.getNumClasses(), 2);
+    ASSERT_EQ(mapped.getNumNodes(), 24*5);
+    ASSERT_FALSE(mapped.isMapped());
+    assertSamePosteriors(forest, mapped);
+
+    forest.enableEarlyExit();
+    mapped.enableEarlyExit();
+    DataPoint x(2);
+    for (int i = -6; i <= 6; i++)
+    {
+        x(0) = i/3.0f;
+        x(1) = -i/4.0f;
+        int forestTrees = 0;
+        int mappedTrees = 0;
+        ASSERT_EQ(forest.classifyEarlyExit(x, &forestTrees), mapped.classifyEarlyExit(x, &mappedTrees));
+        ASSERT_EQ(forestTrees, mappedTrees);
+    }
+}
+
+/**
+ * Tests if the model can be written and read again and if a file can be 
+ * mapped.
+ */
+TEST(MappedRandomForest, readWriteMap)
+{
+    RandomForest<DecisionTree> forest;
+    createTwoLevelForest(16, forest);
+
+    MappedRandomForest mapped;
+    mapped.build(forest);
+
+    std::stringstream stream;
+    mapped.write(stream);
+    ASSERT_EQ(stream.str().size(), mapped.getMemorySize());
+
+    MappedRandomForest loaded;
+    loaded.read(stream);
+    assertSamePosteriors(forest, loaded);
+
+    const std::string filename = "mapped_forest_test.bin";
+    write(filename, mapped);
+
+    MappedRandomForest fromFile;
+    fromFile.map(filename);
+    ASSERT_TRUE(fromFile.isMapped());
+    ASSERT_EQ(fromFile.getMemorySize(), mapped.getMemorySize());
+    assertSamePosteriors(forest, fromFile);
+
+    std::remove(filename.c_str());
+}
+
+/**
+ * Tests if corrupted and truncated files are rejected.
+ */
+TEST(MappedRandomForest, validation)
+{
+    RandomForest<DecisionTree> forest;
+    createTwoLevelForest(4, forest);
+
+    MappedRandomForest mapped;
+    mapped.build(forest);
+    std::stringstream stream;
+    mapped.write(stream);
+    const std::string file = stream.str();
+
+    // Flip a bit of a leaf posterior
+    const MappedRandomForest::Header* header = reinterpret_cast<const MappedRandomForest::Header*>(file.data());
+    std::string corrupted = file;
+    corrupted[header->leavesOffset] ^= 1;
+    std::stringstream corruptedStream(corrupted);
+    MappedRandomForest loaded;
+    ASSERT_THROW(loaded.read(corruptedStream), IOException);
+    ASSERT_EQ(loaded.getSize(), 0);
+
+    std::stringstream truncatedStream(file.substr(0, file.size() - 1));
+    ASSERT_THROW(loaded.read(truncatedStream), IOException);
+
+    // A file size beyond the sections is rejected before the file is read
+    std::string oversized = file;
+    reinterpret_cast<MappedRandomForest::Header*>(&oversized[0])->fileSize = 1ull << 60;
+    std::stringstream oversizedStream(oversized);
+    ASSERT_THROW(loaded.read(oversizedStream), IOException);
+
+    // Without verification only the header is checked
+    const std::string filename = "mapped_forest_test.bin";
+    {
+        std::ofstream os(filename, std::ios::binary);
+        os << corrupted;
+    }
+    ASSERT_THROW(loaded.map(filename), IOException);
+    loaded.map(filename, false);
+    ASSERT_EQ(loaded.getSize(), 4);
+
+    std::remove(filename.c_str());
+}
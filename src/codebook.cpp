@@ -0,0 +1,267 @@
+#include "parser/codebook.h"
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <cmath>
+
+using namespace parser;
+
+////////////////////////////////////////////////////////////////////////////////
+//// CodebookScorer
+////////////////////////////////////////////////////////////////////////////////
+
+void CodebookScorer::project(Eigen::Ref<Eigen::VectorXf> pi)
+{
+    pi = pi.cwiseMax(0.0f);
+    if (pi.sum() <= 1)
+    {
+        return;
+    }
+
+    // Project onto the simplex: Subtract the threshold that lets the positive
+    // entries sum up to 1
+    std::vector<float> sorted(pi.data(), pi.data() + pi.size());
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    float cumulative = 0;
+    float threshold = 0;
+    for (size_t k = 0; k < sorted.size(); k++)
+    {
+        cumulative += sorted[k];
+        const float t = (cumulative - 1)/(k + 1);
+        if (sorted[k] > t)
+        {
+            threshold = t;
+        }
+    }
+    pi = (pi.array() - threshold).cwiseMax(0.0f).matrix();
+}
+
+void CodebookScorer::solveLatentVariables(  const Eigen::MatrixXf & gram,
+                                            const Eigen::MatrixXf & products,
+                                            Eigen::MatrixXf & pis) const
+{
+    pis = Eigen::MatrixXf::Zero(gram.rows(), products.cols());
+    refineLatentVariables(gram, products, pis);
+}
+
+void CodebookScorer::refineLatentVariables( const Eigen::MatrixXf & gram,
+                                            const Eigen::MatrixXf & products,
+                                            Eigen::MatrixXf & pis) const
+{
+    const int K = static_cast<int>(gram.rows());
+    const int N = static_cast<int>(products.cols());
+    if (K == 0 || N == 0)
+    {
+        return;
+    }
+
+    // The step size is the inverse Lipschitz constant of the gradient
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> solver(gram, Eigen::EigenvaluesOnly);
+    const float lipschitz = solver.eigenvalues().maxCoeff();
+    if (lipschitz <= 0)
+    {
+        return;
+    }
+
+    // A warm start has to be feasible
+    for (int n = 0; n < N; n++)
+    {
+        project(pis.col(n));
+    }
+
+    // Accelerated projected gradient descent on all columns at once. Each
+    // iteration is a single K x K times K x N product.
+    Eigen::MatrixXf y = pis;
+    Eigen::MatrixXf next(K, N);
+    float t = 1;
+    for (int iteration = 0; iteration < model.maxIterations; iteration++)
+    {
+        next.noalias() = y - (gram*y - products)/lipschitz;
+
+        #pragma omp parallel for if (N > 256)
+        for (int n = 0; n < N; n++)
+        {
+            project(next.col(n));
+        }
+
+        const float change = (next - pis).cwiseAbs().maxCoeff();
+        const float nextT = (1 + std::sqrt(1 + 4*t*t))/2;
+        y = next + ((t - 1)/nextT)*(next - pis);
+        pis.swap(next);
+        t = nextT;
+
+        if (change < model.tolerance)
+        {
+            break;
+        }
+    }
+}
+
+void CodebookScorer::determineLatentVariables(  const Eigen::MatrixXf & codebook,
+                                                const Eigen::MatrixXf & descriptors,
+                                                Eigen::MatrixXf & pis) const
+{
+    const Eigen::MatrixXf gram = codebook.transpose()*codebook;
+    const Eigen::MatrixXf products = codebook.transpose()*descriptors;
+    solveLatentVariables(gram, products, pis);
+}
+
+void CodebookScorer::calcErrors(const Eigen::MatrixXf & codebook,
+                                const Eigen::MatrixXf & descriptors,
+                                Eigen::VectorXf & errors) const
+{
+    const int D = static_cast<int>(codebook.rows());
+    const Eigen::MatrixXf gram = codebook.transpose()*codebook;
+    const Eigen::MatrixXf products = codebook.transpose()*descriptors;
+
+    Eigen::MatrixXf pis;
+    solveLatentVariables(gram, products, pis);
+
+    // |x - C pi|^2 = x^T x - 2 pi^T C^T x + pi^T C^T C pi
+    const Eigen::MatrixXf reconstructed = gram*pis;
+    errors.resize(descriptors.cols());
+    for (int n = 0; n < descriptors.cols(); n++)
+    {
+        // The terms are of similar size and cancel, so they are accumulated
+        // in double precision
+        const double squaredError = descriptors.col(n).cast<double>().squaredNorm()
+                - 2*products.col(n).cast<double>().dot(pis.col(n).cast<double>())
+                + reconstructed.col(n).cast<double>().dot(pis.col(n).cast<double>());
+        errors(n) = static_cast<float>(std::sqrt(std::max(squaredError, 0.0)/D));
+    }
+}
+
+void CodebookScorer::calcErrors(const std::vector<Eigen::MatrixXf> & codebooks,
+                                int numLabels,
+                                const Eigen::MatrixXf & descriptors,
+                                Eigen::MatrixXf & errors) const
+{
+    errors.resize(descriptors.cols(), numLabels);
+    for (int l = 0; l < numLabels; l++)
+    {
+        Eigen::VectorXf labelErrors;
+        calcErrors(codebooks[l], descriptors, labelErrors);
+        errors.col(l) = labelErrors;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// CodebookLearner
+////////////////////////////////////////////////////////////////////////////////
+
+float CodebookLearner::learn(const Eigen::MatrixXf & descriptors, int K, Eigen::MatrixXf & codebook) const
+{
+    const int D = static_cast<int>(descriptors.rows());
+    const int N = static_cast<int>(descriptors.cols());
+    codebook = Eigen::MatrixXf::Zero(D, K);
+    if (N == 0 || K == 0)
+    {
+        return 0;
+    }
+
+    std::vector<Eigen::MatrixXf> codebooks(model.runs);
+    std::vector<float> errors(model.runs);
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < model.runs; r++)
+    {
+        // Start from randomly chosen descriptors
+        std::vector<int> indices(N);
+        std::iota(indices.begin(), indices.end(), 0);
+        std::mt19937 g(model.seed + r);
+        std::shuffle(indices.begin(), indices.end(), g);
+
+        codebooks[r].resize(D, K);
+        for (int k = 0; k < K; k++)
+        {
+            codebooks[r].col(k) = descriptors.col(indices[k % N]);
+        }
+        errors[r] = learnRun(descriptors, codebooks[r]);
+    }
+
+    // Ties are broken by the run index such that the result does not depend
+    // on the scheduling
+    const int best = static_cast<int>(std::min_element(errors.begin(), errors.end()) - errors.begin());
+    codebook = codebooks[best];
+    return errors[best];
+}
+
+float CodebookLearner::learnRun(const Eigen::MatrixXf & descriptors, Eigen::MatrixXf & codebook) const
+{
+    const int K = static_cast<int>(codebook.cols());
+    const int N = static_cast<int>(descriptors.cols());
+
+    Eigen::MatrixXf pis = Eigen::MatrixXf::Constant(K, N, 1.0f/K);
+    Eigen::MatrixXf bestCodebook = codebook;
+    float bestError = -1;
+    float lastError = -1;
+
+    for (int m = 0; m < model.maxIterations; m++)
+    {
+        // Determine the latent variables starting from the last ones
+        const Eigen::MatrixXf gram = codebook.transpose()*codebook;
+        const Eigen::MatrixXf products = codebook.transpose()*descriptors;
+        scorer.refineLatentVariables(gram, products, pis);
+
+        // Update the codebook starting from the last one
+        updateCodebook(descriptors, pis, codebook);
+
+        const float error = (descriptors - codebook*pis).norm();
+        if (error < bestError || bestError < 0)
+        {
+            bestError = error;
+            bestCodebook = codebook;
+        }
+
+        if (lastError >= 0 && std::abs(error - lastError) <= model.tolerance*lastError)
+        {
+            break;
+        }
+        lastError = error;
+    }
+
+    codebook = bestCodebook;
+    return bestError;
+}
+
+void CodebookLearner::updateCodebook(   const Eigen::MatrixXf & descriptors,
+                                        const Eigen::MatrixXf & pis,
+                                        Eigen::MatrixXf & codebook) const
+{
+    // The rows of the codebook are independent non-negative least squares
+    // problems that share the K x K matrix Pi Pi^T
+    const Eigen::MatrixXf gram = pis*pis.transpose();
+    const Eigen::MatrixXf products = descriptors*pis.transpose();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> solver(gram, Eigen::EigenvaluesOnly);
+    const float lipschitz = solver.eigenvalues().maxCoeff();
+    if (lipschitz <= 0)
+    {
+        return;
+    }
+
+    // Accelerated projected gradient descent on all rows at once
+    codebook = codebook.cwiseMax(0.0f);
+    Eigen::MatrixXf y = codebook;
+    Eigen::MatrixXf next(codebook.rows(), codebook.cols());
+    const float scale = std::max(codebook.cwiseAbs().maxCoeff(), 1e-12f);
+    float t = 1;
+    for (int iteration = 0; iteration < model.maxUpdateIterations; iteration++)
+    {
+        next.noalias() = y - (y*gram - products)/lipschitz;
+        next = next.cwiseMax(0.0f);
+
+        const float change = (next - codebook).cwiseAbs().maxCoeff();
+        const float nextT = (1 + std::sqrt(1 + 4*t*t))/2;
+        y = next + ((t - 1)/nextT)*(next - codebook);
+        codebook.swap(next);
+        t = nextT;
+
+        if (change < scorer.model.tolerance*scale)
+        {
+            break;
+        }
+    }
+}
@@ -5,6 +5,7 @@
 #include "libforest/libforest.h"
 #include <set>
 #include <chrono>
+#include <algorithm>
 
 using namespace parser;
 
@@ -14,25 +15,13 @@ using namespace parser;
 ////////////////////////////////////////////////////////////////////////////////
 
 
-void LineDetector::detectLines( const cv::Mat & image, 
-                                std::vector< LineSegment > & lineSegments, 
-                                bool horizontal) const
+/**
+ * Creates the bounding box lines of the image. We need these in order to
+ * create line segments from the detected lines.
+ */
+static void createBoundingBoxLines(const cv::Mat & image, std::vector<LineSegment> & boundingBoxes)
 {
-    // Detect all lines segments using probabilistic hough transform
-#if 0
-    // Probabilistic Hough transform that generates line segments
-    std::vector<cv::Vec4i> detectedLines;
-    cv::HoughLinesP(image,
-            detectedLines,
-            model.hough.rho,
-            model.hough.theta,
-            model.hough.threshold,
-            model.hough.minLineLength,
-            model.hough.maxLineGap);
-#else
-    // These are the bounding box lines. We need these in order to create line
-    // segments from the detected lines
-    std::vector<LineSegment> boundingBoxes(4);
+    boundingBoxes.resize(4);
     boundingBoxes[0][0][0] = 0;
     boundingBoxes[0][0][1] = 0;
     boundingBoxes[0][1][0] = 10;
@@ -52,114 +41,153 @@ void LineDetector::detectLines( const cv::Mat & image,
     boundingBoxes[3][0][1] = 0;
     boundingBoxes[3][1][0] = image.cols - 1;
     boundingBoxes[3][1][1] = 10;
+}
+
+/**
+ * Computes the end points of a line in normal form (rho, theta) at the 
+ * image borders. Returns false if the line does not cross the image. 
+ */
+static bool computeLineEndPoints(   const cv::Mat & image, 
+                                    const std::vector<LineSegment> & boundingBoxes, 
+                                    const cv::Vec2f & line, 
+                                    cv::Vec4i & endPoints)
+{
+    const float rho = line[0];
+    const float theta = line[1];
+    double a = std::cos(theta), b = std::sin(theta);
+    double x0 = a*rho, y0 = b*rho;
+    
+    // First: Create a line object from the 
+    LineSegment preliminary;
+    // We just need two points on the line
+    preliminary[0][0] = cvRound(x0 + 1000*(-b));
+    preliminary[0][1] = cvRound(y0 + 1000*(a));
+    preliminary[1][0] = cvRound(x0 - 1000*(-b));
+    preliminary[1][1] = cvRound(y0 - 1000*(a));
+
+    // Now compute the intersection points with the bounding box lines
+    std::vector<Vec2> intersectionPoints;
+    float eps = 1e-2;
+    for (size_t j = 0; j < 4; j++)
+    {
+        Vec2 v;
+        LineUtil::calcIntersectionPoint(boundingBoxes[j], preliminary, v);
+        // Check if the point is within the region of interest
+        if (-eps <= v[0] && v[0] <= image.cols - 1 + eps &&
+            -eps <= v[1] && v[1] <= image.rows - 1 + eps)
+        {
+            intersectionPoints.push_back(v);
+        }
+    }
+    
+    if (intersectionPoints.size() != 2)
+    {
+        return false;
+    }
+    
+    endPoints[0] = intersectionPoints[0][0];
+    endPoints[1] = intersectionPoints[0][1];
+    endPoints[2] = intersectionPoints[1][0];
+    endPoints[3] = intersectionPoints[1][1];
+    return true;
+}
+
+/**
+ * Creates a line segment from the end points and checks whether it is 
+ * axis aligned and does not duplicate one of the accepted line segments. 
+ */
+static bool acceptLineSegment(  const cv::Vec4i & lineEndPoints, 
+                                bool horizontal, 
+                                double epsilon, 
+                                const std::vector<LineSegment> & lineSegments, 
+                                LineSegment & lineSegment)
+{
+    // Create a line segment from the detection
+    lineSegment[0][0] = lineEndPoints[0];
+    lineSegment[0][1] = lineEndPoints[1];
+    lineSegment[1][0] = lineEndPoints[2];
+    lineSegment[1][1] = lineEndPoints[3];
+    lineSegment.normalize();
+    
+    float deviation = 0;
+    
+    // Check if this line can be added
+    if (horizontal)
+    {
+        // Compute the deviation in y direction
+        deviation = std::abs(lineSegment[0][1] - lineSegment[1][1]); 
+    }
+    else
+    {
+        // Compute the deviation in x direction
+        deviation = std::abs(lineSegment[0][0] - lineSegment[1][0]); 
+    }
+    
+    // The line segments must not deviate more than epsilon
+    if (deviation >= epsilon)
+    {
+        return false;
+    }
+    
+#if 1
+    // Check if there is a line that is just 1px away from this one
+    for (size_t j = 0; j < lineSegments.size(); j++)
+    {
+        if ((cv::norm(lineSegments[j][0], lineSegment[0]) <= 1.5 && cv::norm(lineSegments[j][1], lineSegment[1]) <= 1.5) ||
+            (cv::norm(lineSegments[j][1], lineSegment[0]) <= 1.5 && cv::norm(lineSegments[j][0], lineSegment[1]) <= 1.5))
+        {
+            return false;
+        }
+    }
+#endif
+    
+    return true;
+}
+
+void LineDetector::detectLines( const cv::Mat & image, 
+                                std::vector< LineSegment > & lineSegments, 
+                                bool horizontal) const
+{
+    // Detect all lines segments using probabilistic hough transform
+#if 0
+    // Probabilistic Hough transform that generates line segments
+    std::vector<cv::Vec4i> detectedLines;
+    cv::HoughLinesP(image,
+            detectedLines,
+            model.hough.rho,
+            model.hough.theta,
+            model.hough.threshold,
+            model.hough.minLineLength,
+            model.hough.maxLineGap);
+#else
+    std::vector<LineSegment> boundingBoxes;
+    createBoundingBoxLines(image, boundingBoxes);
     
     // Standard Hough Transform that generates lines
     cv::vector<cv::Vec2f> lines;
     cv::HoughLines(image, lines, model.hough.rho, model.hough.theta, model.minLength);
 
-    cv::Mat distanceTransform;
-    Processing::computeDistanceTransform(image, distanceTransform);
-
     // Create line segments from these lines
     std::vector<cv::Vec4i> detectedLines;
     for (size_t i = 0; i < lines.size(); i++)
     {
-        const float rho = lines[i][0];
-        const float theta = lines[i][1];
-        double a = std::cos(theta), b = std::sin(theta);
-        double x0 = a*rho, y0 = b*rho;
-        
-        // First: Create a line object from the 
-        LineSegment preliminary;
-        // We just need two points on the line
-        preliminary[0][0] = cvRound(x0 + 1000*(-b));
-        preliminary[0][1] = cvRound(y0 + 1000*(a));
-        preliminary[1][0] = cvRound(x0 - 1000*(-b));
-        preliminary[1][1] = cvRound(y0 - 1000*(a));
-
-        // Now compute the intersection points with the bounding box lines
-        std::vector<Vec2> intersectionPoints;
-        float eps = 1e-2;
-        for (size_t j = 0; j < 4; j++)
-        {
-            Vec2 v;
-            LineUtil::calcIntersectionPoint(boundingBoxes[j], preliminary, v);
-            // Check if the point is within the region of interest
-            if (-eps <= v[0] && v[0] <= image.cols - 1 + eps &&
-                -eps <= v[1] && v[1] <= image.rows - 1 + eps)
-            {
-                intersectionPoints.push_back(v);
-            }
-        }
-        
-        if (intersectionPoints.size() != 2)
+        cv::Vec4i r;
+        if (computeLineEndPoints(image, boundingBoxes, lines[i], r))
         {
-            continue;
+            detectedLines.push_back(r);
         }
-        
-        cv::Vec4i r;
-        r[0] = intersectionPoints[0][0];
-        r[1] = intersectionPoints[0][1];
-        r[2] = intersectionPoints[1][0];
-        r[3] = intersectionPoints[1][1];
-
-        detectedLines.push_back(r);
     }
 #endif
     
     // Filter out all lines that are not axis aligned
     for( std::vector<cv::Vec2i>::size_type i = 0; i < detectedLines.size(); i++ )
     {
-        cv::Vec4i lineEndPoints = detectedLines[i];
-        
-        // Create a line segment from the detection
+        // This is a legit line
         LineSegment lineSegment;
-        lineSegment[0][0] = lineEndPoints[0];
-        lineSegment[0][1] = lineEndPoints[1];
-        lineSegment[1][0] = lineEndPoints[2];
-        lineSegment[1][1] = lineEndPoints[3];
-        lineSegment.normalize();
-        
-        float deviation = 0;
-        
-        // Check if this line can be added
-        if (horizontal)
-        {
-            // Compute the deviation in y direction
-            deviation = std::abs(lineSegment[0][1] - lineSegment[1][1]); 
-        }
-        else
-        {
-            // Compute the deviation in x direction
-            deviation = std::abs(lineSegment[0][0] - lineSegment[1][0]); 
-        }
-        
-        // The line segments must not deviate more than epsilon
-        if (deviation >= model.epsilon)
-        {
-            continue;
-        }
-        
-#if 1
-        // Check if there is a line that is just 1px away from this one
-        bool conflict = false;
-        for (size_t j = 0; j < lineSegments.size(); j++)
+        if (acceptLineSegment(detectedLines[i], horizontal, model.epsilon, lineSegments, lineSegment))
         {
-            if ((cv::norm(lineSegments[j][0], lineSegment[0]) <= 1.5 && cv::norm(lineSegments[j][1], lineSegment[1]) <= 1.5) ||
-                (cv::norm(lineSegments[j][1], lineSegment[0]) <= 1.5 && cv::norm(lineSegments[j][0], lineSegment[1]) <= 1.5))
-            {
-                conflict = true;
-                break;
-            }
-        }
-        if(conflict)
-        {
-            continue;
+            lineSegments.push_back(lineSegment);
         }
-#endif
-
-        // This is a legit line
-        lineSegments.push_back(lineSegment);
     }
 #if 0
     std::cout << lineSegments.size() << "\n";
@@ -344,6 +372,246 @@ void LineDetector::filterShortLines(const std::vector<LineSegment> & lineSegment
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//// AxisAlignedLineDetector
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A local maximum of the hough accumulator
+ */
+struct HoughPeak {
+    /**
+     * The number of votes
+     */
+    int votes;
+    /**
+     * The position in the padded accumulator as used by cv::HoughLines. It
+     * breaks ties between peaks with the same number of votes. 
+     */
+    int index;
+    /**
+     * The line in normal form (rho, theta)
+     */
+    cv::Vec2f line;
+};
+
+double AxisAlignedLineDetector::detectLines(    const cv::Mat & image, 
+                                                std::vector<LineSegment> & resultH, 
+                                                std::vector<LineSegment> & resultV) const
+{
+    resultH.clear();
+    resultV.clear();
+    
+    // The discretization follows cv::HoughLines such that the peaks are 
+    // identical
+    const float rho = static_cast<float>(model.hough.rho);
+    const float theta = static_cast<float>(model.hough.theta);
+    const float irho = 1/rho;
+    const int numAngles = cvRound(CV_PI/theta);
+    const int numRho = cvRound(((image.cols + image.rows)*2 + 1)/rho);
+    const int stride = numRho + 2;
+    
+    // Select the angles whose lines can pass the axis alignment test along
+    // the full image extent
+    std::vector<float> tabSin(numAngles), tabCos(numAngles);
+    std::vector<int> candidates;
+    float angle = 0;
+    for (int n = 0; n < numAngles; angle += theta, n++)
+    {
+        tabSin[n] = static_cast<float>(std::sin(static_cast<double>(angle))*irho);
+        tabCos[n] = static_cast<float>(std::cos(static_cast<double>(angle))*irho);
+        
+        const double deviationH = std::abs(std::tan(angle - CV_PI/2))*(image.cols - 1);
+        const double deviationV = std::abs(std::tan(angle))*(image.rows - 1);
+        if (deviationH < model.epsilon + 1 || deviationV < model.epsilon + 1)
+        {
+            candidates.push_back(n);
+        }
+    }
+    
+    // The accumulator holds the candidate angles and their neighbors for the
+    // non-maximum suppression. The other rows are never read. 
+    std::vector<int> rows(numAngles + 2, -1);
+    std::vector<int> angles;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        for (int n = std::max(candidates[c] - 1, 0); n <= std::min(candidates[c] + 1, numAngles - 1); n++)
+        {
+            if (rows[n + 1] < 0)
+            {
+                rows[n + 1] = static_cast<int>(angles.size());
+                angles.push_back(n);
+            }
+        }
+    }
+    
+    std::vector<int> accumulator(angles.size()*stride, 0);
+    for (int i = 0; i < image.rows; i++)
+    {
+        const uchar* row = image.ptr<uchar>(i);
+        for (int j = 0; j < image.cols; j++)
+        {
+            if (row[j] == 0)
+            {
+                continue;
+            }
+            for (size_t a = 0; a < angles.size(); a++)
+            {
+                int r = cvRound(j*tabCos[angles[a]] + i*tabSin[angles[a]]);
+                r += (numRho - 1)/2;
+                accumulator[a*stride + r + 1]++;
+            }
+        }
+    }
+    
+    // Returns the votes at the padded position, the padding is 0
+    auto getVotes = [&](int n, int r) -> int {
+        const int a = rows[n + 1];
+        return a < 0 ? 0 : accumulator[a*stride + r];
+    };
+    
+    // Find the local maxima above the initial threshold
+    const int threshold = static_cast<int>(model.minLength);
+    std::vector<HoughPeak> peaks;
+    for (size_t c = 0; c < candidates.size(); c++)
+    {
+        const int n = candidates[c];
+        for (int r = 0; r < numRho; r++)
+        {
+            const int votes = getVotes(n, r + 1);
+            if (votes > threshold && 
+                votes > getVotes(n, r) && votes >= getVotes(n, r + 2) &&
+                votes > getVotes(n - 1, r + 1) && votes >= getVotes(n + 1, r + 1))
+            {
+                HoughPeak peak;
+                peak.votes = votes;
+                peak.index = (n + 1)*stride + r + 1;
+                peak.line = cv::Vec2f((r - (numRho - 1)*0.5f)*rho, n*theta);
+                peaks.push_back(peak);
+            }
+        }
+    }
+    
+    std::sort(peaks.begin(), peaks.end(), [](const HoughPeak & p, const HoughPeak & q) {
+        return p.votes > q.votes || (p.votes == q.votes && p.index < q.index);
+    });
+    
+    // A line only conflicts with stronger lines, hence the lines for a 
+    // larger minimum length are a prefix of these lists
+    std::vector<LineSegment> boundingBoxes;
+    createBoundingBoxLines(image, boundingBoxes);
+    std::vector<int> votesH, votesV;
+    for (size_t p = 0; p < peaks.size(); p++)
+    {
+        cv::Vec4i endPoints;
+        if (!computeLineEndPoints(image, boundingBoxes, peaks[p].line, endPoints))
+        {
+            continue;
+        }
+        
+        LineSegment lineSegment;
+        if (acceptLineSegment(endPoints, true, model.epsilon, resultH, lineSegment))
+        {
+            resultH.push_back(lineSegment);
+            votesH.push_back(peaks[p].votes);
+        }
+        if (acceptLineSegment(endPoints, false, model.epsilon, resultV, lineSegment))
+        {
+            resultV.push_back(lineSegment);
+            votesV.push_back(peaks[p].votes);
+        }
+    }
+    
+    // Increase the minimum length until there are few enough lines
+    double minLength = model.minLength;
+    size_t numH = votesH.size();
+    size_t numV = votesV.size();
+    while (static_cast<int>(numH + numV) > model.maxLines && model.lengthStep > 0)
+    {
+        minLength += model.lengthStep;
+        const int minVotes = static_cast<int>(minLength);
+        while (numH > 0 && votesH[numH - 1] <= minVotes)
+        {
+            numH--;
+        }
+        while (numV > 0 && votesV[numV - 1] <= minVotes)
+        {
+            numV--;
+        }
+    }
+    
+    resultH.resize(numH);
+    resultV.resize(numV);
+    return minLength;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// BorderSupportIndex
+////////////////////////////////////////////////////////////////////////////////
+
+void BorderSupportIndex::build(const cv::Mat & distanceTransform, float threshold)
+{
+    rows = distanceTransform.rows;
+    cols = distanceTransform.cols;
+    rowCounts.assign(rows*(cols + 1), 0);
+    columnCounts.assign(cols*(rows + 1), 0);
+    
+    for (int y = 0; y < rows; y++)
+    {
+        const float* row = distanceTransform.ptr<float>(y);
+        for (int x = 0; x < cols; x++)
+        {
+            const int supported = row[x] <= threshold ? 1 : 0;
+            rowCounts[y*(cols + 1) + x + 1] = rowCounts[y*(cols + 1) + x] + supported;
+            columnCounts[x*(rows + 1) + y + 1] = columnCounts[x*(rows + 1) + y] + supported;
+        }
+    }
+}
+
+bool BorderSupportIndex::isRowSupported(int y, int x, int n) const
+{
+    if (n <= 0)
+    {
+        return true;
+    }
+    if (y < 0 || y >= rows || x < 0 || x + n > cols)
+    {
+        return false;
+    }
+    const int* counts = rowCounts.data() + y*(cols + 1);
+    return counts[x + n] - counts[x] == n;
+}
+
+bool BorderSupportIndex::isColumnSupported(int x, int y, int n) const
+{
+    if (n <= 0)
+    {
+        return true;
+    }
+    if (x < 0 || x >= cols || y < 0 || y + n > rows)
+    {
+        return false;
+    }
+    const int* counts = columnCounts.data() + x*(rows + 1);
+    return counts[y + n] - counts[y] == n;
+}
+
+bool BorderSupportIndex::isSupported(const Rectangle & r) const
+{
+    // The pixels are the ones of tracing the borders from the top left 
+    // corner in steps of one pixel
+    const int x1 = static_cast<int>(std::round(r[0][0]));
+    const int x2 = static_cast<int>(std::round(r[1][0]));
+    const int y1 = static_cast<int>(std::round(r[0][1]));
+    const int y2 = static_cast<int>(std::round(r[3][1]));
+    const int top = static_cast<int>(std::round(r[1][1]));
+    const int numX = r[0][0] <= r[1][0] ? static_cast<int>(std::floor(r[1][0] - r[0][0])) + 1 : 0;
+    const int numY = r[1][1] <= r[2][1] ? static_cast<int>(std::floor(r[2][1] - r[1][1])) + 1 : 0;
+    
+    return  isRowSupported(y1, x1, numX) && isRowSupported(y2, x1, numX) &&
+            isColumnSupported(x1, top, numY) && isColumnSupported(x2, top, numY);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //// RectangleDetector
 ////////////////////////////////////////////////////////////////////////////////
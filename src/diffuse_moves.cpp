@@ -30,7 +30,7 @@ int MCMCParserCallback::callback(
     for (size_t h = 0; h < state.size(); h++)
     {
         cv::Scalar color;
-        switch (parts[state[h]].label)
+        switch (hypotheses->getLabel(state[h]))
         {
             case 0:
                 color = cv::Scalar(0,0,255);
@@ -42,7 +42,7 @@ int MCMCParserCallback::callback(
                 color = cv::Scalar(0,255,255);
                 break;
         }
-        PlotUtil::plotRectangle(demo, parts[state[h]].rect, color);
+        PlotUtil::plotRectangle(demo, hypotheses->getRectangle(state[h]), color);
     }
 
     cv::imshow("test", demo);
@@ -74,15 +74,58 @@ void MCMCParserExchangeMove::move(
     addPart = dist(g);//random
 
     newState[replacePart] = addPart;
+    if (addPart != state[replacePart])
+    {
+        diedParts.push_back(state[replacePart]);
+        bornParts.push_back(addPart);
+    }
 
     float proposalFactor = 0.0f;
     //float proposalFactor = std::log((double) ( ( partHypotheses[addPart].posterior ) / ( std::max(0.01f,partHypotheses[state[replacePart]].posterior)) ) );
     logAcceptRatio = proposalFactor;
 }
 
+void MCMCParserExchangeMove::move(
+    const MCMCParserBitsetState & state,
+    MCMCParserBitsetState & newState,
+    float & logAcceptRatio)
+{
+    // Copy all other parts
+    newState.copyFrom(state);
+    logAcceptRatio = 0.0f;
+
+    if (state.size() == 0)
+    {
+        return;
+    }
+
+    // Choose a tree to replace
+    std::uniform_int_distribution<int> stateDist(0, static_cast<int>(state.size() - 1));
+    const int replacePart = state[stateDist(g)];
+
+    // Exchanging with a selected part would shrink the state
+    const int addPart = dist(g);
+    if (!state.contains(addPart))
+    {
+        newState.remove(replacePart);
+        newState.insert(addPart);
+        diedParts.push_back(replacePart);
+        bornParts.push_back(addPart);
+    }
+}
+
 
 // DATA-DRIVEN EXCHANGE
 
+/**
+ * Returns the number of hypotheses similar to h. Hypotheses added by split
+ * and merge during the annealing are not in the index and have none.
+ */
+static int countSimilarRects(const SimilarityIndex & similarityIndex, int h)
+{
+    return h < similarityIndex.size() ? similarityIndex.getNumNeighbors(h) : 0;
+}
+
 void MCMCParserDDExchangeMove::move(
     const MCMCParserStateType & state,
     MCMCParserStateType & newState,
@@ -126,14 +169,13 @@ void MCMCParserDDExchangeMove::move(
 
 
     int rectIDx = state[replacePart];
-    std::vector<int> similarRects;
     //data-drivenness
-    int numSimilarRects = computeSimilarRects(rectIDx, similarRects);
+    const int numSimilarRects = countSimilarRects(*similarityIndex, rectIDx);
 
     if(numSimilarRects > 0)// similar rectangles exist, so exchange in a data driven way
     {
         std::uniform_int_distribution<int> similarRectsDist(0, static_cast<int>(numSimilarRects - 1));
-        addPart = similarRects[similarRectsDist(g)];
+        addPart = similarityIndex->getNeighbor(rectIDx, similarRectsDist(g));
     }
     else // no similar rectangles
     {
@@ -142,79 +184,92 @@ void MCMCParserDDExchangeMove::move(
     }
 
     newState[replacePart] = addPart;
+    if (addPart != state[replacePart])
+    {
+        diedParts.push_back(state[replacePart]);
+        bornParts.push_back(addPart);
+    }
     float proposalFactor = 0.0f;
     //float proposalFactor = std::log((double) ( ( partHypotheses[addPart].posterior ) / ( std::max(0.01f,partHypotheses[state[replacePart]].posterior)) ) );
     // avoid singularity with parts of zero probability
     logAcceptRatio = proposalFactor;
 }
 
-/*
- * Similarity check: for data drivenness
-*/
-
-int MCMCParserDDExchangeMove::computeSimilarRects(const int rectIDx, std::vector<int> & similarRects)
+void MCMCParserDDExchangeMove::move(
+    const MCMCParserBitsetState & state,
+    MCMCParserBitsetState & newState,
+    float & logAcceptRatio)
 {
-    // compute all the rectangles dissimilar from the input rectangle
-    Eigen::MatrixXi overlapRects = Eigen::MatrixXi::Zero(static_cast<int>(1),static_cast<int>(numProposals));
-    similarRects.resize(0);
+    // Copy all other parts
+    newState.copyFrom(state);
+    logAcceptRatio = 0.0f;
 
-    overlapRects = overlapPairs70.row(rectIDx);
+    if (state.size() == 0)
+    {
+        return;
+    }
 
-    for (size_t i = 0; i < numProposals; i++)
+    // The roulette samples the hypothesis itself, which is all the bitset 
+    // state needs
+    int replacePart = -1;
+#if ROULETTE_EXCHANGE
+    replacePart = roulette.sample(rouletteDist(g));
+#endif
+    if (replacePart < 0 || !state.contains(replacePart))
     {
-        if(overlapRects(0,i) != 0)
-        {
-            similarRects.push_back(i);
-        }
+        std::uniform_int_distribution<int> stateDist(0, static_cast<int>(state.size() - 1));
+        replacePart = state[stateDist(g)];
     }
 
-    int numSimilarRects = similarRects.size();
-    return numSimilarRects;
+    const int numSimilarRects = countSimilarRects(*similarityIndex, replacePart);
+    if (numSimilarRects > 0)
+    {
+        std::uniform_int_distribution<int> similarRectsDist(0, static_cast<int>(numSimilarRects - 1));
+        const int addPart = similarityIndex->getNeighbor(replacePart, similarRectsDist(g));
 
+        // Exchanging with a selected part would shrink the state
+        if (!state.contains(addPart))
+        {
+            newState.remove(replacePart);
+            newState.insert(addPart);
+            diedParts.push_back(replacePart);
+            bornParts.push_back(addPart);
+        }
+    }
 }
 
-int MCMCParserDDExchangeMove::computeRussianRoulette(const MCMCParserStateType state)
+int MCMCParserDDExchangeMove::computeRussianRoulette(const MCMCParserStateType & state)
 {
+    // The roulette is kept up to date by accepted and remembers where the 
+    // parts are in the state
+    const int h = roulette.sample(rouletteDist(g));
+    const int replacePart = roulette.locate(state, h);
 
-    int replacePart;
-    float total = 0.0f;
-
-    for(size_t i= 0; i<state.size(); i++ )
+    //special case when  all the posteriors are 1.0f
+    if (replacePart < 0)
     {
-        total += (1.0f - partHypotheses[state[i]].posterior); // least posterior parts must be selected more frequently
+        std::uniform_int_distribution<int> stateDist(0, static_cast<int>(state.size() - 1));
+        return stateDist(g);
     }
 
-    float prevIndex = 0.0f;
-    std::vector<float> rouletteRussian;
-    rouletteRussian.push_back(0.0f);
+    return replacePart;
+}
 
-    for(size_t i= 0; i<state.size(); i++ )
-    {
-         //special case when  all the posteriors are 1.0f
-        if(total == 0)
-        {
-            rouletteRussian.push_back(((double) 1/state.size())  + prevIndex);
-        }
-        else
-        {
-            rouletteRussian.push_back(static_cast<float>( (1.0f- partHypotheses[state[i]].posterior)/total) + prevIndex);
-        }
+void MCMCParserDDExchangeMove::begin(const MCMCParserStateType & state)
+{
+    roulette.assign(state);
+}
 
-        prevIndex = rouletteRussian[i+1];
+void MCMCParserDDExchangeMove::accepted(const std::vector<int> & born, const std::vector<int> & died)
+{
+    for (size_t i = 0; i < died.size(); i++)
+    {
+        roulette.remove(died[i]);
     }
-
-    const float rouletteNum = rouletteDist(g);
-
-    for(size_t i = state.size(); i > 0; i--)// TO DO:Make sure that state size > 0 (prevent death move going to null states)
+    for (size_t i = 0; i < born.size(); i++)
     {
-        if( rouletteNum >= rouletteRussian[i-1] && rouletteNum <= rouletteRussian[i] )
-        {
-            replacePart = i-1;
-            break;
-        }
+        roulette.insert(born[i]);
     }
-
-    return replacePart;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -275,8 +330,8 @@ void MCMCParserLabelDiffuseMove::move(
 
     for(int k = 0; k < newState.size(); k++ )
     {
-        std::min(minPosterior, partHypotheses[newState[k]].posterior);
-        if(minPosterior == partHypotheses[newState[k]].posterior)
+        std::min(minPosterior, hypotheses->getPosterior(newState[k]));
+        if(minPosterior == hypotheses->getPosterior(newState[k]))
         {
             replacePart = k;
         }
@@ -298,6 +353,11 @@ void MCMCParserLabelDiffuseMove::move(
     std::uniform_int_distribution<int> labelDist(0, 2);
 
     newState[replacePart] = state[replacePart] - label + labelDist(g);
+    if (newState[replacePart] != state[replacePart])
+    {
+        diedParts.push_back(state[replacePart]);
+        bornParts.push_back(newState[replacePart]);
+    }
 
     logAcceptRatio = 0.0f;
 }
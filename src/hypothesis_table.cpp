@@ -0,0 +1,166 @@
+#include "parser/hypothesis_table.h"
+
+#include <algorithm>
+
+using namespace parser;
+
+////////////////////////////////////////////////////////////////////////////////
+//// PartHypothesisTable
+////////////////////////////////////////////////////////////////////////////////
+
+void PartHypothesisTable::clear()
+{
+    rectangles.clear();
+    labels.clear();
+    posteriors.clear();
+    likelihoods.clear();
+    shapePriors.clear();
+    corners.clear();
+    bounds.clear();
+    meanDepths.clear();
+    profileArena.clear();
+    profileOffsets.assign(1, 0);
+}
+
+void PartHypothesisTable::reserve(int numRectangles, int numLabels)
+{
+    const int numHypotheses = numRectangles*numLabels;
+    rectangles.reserve(numHypotheses);
+    labels.reserve(numHypotheses);
+    posteriors.reserve(numHypotheses);
+    likelihoods.reserve(numHypotheses);
+    shapePriors.reserve(numHypotheses);
+    corners.reserve(8*numRectangles);
+    bounds.reserve(4*numRectangles);
+    meanDepths.reserve(numRectangles);
+    profileOffsets.reserve(2*numRectangles + 1);
+}
+
+int PartHypothesisTable::addRectangle(
+        const Rectangle & rect,
+        float meanDepth,
+        const std::vector<int> & projProf,
+        const std::vector<int> & projProfTyp)
+{
+    for (int v = 0; v < 4; v++)
+    {
+        corners.push_back(rect[v][0]);
+        corners.push_back(rect[v][1]);
+    }
+
+    bounds.push_back(rect.minX());
+    bounds.push_back(rect.minY());
+    bounds.push_back(rect.maxX());
+    bounds.push_back(rect.maxY());
+
+    meanDepths.push_back(meanDepth);
+
+    profileArena.insert(profileArena.end(), projProf.begin(), projProf.end());
+    profileOffsets.push_back(static_cast<int>(profileArena.size()));
+    profileArena.insert(profileArena.end(), projProfTyp.begin(), projProfTyp.end());
+    profileOffsets.push_back(static_cast<int>(profileArena.size()));
+
+    return getNumRectangles() - 1;
+}
+
+PartHypothesisTable::Handle PartHypothesisTable::addHypothesis(
+        int rectangle,
+        int label,
+        float likelihood,
+        float shapePrior,
+        float posterior)
+{
+    assert(rectangle >= 0 && rectangle < getNumRectangles());
+
+    rectangles.push_back(rectangle);
+    labels.push_back(label);
+    likelihoods.push_back(likelihood);
+    shapePriors.push_back(shapePrior);
+    posteriors.push_back(posterior);
+
+    return size() - 1;
+}
+
+bool PartHypothesisTable::hasGeometry(int r, const Part & part) const
+{
+    for (int v = 0; v < 4; v++)
+    {
+        if (corners[8*r + 2*v] != part.rect[v][0] || corners[8*r + 2*v + 1] != part.rect[v][1])
+        {
+            return false;
+        }
+    }
+
+    if (meanDepths[r] != part.meanDepth)
+    {
+        return false;
+    }
+
+    const int* arena = profileArena.data();
+    return  static_cast<int>(part.projProf.size()) == profileOffsets[2*r + 1] - profileOffsets[2*r] &&
+            static_cast<int>(part.projProfTyp.size()) == profileOffsets[2*r + 2] - profileOffsets[2*r + 1] &&
+            std::equal(part.projProf.begin(), part.projProf.end(), arena + profileOffsets[2*r]) &&
+            std::equal(part.projProfTyp.begin(), part.projProfTyp.end(), arena + profileOffsets[2*r + 1]);
+}
+
+PartHypothesisTable::Handle PartHypothesisTable::add(const Part & part)
+{
+    int r = getNumRectangles() - 1;
+    if (r < 0 || !hasGeometry(r, part))
+    {
+        r = addRectangle(part.rect, part.meanDepth, part.projProf, part.projProfTyp);
+    }
+
+    return addHypothesis(r, part.label, part.likelihood, part.shapePrior, part.posterior);
+}
+
+void PartHypothesisTable::assign(const std::vector<Part> & parts)
+{
+    clear();
+    reserve(static_cast<int>(parts.size()), 1);
+
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        add(parts[p]);
+    }
+}
+
+Rectangle PartHypothesisTable::getRectangle(Handle h) const
+{
+    const float* c = corners.data() + 8*rectangles[h];
+
+    return Rectangle(Vec2(c[0], c[1]), Vec2(c[2], c[3]), Vec2(c[4], c[5]), Vec2(c[6], c[7]));
+}
+
+void PartHypothesisTable::getPart(Handle h, Part & part) const
+{
+    assert(h >= 0 && h < size());
+
+    part.rect = getRectangle(h);
+    part.label = labels[h];
+    part.posterior = posteriors[h];
+    part.likelihood = likelihoods[h];
+    part.shapePrior = shapePriors[h];
+    part.meanDepth = getMeanDepth(h);
+
+    const ProfileView projProf = getProjProf(h);
+    const ProfileView projProfTyp = getProjProfTyp(h);
+    part.projProf.assign(projProf.begin(), projProf.end());
+    part.projProfTyp.assign(projProfTyp.begin(), projProfTyp.end());
+}
+
+void PartHypothesisTable::toParts(std::vector<Part> & parts) const
+{
+    parts.resize(size());
+    for (int h = 0; h < size(); h++)
+    {
+        getPart(h, parts[h]);
+    }
+}
+
+size_t PartHypothesisTable::getMemorySize() const
+{
+    return  (rectangles.size() + labels.size() + profileOffsets.size() + profileArena.size())*sizeof(int) +
+            (posteriors.size() + likelihoods.size() + shapePriors.size())*sizeof(float) +
+            (corners.size() + bounds.size() + meanDepths.size())*sizeof(float);
+}
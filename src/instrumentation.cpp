@@ -0,0 +1,228 @@
+#include "parser/instrumentation.h"
+
+#include <iomanip>
+
+using namespace parser;
+
+/**
+ * Writes a string as quoted JSON string. Quotes, backslashes and control
+ * characters (e.g. in image ids derived from file names) are escaped.
+ */
+static void writeJSONString(std::ostream & os, const std::string & str)
+{
+    os << '"';
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        const unsigned char c = static_cast<unsigned char>(str[i]);
+        switch (c)
+        {
+            case '"':  os << "\\\""; break;
+            case '\\': os << "\\\\"; break;
+            case '\b': os << "\\b"; break;
+            case '\f': os << "\\f"; break;
+            case '\n': os << "\\n"; break;
+            case '\r': os << "\\r"; break;
+            case '\t': os << "\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+                }
+                else
+                {
+                    os << str[i];
+                }
+        }
+    }
+    os << '"';
+}
+
+/**
+ * Returns the entry with the given name. The entry is created if it does not
+ * exist yet.
+ */
+static double & findEntry(std::vector< std::pair<std::string, double> > & entries, const std::string & name)
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].first == name)
+        {
+            return entries[i].second;
+        }
+    }
+    entries.push_back(std::make_pair(name, 0.0));
+    return entries.back().second;
+}
+
+/**
+ * Returns the value of the entry with the given name or 0.
+ */
+static double getEntry(const std::vector< std::pair<std::string, double> > & entries, const std::string & name)
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].first == name)
+        {
+            return entries[i].second;
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// Instrumentation
+////////////////////////////////////////////////////////////////////////////////
+
+Instrumentation::Instrumentation() : enabled(false)
+{
+    stopwatch.set_mode(REAL_TIME);
+}
+
+void Instrumentation::setOutputFile(const std::string & filename)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (output.is_open())
+    {
+        output.close();
+    }
+    output.open(filename, std::ios::app);
+    if (!output.is_open())
+    {
+        std::cout << "Could not open instrumentation file " << filename << std::endl;
+    }
+}
+
+void Instrumentation::beginRecord()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    record.clear();
+}
+
+void Instrumentation::startStage(const std::string & stage)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stopwatch.start(stage);
+}
+
+void Instrumentation::stopStage(const std::string & stage)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stopwatch.stop(stage);
+    findEntry(record.timings, stage) += static_cast<double>(stopwatch.get_last_time(stage));
+}
+
+void Instrumentation::setCounter(const std::string & name, double value)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    findEntry(record.counters, name) = value;
+}
+
+void Instrumentation::addCounter(const std::string & name, double value)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    findEntry(record.counters, name) += value;
+}
+
+void Instrumentation::addRecord(const InstrumentationRecord & other)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < other.timings.size(); i++)
+    {
+        findEntry(record.timings, other.timings[i].first) += other.timings[i].second;
+    }
+    for (size_t i = 0; i < other.counters.size(); i++)
+    {
+        findEntry(record.counters, other.counters[i].first) += other.counters[i].second;
+    }
+}
+
+double Instrumentation::getTime(const std::string & stage) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return getEntry(record.timings, stage);
+}
+
+double Instrumentation::getCounter(const std::string & name) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return getEntry(record.counters, name);
+}
+
+void Instrumentation::writeRecord(std::ostream & os) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    os << std::setprecision(6);
+    os << "{\"id\":";
+    writeJSONString(os, record.id);
+    os << ",\"timings\":{";
+    for (size_t i = 0; i < record.timings.size(); i++)
+    {
+        os << (i > 0 ? "," : "");
+        writeJSONString(os, record.timings[i].first);
+        os << ":" << record.timings[i].second;
+    }
+    os << "},\"counters\":{";
+    for (size_t i = 0; i < record.counters.size(); i++)
+    {
+        os << (i > 0 ? "," : "");
+        writeJSONString(os, record.counters[i].first);
+        os << ":" << record.counters[i].second;
+    }
+    os << "}}\n";
+}
+
+void Instrumentation::emitRecord(const std::string & id)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        record.id = id;
+    }
+
+    if (output.is_open())
+    {
+        writeRecord(output);
+        output.flush();
+    }
+    else
+    {
+        writeRecord(std::cout);
+    }
+}
+
+void Instrumentation::reportAll(std::ostream & os)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopwatch.report_all(os);
+}
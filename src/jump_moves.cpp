@@ -331,7 +331,7 @@ void MCMCParserBirthMove::move(
 
 #if DATA_DRIVEN_BIRTH_DEATH //Data-driven birth // not tested
 
-    MCMCParserDeathMove objD(partHypotheses,overlapPairs);
+    MCMCParserDeathMove objD(*hypotheses, overlapPairs, numClusters);
     std::vector<int> dissimilarRects;
     int numDissimilarRects = objD.computeDissimilarity(state, dissimilarRects);
 
@@ -341,12 +341,14 @@ void MCMCParserBirthMove::move(
         // Choose a tree to add
         const int addPart = dissimilarDist(g);
         newState.push_back(dissimilarRects[addPart]);
+        bornParts.push_back(dissimilarRects[addPart]);
         proposalFactor = std::log( (double) numDissimilarRects / newState.size()  );// Proposal ratio
     }
 
 #else
     const int addPart = dist(g);//random selection
     newState.push_back(addPart);
+    bornParts.push_back(addPart);
     //proposalFactor = std::log((double)numProposals/(newState.size()));// Proposal ratio
     //proposalFactor = std::log((double)numClusters /(newState.size()));// Proposal ratio
     proposalFactor = std::log( numClusters );//proposal ratio factor
@@ -357,6 +359,27 @@ void MCMCParserBirthMove::move(
 
 }
 
+void MCMCParserBirthMove::move(
+    const MCMCParserBitsetState & state,
+    MCMCParserBitsetState & newState,
+    float & logAcceptRatio)
+{
+#if DATA_DRIVEN_BIRTH_DEATH
+    SAMove::move(state, newState, logAcceptRatio);
+#else
+    newState.copyFrom(state);
+
+    // Adding a selected part leaves the state unchanged, the annealer 
+    // rejects such proposals
+    const int addPart = dist(g);
+    if (newState.insert(addPart))
+    {
+        bornParts.push_back(addPart);
+    }
+    logAcceptRatio = std::log( numClusters );
+#endif
+}
+
 /////////////////////////////
 //// MCMCParserDeath: Decrease of dimension
 /////////////////////////////
@@ -378,25 +401,13 @@ void MCMCParserDeathMove::move(
 
     #if ROULETTE_DEATH
 
-        std::vector<Part> posteriorInState;
-        for(size_t i = 0; i < state.size(); i++)
-        {
-            posteriorInState.push_back(partHypotheses[state[i]].posterior);
-        }
-
-        std::vector<float> rouletteRussian;
-
-        computeRussianRoulette(posteriorInState, rouletteRussian);
-        const float rouletteNum = rouletteDist(g);
+        // Parts with low posterior die more frequently
+        deathPart = roulette.locate(state, roulette.sample(rouletteDist(g)));
 
-        for(size_t i = state.size(); i>0; i--)
+        if (deathPart < 0)
         {
-            if( rouletteNum >= rouletteRussian[i-1] && rouletteNum <= rouletteRussian[i] )
-            {
-                deathPart = i-1;
-                //std::cout<<" added part: "<<deathPart<<" out of :"<<state.size()<<" with roulette number: "<<rouletteNum<<std::endl;
-                break;
-            }
+            std::uniform_int_distribution<int> stateDist(0, static_cast<int>(state.size() - 1));
+            deathPart = stateDist(g);
         }
     #else
 
@@ -407,6 +418,7 @@ void MCMCParserDeathMove::move(
         deathPart = stateDist(g);//random selection
     #endif
 
+        diedParts.push_back(state[deathPart]);
         newState.erase(newState.begin() + deathPart);
 
 
@@ -437,6 +449,60 @@ void MCMCParserDeathMove::move(
 
 }
 
+void MCMCParserDeathMove::move(
+    const MCMCParserBitsetState & state,
+    MCMCParserBitsetState & newState,
+    float & logAcceptRatio)
+{
+#if DATA_DRIVEN_BIRTH_DEATH
+    SAMove::move(state, newState, logAcceptRatio);
+#else
+    newState.copyFrom(state);
+    logAcceptRatio = 0.0f;
+
+    if (state.size() == 0)
+    {
+        return;
+    }
+
+    int deathPart = -1;
+#if ROULETTE_DEATH
+    // Parts with low posterior die more frequently
+    deathPart = roulette.sample(rouletteDist(g));
+#endif
+    if (deathPart < 0 || !state.contains(deathPart))
+    {
+        // Remove a random part
+        std::uniform_int_distribution<int> stateDist(0, static_cast<int>(state.size() - 1));
+        deathPart = state[stateDist(g)];
+    }
+    newState.remove(deathPart);
+    diedParts.push_back(deathPart);
+    logAcceptRatio = std::log( state.size() );
+#endif
+}
+
+void MCMCParserDeathMove::begin(const MCMCParserStateType & state)
+{
+#if ROULETTE_DEATH
+    roulette.assign(state);
+#endif
+}
+
+void MCMCParserDeathMove::accepted(const std::vector<int> & born, const std::vector<int> & died)
+{
+#if ROULETTE_DEATH
+    for (size_t i = 0; i < died.size(); i++)
+    {
+        roulette.remove(died[i]);
+    }
+    for (size_t i = 0; i < born.size(); i++)
+    {
+        roulette.insert(born[i]);
+    }
+#endif
+}
+
 ///////////////////////////////////////
 /*
  * For data driven moves
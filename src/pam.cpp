@@ -0,0 +1,234 @@
+#include "parser/pam.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace parser;
+
+////////////////////////////////////////////////////////////////////////////////
+//// KMedoids
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The distances of every object to its closest and second closest medoid
+ */
+struct MedoidState {
+    std::vector<int> nearest;
+    std::vector<double> nearestDistance;
+    std::vector<double> secondDistance;
+    /**
+     * The increase of the objective if a medoid is removed
+     */
+    std::vector<double> removalLoss;
+};
+
+/**
+ * Recomputes the state for the given medoids (K >= 2) and returns the
+ * objective
+ */
+static double updateState(const Eigen::MatrixXf & distances, const std::vector<int> & medoids, MedoidState & state)
+{
+    const int N = static_cast<int>(distances.rows());
+    const int K = static_cast<int>(medoids.size());
+
+    state.nearest.resize(N);
+    state.nearestDistance.resize(N);
+    state.secondDistance.resize(N);
+    state.removalLoss.assign(K, 0);
+
+    double objective = 0;
+    for (int o = 0; o < N; o++)
+    {
+        int nearest = 0;
+        double nearestDistance = std::numeric_limits<double>::max();
+        double secondDistance = std::numeric_limits<double>::max();
+        for (int k = 0; k < K; k++)
+        {
+            const double d = distances(o, medoids[k]);
+            if (d < nearestDistance)
+            {
+                secondDistance = nearestDistance;
+                nearestDistance = d;
+                nearest = k;
+            }
+            else if (d < secondDistance)
+            {
+                secondDistance = d;
+            }
+        }
+
+        state.nearest[o] = nearest;
+        state.nearestDistance[o] = nearestDistance;
+        state.secondDistance[o] = secondDistance;
+        state.removalLoss[nearest] += secondDistance - nearestDistance;
+        objective += nearestDistance;
+    }
+    return objective;
+}
+
+float KMedoids::cluster(const Eigen::MatrixXf & distances, int K, std::vector<int> & medoids) const
+{
+    build(distances, K, medoids);
+    const float objective = swap(distances, medoids);
+    std::sort(medoids.begin(), medoids.end());
+    return objective;
+}
+
+void KMedoids::build(const Eigen::MatrixXf & distances, int K, std::vector<int> & medoids) const
+{
+    const int N = static_cast<int>(distances.rows());
+    K = std::max(0, std::min(K, N));
+    medoids.clear();
+    if (K == 0)
+    {
+        return;
+    }
+
+    // The first medoid is the one with the smallest distance sum
+    const Eigen::VectorXd sums = distances.cast<double>().colwise().sum().transpose();
+    int first;
+    sums.minCoeff(&first);
+    medoids.push_back(first);
+
+    std::vector<double> nearestDistance(N);
+    std::vector<bool> isMedoid(N, false);
+    isMedoid[first] = true;
+    for (int o = 0; o < N; o++)
+    {
+        nearestDistance[o] = distances(o, first);
+    }
+
+    while (static_cast<int>(medoids.size()) < K)
+    {
+        int best = -1;
+        double bestGain = -1;
+        for (int c = 0; c < N; c++)
+        {
+            if (isMedoid[c])
+            {
+                continue;
+            }
+
+            double gain = 0;
+            for (int o = 0; o < N; o++)
+            {
+                gain += std::max(nearestDistance[o] - distances(o, c), 0.0);
+            }
+            if (gain > bestGain)
+            {
+                bestGain = gain;
+                best = c;
+            }
+        }
+
+        medoids.push_back(best);
+        isMedoid[best] = true;
+        for (int o = 0; o < N; o++)
+        {
+            nearestDistance[o] = std::min(nearestDistance[o], static_cast<double>(distances(o, best)));
+        }
+    }
+}
+
+float KMedoids::swap(const Eigen::MatrixXf & distances, std::vector<int> & medoids) const
+{
+    const int N = static_cast<int>(distances.rows());
+    const int K = static_cast<int>(medoids.size());
+    if (K == 0)
+    {
+        return 0;
+    }
+
+    if (K == 1)
+    {
+        // The best single medoid is the one with the smallest distance sum
+        const Eigen::VectorXd sums = distances.cast<double>().colwise().sum().transpose();
+        sums.minCoeff(&medoids[0]);
+        return static_cast<float>(sums(medoids[0]));
+    }
+
+    std::vector<bool> isMedoid(N, false);
+    for (int k = 0; k < K; k++)
+    {
+        isMedoid[medoids[k]] = true;
+    }
+
+    MedoidState state;
+    double objective = updateState(distances, medoids, state);
+    std::vector<double> delta(K);
+
+    for (int iteration = 0; iteration < model.maxIterations; iteration++)
+    {
+        bool swapped = false;
+
+        for (int c = 0; c < N; c++)
+        {
+            if (isMedoid[c])
+            {
+                continue;
+            }
+
+            // delta[k] + shared is the change of the objective if medoid k is
+            // replaced by c. Objects that move to c contribute to all k;
+            // otherwise only the removal of the closest medoid matters.
+            delta = state.removalLoss;
+            double shared = 0;
+            for (int o = 0; o < N; o++)
+            {
+                const double d = distances(o, c);
+                const int n = state.nearest[o];
+                if (d < state.nearestDistance[o])
+                {
+                    shared += d - state.nearestDistance[o];
+                    delta[n] += state.nearestDistance[o] - state.secondDistance[o];
+                }
+                else if (d < state.secondDistance[o])
+                {
+                    delta[n] += d - state.secondDistance[o];
+                }
+            }
+
+            const int k = static_cast<int>(std::min_element(delta.begin(), delta.end()) - delta.begin());
+            if (delta[k] + shared < -model.tolerance*objective)
+            {
+                isMedoid[medoids[k]] = false;
+                isMedoid[c] = true;
+                medoids[k] = c;
+                objective = updateState(distances, medoids, state);
+                swapped = true;
+            }
+        }
+
+        if (!swapped)
+        {
+            break;
+        }
+    }
+
+    return static_cast<float>(objective);
+}
+
+float KMedoids::computeAssignments( const Eigen::MatrixXf & distances,
+                                    const std::vector<int> & medoids,
+                                    std::vector<int> & assignments)
+{
+    const int N = static_cast<int>(distances.rows());
+    const int K = static_cast<int>(medoids.size());
+    assignments.assign(N, -1);
+
+    double objective = 0;
+    for (int o = 0; o < N && K > 0; o++)
+    {
+        int nearest = 0;
+        for (int k = 1; k < K; k++)
+        {
+            if (distances(o, medoids[k]) < distances(o, medoids[nearest]))
+            {
+                nearest = k;
+            }
+        }
+        assignments[o] = nearest;
+        objective += distances(o, medoids[nearest]);
+    }
+    return static_cast<float>(objective);
+}
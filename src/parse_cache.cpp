@@ -0,0 +1,305 @@
+#include "parser/parse_cache.h"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <ctime>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+using namespace parser;
+
+/**
+ * The file header and the version of the entry format
+ */
+static const char ENTRY_MAGIC[4] = {'P', 'P', 'C', 'E'};
+static const uint32_t ENTRY_VERSION = 1;
+
+/**
+ * The file extension of entries
+ */
+static const char* ENTRY_EXTENSION = ".parse";
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseCache
+////////////////////////////////////////////////////////////////////////////////
+
+bool ParseCache::open(const std::string & _directory)
+{
+    boost::system::error_code error;
+    boost::filesystem::create_directories(_directory, error);
+    if (!boost::filesystem::is_directory(_directory))
+    {
+        std::cout << "Could not open the cache directory " << _directory << std::endl;
+        directory.clear();
+        return false;
+    }
+
+    directory = _directory;
+
+    // Build the index from the entries on disk, the last write time is the
+    // last use
+    struct Entry {
+        std::time_t time;
+        uintmax_t size;
+        std::string key;
+    };
+
+    std::vector<Entry> entries;
+    for (boost::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        if (!boost::filesystem::is_regular_file(it->path()) || it->path().extension() != ENTRY_EXTENSION)
+        {
+            continue;
+        }
+
+        Entry entry;
+        entry.key = it->path().stem().string();
+        entry.time = boost::filesystem::last_write_time(it->path(), error);
+        entry.size = boost::filesystem::file_size(it->path(), error);
+        if (error)
+        {
+            // The entry was removed by someone else
+            error.clear();
+            continue;
+        }
+        entries.push_back(entry);
+    }
+
+    // Oldest entries first
+    std::sort(entries.begin(), entries.end(), [](const Entry & lhs, const Entry & rhs) -> bool {
+        return lhs.time < rhs.time || (lhs.time == rhs.time && lhs.key < rhs.key);
+    });
+
+    recency.clear();
+    index.clear();
+    totalBytes = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        touch(entries[i].key, entries[i].size);
+    }
+    return true;
+}
+
+std::string ParseCache::computeKey(
+        const cv::Mat & image,
+        const cv::Mat & imageDepth,
+        const Rectangle & region,
+        const std::string & fingerprint)
+{
+    ContentHasher hasher;
+    hasher.updateValue(ENTRY_VERSION);
+    hasher.update(fingerprint);
+    hasher.update(image);
+    hasher.update(imageDepth);
+    for (int v = 0; v < 4; v++)
+    {
+        hasher.updateValue(region[v][0]);
+        hasher.updateValue(region[v][1]);
+    }
+    return hasher.getHex();
+}
+
+std::string ParseCache::getEntryFile(const std::string & key) const
+{
+    return (boost::filesystem::path(directory) / (key + ENTRY_EXTENSION)).string();
+}
+
+bool ParseCache::lookup(const std::string & key, std::vector<Part> & parts)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+
+    const std::string file = getEntryFile(key);
+    if (!readEntry(file, key, parts))
+    {
+        numMisses++;
+        return false;
+    }
+
+    // Mark the entry as recently used, also for other processes
+    boost::system::error_code error;
+    boost::filesystem::last_write_time(file, std::time(0), error);
+    
+    const auto it = index.find(key);
+    touch(key, it != index.end() ? it->second->size : boost::filesystem::file_size(file, error));
+
+    numHits++;
+    return true;
+}
+
+bool ParseCache::contains(const std::string & key) const
+{
+    return isOpen() && boost::filesystem::exists(getEntryFile(key));
+}
+
+void ParseCache::store(const std::string & key, const std::vector<Part> & parts)
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    // Write to a temporary file first such that readers never see partial
+    // entries
+    std::stringstream ss;
+    ss << getEntryFile(key) << ".tmp" << std::hex << ::getpid() << "_" << reinterpret_cast<uintptr_t>(this) << "_" << std::time(0);
+    const std::string tmpFile = ss.str();
+
+    if (!writeEntry(tmpFile, key, parts))
+    {
+        std::cout << "Could not write cache entry " << tmpFile << std::endl;
+        return;
+    }
+
+    boost::system::error_code error;
+    const uintmax_t size = boost::filesystem::file_size(tmpFile, error);
+    boost::filesystem::rename(tmpFile, getEntryFile(key), error);
+    if (error)
+    {
+        boost::filesystem::remove(tmpFile, error);
+        return;
+    }
+
+    touch(key, size);
+    evict();
+}
+
+void ParseCache::evict()
+{
+    if (!isOpen())
+    {
+        return;
+    }
+
+    boost::system::error_code error;
+    while (!recency.empty() && (index.size() > maxEntries || totalBytes > maxBytes))
+    {
+        // The entry might have been removed by someone else already
+        const std::string key = recency.front().key;
+        boost::filesystem::remove(getEntryFile(key), error);
+        forget(key);
+        numEvictions++;
+    }
+}
+
+void ParseCache::touch(const std::string & key, uint64_t size)
+{
+    forget(key);
+    recency.push_back(IndexEntry());
+    recency.back().key = key;
+    recency.back().size = size;
+    index[key] = std::prev(recency.end());
+    totalBytes += size;
+}
+
+void ParseCache::forget(const std::string & key)
+{
+    const auto it = index.find(key);
+    if (it == index.end())
+    {
+        return;
+    }
+    totalBytes -= it->second->size;
+    recency.erase(it->second);
+    index.erase(it);
+}
+
+void ParseCache::listKeys(std::vector<std::string> & keys) const
+{
+    keys.clear();
+    if (!isOpen())
+    {
+        return;
+    }
+
+    boost::system::error_code error;
+    for (boost::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        if (boost::filesystem::is_regular_file(it->path()) && it->path().extension() == ENTRY_EXTENSION)
+        {
+            keys.push_back(it->path().stem().string());
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+}
+
+bool ParseCache::writeEntry(const std::string & file, const std::string & key, const std::vector<Part> & parts)
+{
+    std::string buffer;
+    beginFile(buffer, ENTRY_MAGIC, ENTRY_VERSION);
+    appendValue(buffer, static_cast<uint32_t>(key.size()));
+    buffer.append(key);
+    appendValue(buffer, static_cast<uint32_t>(parts.size()));
+
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        appendRectangle(buffer, parts[p].rect);
+        appendValue(buffer, static_cast<int32_t>(parts[p].label));
+        appendValue(buffer, parts[p].posterior);
+        appendValue(buffer, parts[p].likelihood);
+        appendValue(buffer, parts[p].shapePrior);
+        appendValue(buffer, parts[p].meanDepth);
+    }
+
+    return finishFile(file, buffer);
+}
+
+bool ParseCache::readEntry(const std::string & file, const std::string & key, std::vector<Part> & parts)
+{
+    std::string buffer;
+    size_t offset;
+    if (!readFile(file, ENTRY_MAGIC, ENTRY_VERSION, buffer, offset))
+    {
+        return false;
+    }
+
+    uint32_t keySize, numParts;
+    if (!readValue(buffer, offset, keySize))
+    {
+        return false;
+    }
+    if (keySize > buffer.size() - offset || buffer.compare(offset, keySize, key) != 0)
+    {
+        return false;
+    }
+    offset += keySize;
+    if (!readValue(buffer, offset, numParts))
+    {
+        return false;
+    }
+
+    // Check the number of parts before allocating them
+    const size_t partSize = 8*sizeof(float) + sizeof(int32_t) + sizeof(Part::posterior) + 
+            sizeof(Part::likelihood) + sizeof(Part::shapePrior) + sizeof(Part::meanDepth);
+    if (numParts > (buffer.size() - offset)/partSize)
+    {
+        return false;
+    }
+
+    std::vector<Part> result(numParts);
+    for (uint32_t p = 0; p < numParts; p++)
+    {
+        int32_t label;
+        if (!readRectangle(buffer, offset, result[p].rect) ||
+            !readValue(buffer, offset, label) ||
+            !readValue(buffer, offset, result[p].posterior) ||
+            !readValue(buffer, offset, result[p].likelihood) ||
+            !readValue(buffer, offset, result[p].shapePrior) ||
+            !readValue(buffer, offset, result[p].meanDepth))
+        {
+            return false;
+        }
+        result[p].label = label;
+    }
+
+    // Trailing bytes indicate a corrupted entry, the output is left untouched
+    if (offset != buffer.size())
+    {
+        return false;
+    }
+    parts.swap(result);
+    return true;
+}
@@ -0,0 +1,360 @@
+#include "parser/parse_record.h"
+#include "parser/serialization.h"
+#include "parser/util.h"
+
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+using namespace parser;
+
+/**
+ * The file header and the version of the record format
+ */
+static const char RECORD_MAGIC[4] = {'P', 'P', 'R', 'R'};
+static const uint32_t RECORD_VERSION = 1;
+
+/**
+ * Appends a list of values as count followed by the values of type S
+ */
+template <class S, class T>
+static void appendList(std::string & buffer, const std::vector<T> & values)
+{
+    appendValue(buffer, static_cast<uint32_t>(values.size()));
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        appendValue(buffer, static_cast<S>(values[i]));
+    }
+}
+
+/**
+ * Reads a list that has been written by appendList
+ */
+template <class S, class T>
+static bool readList(const std::string & buffer, size_t & offset, std::vector<T> & values)
+{
+    uint32_t size;
+    if (!readValue(buffer, offset, size) || offset + size*sizeof(S) > buffer.size())
+    {
+        return false;
+    }
+    values.resize(size);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        S value;
+        readValue(buffer, offset, value);
+        values[i] = static_cast<T>(value);
+    }
+    return true;
+}
+
+/**
+ * Appends a list of rectangles
+ */
+static void appendRectangles(std::string & buffer, const std::vector<Rectangle> & rectangles)
+{
+    appendValue(buffer, static_cast<uint32_t>(rectangles.size()));
+    for (size_t r = 0; r < rectangles.size(); r++)
+    {
+        appendRectangle(buffer, rectangles[r]);
+    }
+}
+
+/**
+ * Reads a list of rectangles
+ */
+static bool readRectangles(const std::string & buffer, size_t & offset, std::vector<Rectangle> & rectangles)
+{
+    uint32_t size;
+    if (!readValue(buffer, offset, size) || size > (buffer.size() - offset)/(8*sizeof(float)))
+    {
+        return false;
+    }
+    rectangles.resize(size);
+    for (uint32_t r = 0; r < size; r++)
+    {
+        readRectangle(buffer, offset, rectangles[r]);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseRecord
+////////////////////////////////////////////////////////////////////////////////
+
+void ParseRecord::clear()
+{
+    id.clear();
+    rectangles.clear();
+    hypothesisRectangles.clear();
+    hypothesisLabels.clear();
+    hypothesisPosteriors.clear();
+    bestState.clear();
+    groundTruth.clear();
+    groundTruthLabels.clear();
+}
+
+bool ParseRecord::write(const std::string & file, const ParseRecord & record)
+{
+    std::string buffer;
+    beginFile(buffer, RECORD_MAGIC, RECORD_VERSION);
+    appendValue(buffer, static_cast<uint32_t>(record.id.size()));
+    buffer.append(record.id);
+
+    appendRectangles(buffer, record.rectangles);
+    appendList<int32_t>(buffer, record.hypothesisRectangles);
+    appendList<int32_t>(buffer, record.hypothesisLabels);
+    appendList<float>(buffer, record.hypothesisPosteriors);
+    appendList<int32_t>(buffer, record.bestState);
+    appendRectangles(buffer, record.groundTruth);
+    appendList<int32_t>(buffer, record.groundTruthLabels);
+
+    return finishFile(file, buffer);
+}
+
+bool ParseRecord::read(const std::string & file, ParseRecord & record)
+{
+    std::string buffer;
+    size_t offset;
+    uint32_t idSize;
+    if (!readFile(file, RECORD_MAGIC, RECORD_VERSION, buffer, offset) || !readValue(buffer, offset, idSize) || idSize > buffer.size() - offset)
+    {
+        return false;
+    }
+
+    ParseRecord result;
+    result.id = buffer.substr(offset, idSize);
+    offset += idSize;
+
+    if (!readRectangles(buffer, offset, result.rectangles) ||
+        !readList<int32_t>(buffer, offset, result.hypothesisRectangles) ||
+        !readList<int32_t>(buffer, offset, result.hypothesisLabels) ||
+        !readList<float>(buffer, offset, result.hypothesisPosteriors) ||
+        !readList<int32_t>(buffer, offset, result.bestState) ||
+        !readRectangles(buffer, offset, result.groundTruth) ||
+        !readList<int32_t>(buffer, offset, result.groundTruthLabels))
+    {
+        return false;
+    }
+
+    // The references have to be consistent
+    const size_t numHypotheses = result.hypothesisRectangles.size();
+    if (result.hypothesisLabels.size() != numHypotheses || result.hypothesisPosteriors.size() != numHypotheses || result.groundTruthLabels.size() != result.groundTruth.size())
+    {
+        return false;
+    }
+    for (size_t h = 0; h < numHypotheses; h++)
+    {
+        if (result.hypothesisRectangles[h] < 0 || result.hypothesisRectangles[h] >= static_cast<int>(result.rectangles.size()))
+        {
+            return false;
+        }
+    }
+    for (size_t s = 0; s < result.bestState.size(); s++)
+    {
+        if (result.bestState[s] < 0 || result.bestState[s] >= static_cast<int>(numHypotheses))
+        {
+            return false;
+        }
+    }
+
+    record = result;
+    return offset == buffer.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// PrecisionRecallPoint
+////////////////////////////////////////////////////////////////////////////////
+
+void PrecisionRecallPoint::writeJson(std::ostream & os) const
+{
+    os << std::setprecision(6);
+    os << "{\"acceptance\":" << acceptanceThreshold
+       << ",\"posterior\":" << posteriorThreshold
+       << ",\"pruning\":" << pruningThreshold
+       << ",\"precision\":" << getPrecision()
+       << ",\"recall\":" << getRecall()
+       << ",\"f1\":" << getF1()
+       << ",\"label_accuracy\":" << getLabelAccuracy()
+       << ",\"proposal_recall\":" << getProposalRecall()
+       << ",\"ground_truth\":" << numGroundTruth
+       << ",\"detected\":" << numDetected
+       << ",\"proposals\":" << numProposals
+       << "}\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseRecordEvaluator
+////////////////////////////////////////////////////////////////////////////////
+
+void ParseRecordEvaluator::add(const ParseRecord & record)
+{
+    Entry entry;
+    const size_t numRectangles = record.rectangles.size();
+    const size_t numGroundTruth = record.groundTruth.size();
+
+    entry.overlaps.resize(numRectangles*numGroundTruth);
+    for (size_t r = 0; r < numRectangles; r++)
+    {
+        for (size_t g = 0; g < numGroundTruth; g++)
+        {
+            entry.overlaps[r*numGroundTruth + g] = RectangleUtil::calcIOU(record.rectangles[r], record.groundTruth[g]);
+        }
+    }
+
+    entry.maxPosteriors.assign(numRectangles, 0);
+    for (size_t h = 0; h < record.hypothesisRectangles.size(); h++)
+    {
+        float & maxPosterior = entry.maxPosteriors[record.hypothesisRectangles[h]];
+        maxPosterior = std::max(maxPosterior, record.hypothesisPosteriors[h]);
+    }
+
+    for (size_t s = 0; s < record.bestState.size(); s++)
+    {
+        const int h = record.bestState[s];
+        entry.selectedRectangles.push_back(record.hypothesisRectangles[h]);
+        entry.selectedLabels.push_back(record.hypothesisLabels[h]);
+        entry.selectedPosteriors.push_back(record.hypothesisPosteriors[h]);
+    }
+
+    entry.groundTruthLabels = record.groundTruthLabels;
+    entries.push_back(entry);
+}
+
+int ParseRecordEvaluator::addDirectory(const std::string & directory)
+{
+    if (!boost::filesystem::is_directory(directory))
+    {
+        return -1;
+    }
+
+    // Sort the files such that the order does not depend on the file system
+    std::vector<std::string> files;
+    for (boost::filesystem::directory_iterator it(directory), end; it != end; ++it)
+    {
+        if (boost::filesystem::is_regular_file(it->path()) && it->path().extension() == ".record")
+        {
+            files.push_back(it->path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    int numAdded = 0;
+    for (size_t f = 0; f < files.size(); f++)
+    {
+        ParseRecord record;
+        if (!ParseRecord::read(files[f], record))
+        {
+            std::cout << "Skipping corrupted record " << files[f] << "\n";
+            continue;
+        }
+        add(record);
+        numAdded++;
+    }
+    return numAdded;
+}
+
+void ParseRecordEvaluator::evaluate(float acceptanceThreshold, float posteriorThreshold, float pruningThreshold, PrecisionRecallPoint & point) const
+{
+    point = PrecisionRecallPoint();
+    point.acceptanceThreshold = acceptanceThreshold;
+    point.posteriorThreshold = posteriorThreshold;
+    point.pruningThreshold = pruningThreshold;
+
+    for (size_t e = 0; e < entries.size(); e++)
+    {
+        const Entry & entry = entries[e];
+        const size_t numGroundTruth = entry.groundTruthLabels.size();
+        const size_t numRectangles = entry.maxPosteriors.size();
+        point.numGroundTruth += static_cast<int>(numGroundTruth);
+
+        // The proposals that survive the pruning
+        std::vector<bool> proposalFound(numGroundTruth, false);
+        for (size_t r = 0; r < numRectangles; r++)
+        {
+            if (entry.maxPosteriors[r] < pruningThreshold)
+            {
+                continue;
+            }
+            point.numProposals++;
+            for (size_t g = 0; g < numGroundTruth; g++)
+            {
+                if (entry.overlaps[r*numGroundTruth + g] >= acceptanceThreshold)
+                {
+                    proposalFound[g] = true;
+                }
+            }
+        }
+        point.numProposalsFound += static_cast<int>(std::count(proposalFound.begin(), proposalFound.end(), true));
+
+        // The selected parts with a sufficient posterior
+        std::vector<int> selected;
+        for (size_t s = 0; s < entry.selectedRectangles.size(); s++)
+        {
+            if (entry.selectedPosteriors[s] >= posteriorThreshold)
+            {
+                selected.push_back(static_cast<int>(s));
+            }
+        }
+        point.numDetected += static_cast<int>(selected.size());
+
+        // Precision: Every detection that matches some ground truth part
+        for (size_t i = 0; i < selected.size(); i++)
+        {
+            const int r = entry.selectedRectangles[selected[i]];
+            float maxIOU = 0;
+            for (size_t g = 0; g < numGroundTruth; g++)
+            {
+                maxIOU = std::max(maxIOU, entry.overlaps[r*numGroundTruth + g]);
+            }
+            if (maxIOU >= acceptanceThreshold)
+            {
+                point.numTrueDetected++;
+            }
+        }
+
+        // Recall: Every ground truth part with a matching detection. The
+        // label is taken from the best matching detection.
+        for (size_t g = 0; g < numGroundTruth; g++)
+        {
+            float maxIOU = 0;
+            int maxS = -1;
+            for (size_t i = 0; i < selected.size(); i++)
+            {
+                const float iou = entry.overlaps[entry.selectedRectangles[selected[i]]*numGroundTruth + g];
+                if (iou > maxIOU)
+                {
+                    maxIOU = iou;
+                    maxS = selected[i];
+                }
+            }
+            if (maxS >= 0 && maxIOU >= acceptanceThreshold)
+            {
+                point.numFound++;
+                if (entry.selectedLabels[maxS] == entry.groundTruthLabels[g])
+                {
+                    point.numLabelCorrect++;
+                }
+            }
+        }
+    }
+}
+
+void ParseRecordEvaluator::sweep(   const std::vector<float> & acceptanceThresholds,
+                                    const std::vector<float> & posteriorThresholds,
+                                    const std::vector<float> & pruningThresholds,
+                                    std::vector<PrecisionRecallPoint> & points) const
+{
+    const int numPoints = static_cast<int>(acceptanceThresholds.size()*posteriorThresholds.size()*pruningThresholds.size());
+    points.resize(numPoints);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int p = 0; p < numPoints; p++)
+    {
+        const int k = p % static_cast<int>(pruningThresholds.size());
+        const int j = (p/static_cast<int>(pruningThresholds.size())) % static_cast<int>(posteriorThresholds.size());
+        const int i = p/static_cast<int>(pruningThresholds.size()*posteriorThresholds.size());
+        evaluate(acceptanceThresholds[i], posteriorThresholds[j], pruningThresholds[k], points[p]);
+    }
+}
@@ -3,9 +3,12 @@
 #include <set>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <exception>
 #include <boost/filesystem.hpp>
 #include <netdb.h>
 #include <algorithm>
+#include <numeric>
 #include <regex>
 #include <cmath>
 #include <chrono>
@@ -21,11 +24,17 @@
 #include "parser/jump_moves.h"
 #include "parser/diffuse_moves.h"
 #include "parser/rjmcmc_sa.h"
+#include "parser/hypothesis_table.h"
+#include "parser/similarity_index.h"
+#include "parser/parse_cache.h"
+#include "parser/sequence.h"
+#include "parser/parse_record.h"
+#include "parser/codebook.h"
+#include "parser/shape_prior.h"
 #include "libforest/libforest.h"
-#include "gurobi_c++.h"
 #include <boost/filesystem.hpp>
 #include "parser/canny.h"
-#include "pam.h"
+#include "parser/pam.h"
 
 
 
@@ -59,6 +68,34 @@ float rectangleAcceptanceThreshold = 0.65;
 float rectangleDetectionThreshold = 6;// High Recall (low precision, almost fixed F1 measure) with high value (but over segmentation)
 const float pruningThreshold = 0.65;
 
+/**
+ * Returns the name of the float edge detector forest that is used for 
+ * parsing (see EDGE_DETECTOR_COMPRESSED)
+ */
+static std::string getEdgeDetectorName(int depthFlag)
+{
+    std::string name = depthFlag == 0 ? "edge_model" : "edge_model_depth";
+#if EDGE_DETECTOR_COMPRESSED
+    name += "_compressed";
+#endif
+    return name;
+}
+
+/**
+ * Returns the file of the edge detector forest that is used for parsing 
+ * (see EDGE_DETECTOR_QUANTIZED and EDGE_DETECTOR_MAPPED)
+ */
+static std::string getEdgeDetectorFile(int depthFlag)
+{
+#if EDGE_DETECTOR_QUANTIZED
+    return getEdgeDetectorName(depthFlag) + "_quantized.bin";
+#elif EDGE_DETECTOR_MAPPED
+    return getEdgeDetectorName(depthFlag) + "_mapped.bin";
+#else
+    return getEdgeDetectorName(depthFlag) + ".bin";
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //// CabinetParser
 ////////////////////////////////////////////////////////////////////////////////
@@ -67,6 +104,152 @@ void CabinetParser::parse(  const cv::Mat & image,
                             const cv::Mat & imageDepth,
                             const Rectangle & regionOfInterest, 
                             std::vector<Part> & parts)
+{
+    instrumentation.beginRecord();
+    ScopedTimer totalTimer(instrumentation, "total");
+    
+    // Look up the result of earlier runs on the same input
+    std::string cacheKey;
+    if (cache != 0 && cache->isOpen())
+    {
+        ScopedTimer cacheTimer(instrumentation, "cache_lookup");
+        cacheKey = ParseCache::computeKey(image, imageDepth, regionOfInterest, getModelFingerprint());
+        const bool hit = cache->lookup(cacheKey, parts);
+        cacheTimer.stop();
+        
+        instrumentation.setCounter("cache_hit", hit ? 1 : 0);
+        instrumentation.setCounter("cache_hits", cache->getNumHits());
+        instrumentation.setCounter("cache_misses", cache->getNumMisses());
+        if (hit)
+        {
+            std::cout << "Using cached result " << cacheKey << std::endl;
+            return;
+        }
+    }
+    
+    parseRegion(image, imageDepth, regionOfInterest, parts);
+    
+    if (!cacheKey.empty())
+    {
+        cache->store(cacheKey, parts);
+        instrumentation.setCounter("cache_evictions", cache->getNumEvictions());
+    }
+}
+
+void CabinetParser::parse(  const cv::Mat & image,
+                            const cv::Mat & imageDepth,
+                            const std::vector<Rectangle> & regions, 
+                            std::vector< std::vector<Part> > & results)
+{
+    instrumentation.beginRecord();
+    ScopedTimer totalTimer(instrumentation, "total");
+    instrumentation.setCounter("num_regions", regions.size());
+    
+    results.assign(regions.size(), std::vector<Part>());
+    
+    // Look up the regions in the cache. The cache is not thread safe, hence 
+    // all lookups and stores are done outside of the parallel section
+    std::vector<std::string> cacheKeys(regions.size());
+    std::vector<int> pending;
+    for (size_t r = 0; r < regions.size(); r++)
+    {
+        if (cache != 0 && cache->isOpen())
+        {
+            ScopedTimer cacheTimer(instrumentation, "cache_lookup");
+            cacheKeys[r] = ParseCache::computeKey(image, imageDepth, regions[r], getModelFingerprint());
+            if (cache->lookup(cacheKeys[r], results[r]))
+            {
+                continue;
+            }
+        }
+        pending.push_back(static_cast<int>(r));
+    }
+    if (cache != 0 && cache->isOpen())
+    {
+        instrumentation.setCounter("cache_hits", cache->getNumHits());
+        instrumentation.setCounter("cache_misses", cache->getNumMisses());
+    }
+    
+    if (pending.size() > 0)
+    {
+        // Load the models once for all regions
+        ScopedTimer loadTimer(instrumentation, "load_models");
+        std::shared_ptr<EdgeDetectorForest> forests[2];
+        for (int depthFlag = 0; depthFlag < 2; depthFlag++)
+        {
+            forests[depthFlag] = edgeDetectors[depthFlag] ? edgeDetectors[depthFlag] : loadEdgeDetector(depthFlag);
+        }
+        std::shared_ptr<const SelectionModels> models = selectionModels ? selectionModels : loadSelectionModels();
+        loadTimer.stop();
+        
+        // Every region is parsed by its own parser such that the 
+        // instrumentation records do not interfere. If there is only one 
+        // region, the stages are parallelized instead.
+        ScopedTimer regionsTimer(instrumentation, "regions");
+        std::exception_ptr error;
+        
+        #pragma omp parallel for schedule(dynamic, 1) if(pending.size() > 1)
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            const int r = pending[i];
+            
+            CabinetParser worker;
+            worker.parameters = parameters;
+            worker.edgeDetectors[0] = forests[0];
+            worker.edgeDetectors[1] = forests[1];
+            worker.selectionModels = models;
+            worker.getInstrumentation().setEnabled(instrumentation.isEnabled());
+            
+            try 
+            {
+                worker.getInstrumentation().beginRecord();
+                worker.parseRegion(image, imageDepth, regions[r], results[r]);
+            }
+            catch (...)
+            {
+                #pragma omp critical
+                error = std::current_exception();
+            }
+            
+            instrumentation.addRecord(worker.getInstrumentation().getRecord());
+        }
+        regionsTimer.stop();
+        
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+    
+    if (cache != 0 && cache->isOpen())
+    {
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            cache->store(cacheKeys[pending[i]], results[pending[i]]);
+        }
+        instrumentation.setCounter("cache_evictions", cache->getNumEvictions());
+    }
+}
+
+void CabinetParser::parseSequenceFrame(const cv::Mat & image,
+                                        const cv::Mat & imageDepth,
+                                        const Rectangle & regionOfInterest, 
+                                        SequenceState & sequence,
+                                        std::vector<Part> & parts)
+{
+    instrumentation.beginRecord();
+    ScopedTimer totalTimer(instrumentation, "total");
+    
+    parseRegion(image, imageDepth, regionOfInterest, parts, &sequence);
+    instrumentation.setCounter("sequence_frames", sequence.numFrames);
+    instrumentation.setCounter("sequence_warm_frames", sequence.numWarmFrames);
+}
+
+void CabinetParser::parseRegion(const cv::Mat & image,
+                                const cv::Mat & imageDepth,
+                                const Rectangle & regionOfInterest, 
+                                std::vector<Part> & parts,
+                                SequenceState* sequence)
 {
     // Compute the multi channel image. For this purpose, we need to warp the 
     // region of interest
@@ -114,10 +297,12 @@ void CabinetParser::parse(  const cv::Mat & image,
 #endif
 
     // Get the canny edge image
+    ScopedTimer cannyTimer(instrumentation, "canny");
     std::vector<cv::Mat> channels;
     cv::split(rectifiedMultiChannelImage, channels);
     cv::Mat cannyEdges;
     Processing::computeCannyEdges(channels[EDGE_DETECTOR_CHANNEL_INTENSITY], cannyEdges);
+    cannyTimer.stop();
     
 #if 0
     // Get the canny edge depth image
@@ -170,10 +355,36 @@ void CabinetParser::parse(  const cv::Mat & image,
 	cv::waitKey();
 #endif
         
-    // Detect rectangles
+    // Detect rectangles. In sequence mode, we try to start from the last
+    // frame.
     std::vector<Rectangle> partHypotheses;
-    detectRectangles(edgeImage, cannyEdges, partHypotheses);
+    std::vector<Part> trackedParts;
+    bool warm = false;
+    if (sequence != 0)
+    {
+        std::vector<Rectangle> trackedProposals;
+        if (sequence->canWarmStart(regionOfInterest, edgeImage, parameters.rectifiedROISize, trackedProposals, trackedParts))
+        {
+            const int numKept = detectRectangles(edgeImage, cannyEdges, trackedProposals, sequence->model.numSamples, partHypotheses);
+            warm = numKept > 0 && numKept >= sequence->model.minTrackedProposals*trackedProposals.size();
+            instrumentation.setCounter("tracked_proposals", numKept);
+        }
+        instrumentation.setCounter("sequence_warm", warm ? 1 : 0);
+    }
+    if (!warm)
+    {
+        partHypotheses.clear();
+        detectRectangles(edgeImage, cannyEdges, partHypotheses);
+    }
     std::cout << std::setw(5) << partHypotheses.size() << " rectangles detected" << std::endl;
+    instrumentation.setCounter("proposals", partHypotheses.size());
+    
+    // The hypotheses are augmented by selectParts
+    std::vector<Rectangle> detectedProposals;
+    if (sequence != 0)
+    {
+        detectedProposals = partHypotheses;
+    }
 
 #if 0
     cv::Mat demo(rectifiedMultiChannelImage.rows, rectifiedMultiChannelImage.cols, CV_8UC3);
@@ -211,8 +422,97 @@ void CabinetParser::parse(  const cv::Mat & image,
      * Proposal Selection using RJMCMC
      */
     std::cout<<"Selecting from un-Pruned pool of rectangles"<<std::endl;
-    selectParts(rectifiedMultiChannelImage, intensityDepth, edgeImage, partHypotheses, parts);
+    if (warm)
+    {
+        selectParts(rectifiedMultiChannelImage, intensityDepth, edgeImage, partHypotheses, parts, &trackedParts, sequence->model.warmStartTemperature);
+    }
+    else
+    {
+        selectParts(rectifiedMultiChannelImage, intensityDepth, edgeImage, partHypotheses, parts);
+    }
+    
+    if (sequence != 0)
+    {
+        sequence->update(regionOfInterest, edgeImage, detectedProposals, parts, warm);
+    }
+}
 
+const std::string & CabinetParser::getModelFingerprint()
+{
+    if (!modelFingerprint.empty())
+    {
+        return modelFingerprint;
+    }
+    
+    ContentHasher hasher;
+    
+    // The models that are loaded from the working directory
+    const std::string modelFiles[] = {getEdgeDetectorFile(0), getEdgeDetectorFile(1), 
+            "codebook.dat", "class0vsAllSVM.xml", "class1vsAllSVM.xml", "class2vsAllSVM.xml", "shapePrior.dat", "trainParameters.yml"};
+    
+    for (size_t f = 0; f < sizeof(modelFiles)/sizeof(modelFiles[0]); f++)
+    {
+        hasher.update(std::string(modelFiles[f]));
+        
+        std::ifstream is(modelFiles[f], std::ios::binary);
+        if (!is.is_open())
+        {
+            hasher.update(std::string("missing"));
+            continue;
+        }
+        
+        char buffer[65536];
+        while (is.read(buffer, sizeof(buffer)) || is.gcount() > 0)
+        {
+            hasher.update(buffer, static_cast<size_t>(is.gcount()));
+        }
+    }
+    
+    // The parameters that change the result
+    std::stringstream ss;
+    ss << "INCLUDE_DEPTH=" << INCLUDE_DEPTH
+            << " SPLIT_MERGE_AUGMENT=" << SPLIT_MERGE_AUGMENT
+            << " PROJ_PROF_THRESH=" << PROJ_PROF_THRESH
+            << " MERGE_ALLOWANCE=" << MERGE_ALLOWANCE
+            << " CLUSTER_MAX_IOU=" << CLUSTER_MAX_IOU
+            << " MAX_OVERLAP=" << MAX_OVERLAP
+            << " STEEPNESS=" << STEEPNESS
+            << " INIT_PROB_BIRTH=" << INIT_PROB_BIRTH
+            << " INIT_PROB_DEATH=" << INIT_PROB_DEATH
+            << " INIT_PROB_SPLIT=" << INIT_PROB_SPLIT
+            << " INIT_PROB_MERGE=" << INIT_PROB_MERGE
+            << " INIT_PROB_LABEL_DIFFUSE=" << INIT_PROB_LABEL_DIFFUSE
+            << " INIT_PROB_EXCHANGE_DATADRIVEN=" << INIT_PROB_EXCHANGE_DATADRIVEN
+            << " INIT_PROB_UPDATE_CENTER=" << INIT_PROB_UPDATE_CENTER
+            << " INIT_PROB_UPDATE_WIDTH=" << INIT_PROB_UPDATE_WIDTH
+            << " INIT_PROB_UPDATE_HEIGHT=" << INIT_PROB_UPDATE_HEIGHT
+            << " MAX_TEMP=" << MAX_TEMP
+            << " MIN_TEMP=" << MIN_TEMP
+            << " ALPHA=" << ALPHA
+            << " MAX_UPDATE_ITER=" << MAX_UPDATE_ITER
+            << " NUM_INNER_LOOPS=" << NUM_INNER_LOOPS
+            << " DUMMY_MCMC_LOGIC=" << DUMMY_MCMC_LOGIC
+            << " ADAPTIVE_COOLING=" << ADAPTIVE_COOLING
+            << " ADAPTIVE_COOLING_GAIN=" << ADAPTIVE_COOLING_GAIN
+            << " PLATEAU_ITER=" << PLATEAU_ITER
+            << " PLATEAU_TOLERANCE=" << PLATEAU_TOLERANCE
+            << " SA_TIME_BUDGET=" << SA_TIME_BUDGET
+            << " BITSET_STATE=" << BITSET_STATE
+            << " ROULETTE_EXCHANGE=" << ROULETTE_EXCHANGE
+            << " ROULETTE_DEATH=" << ROULETTE_DEATH
+            << " DATA_DRIVEN_BIRTH_DEATH=" << DATA_DRIVEN_BIRTH_DEATH
+            << " EDGE_DETECTOR_QUANTIZED=" << EDGE_DETECTOR_QUANTIZED
+            << " EDGE_DETECTOR_EARLY_EXIT=" << EDGE_DETECTOR_EARLY_EXIT
+            << " EDGE_DETECTOR_EARLY_EXIT_MARGIN=" << EDGE_DETECTOR_EARLY_EXIT_MARGIN
+            << " EDGE_DETECTOR_MAPPED=" << EDGE_DETECTOR_MAPPED
+            << " rectangleAcceptanceThreshold=" << rectangleAcceptanceThreshold
+            << " rectangleDetectionThreshold=" << rectangleDetectionThreshold
+            << " pruningThreshold=" << pruningThreshold
+            << " rectifiedROISize=" << parameters.rectifiedROISize;
+    hasher.update(ss.str());
+    
+    modelFingerprint = hasher.getHex();
+    return modelFingerprint;
 }
 
 void CabinetParser::visualizeSegmentation(const cv::Mat & image, const Rectangle & ROI, const std::vector<Part> & parts, cv::Mat & display)
@@ -363,8 +663,12 @@ void CabinetParser::removeNonRectanglePixels3(const std::vector<Rectangle> & rec
 void CabinetParser::extractRectifiedMultiChannelImage(const cv::Mat & image, const Rectangle & region, cv::Mat & out)
 {
     // First: Rectify the region of interest
+    ScopedTimer rectifyTimer(instrumentation, "rectify");
     cv::Mat rectifiedRegionOfInterest;
     Processing::rectifyRegion(image, region, parameters.rectifiedROISize, rectifiedRegionOfInterest);
+    rectifyTimer.stop();
+    
+    ScopedTimer multiChannelTimer(instrumentation, "multichannel");
     
     // Convert the image to the to the Luv color space for the feature image
     // as well as to gray scale in order to compute the additional features
@@ -891,47 +1195,6 @@ void CabinetParser::trainEdgeDetector(const std::vector< std::tuple<cv::Mat, Seg
     libf::ConfusionMatrixTool confusionMatrixToolD;
     confusionMatrixToolD.measureAndPrint(forestD, trainingSetD);
 #endif
-
-#if 0
-    // Select a subset of trees
-    int N = forest->getSize();
-    double* distances = new double[N];
-    for (int i = 0; i < N; i++)
-    {
-        for (int j = i+1; j < N; j++)
-        {
-            int disagreements = 0;
-
-            for (int n = 0; n < trainingSet->getSize(); n++)
-            {
-                if (forest->getTree(i)->classify(trainingSet->getDataPoint(n)) != forest->getTree(j)->classify(trainingSet->getDataPoint(n)))
-                {
-                    disagreements--;
-                }
-            }
-
-            distances[i*N + j] = disagreements;
-            distances[j*N + i] = disagreements;
-        }
-    }
-
-    int K = 30;
-    size_t* centers = new size_t[K];
-    size_t* assignments = new size_t[N];
-    double objective;
-    pam(K, N, distances, centers, assignments, &objective);
-
-    delete[] assignments;
-
-    auto newforest = std::make_shared<libf::RandomForest<libf::DecisionTree> >();
-
-    for (int i = 0; i < K; i++)
-    {
-        newforest->addTree(forest->getTree(centers[i]));
-    }
-
-    libf::write("edge_model.bin", *newforest);
-#endif
 }
 
 
@@ -1175,6 +1438,112 @@ void histogram(const cv::Mat & votes, int bins, std::vector<int> & hist)
     }
 }
 
+void CabinetParser::loadModels()
+{
+    for (int depthFlag = 0; depthFlag < 2; depthFlag++)
+    {
+        if (!edgeDetectors[depthFlag])
+        {
+            edgeDetectors[depthFlag] = loadEdgeDetector(depthFlag);
+        }
+    }
+    if (!selectionModels)
+    {
+        selectionModels = loadSelectionModels();
+    }
+}
+
+void CabinetParser::shareModels(const CabinetParser & other)
+{
+    parameters = other.parameters;
+    edgeDetectors[0] = other.edgeDetectors[0];
+    edgeDetectors[1] = other.edgeDetectors[1];
+    selectionModels = other.selectionModels;
+}
+
+bool CabinetParser::setRecordDirectory(const std::string & directory)
+{
+    if (!directory.empty())
+    {
+        boost::system::error_code error;
+        boost::filesystem::create_directories(directory, error);
+        if (!boost::filesystem::is_directory(directory))
+        {
+            std::cout << "Could not create the record directory " << directory << "\n";
+            return false;
+        }
+    }
+    recordDirectory = directory;
+    return true;
+}
+
+std::shared_ptr<EdgeDetectorForest> CabinetParser::loadEdgeDetector(int depthFlag)
+{
+    std::shared_ptr<EdgeDetectorForest> forest = std::make_shared<EdgeDetectorForest>();
+#if EDGE_DETECTOR_MAPPED
+    if(depthFlag == 0 || depthFlag == 1)
+	forest->map(getEdgeDetectorFile(depthFlag));
+#else
+    if(depthFlag == 0 || depthFlag == 1)
+	libf::read(getEdgeDetectorFile(depthFlag), *forest);
+#endif
+    else
+	std::cout<<"Invalid depth flag"<<std::endl;
+    
+#if !EDGE_DETECTOR_QUANTIZED && EDGE_DETECTOR_EARLY_EXIT
+    forest->enableEarlyExit(EDGE_DETECTOR_EARLY_EXIT_MARGIN);
+#endif
+    return forest;
+}
+
+std::shared_ptr<const SelectionModels> CabinetParser::loadSelectionModels()
+{
+    std::shared_ptr<SelectionModels> models = std::make_shared<SelectionModels>();
+    
+    // Load the appearance codebook
+    models->codebooks.resize(5);
+    std::ifstream res("codebook.dat");
+    for (int l = 0; l < 3; l++)
+    {
+        libf::readBinary(res, models->codebooks[l]);
+    }
+    res.close();
+    
+    /**
+     * Read the training parameters
+     */
+    cv::FileStorage fsRead("trainParameters.yml", cv::FileStorage::READ);
+    fsRead ["maxDepthTrain"] >> models->maxDepth;
+    fsRead ["maxAngleRatio"] >> models->maxAngleRatio;
+    fsRead ["maxAspRatioTrain"] >> models->maxAspRatio;
+    fsRead ["maxDWAspRatioTrain"] >> models->maxDWAspRatio;
+    fsRead ["maxDHAspRatioTrain"] >> models->maxDHAspRatio;
+    fsRead ["class0Count"] >> models->partCount[0];
+    fsRead ["class1Count"] >> models->partCount[1];
+    fsRead ["class2Count"] >> models->partCount[2];
+    fsRead.release();
+    
+    /**
+     * probabilistic SVM for shape prior
+     */
+    if (!models->shapePrior.load("shapePrior.dat"))
+    {
+        // Models trained before the export only contain the SVMs
+        models->shapePrior.loadSVMs({"class0vsAllSVM.xml", "class1vsAllSVM.xml", "class2vsAllSVM.xml"});
+    }
+#if INCLUDE_DEPTH
+    const int numShapeFeatures = 7;
+#else
+    const int numShapeFeatures = 4;
+#endif
+    if (models->shapePrior.getNumLabels() != 3 || models->shapePrior.getNumFeatures() != numShapeFeatures)
+    {
+        throw ParserException("Shape prior does not match the features.");
+    }
+    
+    return models;
+}
+
 void CabinetParser::applyEdgeDetector(  const cv::Mat & multiChannelImage, 
                                         cv::Mat & edges, int depthFlag)
 {
@@ -1182,17 +1551,16 @@ void CabinetParser::applyEdgeDetector(  const cv::Mat & multiChannelImage,
     std::vector<cv::Mat> channels;
     cv::split(multiChannelImage, channels);
 #endif
+    ScopedTimer forestTimer(instrumentation, depthFlag == 0 ? "forest_rgb" : "forest_depth");
+    
     // Initialize the output image
     edges = cv::Mat::zeros(multiChannelImage.rows, multiChannelImage.cols, CV_8UC1);
     
-    Forest::ptr forest = std::make_shared<Forest>();
-    if(depthFlag == 0)
-	libf::read("edge_model.bin", *forest);
-    else if(depthFlag == 1)
-	libf::read("edge_model_depth.bin", *forest);
-    else
-	std::cout<<"Invalid depth flag"<<std::endl;
-    
+    std::shared_ptr<EdgeDetectorForest> forest = edgeDetectors[depthFlag];
+    if (!forest)
+    {
+        forest = loadEdgeDetector(depthFlag);
+    }
 
     cv::Mat votes = cv::Mat::zeros(multiChannelImage.rows, multiChannelImage.cols, CV_16S);
 
@@ -1202,7 +1570,11 @@ void CabinetParser::applyEdgeDetector(  const cv::Mat & multiChannelImage,
     //swatch.set_mode(REAL_TIME);
     //swatch.start("My astounding algorithm");
 
-    #pragma omp parallel for
+    // The forest might be shared with other parsers, hence the number of 
+    // evaluated trees is counted here
+    long numTreesEvaluated = 0;
+    
+    #pragma omp parallel for reduction(+:numTreesEvaluated)
     for (int w = 0; w < multiChannelImage.cols - 0; w++)
     {
         libf::DataPoint point(PATCH_SIZE*PATCH_SIZE*EDGE_DETECTOR_CHANNELS);
@@ -1220,11 +1592,22 @@ void CabinetParser::applyEdgeDetector(  const cv::Mat & multiChannelImage,
             {
                 votes.at<short>(h,w) = 0;
             }
+#elif EDGE_DETECTOR_EARLY_EXIT && !EDGE_DETECTOR_QUANTIZED
+            int numTrees = 0;
+            edges.at<uchar>(h,w) = static_cast<uchar>(255* forest->classifyEarlyExit(point, &numTrees));
+            numTreesEvaluated += numTrees;
 #else
             edges.at<uchar>(h,w) = static_cast<uchar>(255* forest->classify(point));
 #endif
         }
     }
+#if EDGE_DETECTOR_EARLY_EXIT && !EDGE_DETECTOR_QUANTIZED
+    const float averageNumTrees = numTreesEvaluated/static_cast<float>(std::max(1, multiChannelImage.rows*multiChannelImage.cols));
+    instrumentation.setCounter(depthFlag == 0 ? "forest_trees_rgb" : "forest_trees_depth", averageNumTrees);
+#if VERBOSE_MODE
+    std::cout << "Average number of trees evaluated: " << averageNumTrees << "/" << forest->getSize() << std::endl;
+#endif
+#endif
 #if 1
     Processing::add1pxBorders(edges);
     return;
@@ -1328,6 +1711,13 @@ void CabinetParser::detectLines(const cv::Mat & image,
 {
     LineDetector detector;
     
+#if AXIS_ALIGNED_LINES
+    // Detect the line segments in the binary image. The minimum length is
+    // increased until there are at most 30 lines. 
+    AxisAlignedLineDetector axisAlignedDetector;
+    const double minLength = axisAlignedDetector.detectLines(image, resultH, resultV);
+    instrumentation.setCounter("line_min_length", minLength);
+#else
     //std::vector<LineSegment> preliminaryH, preliminaryV;
     std::vector<LineSegment> tempResultH;
     std::vector<LineSegment> tempResultV;
@@ -1344,6 +1734,7 @@ void CabinetParser::detectLines(const cv::Mat & image,
 
     resultH = tempResultH;
     resultV = tempResultV;
+#endif
 
     // Remove very short line segments
     //detector.filterShortLines(preliminaryH, resultH);
@@ -1366,15 +1757,60 @@ void CabinetParser::detectLines(const cv::Mat & image,
 }
 
 
+void CabinetParser::recordAnnealingStatistics(const SimulatedAnnealing & sa, const std::string & prefix)
+{
+    if (!instrumentation.isEnabled())
+    {
+        return;
+    }
+    
+    // Same order as the move indices
+    static const char* moveNames[] = {"exchange", "birth", "death", "split", "merge", "label_diffuse", 
+                                      "dd_exchange", "update_center", "update_width", "update_height"};
+    
+    const std::vector<int> & proposed = sa.getNumProposedMoves();
+    const std::vector<int> & accepted = sa.getNumAcceptedMoves();
+    
+    int totalProposed = 0;
+    int totalAccepted = 0;
+    for (size_t m = 0; m < proposed.size(); m++)
+    {
+        totalProposed += proposed[m];
+        totalAccepted += accepted[m];
+        
+        if (proposed[m] > 0 && m < sizeof(moveNames)/sizeof(moveNames[0]))
+        {
+            instrumentation.setCounter(prefix + "accept_rate_" + moveNames[m], accepted[m]/static_cast<double>(proposed[m]));
+        }
+    }
+    
+    instrumentation.setCounter(prefix + "iterations", sa.getNumIterations());
+    instrumentation.setCounter(prefix + "moves", totalProposed);
+    instrumentation.setCounter(prefix + "accepted", totalAccepted);
+    instrumentation.setCounter(prefix + "accept_rate", totalProposed > 0 ? totalAccepted/static_cast<double>(totalProposed) : 0);
+    instrumentation.setCounter(prefix + "termination", sa.getTerminationReason());
+}
+
 void CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cannyEdges, std::vector<Rectangle> & result)
+{
+    std::vector<Rectangle> seeds;
+    detectRectangles(image, cannyEdges, seeds, 0, result);
+}
+
+int CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cannyEdges, const std::vector<Rectangle> & seeds, int numSamples, std::vector<Rectangle> & result)
 {
 
     //std::cout<<"Rectangle Acceptance Threshold: "<<rectangleAcceptanceThreshold<<std::endl;
     //std::cout<<"Rectangle Detection Threshold: "<<rectangleDetectionThreshold<<std::endl;
 
     // Detect line segments
+    ScopedTimer linesTimer(instrumentation, "lines");
     std::vector<LineSegment> lineSegmentsH, lineSegmentsV;
     detectLines(image, lineSegmentsH, lineSegmentsV);
+    linesTimer.stop();
+    instrumentation.setCounter("lines", lineSegmentsH.size() + lineSegmentsV.size());
+    
+    ScopedTimer rectanglesTimer(instrumentation, "rectangles");
 
 #if 0
     Util::imshow(image);
@@ -1423,7 +1859,12 @@ void CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cann
 
     Processing::computeDistanceTransform(computedEdges, inputDist);
 
-    RectangleDetector detector;
+    RectangleDetector::Model detectorModel;
+    if (numSamples > 0)
+    {
+        detectorModel.numSamples = numSamples;
+    }
+    RectangleDetector detector(detectorModel);
 #if 0
 
 #endif
@@ -1438,8 +1879,14 @@ void CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cann
     Processing::computeDistanceTransform(verticalEdges, verticalDistanceTransform);
 #endif
 
-    // Detect the initial set of rectangles
-    detector.detectRectangles(image, lineSegmentsH, lineSegmentsV, result, [& inputDist](const Rectangle & r) -> bool
+#if BORDER_SUPPORT_INDEX
+    // Every rectangle is checked with a few lookups instead of tracing its
+    // borders
+    BorderSupportIndex supportIndex;
+    supportIndex.build(inputDist, rectangleDetectionThreshold);
+    const std::function<bool(const Rectangle &)> isSupported = supportIndex.getPredicate();
+#else
+    auto isSupported = [& inputDist](const Rectangle & r) -> bool
     {
         const float thresh = rectangleDetectionThreshold;
         
@@ -1471,7 +1918,37 @@ void CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cann
         }
         
         return true;
-    });
+    };
+#endif
+    
+    // Keep the seeds that are still supported by the edges. They are clamped
+    // to the image first as the support is traced on the distance transform.
+    Rectangle imageBox(Vec2(0, 0), Vec2(image.cols - 1, 0), Vec2(image.cols - 1, image.rows - 1), Vec2(0, image.rows - 1));
+    int numKept = 0;
+    for (size_t s = 0; s < seeds.size(); s++)
+    {
+        const float x0 = std::max(0.0f, std::min(static_cast<float>(image.cols - 1), static_cast<float>(seeds[s][0][0])));
+        const float x1 = std::max(0.0f, std::min(static_cast<float>(image.cols - 1), static_cast<float>(seeds[s][1][0])));
+        const float y0 = std::max(0.0f, std::min(static_cast<float>(image.rows - 1), static_cast<float>(seeds[s][0][1])));
+        const float y1 = std::max(0.0f, std::min(static_cast<float>(image.rows - 1), static_cast<float>(seeds[s][2][1])));
+        Rectangle seed(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1));
+        
+        // The region of interest box is added below anyway
+        if (seed.getWidth() < 32 || seed.getHeight() < 32 || RectangleUtil::calcIOU(seed, imageBox) > detectorModel.maxIOU)
+        {
+            continue;
+        }
+        
+        if (isSupported(seed))
+        {
+            result.push_back(seed);
+            numKept++;
+        }
+    }
+    
+    // Detect the initial set of rectangles. Rectangles that are too similar
+    // to the seeds are rejected by the detector.
+    detector.detectRectangles(image, lineSegmentsH, lineSegmentsV, result, isSupported);
     
     // Add the region of interest box
     Rectangle r;
@@ -1499,6 +1976,8 @@ void CabinetParser::detectRectangles(const cv::Mat & image, const cv::Mat & cann
     cv::imshow("demo", demo);
     cv::waitKey();
 #endif
+    
+    return numKept;
 }
 
 void CabinetParser::loadImage(const std::string & directory, std::vector< std::tuple<cv::Mat,  Segmentation, cv::Mat > > & images)
@@ -1577,13 +2056,308 @@ void CabinetParser::train(const std::vector< std::tuple<cv::Mat, Segmentation, c
     std::cout << "===================\n";
     trainPartPrior(images);
 
-    
-    // Train the appearances
-    std::cout << "Train appearance codebook\n";
-    std::cout << "===================\n";
-    trainAppearanceCodeBook(images);
-    std::cout << "===================\n";
-    std::cout << "DONE\n";
+    
+    // Train the appearances
+    std::cout << "Train appearance codebook\n";
+    std::cout << "===================\n";
+    trainAppearanceCodeBook(images);
+    std::cout << "===================\n";
+    std::cout << "DONE\n";
+}
+
+void CabinetParser::quantizeEdgeDetector(const std::string & directory)
+{
+    std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat> > validationData;
+    
+    std::cout << "Load validation data from " << directory << "\n";
+    loadImage(directory, validationData);
+    
+    std::cout << "Done loading validation data\n";
+    std::cout << validationData.size() << " images loaded\n\n";
+    
+    quantizeEdgeDetector(validationData);
+}
+
+void CabinetParser::quantizeEdgeDetector(const std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat > > & images)
+{
+    // The feature ranges are fitted on one part of the images and the 
+    // agreement is reported on the held out images. Patches of the same 
+    // image are correlated, hence the images are split and not the patches.
+    std::vector<size_t> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 g(0);
+    std::shuffle(order.begin(), order.end(), g);
+    const size_t numHeldOut = images.size() > 1 ? std::max(static_cast<size_t>(1), images.size()/5) : 0;
+    
+    std::vector< std::pair<cv::Mat, Segmentation > > imagesRGB[2];
+    std::vector< std::pair<cv::Mat, Segmentation > > imagesD[2];
+    
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const std::tuple<cv::Mat, Segmentation, cv::Mat> & image = images[order[i]];
+        const int set = i < numHeldOut ? 1 : 0;
+        imagesRGB[set].push_back(std::make_pair(std::get<0>(image), std::get<1>(image)));
+        imagesD[set].push_back(std::make_pair(std::get<2>(image), std::get<1>(image)));
+    }
+    
+    if (numHeldOut == 0)
+    {
+        std::cout << "Not enough images for a held out set, the agreement is measured on the fitted images\n";
+    }
+    
+    for (int depthFlag = 0; depthFlag < 2; depthFlag++)
+    {
+        const std::string model = getEdgeDetectorName(depthFlag);
+        std::cout << "Quantize " << model << "\n";
+        
+        libf::DataStorage::ptr fitSet = libf::DataStorage::Factory::create();
+        extractEdgeDetectorPatches(fitSet, depthFlag == 0 ? imagesRGB[0] : imagesD[0]);
+        
+        libf::DataStorage::ptr heldOutSet = fitSet;
+        if (numHeldOut > 0)
+        {
+            heldOutSet = libf::DataStorage::Factory::create();
+            extractEdgeDetectorPatches(heldOutSet, depthFlag == 0 ? imagesRGB[1] : imagesD[1]);
+        }
+        
+        Forest forest;
+        libf::read(model + ".bin", forest);
+        
+        libf::QuantizedRandomForest quantized;
+        quantized.quantize(forest, fitSet);
+        libf::write(model + "_quantized.bin", quantized);
+        
+        if (numHeldOut > 0)
+        {
+            std::cout << "Agreement on " << numHeldOut << " held out images\n";
+        }
+        libf::QuantizationTool quantizationTool;
+        quantizationTool.measureAndPrint(forest, quantized, heldOutSet);
+    }
+}
+
+bool CabinetParser::convertEdgeDetector()
+{
+    for (int depthFlag = 0; depthFlag < 2; depthFlag++)
+    {
+        const std::string model = getEdgeDetectorName(depthFlag);
+        std::cout << "Convert " << model << "\n";
+        
+        try
+        {
+            Forest forest;
+            libf::read(model + ".bin", forest);
+            
+            libf::MappedRandomForest mapped;
+            mapped.build(forest);
+            libf::write(model + "_mapped.bin", mapped);
+            
+            std::cout << forest.getSize() << " trees, " << mapped.getNumNodes() << " nodes, " << mapped.getMemorySize() << " bytes\n";
+        }
+        catch (libf::IOException & e)
+        {
+            std::cout << "Could not convert " << model << ".bin: " << e.what() << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+void CabinetParser::compressEdgeDetector(const std::string & directory, int numTrees)
+{
+    std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat> > validationData;
+
+    std::cout << "Load validation data from " << directory << "\n";
+    loadImage(directory, validationData);
+
+    std::cout << "Done loading validation data\n";
+    std::cout << validationData.size() << " images loaded\n\n";
+
+    compressEdgeDetector(validationData, numTrees);
+}
+
+/**
+ * Classifies the S sample points with a subset of the trees given the T x S x C
+ * log posteriors of all trees
+ */
+static void classifyWithTrees(  const std::vector<float> & posteriors,
+                                const std::vector<int> & trees,
+                                int S,
+                                int C,
+                                std::vector<int> & predictions)
+{
+    predictions.resize(S);
+
+    #pragma omp parallel for
+    for (int s = 0; s < S; s++)
+    {
+        std::vector<float> sum(C, 0.0f);
+        for (size_t t = 0; t < trees.size(); t++)
+        {
+            const float* posterior = &posteriors[(static_cast<size_t>(trees[t])*S + s)*C];
+            for (int c = 0; c < C; c++)
+            {
+                sum[c] += posterior[c];
+            }
+        }
+        predictions[s] = static_cast<int>(std::max_element(sum.begin(), sum.end()) - sum.begin());
+    }
+}
+
+/**
+ * Returns the fraction of equal entries
+ */
+static float computeAgreement(const std::vector<int> & a, const std::vector<int> & b)
+{
+    int equal = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        equal += a[i] == b[i] ? 1 : 0;
+    }
+    return a.size() > 0 ? equal/static_cast<float>(a.size()) : 0;
+}
+
+void CabinetParser::compressEdgeDetector(const std::vector< std::tuple<cv::Mat, Segmentation, cv::Mat > > & images, int numTrees)
+{
+    // The number of held-out pixels on which the trees are compared
+    const int maxSamples = 20000;
+
+    std::vector< std::pair<cv::Mat, Segmentation > > imagesRGB;
+    std::vector< std::pair<cv::Mat, Segmentation > > imagesD;
+
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        imagesRGB.push_back(std::make_pair(std::get<0>(images[i]), std::get<1>(images[i])));
+        imagesD.push_back(std::make_pair(std::get<2>(images[i]), std::get<1>(images[i])));
+    }
+
+    const std::string models[2] = {"edge_model", "edge_model_depth"};
+    for (int depthFlag = 0; depthFlag < 2; depthFlag++)
+    {
+        std::cout << "Compress " << models[depthFlag] << "\n";
+
+        libf::DataStorage::ptr validationSet = libf::DataStorage::Factory::create();
+        extractEdgeDetectorPatches(validationSet, depthFlag == 0 ? imagesRGB : imagesD);
+
+        Forest forest;
+        libf::read(models[depthFlag] + ".bin", forest);
+
+        const int T = forest.getSize();
+        if (T == 0 || validationSet->getSize() == 0)
+        {
+            std::cout << "No trees or no validation data\n";
+            continue;
+        }
+
+        // Draw a fixed sample of the validation pixels
+        std::vector<int> sample(validationSet->getSize());
+        std::iota(sample.begin(), sample.end(), 0);
+        std::mt19937 g(0);
+        std::shuffle(sample.begin(), sample.end(), g);
+        sample.resize(std::min(static_cast<int>(sample.size()), maxSamples));
+        const int S = static_cast<int>(sample.size());
+
+        std::vector<int> labels(S);
+        for (int s = 0; s < S; s++)
+        {
+            labels[s] = validationSet->getClassLabel(sample[s]);
+        }
+
+        // Evaluate every tree once. The posteriors of any subset of trees
+        // are sums of these.
+        std::vector<float> posterior;
+        forest.getTree(0)->classLogPosterior(validationSet->getDataPoint(sample[0]), posterior);
+        const int C = static_cast<int>(posterior.size());
+
+        std::vector<float> posteriors(static_cast<size_t>(T)*S*C);
+        std::vector<int> votes(static_cast<size_t>(T)*S);
+
+        #pragma omp parallel for
+        for (int t = 0; t < T; t++)
+        {
+            std::vector<float> treePosterior;
+            for (int s = 0; s < S; s++)
+            {
+                forest.getTree(t)->classLogPosterior(validationSet->getDataPoint(sample[s]), treePosterior);
+                std::copy(treePosterior.begin(), treePosterior.end(), posteriors.begin() + (static_cast<size_t>(t)*S + s)*C);
+                votes[static_cast<size_t>(t)*S + s] = static_cast<int>(std::max_element(treePosterior.begin(), treePosterior.end()) - treePosterior.begin());
+            }
+        }
+
+        // The distance of two trees is the fraction of sample pixels on which
+        // they disagree
+        Eigen::MatrixXf distances = Eigen::MatrixXf::Zero(T, T);
+
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (int i = 0; i < T; i++)
+        {
+            for (int j = i + 1; j < T; j++)
+            {
+                int disagreements = 0;
+                for (int s = 0; s < S; s++)
+                {
+                    disagreements += votes[static_cast<size_t>(i)*S + s] != votes[static_cast<size_t>(j)*S + s] ? 1 : 0;
+                }
+                distances(i, j) = disagreements/static_cast<float>(S);
+                distances(j, i) = distances(i, j);
+            }
+        }
+
+        std::vector<int> allTrees(T);
+        std::iota(allTrees.begin(), allTrees.end(), 0);
+        std::vector<int> reference;
+        classifyWithTrees(posteriors, allTrees, S, C, reference);
+        const float accuracy = computeAgreement(reference, labels);
+
+        // Report the accuracy for a range of sizes. The first trees of the
+        // forest are an uninformed baseline.
+        std::set<int> sizes;
+        for (int k = 1; k <= 8; k++)
+        {
+            sizes.insert(std::max(1, T*k/8));
+        }
+        const int target = std::max(1, std::min(numTrees, T));
+        sizes.insert(target);
+
+        KMedoids kmedoids;
+        std::vector<int> selected;
+        std::stringstream report;
+        report << "trees\taccuracy\tagreement\taccuracy_first_trees\n";
+        for (auto it = sizes.begin(); it != sizes.end(); ++it)
+        {
+            std::vector<int> medoids;
+            kmedoids.cluster(distances, *it, medoids);
+            if (*it == target)
+            {
+                selected = medoids;
+            }
+
+            std::vector<int> predictions;
+            classifyWithTrees(posteriors, medoids, S, C, predictions);
+
+            std::vector<int> firstPredictions;
+            classifyWithTrees(posteriors, std::vector<int>(allTrees.begin(), allTrees.begin() + *it), S, C, firstPredictions);
+
+            report << *it << "\t" << computeAgreement(predictions, labels)
+                    << "\t" << computeAgreement(predictions, reference)
+                    << "\t" << computeAgreement(firstPredictions, labels) << "\n";
+        }
+
+        std::cout << "Accuracy of all " << T << " trees on " << S << " pixels: " << accuracy << "\n";
+        std::cout << report.str() << "\n";
+
+        std::ofstream os(models[depthFlag] + "_compression.txt");
+        os << report.str();
+
+        Forest compressed;
+        for (size_t k = 0; k < selected.size(); k++)
+        {
+            compressed.addTree(forest.getTree(selected[k]));
+        }
+        libf::write(models[depthFlag] + "_compressed.bin", compressed);
+
+        std::cout << "Wrote " << selected.size() << " of " << T << " trees to " << models[depthFlag] << "_compressed.bin\n\n";
+    }
 }
 
 void CabinetParser::test(const std::string & directory)
@@ -1673,10 +2447,15 @@ void CabinetParser::selectParts(
     const cv::Mat & depthImage,    
     const cv::Mat & edgeImage,
     std::vector<Rectangle> & hypotheses,
-    std::vector<Part> & result)
+    std::vector<Part> & result,
+    const std::vector<Part>* initialParts,
+    float startTemperature)
 {
-    // First, we create parts from the hypotheses rectangles.
-    std::vector<Part> partHypotheses;
+    ScopedTimer selectTimer(instrumentation, "select_parts");
+    
+    // First, we create parts from the hypotheses rectangles. Hypothesis h*3+l
+    // is rectangle h with label l.
+    PartHypothesisTable hypothesisTable;
     
     // Compute the canny edge image
     std::vector<cv::Mat> channels;
@@ -1687,19 +2466,12 @@ void CabinetParser::selectParts(
     channels[EDGE_DETECTOR_CHANNEL_INTENSITY].convertTo(intensityImage, CV_8UC1);
     Processing::computeCannyEdges(intensityImage, cannyEdges);
         
-    // Load the appearance codebook
-    std::vector<Eigen::MatrixXf> codebooks(5);
-    std::ifstream res("codebook.dat");
-    for (int l = 0; l < 3; l++)
+    // The models are loaded once and shared between the regions
+    if (!selectionModels)
     {
-        libf::readBinary(res, codebooks[l]);
-        std::stringstream ss;
-        ss << l << "_codebook.csv";
-        std::ofstream o(ss.str());
-        o << codebooks[l];
-        o.close();
+        selectionModels = loadSelectionModels();
     }
-    res.close();
+    const SelectionModels & models = *selectionModels;
     
     cv::Mat gradMag;
     Processing::computeGradientMagnitudeImageFloat(channels[EDGE_DETECTOR_CHANNEL_INTENSITY], gradMag);
@@ -1728,6 +2500,7 @@ void CabinetParser::selectParts(
     int numClusters = OPTIMUM_RECTS;
 
 #if SPLIT_MERGE_AUGMENT
+    ScopedTimer augmentTimer(instrumentation, "augment");
     std::cout <<"Redundany Threshold: "<<CLUSTER_MAX_IOU<<std::endl;
     removeRedundantRects(hypotheses, CLUSTER_MAX_IOU);
     std::cout << std::setw(5) << hypotheses.size() << " possibly different rectangles after redundancy removal" << std::endl;
@@ -1748,6 +2521,8 @@ void CabinetParser::selectParts(
     removeRedundantRects(hypothesesDupli, 0.8f);// TO DO: Tuning
     numClusters = hypothesesDupli.size();
     std::cout <<"Number of rectangle clusters: "<<numClusters<<std::endl;
+    augmentTimer.stop();
+    instrumentation.setCounter("augmented_proposals", hypotheses.size());
 #endif
 
 
@@ -1773,20 +2548,14 @@ void CabinetParser::selectParts(
 #endif
 
     /**
-     * Read the training parameters
+     * The training parameters, the maxima are extended below
      */
-    float maxAspRatio, maxDWAspRatio, maxDHAspRatio, maxDepthGlobal, maxAngleRatio;
-    int partCount[3];
-    cv::FileStorage fsRead("trainParameters.yml", cv::FileStorage::READ);
-    fsRead ["maxDepthTrain"] >> maxDepthGlobal;
-    fsRead ["maxAngleRatio"] >> maxAngleRatio;
-    fsRead ["maxAspRatioTrain"] >> maxAspRatio;
-    fsRead ["maxDWAspRatioTrain"] >> maxDWAspRatio;
-    fsRead ["maxDHAspRatioTrain"] >> maxDHAspRatio;
-    fsRead ["class0Count"] >> partCount[0];
-    fsRead ["class1Count"] >> partCount[1];
-    fsRead ["class2Count"] >> partCount[2];
-    fsRead.release();
+    float maxAspRatio = models.maxAspRatio;
+    float maxDWAspRatio = models.maxDWAspRatio;
+    float maxDHAspRatio = models.maxDHAspRatio;
+    float maxDepthGlobal = models.maxDepth;
+    float maxAngleRatio = models.maxAngleRatio;
+    const int* partCount = models.partCount;
     
 #if 0
     std::cout<<"Maximum Depth Value (Global) from training : "<<maxDepthGlobal<<std::endl;
@@ -1818,8 +2587,6 @@ void CabinetParser::selectParts(
     {
         labelPrior[l] /= normalizeLabels;
     }
-    
-    float meanDepth[hypotheses.size()];
 
     cv::Mat depthImg =  cv::Scalar::all(255) - depthImage;
     cv::Mat rectifiedDepth;
@@ -1837,134 +2604,150 @@ void CabinetParser::selectParts(
     cv::waitKey();
 #endif
 
-    float formFactorH = 0.0f;
-    float angleRatio = 0.0f;
-
-    //#pragma omp parallel for
-    for (size_t h = 0; h < hypotheses.size(); h++)
+    ScopedTimer scoringTimer(instrumentation, "scoring");
+    hypothesisTable.reserve(static_cast<int>(hypotheses.size()), 3);
+    
+    const int numHypotheses = static_cast<int>(hypotheses.size());
+    
+    // Stack the descriptors of the hypotheses and score them against the 
+    // codebooks. The descriptors are long, so they are stacked in chunks of 
+    // fixed size instead of all at once.
+    Eigen::MatrixXf codebookErrors(numHypotheses, 3);
+    {
+        ScopedTimer codebookTimer(instrumentation, "codebook");
+        CodebookScorer scorer;
+        Eigen::MatrixXf descriptors;
+        if (numHypotheses > 0)
+        {
+            libf::DataPoint p, p2;
+            extractDiscretizedAppearanceDataGM(gradMag, hypotheses[0], p, p2);
+            descriptors.resize(p.rows(), std::min(scorer.model.chunkSize, numHypotheses));
+        }
+        
+        for (int begin = 0; begin < numHypotheses; begin += scorer.model.chunkSize)
+        {
+            const int size = std::min(scorer.model.chunkSize, numHypotheses - begin);
+            if (size != descriptors.cols())
+            {
+                descriptors.resize(descriptors.rows(), size);
+            }
+            
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (int h = 0; h < size; h++)
+            {
+                libf::DataPoint p, p2;
+                extractDiscretizedAppearanceDataGM(gradMag, hypotheses[begin + h], p, p2);
+                descriptors.col(h) = p;
+            }
+            
+            Eigen::MatrixXf chunkErrors;
+            scorer.calcErrors(models.codebooks, 3, descriptors, chunkErrors);
+            codebookErrors.middleRows(begin, size) = chunkErrors;
+        }
+    }
+    
+    // The scoring is done in two phases such that the posteriors do not 
+    // depend on the order of the hypotheses or on the number of threads:
+    // First, the geometric and depth features of all hypotheses are 
+    // computed and the normalization constants are reduced over all of them.
+    // Then, every hypothesis is scored against the fixed normalization.
+    std::vector<float> meanDepth(numHypotheses);
+    std::vector<float> angleRatios(numHypotheses);
+    std::vector< std::vector<int> > projProfs(numHypotheses);
+    std::vector< std::vector<int> > projProfTyps(numHypotheses);
+    
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int h = 0; h < numHypotheses; h++)
     {
-        // Extract the descriptor
-        libf::DataPoint p, p2;
-        extractDiscretizedAppearanceDataGM(gradMag, hypotheses[h], p, p2);
-
-        std::vector<int> projProf;
-        std::vector<int> projProfTyp;
-
-        /**
-         * Edge Projection Profile for Split Augmentation
-         */
-        extractEdgeProjectionProfile(gradMag, hypotheses[h], projProf, projProfTyp);
-
-        // We have to normalize the reconstruction errors and prior probabilities 
-        // in order to get decent numerical joint probabilities
-        float reconstructionErrors[3];
-        float priorProbabilities[3];
-
         /**
          * Mean depth of each IE
          */
         meanDepth[h] = extractMeanPartDepth(rectifiedDepth, hypotheses[h]);
-        /**
-         * Boundary Conditions
-         */
-        if(meanDepth[h]>maxDepthGlobal)
-            maxDepthGlobal = meanDepth[h]; // precaution in case the depth under test is more than the ones alread seen
-
-        if((hypotheses[h].getWidth()/edgeImage.cols)/(hypotheses[h].getHeight()/edgeImage.rows)>maxAspRatio)
-            maxAspRatio = (hypotheses[h].getWidth()/edgeImage.cols)/(hypotheses[h].getHeight()/edgeImage.rows); // precaution in case the asp 	ratio under test is more than the ones alread seen
-       
-        if(meanDepth[h]/hypotheses[h].getWidth()>maxDWAspRatio)
-            maxDWAspRatio = meanDepth[h]/hypotheses[h].getWidth();	
-
-        if(meanDepth[h]/hypotheses[h].getHeight()>maxDHAspRatio)
-            maxDHAspRatio = meanDepth[h]/hypotheses[h].getHeight();	
-	
-        formFactorH = 4*hypotheses[h].getWidth()*hypotheses[h].getHeight()/pow((hypotheses[h].getWidth() + hypotheses[h].getHeight()),2);
-      
-        angleRatio = std::atan2((double) hypotheses[h].getWidth(),(double) hypotheses[h].getHeight()) / std::atan2((double) hypotheses[h].getHeight(),(double) hypotheses[h].getWidth());
         
-        if(angleRatio>maxAngleRatio)
-            maxAngleRatio = angleRatio;	
-	
-        /**
-         * probabilistic SVM for shape prior: Testing
-         */
-        CvSVM SVM;
-        cv::Mat testDataSVM;
+        angleRatios[h] = std::atan2((double) hypotheses[h].getWidth(),(double) hypotheses[h].getHeight()) / std::atan2((double) hypotheses[h].getHeight(),(double) hypotheses[h].getWidth());
+        
         /**
-         * Feature Vector Formation
+         * Edge Projection Profile for Split Augmentation
          */
-        hconcat(hypotheses[h].getWidth()/edgeImage.cols, hypotheses[h].getHeight()/edgeImage.rows, testDataSVM);
-        //hconcat(testDataSVM, (hypotheses[h].getWidth()/edgeImage.cols)/(hypotheses[h].getHeight()/edgeImage.rows)/maxAspRatio, testDataSVM);
-        hconcat(testDataSVM, hypotheses[h].getWidth()/hypotheses[h].getHeight()/maxAspRatio, testDataSVM);
+        extractEdgeProjectionProfile(gradMag, hypotheses[h], projProfs[h], projProfTyps[h]);
+    }
+    
+    /**
+     * Boundary Conditions: precaution in case the values under test are 
+     * larger than the ones already seen during training
+     */
+    for (int h = 0; h < numHypotheses; h++)
+    {
+        maxDepthGlobal = std::max(maxDepthGlobal, meanDepth[h]);
+        maxAspRatio = std::max(maxAspRatio, (hypotheses[h].getWidth()/edgeImage.cols)/(hypotheses[h].getHeight()/edgeImage.rows));
+        maxDWAspRatio = std::max(maxDWAspRatio, meanDepth[h]/hypotheses[h].getWidth());
+        maxDHAspRatio = std::max(maxDHAspRatio, meanDepth[h]/hypotheses[h].getHeight());
+        maxAngleRatio = std::max(maxAngleRatio, angleRatios[h]);
+    }
+    
+    // Evaluate the linear shape priors of all hypotheses at once
+    Eigen::MatrixXf shapePriors;
+    {
+        ScopedTimer shapePriorTimer(instrumentation, "shape_prior");
 #if INCLUDE_DEPTH
-        hconcat(testDataSVM, meanDepth[h]/hypotheses[h].getWidth()/maxDWAspRatio, testDataSVM);
-        hconcat(testDataSVM, meanDepth[h]/hypotheses[h].getHeight()/maxDHAspRatio, testDataSVM);
-        //hconcat(meanDepth[h]/hypotheses[h].getWidth()/maxDWAspRatio, meanDepth[h]/hypotheses[h].getHeight()/maxDHAspRatio, testDataSVM);
-        hconcat(testDataSVM, meanDepth[h]/maxDepthGlobal, testDataSVM);// Normalised mean Depth
+        Eigen::MatrixXf shapeFeatures(numHypotheses, 7);
+#else
+        Eigen::MatrixXf shapeFeatures(numHypotheses, 4);
 #endif
-        hconcat(testDataSVM, angleRatio/maxAngleRatio, testDataSVM);// Normalised Angle Ratio between diagonals
-        //hconcat(testDataSVM, formFactorH, testDataSVM);
-
-        testDataSVM.convertTo(testDataSVM,CV_32FC1);
-
-        // Determine the un-normalized probabilities
-        for (int l = 0; l < 3; l++)
+        #pragma omp parallel for
+        for (int h = 0; h < numHypotheses; h++)
         {
-            // Get the reconstruction error
-            reconstructionErrors[l] = calcCodebookError(codebooks[l], p);
-            
-            // Get the prior probability (SVM)
-            switch (l)
-            {
-                case 0 :
-                    SVM.load("class0vsAllSVM.xml");
-                    break;
-                case 1 :
-                    SVM.load("class1vsAllSVM.xml");
-                    break;
-                case 2 :
-                    SVM.load("class2vsAllSVM.xml");
-                    break;
-                default :
-                    std::cout<<"unknown label"<<std::endl;
-            }
-
-            float predicted = SVM.predict(testDataSVM, true);
-
-            //Sigmoid of output
-            priorProbabilities[l] = 1 - (1.0 / (1.0 + exp(-STEEPNESS*predicted)));
-
+            /**
+             * Feature Vector Formation (same order as in probSVMPrior)
+             */
+            int f = 0;
+            shapeFeatures(h, f++) = hypotheses[h].getWidth()/edgeImage.cols;
+            shapeFeatures(h, f++) = hypotheses[h].getHeight()/edgeImage.rows;
+            shapeFeatures(h, f++) = hypotheses[h].getWidth()/hypotheses[h].getHeight()/maxAspRatio;
+#if INCLUDE_DEPTH
+            shapeFeatures(h, f++) = meanDepth[h]/hypotheses[h].getWidth()/maxDWAspRatio;
+            shapeFeatures(h, f++) = meanDepth[h]/hypotheses[h].getHeight()/maxDHAspRatio;
+            shapeFeatures(h, f++) = meanDepth[h]/maxDepthGlobal;// Normalised mean Depth
+#endif
+            shapeFeatures(h, f++) = angleRatios[h]/maxAngleRatio;// Normalised Angle Ratio between diagonals
         }
-        
-        // Determine the normalized probabilities
-        // For the reconstruction error, we first normalize the probabilities 
-        // using the zscore. 
-        //Util::normalizeZScore<3>(reconstructionErrors);
-        
+
+        /**
+         * probabilistic SVM for shape prior: Testing
+         */
+        models.shapePrior.computePriors(shapeFeatures, STEEPNESS, shapePriors);
+    }
+    
+    // Every hypothesis writes its posteriors to its own row
+    Eigen::MatrixXf posteriors(numHypotheses, 3);
+    
+    #pragma omp parallel for
+    for (int h = 0; h < numHypotheses; h++)
+    {
         /**
          * Rectangle Weights: Bayesian
          */
-
         float likelihoods[3];
         float normalizationFactor = 0.0f;
         for (int l = 0; l < 3; l++)
         {
-            likelihoods[l] = -reconstructionErrors[l]/0.01f;
-            likelihoods[l] += std::log(priorProbabilities[l]);
+            likelihoods[l] = -codebookErrors(h, l)/0.01f;
+            likelihoods[l] += std::log(shapePriors(h, l));
             likelihoods[l] += std::log(labelPrior[l]);
             normalizationFactor  += exp(likelihoods[l]);
         }
 
-        float posterior[3];
-
         for (int l = 0; l < 3; l++)
         {
-            posterior[l] = exp(likelihoods[l])/normalizationFactor;// normalised 0-1
+            posteriors(h, l) = exp(likelihoods[l])/normalizationFactor;// normalised 0-1
         }
-
-
-
+    }
+    
+    // Fill the table in the order of the hypotheses
+    for (int h = 0; h < numHypotheses; h++)
+    {
+        // All labels share the geometry of the rectangle
+        const int rectangle = hypothesisTable.addRectangle(hypotheses[h], meanDepth[h], projProfs[h], projProfTyps[h]);
 
         for (int l = 0; l < 3; l++)
         {
@@ -1976,10 +2759,10 @@ void CabinetParser::selectParts(
                 cv::cvtColor(demo, demo, CV_GRAY2BGR);
 
                 std::cout << std::setw(25) << "Class=" << l << std::endl;
-                std::cout << std::setw(25) << "appearance likelihood=" << exp(-reconstructionErrors[l]/0.01f) << std::endl;
-                std::cout << std::setw(25) << "prior probability=" << priorProbabilities[l] << std::endl;
+                std::cout << std::setw(25) << "appearance likelihood=" << exp(-codebookErrors(h, l)/0.01f) << std::endl;
+                std::cout << std::setw(25) << "prior probability=" << shapePriors(h, l) << std::endl;
                 std::cout << std::setw(25) << "label prior=" << labelPrior[l] << std::endl;
-                std::cout << std::setw(25) << "Posterior (final weight)=" << posterior[l] << std::endl;
+                std::cout << std::setw(25) << "Posterior (final weight)=" << posteriors(h, l) << std::endl;
                 
                 switch (l)
                 {
@@ -1998,22 +2781,17 @@ void CabinetParser::selectParts(
             }
 #endif
             // Create the part (=Interaction Element = weighted and labelled rectangle)
-            Part part;
-            part.rect = hypotheses[h];
-            part.label = l;
-            part.meanDepth = meanDepth[h];
-            part.likelihood = exp(-reconstructionErrors[l]/0.01f);
-            part.shapePrior = priorProbabilities[l];
-            part.posterior = posterior[l];
-            part.projProf = projProf;
-            part.projProfTyp = projProfTyp;
-            
-            #pragma omp critical
-            {
-                partHypotheses.push_back(part);
-            }
+            hypothesisTable.addHypothesis(rectangle, l, exp(-codebookErrors(h, l)/0.01f), shapePriors(h, l), posteriors(h, l));
         }
     }
+    scoringTimer.stop();
+    instrumentation.setCounter("hypotheses", hypothesisTable.size());
+    instrumentation.setCounter("hypothesis_table_bytes", hypothesisTable.getMemorySize());
+
+    // The annealer works on the materialized parts as the split and merge
+    // moves add new hypotheses. All other consumers refer to the table.
+    std::vector<Part> partHypotheses;
+    hypothesisTable.toParts(partHypotheses);
 
 
 #if 0
@@ -2061,19 +2839,28 @@ void CabinetParser::selectParts(
 
     // Rectangle proposal pool
     std::vector<Rectangle> proposals;
-    for(size_t i = 0; i<partHypotheses.size(); i++)
+    proposals.reserve(hypothesisTable.size());
+    for(int i = 0; i < hypothesisTable.size(); i++)
     {
-        proposals.push_back(partHypotheses[i].rect);
+        proposals.push_back(hypothesisTable.getRectangle(i));
     }
 
     // One time computation of all matrices related to proposal rectangles
     Eigen::MatrixXi overlapPairs;
-    Eigen::MatrixXi overlapPairs70;
     std::vector<float> areas;
     Eigen::MatrixXf overlapArea;
     Eigen::MatrixXi widthMergeable;
     Eigen::MatrixXi heightMergeable;
-    computeProposalMatrices(proposals, imageArea, overlapPairs, overlapPairs70, areas, overlapArea, widthMergeable, heightMergeable);
+    ScopedTimer matricesTimer(instrumentation, "proposal_matrices");
+    computeProposalMatrices(proposals, imageArea, overlapPairs, areas, overlapArea, widthMergeable, heightMergeable);
+    matricesTimer.stop();
+
+    // Neighbor lists for the data driven exchange
+    ScopedTimer similarityTimer(instrumentation, "similarity_index");
+    SimilarityIndex similarityIndex;
+    similarityIndex.build(hypothesisTable, 0.7f, 1.0f);
+    similarityTimer.stop();
+    instrumentation.setCounter("similar_pairs", similarityIndex.getNumEntries());
 
     Eigen::SparseMatrix<int> widthMergeableSparse = widthMergeable.sparseView();
     std::cout<<"Possible Width Mergeable pairs : "<<widthMergeableSparse.nonZeros()<<" out of a max of : "<<( proposals.size()*proposals.size() - proposals.size() )/2<<std::endl;
@@ -2091,7 +2878,6 @@ void CabinetParser::selectParts(
                           gradMag,
                           areas,
                           overlapPairs,
-                          overlapPairs70,
                           overlapArea,
                           cannyEdges);
     sa.setNumInnerLoops(NUM_INNER_LOOPS);
@@ -2100,10 +2886,23 @@ void CabinetParser::selectParts(
     // Set up the cooling schedule
     GeometricCoolingSchedule schedule;
     schedule.setAlpha(ALPHA);
-    schedule.setStartTemperature(MAX_TEMP);
+    schedule.setStartTemperature(startTemperature);
     schedule.setEndTemperature(MIN_TEMP);
     sa.setCoolingSchedule(schedule);
 
+#if ADAPTIVE_COOLING
+    // Use the same iteration budget as the geometric schedule, easy images
+    // terminate early due to the plateau detection
+    AdaptiveCoolingSchedule adaptiveSchedule;
+    adaptiveSchedule.setStartTemperature(startTemperature);
+    adaptiveSchedule.setEndTemperature(MIN_TEMP);
+    adaptiveSchedule.setMaxIterations(std::max(1, static_cast<int>(std::ceil(std::log(MIN_TEMP/startTemperature)/std::log(ALPHA)))));
+    adaptiveSchedule.setGain(ADAPTIVE_COOLING_GAIN);
+    sa.setCoolingSchedule(&adaptiveSchedule);
+    sa.setPlateauDetection(PLATEAU_ITER, PLATEAU_TOLERANCE);
+#endif
+    sa.setTimeBudget(SA_TIME_BUDGET);
+
     //sa.setProposals(proposals);
 
     // KEEP THE ORDER of MOVES
@@ -2124,17 +2923,17 @@ void CabinetParser::selectParts(
     //Set up the moves
 
     //Random Exchange move
-    MCMCParserExchangeMove exchangeMove(partHypotheses);
+    MCMCParserExchangeMove exchangeMove(hypothesisTable);
     sa.addMove(&exchangeMove, INIT_PROB_EXCHANGE_RANDOM);
     initialMoveProbs.push_back(INIT_PROB_EXCHANGE_RANDOM);
 
     //Birth move
-    MCMCParserBirthMove birthMove(partHypotheses, overlapPairs, numClusters);
+    MCMCParserBirthMove birthMove(hypothesisTable, overlapPairs, numClusters);
     sa.addMove(&birthMove, INIT_PROB_BIRTH);
     initialMoveProbs.push_back(INIT_PROB_BIRTH);
 
     //Death move
-    MCMCParserDeathMove deathMove(partHypotheses, overlapPairs, numClusters);
+    MCMCParserDeathMove deathMove(hypothesisTable, overlapPairs, numClusters);
     sa.addMove(&deathMove, INIT_PROB_DEATH);
     initialMoveProbs.push_back(INIT_PROB_DEATH);
 
@@ -2159,12 +2958,12 @@ void CabinetParser::selectParts(
 #endif
 
     //Switch(Label Diffuse) move
-    MCMCParserLabelDiffuseMove labelDiffuseMove(partHypotheses);
+    MCMCParserLabelDiffuseMove labelDiffuseMove(hypothesisTable);
     sa.addMove(&labelDiffuseMove, INIT_PROB_LABEL_DIFFUSE);
     initialMoveProbs.push_back(INIT_PROB_LABEL_DIFFUSE);
 
     //Data driven Exchange move
-    MCMCParserDDExchangeMove exchangeDDMove(partHypotheses, overlapPairs70);// Needs unsorted rectangles
+    MCMCParserDDExchangeMove exchangeDDMove(hypothesisTable, similarityIndex);// Needs unsorted rectangles
     sa.addMove(&exchangeDDMove, INIT_PROB_EXCHANGE_DATADRIVEN);
     initialMoveProbs.push_back(INIT_PROB_EXCHANGE_DATADRIVEN);
 
@@ -2184,7 +2983,7 @@ void CabinetParser::selectParts(
     initialMoveProbs.push_back(INIT_PROB_UPDATE_HEIGHT);
 
     // Set up the energy function
-    MCMCParserEnergy energyObj(partHypotheses, areas, overlapPairs, overlapArea, edgeImage);
+    MCMCParserEnergy energyObj(hypothesisTable, areas, overlapPairs, overlapArea, edgeImage);
     sa.setEnergyFunction(energyObj);
 
     //2phase architecture
@@ -2197,7 +2996,6 @@ void CabinetParser::selectParts(
                           gradMag,
                           areas,
                           overlapPairs,
-                          overlapPairs70,
                           overlapArea,
                           cannyEdges);
 
@@ -2231,7 +3029,6 @@ void CabinetParser::selectParts(
                           gradMag,
                           areas,
                           overlapPairs,
-                          overlapPairs70,
                           overlapArea,
                           cannyEdges);
 
@@ -2260,10 +3057,10 @@ void CabinetParser::selectParts(
     int rectIdx = 0;
     float maxPosterior = 0.0f;
     //Find the rectangle with highest posterior
-    for (int i = 0; i < partHypotheses.size(); i++)
+    for (int i = 0; i < hypothesisTable.size(); i++)
     {
-        maxPosterior = std::max(maxPosterior, partHypotheses[i].posterior);
-        if(partHypotheses[i].posterior == maxPosterior)
+        maxPosterior = std::max(maxPosterior, hypothesisTable.getPosterior(i));
+        if(hypothesisTable.getPosterior(i) == maxPosterior)
         {
             rectIdx = i;
         }
@@ -2272,10 +3069,46 @@ void CabinetParser::selectParts(
     {
 
         //int rectIdx = rand() % partHypotheses.size();
-        std::cout<<"The Max posterior is: "<<partHypotheses[rectIdx].posterior<<"   with rectangle index : "<<rectIdx<<std::endl;
+        std::cout<<"The Max posterior is: "<<hypothesisTable.getPosterior(rectIdx)<<"   with rectangle index : "<<rectIdx<<std::endl;
         state.push_back(rectIdx);
     }
 
+    // Warm start: Every initial part is replaced by the hypothesis with the
+    // same label that overlaps it the most
+    if (initialParts != 0)
+    {
+        MCMCParserStateType warmState;
+        for (size_t p = 0; p < initialParts->size(); p++)
+        {
+            const Part & part = (*initialParts)[p];
+            int bestHypothesis = -1;
+            float bestIOU = 0.5f;
+            for (int i = 0; i < hypothesisTable.size(); i++)
+            {
+                if (hypothesisTable.getLabel(i) != part.label)
+                {
+                    continue;
+                }
+                const float iou = RectangleUtil::calcIOU(hypothesisTable.getRectangle(i), part.rect);
+                if (iou >= bestIOU)
+                {
+                    bestIOU = iou;
+                    bestHypothesis = i;
+                }
+            }
+            if (bestHypothesis >= 0 && std::find(warmState.begin(), warmState.end(), bestHypothesis) == warmState.end())
+            {
+                warmState.push_back(bestHypothesis);
+            }
+        }
+        
+        instrumentation.setCounter("warm_start_parts", warmState.size());
+        if (warmState.size() > 0)
+        {
+            state = warmState;
+        }
+    }
+
 
     float bestLabelEnergy;
     float bestWeightEnergy;
@@ -2290,19 +3123,36 @@ void CabinetParser::selectParts(
 
         // Set up the callback function
 #if 0
-        MCMCParserCallback callback(partHypotheses);
+        MCMCParserCallback callback(hypothesisTable);
         sa.addCallback(&callback);
 #endif
 
         std::cout<<" "<<std::endl;
+        ScopedTimer annealingTimer(instrumentation, "annealing");
 #if DUMMY_MCMC_LOGIC
         float warmupBestEnergy = saWarmup.optimize(state);
         std::cout<<std::endl<<"Warmup initial state size "<<state.size()<<std::endl;
         float bestEnergy = saMaster.optimize(state);
-
+        recordAnnealingStatistics(saWarmup, "sa_warmup_");
+        recordAnnealingStatistics(saMaster, "sa_");
+#elif BITSET_STATE
+        MCMCParserBitsetState bitsetState(static_cast<int>(partHypotheses.size()));
+        bitsetState.assign(state);
+        float bestEnergy = sa.optimize(bitsetState);
+        bitsetState.toVector(state);
+        recordAnnealingStatistics(sa, "sa_");
 #else
         float bestEnergy = sa.optimize(state);
+        recordAnnealingStatistics(sa, "sa_");
 #endif
+        annealingTimer.stop();
+
+        // Split and merge appended their hypotheses to the parts, hence the
+        // table has to know them before the state is looked up
+        for (size_t h = hypothesisTable.size(); h < partHypotheses.size(); h++)
+        {
+            hypothesisTable.add(partHypotheses[h]);
+        }
 
         // Energy Function
         energyObj.energy(state, initialMoveProbs, areas, overlapPairs, overlapArea, partHypotheses);
@@ -2360,30 +3210,44 @@ void CabinetParser::selectParts(
     result.resize(bestState.size());
     for (size_t h = 0; h < bestState.size(); h++)
     {
-        std::cout << partHypotheses[bestState[h]].rect << " - > " << partHypotheses[bestState[h]].label << "\n";
-        std::cout << "Mean part depth: "<<partHypotheses[bestState[h]].meanDepth <<std::endl;
-        std::cout << "Posterior: "<<partHypotheses[bestState[h]].posterior <<std::endl;
-        std::cout << "Likelihood: "<<partHypotheses[bestState[h]].likelihood <<std::endl;
-        std::cout << "Shape Prior: "<<partHypotheses[bestState[h]].shapePrior <<std::endl;
+        hypothesisTable.getPart(bestState[h], result[h]);
+
+        std::cout << result[h].rect << " - > " << result[h].label << "\n";
+        std::cout << "Mean part depth: "<<result[h].meanDepth <<std::endl;
+        std::cout << "Posterior: "<<result[h].posterior <<std::endl;
+        std::cout << "Likelihood: "<<result[h].likelihood <<std::endl;
+        std::cout << "Shape Prior: "<<result[h].shapePrior <<std::endl;
 
         std::cout <<std::endl;
-        result[h] = partHypotheses[bestState[h]];
     }
 
-
+    // Store the proposals and the best state for offline evaluation
+    if (parseRecord != 0)
+    {
+        parseRecord->rectangles.resize(hypothesisTable.getNumRectangles());
+        parseRecord->hypothesisRectangles.resize(hypothesisTable.size());
+        parseRecord->hypothesisLabels = hypothesisTable.getLabels();
+        parseRecord->hypothesisPosteriors = hypothesisTable.getPosteriors();
+        for (int h = 0; h < hypothesisTable.size(); h++)
+        {
+            const int r = hypothesisTable.getRectangleIndex(h);
+            parseRecord->hypothesisRectangles[h] = r;
+            parseRecord->rectangles[r] = hypothesisTable.getRectangle(h);
+        }
+        parseRecord->bestState.assign(bestState.begin(), bestState.end());
+    }
 }
 
 /*
  * One time Computation of all proposal matrices
 */
 void CabinetParser::computeProposalMatrices(const std::vector<Rectangle> proposals, const float imageArea,
-                Eigen::MatrixXi & overlapPairs, Eigen::MatrixXi & overlapPairs70,std::vector<float> & areas,
+                Eigen::MatrixXi & overlapPairs, std::vector<float> & areas,
                 Eigen::MatrixXf & overlapArea, Eigen::MatrixXi & widthMergeable, Eigen::MatrixXi & heightMergeable)
 {
     //Initialize the matrices
     areas.resize(proposals.size());
     overlapPairs = Eigen::MatrixXi::Zero(static_cast<int>(proposals.size()),static_cast<int>(proposals.size()));
-    overlapPairs70 = Eigen::MatrixXi::Zero(static_cast<int>(proposals.size()),static_cast<int>(proposals.size()));
     overlapArea = Eigen::MatrixXf::Zero(static_cast<int>(proposals.size()),static_cast<int>(proposals.size()));
     widthMergeable = Eigen::MatrixXi::Zero(static_cast<int>(proposals.size()),static_cast<int>(proposals.size()));
     heightMergeable = Eigen::MatrixXi::Zero(static_cast<int>(proposals.size()),static_cast<int>(proposals.size()));
@@ -2395,8 +3259,6 @@ void CabinetParser::computeProposalMatrices(const std::vector<Rectangle> proposa
         areas[n] = proposals[n].getArea()/imageArea;
         // with overlap
         overlapPairs(static_cast<int>(n), static_cast<int>(n)) = 1;
-        //with at least 70% overlap
-        overlapPairs70(static_cast<int>(n), static_cast<int>(n)) = 1;
         // Extent of overlp
         overlapArea(static_cast<int>(n), static_cast<int>(n)) = 1.0f;
 
@@ -2411,11 +3273,6 @@ void CabinetParser::computeProposalMatrices(const std::vector<Rectangle> proposa
                 overlapPairs(static_cast<int>(n),static_cast<int>(m)) = 1;
                 overlapPairs(static_cast<int>(m),static_cast<int>(n)) = 1;
             }
-            if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-            {
-                overlapPairs70(static_cast<int>(n),static_cast<int>(m)) = 1;
-                overlapPairs70(static_cast<int>(m),static_cast<int>(n)) = 1;
-            }
             overlapArea(static_cast<int>(n),static_cast<int>(m)) = intersectionScore;//relative Area
             overlapArea(static_cast<int>(m),static_cast<int>(n)) = intersectionScore;
 
@@ -2630,6 +3487,22 @@ void CabinetParser::trainSVM(cv::Mat & trainDataSVM, int partCount[3])
                     std::cout<<" invalid label"<<std::endl;
         }
     }
+    
+    exportShapePrior("shapePrior.dat");
+}
+
+/*
+ * Shape Prior: Reduce the linear SVMs to a weight matrix
+*/
+
+bool CabinetParser::exportShapePrior(const std::string & file)
+{
+    LinearShapePrior shapePrior;
+    if (!shapePrior.loadSVMs({"class0vsAllSVM.xml", "class1vsAllSVM.xml", "class2vsAllSVM.xml"}))
+    {
+        return false;
+    }
+    return shapePrior.save(file);
 }
 
 
@@ -3364,22 +4237,22 @@ void CabinetParser::extractDiscretizedAppearanceData(const cv::Mat & rectifiedEd
     KernelDistribution<float, float, 2>::Model model;
     model.estimate(samples);
     KernelDistribution<float, float, 2> kde(model);
-    kde.normalizeMCMC();
+    kde.normalizeUnitBox();
     
     int latticeResolution = 50;
     
     descriptor.resize((latticeResolution+1)*(latticeResolution+1));
     
     // Discretize the KDE
+    cv::Mat lattice;
+    const float spacing = 1.0f/latticeResolution;
+    kde.evalGrid(KernelDistribution<float, float, 2>::Vec(0, 0), KernelDistribution<float, float, 2>::Vec(spacing, spacing), 
+            cv::Size(latticeResolution+1, latticeResolution+1), lattice);
     for (int _x = 0; _x <= latticeResolution; _x++)
     {
         for (int _y = 0; _y <= latticeResolution; _y++)
         {
-            Vec2 p;
-            p[0] = _x/static_cast<float>(latticeResolution);
-            p[1] = _y/static_cast<float>(latticeResolution);
-            
-            descriptor(_x + (latticeResolution+1)*_y) = kde.eval(p);
+            descriptor(_x + (latticeResolution+1)*_y) = lattice.at<double>(_y, _x);
         }
     }
 }
@@ -3533,80 +4406,8 @@ void CabinetParser::extractDiscretizedAppearanceDistributions(libf::DataStorage:
 
 void CabinetParser::determineLatentVariables(const Eigen::MatrixXf& codebook, const Eigen::MatrixXf& data, Eigen::MatrixXf& pis)
 {
-    const int K = codebook.cols();
-    const int N = data.cols();
-    
-    Eigen::MatrixXf G = codebook.adjoint()*codebook;
-    
-    for (int n = 0; n < N; n++)
-    {
-        Eigen::VectorXf a = -data.col(n).adjoint()*codebook;
-
-        try {
-            GRBEnv env = GRBEnv();
-            GRBModel model = GRBModel(env);
-            // Create one variable for each part
-            auto lowerBounds = new double[K];
-            auto upperBounds = new double[K];
-            auto types = new char[K];
-            for (int k = 0; k < K; k++)
-            {
-                lowerBounds[k] = 0.0;
-                upperBounds[k] = 1.0;
-                types[k] = GRB_CONTINUOUS;
-            }
-            GRBVar* variables = model.addVars(lowerBounds, upperBounds, 0, types, 0, K);
-            
-            // Integrate new variables
-            model.update();
-
-            GRBQuadExpr obj = 0.0;
-            // Add the linear terms
-            for (int k = 0; k < K; k++)
-            {
-                obj += a(k)*variables[k];
-            }
-            // Add the quadratic terms
-            for (int k = 0; k < K; k++)
-            {
-                for (int l = 0; l < K; l++)
-                {
-                    obj += 0.5*variables[k]*variables[l]*G(k,l);
-                }
-            }
-            model.setObjective(obj, GRB_MINIMIZE);
-
-            // Add the constraint
-            GRBLinExpr con = 0.0;
-            for (int k = 0; k < K; k++)
-            {
-                con += variables[k];
-            }
-            model.addConstr(con, GRB_LESS_EQUAL, 1.0);
-
-            model.getEnv().set(GRB_IntParam_Threads, 2);
-            model.getEnv().set(GRB_IntParam_OutputFlag, 0);
-
-            model.optimize();
-
-            for (int k = 0;  k < K; k++)
-            {
-                pis(k,n) = variables[k].get(GRB_DoubleAttr_X);
-            }
-            delete[] variables;
-            delete[] lowerBounds;
-            delete[] upperBounds;
-            delete[] types;
-        }
-        catch(GRBException e) {
-            std::cout << "Error code = " << e.getErrorCode() << std::endl;
-            std::cout << e.getMessage() << std::endl;
-            exit(1);
-        } catch(...) {
-            std::cout << "Exception during optimization" << std::endl;
-            exit(1);
-        }    
-    }
+    CodebookScorer scorer;
+    scorer.determineLatentVariables(codebook, data, pis);
 }
 
 
@@ -3628,178 +4429,12 @@ void CabinetParser::learnCodebook(libf::AbstractDataStorage::ptr _storage, Eigen
         data.col(n) = storage->getDataPoint(n);
     }
     
-    // Fix some parameters for the learning process
-    // How many runs with different random initializations shall be performed
-    const int runs = 3;
-    // The number of codebook entries
-    //int K = 8;
-    // How many iterations the inner loop shall perform
-    const int M = 100;
-    
-    std::random_device rd;
-    // Set up a list of indices in order to sample without replacement
-    std::vector<int> indices(N);
-    for (int n = 0; n < N; n++)
-    {
-        indices[n] = n;
-    }
-    float bestError = -1;
-    
-    std::vector<int> components(K);
-    for (int k = 0; k < K; k++)
-    {
-        components[k] = k;
-    }
-    
-    std::mt19937 g(rd());
-    std::uniform_real_distribution<float> d(0, 1e-5);
-    
-    for (int r = 0; r < runs; r++)
-    {
-        std::cout << "Start run " << (r+1) << "/" << runs << "\n";
-        float lastError = -1;
-        
-        // Set up a new random codebook
-        std::shuffle(indices.begin(), indices.end(), std::default_random_engine(rd()));
-        Eigen::MatrixXf codebook(D, K);
-        for (int k = 0; k < K; k++)
-        {
-            codebook.col(k) = data.col(indices[k]);
-        }
-        
-        Eigen::MatrixXf pis(K, N);
-        for (int k = 0; k < K; k++)
-        {
-            for (int n = 0; n < N; n++)
-            {
-                pis(k,n) = 1.0/K;
-            }
-        }
-        
-        // Optimize iteratively
-        for (int m = 0; m < M; m++)
-        {
-            std::cout << "-- Iteration " << (m+1) << "/" << M << "\n";
-            // Determine the latent variables
-            determineLatentVariables(codebook, data, pis);
-            
-            // Update the codebook
-#if 0
-            for (int l = 0; l < 3; l++)
-            {
-                std::shuffle(components.begin(), components.end(), std::default_random_engine(rd()));
-                for (int _k = 0; _k < K; _k++)
-                {
-                    int k = components[_k];
-                    Eigen::MatrixXf pis_copy = pis;
-                    pis_copy.row(k) *= 0;
-                    const float normalize = pis.row(k)*pis.row(k).adjoint();
-                    
-                    codebook.col(k) = (data*pis.row(k).adjoint() - (codebook*pis_copy)*pis.row(k).adjoint())/(normalize + lambda);
-                }
-            }
-#else
-            {
-                try {
-                    GRBEnv env = GRBEnv();
-                    GRBModel model = GRBModel(env);
-                    // Create one variable for each part
-                    GRBVar* variables = model.addVars(K*D, GRB_CONTINUOUS);
-
-                    // Integrate new variables
-                    model.update();
-
-                    // Set objective: maximize the covered area and minimize the overlap 
-                    // by using a high penalty on the overlap
-
-                    GRBQuadExpr obj = 0.0;
-                    // Add the linear terms
-                    for (int n = 0; n < N; n++)
-                    {
-                        for (int k = 0; k < K; k++)
-                        {
-                            for (int d = 0; d < D; d++)
-                            {
-                                obj += -pis(k,n)*data(d,n)*variables[k*D+d];
-                            }
-                        }
-                    }
-                    
-                    // Add the quadratic terms
-                    for (int n = 0; n < N; n++)
-                    {
-                        for (int k = 0; k < K; k++)
-                        {
-                            for (int j = k; j < K; j++)
-                            {
-                                for (int d = 0; d < D; d++)
-                                {
-                                    double factor = 1;
-                                    if (j == k)
-                                    {
-                                        factor = 2;
-                                    }
-                                    obj += factor*pis(k,n)*pis(j,n)*variables[k*D+d]*variables[j*D+d];
-                                }
-                            }
-                        }
-                    }
-                    
-                    model.setObjective(obj, GRB_MINIMIZE);
-
-                    // Add the constraint
-                    for (int k = 0; k < K; k++)
-                    {
-                        for (int d = 0; d < D; d++)
-                        {
-                            GRBLinExpr con2 = variables[k*D+d];
-                            model.addConstr(con2, GRB_GREATER_EQUAL, 0);
-                        }
-                    }
-                    
-
-                    model.getEnv().set(GRB_IntParam_Threads, 4);
-                    model.getEnv().set(GRB_IntParam_OutputFlag, 1);
-
-                    // Optimize model
-                    model.optimize();
-
-                    for (int k = 0; k < K; k++)
-                    {
-                        for (int d = 0; d < D; d++)
-                        {
-                            codebook(d,k) = variables[k*D+d].get(GRB_DoubleAttr_X);
-                        }
-                    }
-                    
-                    delete[] variables;
-                }
-                catch(GRBException e) {
-                    std::cout << "Error code = " << e.getErrorCode() << std::endl;
-                    std::cout << e.getMessage() << std::endl;
-                    exit(1);
-                } catch(...) {
-                    std::cout << "Exception during optimization" << std::endl;
-                    exit(1);
-                }
-            }
-#endif
-            
-            float error = (data - codebook*pis).norm();
-            std::cout << "-- Error: " << (error) << "/" << (bestError) << "\n";
-            if (error < bestError || bestError < 0)
-            {
-                bestError = error;
-                bestCodebook = codebook;
-            }
-
-            if (lastError > 0 && (std::abs(error - lastError) < 1 || (error > lastError + 1.5)))
-            {
-                break;
-            }
-            lastError = error;
-        }
-    }
+    // The runs from different random initializations are performed in 
+    // parallel
+    CodebookLearner learner;
+    learner.model.seed = std::random_device()();
+    const float error = learner.learn(data, K, bestCodebook);
+    std::cout << "-- Error: " << error << "\n";
 }
 
 float CabinetParser::calcCodebookError(const Eigen::MatrixXf& codebook, const Eigen::VectorXf& x)
@@ -3809,7 +4444,8 @@ float CabinetParser::calcCodebookError(const Eigen::MatrixXf& codebook, const Ei
     
     // Determine the pis
     Eigen::MatrixXf pi(K, 1);
-    determineLatentVariables(codebook, x, pi);
+    CodebookScorer scorer;
+    scorer.determineLatentVariables(codebook, x, pi);
     
     const float temp = (x - codebook*pi).lpNorm<2>();
     return std::sqrt(temp*temp/D);
@@ -5275,7 +5911,34 @@ void CabinetParser::evaluateSegmentation(const std::vector<std::tuple<cv::Mat, S
         
         // Segment the image
         std::vector<Part> segmentation;
-        parse(std::get<0>(images[i]), std::get<2>(images[i]), modifiedROI, segmentation);
+        if (recordDirectory.empty())
+        {
+            parse(std::get<0>(images[i]), std::get<2>(images[i]), modifiedROI, segmentation);
+        }
+        else
+        {
+            // Cached results do not contain the proposals, hence the cache
+            // is bypassed while recording
+            ParseRecord record;
+            ParseCache* previousCache = cache;
+            cache = 0;
+            parseRecord = &record;
+            parse(std::get<0>(images[i]), std::get<2>(images[i]), modifiedROI, segmentation);
+            parseRecord = 0;
+            cache = previousCache;
+            
+            record.id = std::get<1>(images[i]).file;
+            record.groundTruth = rectifiedParts;
+            record.groundTruthLabels = std::get<1>(images[i]).labels;
+            boost::filesystem::path recordFile(recordDirectory);
+            recordFile /= std::get<1>(images[i]).file + ".record";
+            if (!ParseRecord::write(recordFile.string(), record))
+            {
+                std::cout << "Could not write parse record " << recordFile.string() << "\n";
+            }
+        }
+        instrumentation.setCounter("parts", segmentation.size());
+        instrumentation.emitRecord(std::get<1>(images[i]).file);
         
         // Save an image
         cv::Mat visualization = cv::Mat::zeros(std::get<0>(images[i]).rows, std::get<0>(images[i]).cols, CV_8UC3);
@@ -161,6 +161,27 @@ float MCMCParserEnergy::energy(const MCMCParserStateType & state, std::vector<fl
                                const Eigen::MatrixXf & overlaps,
                                std::vector<Part>& parts
                                )
+{
+    return computeEnergy(state, moveProbabilities, areas, overlapConflicts, overlaps, parts);
+}
+
+float MCMCParserEnergy::energy(const MCMCParserBitsetState & state, std::vector<float>& moveProbabilities,
+                               const std::vector<float> & areas,
+                               const Eigen::MatrixXi & overlapConflicts,
+                               const Eigen::MatrixXf & overlaps,
+                               std::vector<Part>& parts
+                               )
+{
+    return computeEnergy(state, moveProbabilities, areas, overlapConflicts, overlaps, parts);
+}
+
+template <class StateType>
+float MCMCParserEnergy::computeEnergy(const StateType & state, std::vector<float>& moveProbabilities,
+                               const std::vector<float> & areas,
+                               const Eigen::MatrixXi & overlapConflicts,
+                               const Eigen::MatrixXf & overlaps,
+                               std::vector<Part>& parts
+                               )
 {
     // Check if this is a valid rectangle covering
     float coveredArea = 0.0f;
@@ -389,7 +410,7 @@ float MCMCParserEnergy::energy(const MCMCParserStateType & state, std::vector<fl
     // Prefers states with more number of parts
     lastStateSizeEnergy =  (double) numRects/OPTIMUM_RECTS - 1.0f;//normalised ~(0-1)
 
-    //lastFormFactorEnergy = computeFormFactorEnergy(state);
+    //lastFormFactorEnergy = computeFormFactorEnergy(state, parts);
 
 #if DEBUG_MODE_ON
     // Check for normalization issues if any
@@ -444,12 +465,13 @@ float MCMCParserEnergy::energy(const MCMCParserStateType & state, std::vector<fl
  * Fom factor energy: to trim weird structures
  */
 
-int MCMCParserEnergy::computeFormFactorEnergy(const MCMCParserStateType & state)
+int MCMCParserEnergy::computeFormFactorEnergy(const MCMCParserStateType & state, const std::vector<Part> & parts)
 {
     float formFactor = 0.0f;
 
     for(size_t i = 0; i < state.size(); i++)
     {
+        // Split and merge append hypotheses that are not in the table
         float height = parts[state[i]].rect.getHeight();
         float width  = parts[state[i]].rect.getWidth();
         formFactor += (double)(4*height*width/(height+width)/(height+width));
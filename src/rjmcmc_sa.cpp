@@ -1,9 +1,51 @@
 #include "parser/rjmcmc_sa.h"
 #include <math.h>
+#include <algorithm>
 
 using namespace parser;
 
 static std::random_device rd;
+
+/*
+ * Lam-style target acceptance rate
+ */
+float AdaptiveCoolingSchedule::getTargetAcceptanceRate(int iteration) const
+{
+    const float progress = iteration/static_cast<float>(std::max(1, maxIterations));
+    if (progress < 0.15f)
+    {
+        return 0.44f + 0.56f*std::pow(560.0f, -progress/0.15f);
+    }
+    else if (progress < 0.65f)
+    {
+        return 0.44f;
+    }
+    return 0.44f*std::pow(440.0f, -(progress - 0.65f)/0.35f);
+}
+
+/*
+ * Steers the temperature towards the target acceptance rate
+ */
+float AdaptiveCoolingSchedule::calcTemperature(int iteration, float temperature) const
+{
+    if (iteration >= maxIterations)
+    {
+        return endTemperature;
+    }
+    
+    // The geometric base schedule reaches the end temperature after 
+    // maxIterations
+    const float baseAlpha = std::pow(endTemperature/startTemperature, 1.0f/std::max(1, maxIterations));
+    if (!hasAcceptanceRate)
+    {
+        return temperature*baseAlpha;
+    }
+    
+    const float target = getTargetAcceptanceRate(iteration);
+    const float alpha = baseAlpha*std::exp(gain*(target - acceptanceRate));
+    return temperature*std::max(minAlpha, std::min(maxAlpha, alpha));
+}
+
 /*
  * Update the proposal Matrices in Height update move
  */
@@ -28,11 +70,6 @@ void SimulatedAnnealing::updateMatricesHeightDiffuse(const MCMCParserStateType s
             overlapPairs(static_cast<int>(state[updateHeightPart]),static_cast<int>(m)) = 1;
             overlapPairs(static_cast<int>(m),static_cast<int>(state[updateHeightPart])) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70(static_cast<int>(state[updateHeightPart]),static_cast<int>(m)) = 1;
-            overlapPairs70(static_cast<int>(m),static_cast<int>(state[updateHeightPart])) = 1;
-        }*/
         overlapArea(static_cast<int>(state[updateHeightPart]),static_cast<int>(m)) = intersectionScore;
         overlapArea(static_cast<int>(m),static_cast<int>(state[updateHeightPart])) = intersectionScore;
     }
@@ -54,15 +91,11 @@ void SimulatedAnnealing::updateMatricesHeightDiffuse(const MCMCParserStateType s
 
             overlapPairs.row(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs.row(state[updateHeightPart]);
             overlapPairs.row(state[updateHeightPart] + static_cast<int>(2)) = overlapPairs.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] + static_cast<int>(2)) = overlapPairs70.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] + static_cast<int>(1)) = overlapArea.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] + static_cast<int>(2)) = overlapArea.row(state[updateHeightPart]);
 
             overlapPairs.col(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs.col(state[updateHeightPart]);
             overlapPairs.col(state[updateHeightPart] + static_cast<int>(2)) = overlapPairs.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] + static_cast<int>(2)) = overlapPairs70.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] + static_cast<int>(1)) = overlapArea.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] + static_cast<int>(2)) = overlapArea.col(state[updateHeightPart]);
             break;
@@ -72,15 +105,11 @@ void SimulatedAnnealing::updateMatricesHeightDiffuse(const MCMCParserStateType s
             areas[state[updateHeightPart] + static_cast<int>(1)] = areas[state[updateHeightPart]];
             overlapPairs.row(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs.row(state[updateHeightPart]);
             overlapPairs.row(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] + static_cast<int>(1)) = overlapArea.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] - static_cast<int>(1)) = overlapArea.row(state[updateHeightPart]);
 
             overlapPairs.col(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs.col(state[updateHeightPart]);
             overlapPairs.col(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] + static_cast<int>(1)) = overlapArea.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] - static_cast<int>(1)) = overlapArea.col(state[updateHeightPart]);
             break;
@@ -91,15 +120,11 @@ void SimulatedAnnealing::updateMatricesHeightDiffuse(const MCMCParserStateType s
 
             overlapPairs.row(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs.row(state[updateHeightPart]);
             overlapPairs.row(state[updateHeightPart] - static_cast<int>(2)) = overlapPairs.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateHeightPart]);
-            //overlapPairs70.row(state[updateHeightPart] - static_cast<int>(2)) = overlapPairs70.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] - static_cast<int>(1)) = overlapArea.row(state[updateHeightPart]);
             overlapArea.row(state[updateHeightPart] - static_cast<int>(2)) = overlapArea.row(state[updateHeightPart]);
 
             overlapPairs.col(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs.col(state[updateHeightPart]);
             overlapPairs.col(state[updateHeightPart] - static_cast<int>(2)) = overlapPairs.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateHeightPart]);
-            //overlapPairs70.col(state[updateHeightPart] - static_cast<int>(2)) = overlapPairs70.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] - static_cast<int>(1)) = overlapArea.col(state[updateHeightPart]);
             overlapArea.col(state[updateHeightPart] - static_cast<int>(2)) = overlapArea.col(state[updateHeightPart]);
             break;
@@ -140,11 +165,6 @@ void SimulatedAnnealing::updateMatricesWidthDiffuse(const MCMCParserStateType st
             overlapPairs(static_cast<int>(state[updateWidthPart]),static_cast<int>(m)) = 1;
             overlapPairs(static_cast<int>(m),static_cast<int>(state[updateWidthPart])) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70(static_cast<int>(state[updateWidthPart]),static_cast<int>(m)) = 1;
-            overlapPairs70(static_cast<int>(m),static_cast<int>(state[updateWidthPart])) = 1;
-        }*/
         overlapArea(static_cast<int>(state[updateWidthPart]),static_cast<int>(m)) = intersectionScore;
         overlapArea(static_cast<int>(m),static_cast<int>(state[updateWidthPart])) = intersectionScore;
     }
@@ -166,15 +186,11 @@ void SimulatedAnnealing::updateMatricesWidthDiffuse(const MCMCParserStateType st
 
             overlapPairs.row(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs.row(state[updateWidthPart]);
             overlapPairs.row(state[updateWidthPart] + static_cast<int>(2)) = overlapPairs.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] + static_cast<int>(2)) = overlapPairs70.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] + static_cast<int>(1)) = overlapArea.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] + static_cast<int>(2)) = overlapArea.row(state[updateWidthPart]);
 
             overlapPairs.col(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs.col(state[updateWidthPart]);
             overlapPairs.col(state[updateWidthPart] + static_cast<int>(2)) = overlapPairs.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] + static_cast<int>(2)) = overlapPairs70.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] + static_cast<int>(1)) = overlapArea.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] + static_cast<int>(2)) = overlapArea.col(state[updateWidthPart]);
             break;
@@ -184,15 +200,11 @@ void SimulatedAnnealing::updateMatricesWidthDiffuse(const MCMCParserStateType st
             areas[state[updateWidthPart] + static_cast<int>(1)] = areas[state[updateWidthPart]];
             overlapPairs.row(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs.row(state[updateWidthPart]);
             overlapPairs.row(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] + static_cast<int>(1)) = overlapArea.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] - static_cast<int>(1)) = overlapArea.row(state[updateWidthPart]);
 
             overlapPairs.col(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs.col(state[updateWidthPart]);
             overlapPairs.col(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] + static_cast<int>(1)) = overlapArea.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] - static_cast<int>(1)) = overlapArea.col(state[updateWidthPart]);
             break;
@@ -203,15 +215,11 @@ void SimulatedAnnealing::updateMatricesWidthDiffuse(const MCMCParserStateType st
 
             overlapPairs.row(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs.row(state[updateWidthPart]);
             overlapPairs.row(state[updateWidthPart] - static_cast<int>(2)) = overlapPairs.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateWidthPart]);
-            //overlapPairs70.row(state[updateWidthPart] - static_cast<int>(2)) = overlapPairs70.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] - static_cast<int>(1)) = overlapArea.row(state[updateWidthPart]);
             overlapArea.row(state[updateWidthPart] - static_cast<int>(2)) = overlapArea.row(state[updateWidthPart]);
 
             overlapPairs.col(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs.col(state[updateWidthPart]);
             overlapPairs.col(state[updateWidthPart] - static_cast<int>(2)) = overlapPairs.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateWidthPart]);
-            //overlapPairs70.col(state[updateWidthPart] - static_cast<int>(2)) = overlapPairs70.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] - static_cast<int>(1)) = overlapArea.col(state[updateWidthPart]);
             overlapArea.col(state[updateWidthPart] - static_cast<int>(2)) = overlapArea.col(state[updateWidthPart]);
             break;
@@ -238,11 +246,6 @@ void SimulatedAnnealing::updateMatricesCenterLocDiffuse(const MCMCParserStateTyp
             overlapPairs(static_cast<int>(state[updateCenterPart]),static_cast<int>(m)) = 1;
             overlapPairs(static_cast<int>(m),static_cast<int>(state[updateCenterPart])) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70(static_cast<int>(state[updateCenterPart]),static_cast<int>(m)) = 1;
-            overlapPairs70(static_cast<int>(m),static_cast<int>(state[updateCenterPart])) = 1;
-        }*/
         overlapArea(static_cast<int>(state[updateCenterPart]),static_cast<int>(m)) = intersectionScore;
         overlapArea(static_cast<int>(m),static_cast<int>(state[updateCenterPart])) = intersectionScore;
     }
@@ -256,15 +259,11 @@ void SimulatedAnnealing::updateMatricesCenterLocDiffuse(const MCMCParserStateTyp
         case 0://door
             overlapPairs.row(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs.row(state[updateCenterPart]);
             overlapPairs.row(state[updateCenterPart] + static_cast<int>(2)) = overlapPairs.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] + static_cast<int>(2)) = overlapPairs70.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] + static_cast<int>(1)) = overlapArea.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] + static_cast<int>(2)) = overlapArea.row(state[updateCenterPart]);
 
             overlapPairs.col(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs.col(state[updateCenterPart]);
             overlapPairs.col(state[updateCenterPart] + static_cast<int>(2)) = overlapPairs.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] + static_cast<int>(2)) = overlapPairs70.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] + static_cast<int>(1)) = overlapArea.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] + static_cast<int>(2)) = overlapArea.col(state[updateCenterPart]);
             break;
@@ -272,15 +271,11 @@ void SimulatedAnnealing::updateMatricesCenterLocDiffuse(const MCMCParserStateTyp
         case 1://drawer
             overlapPairs.row(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs.row(state[updateCenterPart]);
             overlapPairs.row(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs70.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] + static_cast<int>(1)) = overlapArea.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] - static_cast<int>(1)) = overlapArea.row(state[updateCenterPart]);
 
             overlapPairs.col(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs.col(state[updateCenterPart]);
             overlapPairs.col(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] + static_cast<int>(1)) = overlapPairs70.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] + static_cast<int>(1)) = overlapArea.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] - static_cast<int>(1)) = overlapArea.col(state[updateCenterPart]);
             break;
@@ -288,15 +283,11 @@ void SimulatedAnnealing::updateMatricesCenterLocDiffuse(const MCMCParserStateTyp
         case 2://shelf
             overlapPairs.row(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs.row(state[updateCenterPart]);
             overlapPairs.row(state[updateCenterPart] - static_cast<int>(2)) = overlapPairs.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs70.row(state[updateCenterPart]);
-            //overlapPairs70.row(state[updateCenterPart] - static_cast<int>(2)) = overlapPairs70.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] - static_cast<int>(1)) = overlapArea.row(state[updateCenterPart]);
             overlapArea.row(state[updateCenterPart] - static_cast<int>(2)) = overlapArea.row(state[updateCenterPart]);
 
             overlapPairs.col(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs.col(state[updateCenterPart]);
             overlapPairs.col(state[updateCenterPart] - static_cast<int>(2)) = overlapPairs.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] - static_cast<int>(1)) = overlapPairs70.col(state[updateCenterPart]);
-            //overlapPairs70.col(state[updateCenterPart] - static_cast<int>(2)) = overlapPairs70.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] - static_cast<int>(1)) = overlapArea.col(state[updateCenterPart]);
             overlapArea.col(state[updateCenterPart] - static_cast<int>(2)) = overlapArea.col(state[updateCenterPart]);
             break;
@@ -531,7 +522,6 @@ void SimulatedAnnealing::updateMatricesSplit(const std::vector<Part> partHypothe
 {
     //Initialize
     Eigen::MatrixXi overlapPairsNew = Eigen::MatrixXi::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
-    //Eigen::MatrixXi overlapPairs70New = Eigen::MatrixXi::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
     Eigen::MatrixXf overlapAreaNew = Eigen::MatrixXf::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
 
     for (size_t m = 0; m < partHypotheses.size(); m++)
@@ -545,11 +535,6 @@ void SimulatedAnnealing::updateMatricesSplit(const std::vector<Part> partHypothe
             overlapPairsNew(static_cast<int>(partHypotheses.size()-2),static_cast<int>(m)) = 1;
             overlapPairsNew(static_cast<int>(m),static_cast<int>(partHypotheses.size()-2)) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70New(static_cast<int>(partHypotheses.size()-2),static_cast<int>(m)) = 1;
-            overlapPairs70New(static_cast<int>(m),static_cast<int>(partHypotheses.size()-2)) = 1;
-        }*/
         if(isnan(intersectionScore))
         {
 #if DEBUG_MODE_ON
@@ -576,21 +561,14 @@ void SimulatedAnnealing::updateMatricesSplit(const std::vector<Part> partHypothe
             overlapPairsNew(static_cast<int>(partHypotheses.size()-1),static_cast<int>(m)) = 1;
             overlapPairsNew(static_cast<int>(m),static_cast<int>(partHypotheses.size()-1)) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70New(static_cast<int>(partHypotheses.size()-1),static_cast<int>(m)) = 1;
-            overlapPairs70New(static_cast<int>(m),static_cast<int>(partHypotheses.size()-1)) = 1;
-        }*/
         overlapAreaNew(static_cast<int>(partHypotheses.size()-1),static_cast<int>(m)) = intersectionScore;
         overlapAreaNew(static_cast<int>(m),static_cast<int>(partHypotheses.size()-1)) = intersectionScore;
     }
 
     overlapPairsNew.block(0,0,partHypotheses.size()-3,partHypotheses.size()-3) = overlapPairs;
-    //overlapPairs70New.block(0,0,partHypotheses.size()-3,partHypotheses.size()-3) = overlapPairs70;
     overlapAreaNew.block(0,0,partHypotheses.size()-3,partHypotheses.size()-3) = overlapArea;
 
     overlapPairs = overlapPairsNew;
-    //overlapPairs70 = overlapPairs70New;
     overlapArea = overlapAreaNew;
 
 
@@ -613,7 +591,6 @@ void SimulatedAnnealing::updateMatricesMerge(const std::vector<Part> partHypothe
 {
     //Initialize
     Eigen::MatrixXi overlapPairsMergeNew = Eigen::MatrixXi::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
-    //Eigen::MatrixXi overlapPairs70MergeNew = Eigen::MatrixXi::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
     Eigen::MatrixXf overlapAreaMergeNew = Eigen::MatrixXf::Zero(static_cast<int>(partHypotheses.size()),static_cast<int>(partHypotheses.size()));
 
     for (size_t m = 0; m < partHypotheses.size(); m++)
@@ -627,11 +604,6 @@ void SimulatedAnnealing::updateMatricesMerge(const std::vector<Part> partHypothe
             overlapPairsMergeNew(static_cast<int>(partHypotheses.size()-1),static_cast<int>(m)) = 1;
             overlapPairsMergeNew(static_cast<int>(m),static_cast<int>(partHypotheses.size()-1)) = 1;
         }
-        /*if (intersectionScore > 0.7f && intersectionScore < 1.0f)// Perfect matches also left out
-        {
-            overlapPairs70MergeNew(static_cast<int>(partHypotheses.size()-1),static_cast<int>(m)) = 1;
-            overlapPairs70MergeNew(static_cast<int>(m),static_cast<int>(partHypotheses.size()-1)) = 1;
-        }*/
         if(isnan(intersectionScore))
         {
             std::cout<<"NaN detected in matrix"<<std::endl;
@@ -646,11 +618,9 @@ void SimulatedAnnealing::updateMatricesMerge(const std::vector<Part> partHypothe
     }
 
     overlapPairsMergeNew.block(0,0,partHypotheses.size()-2,partHypotheses.size()-2) = overlapPairs;
-    //overlapPairs70New.block(0,0,partHypotheses.size()-2,partHypotheses.size()-2) = overlapPairs70;
     overlapAreaMergeNew.block(0,0,partHypotheses.size()-2,partHypotheses.size()-2) = overlapArea;
 
     overlapPairs = overlapPairsMergeNew;
-    //overlapPairs70 = overlapPairs70MergeNew;
     overlapArea = overlapAreaMergeNew;
 
 }
@@ -751,28 +721,14 @@ void SimulatedAnnealing::computeMergeability(const MCMCParserStateType state, co
 
 int SimulatedAnnealing::selectRJMCMCMoveType(const float u)
 {
-    int randomMove = -1;
-    float probSum = 0;
-    for (size_t i = 0; i < moveProbabilities.size(); i++)
-    {
-        if (probSum <= u && u < probSum+moveProbabilities[i])
-        {
-            randomMove = static_cast<int>(i);
-            break;
-        }
-        else
-        {
-            probSum += moveProbabilities[i];
-        }
-    }
-    // Did we find a move?
-    if (randomMove < 0)
+    // The energy function adapts the probabilities only occasionally
+    if (moveTableProbabilities != moveProbabilities)
     {
-        // Nope, then we sampled the last move
-        randomMove = static_cast<int>(moveProbabilities.size() - 1);
+        moveTable.build(moveProbabilities);
+        moveTableProbabilities = moveProbabilities;
     }
 
-    return randomMove;
+    return moveTable.sample(u);
 }
 
 /*
@@ -821,6 +777,102 @@ void SimulatedAnnealing::plotMarkovChainState(const MCMCParserStateType state, c
         cv::waitKey(0);
 }
 
+/*
+ * Termination criteria that are checked after every temperature
+ */
+bool SimulatedAnnealing::checkTermination(int iteration, int noUpdateIterations, float bestEnergy, float & plateauEnergy,
+                                          int & plateauStart, const std::chrono::steady_clock::time_point & startTime)
+{
+    if (noUpdateIterations >= maxNoUpdateIterations)
+    {
+        terminationReason = TERMINATION_NO_UPDATE;
+        return true;
+    }
+    
+    // Stop if the energy has not improved significantly for a while
+    if (plateauIterations > 0 && iteration - plateauStart >= plateauIterations)
+    {
+        if (plateauEnergy - bestEnergy <= plateauTolerance*std::abs(plateauEnergy))
+        {
+            terminationReason = TERMINATION_PLATEAU;
+            return true;
+        }
+        plateauEnergy = bestEnergy;
+        plateauStart = iteration;
+    }
+    
+    if (timeBudget > 0)
+    {
+        const std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - startTime;
+        if (elapsed.count() >= timeBudget)
+        {
+            terminationReason = TERMINATION_TIME_BUDGET;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SimulatedAnnealing::beginMoves(const MCMCParserStateType & state)
+{
+    for (size_t m = 0; m < moves.size(); m++)
+    {
+        moves[m]->begin(state);
+    }
+}
+
+void SimulatedAnnealing::notifyMoves()
+{
+    if (bornParts.size() > 0 || diedParts.size() > 0)
+    {
+        for (size_t m = 0; m < moves.size(); m++)
+        {
+            moves[m]->accepted(bornParts, diedParts);
+        }
+    }
+}
+
+bool SimulatedAnnealing::filterChange(const MCMCParserBitsetState & state, const MCMCParserBitsetState & newState)
+{
+    // Moves that fall back to the list representation may report parts 
+    // that were already selected
+    size_t numBorn = 0;
+    for (size_t i = 0; i < bornParts.size(); i++)
+    {
+        if (!state.contains(bornParts[i]) && newState.contains(bornParts[i]))
+        {
+            bornParts[numBorn++] = bornParts[i];
+        }
+    }
+    bornParts.resize(numBorn);
+    
+    size_t numDied = 0;
+    for (size_t i = 0; i < diedParts.size(); i++)
+    {
+        if (state.contains(diedParts[i]) && !newState.contains(diedParts[i]))
+        {
+            diedParts[numDied++] = diedParts[i];
+        }
+    }
+    diedParts.resize(numDied);
+    
+    return numBorn > 0 || numDied > 0;
+}
+
+void SimulatedAnnealing::disableListMoves()
+{
+    // Split and merge append hypotheses and the update moves change their
+    // rectangles, which the bitset state cannot represent
+    const int listMoves[] = {SPLIT_MOVE_IDX, MERGE_MOVE_IDX, UPDATE_CENTER_MOVE_IDX, UPDATE_WIDTH_MOVE_IDX, UPDATE_HEIGHT_MOVE_IDX};
+    for (size_t i = 0; i < sizeof(listMoves)/sizeof(int); i++)
+    {
+        if (listMoves[i] < static_cast<int>(moveProbabilities.size()))
+        {
+            moveProbabilities[listMoves[i]] = 0;
+        }
+    }
+}
+
 /*
  * The trans-dimensional optimization function using simulated annealing variant of rjMCMC
   * Joint optimization over structure and class labels
@@ -836,7 +888,11 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
     std::uniform_real_distribution<float> uniformDist(0,1);
 
     // Get the temperature
-    float temperature = coolingSchedule.getStartTemperature();
+    SACoolingSchedule & schedule = customCoolingSchedule != 0 ? *customCoolingSchedule : coolingSchedule;
+    schedule.reset();
+    float temperature = schedule.getStartTemperature();
+    
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
     // Get the current error
     float currentEnergy = energyFunction.energy(state, moveProbabilities, areas, overlapPairs, overlapArea, partHypotheses);
@@ -844,13 +900,23 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
     // Keep track on the optimum
     float bestEnergy = currentEnergy;
     MCMCParserStateType bestState = state;
+    beginMoves(state);
 
     // Start the optimization
     int iteration = 0;
     int noUpdateIterations = 0;
+    
+    // The best energy at the beginning of the current plateau window
+    float plateauEnergy = bestEnergy;
+    int plateauStart = 0;
+    terminationReason = TERMINATION_TEMPERATURE;
 
     displaySimAnnealParams();
 
+    numIterations = 0;
+    numProposedMoves.assign(moves.size(), 0);
+    numAcceptedMoves.assign(moves.size(), 0);
+
     // Track the move selection: debug purpose
     int exchangeCount = 0, specialExchangeCount = 0, totalExchangeCount = 0;
     int birthCount = 0, specialBirthCount = 0, totalBirthCount = 0;
@@ -865,11 +931,12 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
     float posteriorFactor = 0.0f, moveProbfactor = 0.0f;
 
-    while (temperature > coolingSchedule.getEndTemperature())
+    while (temperature > schedule.getEndTemperature())
     {
         iteration++;
-        temperature = coolingSchedule.calcTemperature(iteration, temperature);
+        temperature = schedule.calcTemperature(iteration, temperature);
         bool update = false;
+        int innerProposed = 0, innerAccepted = 0;
         for (int inner = 0; inner < numInnerLoops; inner++)
         {
 
@@ -880,7 +947,9 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
             // Get the result of the move
             MCMCParserStateType newState;
             float logAcceptRatio;
-            moves[randomMove]->move(state, newState, logAcceptRatio);
+            proposeMove(randomMove, state, newState, logAcceptRatio);
+            numProposedMoves[randomMove]++;
+            innerProposed++;
 
             Rectangle originalCenterRect, originalWidthRect, originalHeightRect;
             Part originalPartB4Split, originalPartB4Merge;
@@ -891,7 +960,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
             imageArea *= gradMag.cols;
 
             Eigen::MatrixXi originalOverlapPairsSplit, originalOverlapPairsMerge, originalOverlapPairsCenter, originalOverlapPairsWidth, originalOverlapPairsHeight;
-            //Eigen::MatrixXi originalOverlapPairs70Split, originalOverlapPairs70Merge, originalOverlapPairs70Center, originalOverlapPairs70Width, originalOverlapPairs70Height;
             Eigen::MatrixXf originalOverlapAreaSplit, originalOverlapAreaMerge, originalOverlapAreaCenter, originalOverlapAreaWidth, originalOverlapAreaHeight;
 
             //Move specific acceptance ratios
@@ -953,7 +1021,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
                     // Update the matrix entries corresponding to the newly formed rectangles
                     originalOverlapPairsSplit = overlapPairs;
-                    //originalOverlapPairs70Split = overlapPairs70;
                     originalOverlapAreaSplit = overlapArea;
                 #if DEBUG_MODE_ON
                     std::cout<<"Size of overlap pair binary matrix before split "<<overlapPairs.rows()<<" x "<<overlapPairs.cols()<<std::endl;
@@ -970,9 +1037,12 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                 #endif
 
                     //Update the state: erase old rectangle and add two new rectangles
+                    diedParts.push_back(newState[splitPart]);
                     newState.erase(newState.begin() + splitPart);// or splitPart-1 confirm?
                     newState.push_back(partHypotheses.size()-1);
                     newState.push_back(partHypotheses.size()-2);
+                    bornParts.push_back(partHypotheses.size()-1);
+                    bornParts.push_back(partHypotheses.size()-2);
 
                 #if DEBUG_MODE_ON
                     std::cout<<"Size of state after split "<<newState.size()<<std::endl;
@@ -1015,7 +1085,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
                     //update the overlap matrices
                     originalOverlapPairsMerge = overlapPairs;
-                    //originalOverlapPairs70Merge = overlapPairs70;
                     originalOverlapAreaMerge = overlapArea;
 
                 #if DEBUG_MODE_ON
@@ -1025,6 +1094,9 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
                     updateMatricesMerge(partHypotheses, mergedRect, overlapPairs, overlapArea);
 
+                    bornParts.push_back(partHypotheses.size()-1);
+                    diedParts.push_back(newState[rectIdx1]);
+                    diedParts.push_back(newState[rectIdx2]);
                     newState.push_back(partHypotheses.size()-1);
                     newState.erase(newState.begin() + rectIdx1);
                     newState.erase(newState.begin() + rectIdx2 - 1);// the location decreases by one with previos erase
@@ -1100,7 +1172,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                 partHypotheses[state[updateCenterPart]].rect = modifiedCenterRect;
                 //update the overlap matrices
                 originalOverlapPairsCenter = overlapPairs;
-                //originalOverlapPairs70Center = overlapPairs70;
                 originalOverlapAreaCenter = overlapArea;
                 updateMatricesCenterLocDiffuse(state,
                                                partHypotheses,
@@ -1134,7 +1205,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
                 //update the overlap matrices
                 originalOverlapPairsWidth = overlapPairs;
-                //originalOverlapPairs70Width = overlapPairs70;
                 originalOverlapAreaWidth = overlapArea;
 
                 updateMatricesWidthDiffuse(state,
@@ -1175,7 +1245,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
                 //update the overlap matrices
                 originalOverlapPairsHeight = overlapPairs;
-                //originalOverlapPairs70Height = overlapPairs70;
                 originalOverlapAreaHeight = overlapArea;
 
                 updateMatricesHeightDiffuse(state,
@@ -1210,7 +1279,10 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
             {
                 // We improved the energy, accept this step
                 currentEnergy = newError;
+                notifyMoves();
                 state = newState;
+                numAcceptedMoves[randomMove]++;
+                innerAccepted++;
 #if DEBUG_MODE_ON
                 plotMarkovChainState(state, partHypotheses);
                 std::cout <<"blind accept temperature: "<<temperature<<" energy: "<<newError<< "\n";
@@ -1283,7 +1355,10 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                 if (std::log(u) <= -logAcceptRatio)
                 {
                     currentEnergy = newError;
+                    notifyMoves();
                     state = newState;
+                    numAcceptedMoves[randomMove]++;
+                    innerAccepted++;
 
 #if DEBUG_MODE_ON
                     plotMarkovChainState(state, partHypotheses);
@@ -1366,7 +1441,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                         areas.pop_back();
                         areas.pop_back();
                         overlapPairs = originalOverlapPairsSplit;
-                        //overlapPairs70 = originalOverlapPairs70Split;
                         overlapArea = originalOverlapAreaSplit;
 
                     }
@@ -1375,7 +1449,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                         partHypotheses.pop_back();
                         areas.pop_back();
                         overlapPairs = originalOverlapPairsMerge;
-                        //overlapPairs70 = originalOverlapPairs70Merge;
                         overlapArea = originalOverlapAreaMerge;
                         //partHypotheses[state[updateCenterPart]].rect = originalCenterRect;
                         //std::cout<<"Rejected update Part is : "<<replacePart<<" out of :"<<proposals.size()<<std::endl;
@@ -1384,7 +1457,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                     {
                         partHypotheses[state[updateCenterPart]].rect = originalCenterRect;
                         overlapPairs = originalOverlapPairsCenter;
-                        //overlapPairs70 = originalOverlapPairs70Center;
                         overlapArea = originalOverlapAreaCenter;
                         //std::cout<<"Rejected update Part is : "<<replacePart<<" out of :"<<proposals.size()<<std::endl;
                     }
@@ -1410,7 +1482,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                         }
 
                         overlapPairs = originalOverlapPairsWidth;
-                        //overlapPairs70 = originalOverlapPairs70Width;
                         overlapArea = originalOverlapAreaWidth;
                     }
                     else if(randomMove == UPDATE_HEIGHT_MOVE_IDX)
@@ -1439,7 +1510,6 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
                         std::cout<<"Reject Rect area/ ROI area : "<<originalHeightRect.getArea()/imageArea<<std::endl;
 #endif
                         overlapPairs = originalOverlapPairsHeight;
-                        //overlapPairs70 = originalOverlapPairs70Height;
                         overlapArea = originalOverlapAreaHeight;
                     }
                 }
@@ -1460,6 +1530,8 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
         {
             noUpdateIterations = 0;
         }
+        
+        schedule.update(iteration, innerProposed > 0 ? innerAccepted/static_cast<float>(innerProposed) : 0.0f);
 
         // Call the callback functions
 #if 1
@@ -1471,22 +1543,26 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
 
         if (result < 0)
         {
+            terminationReason = TERMINATION_CALLBACK;
             break;
         }
 
 #endif
-        if (noUpdateIterations >= maxNoUpdateIterations)
+        if (checkTermination(iteration, noUpdateIterations, bestEnergy, plateauEnergy, plateauStart, startTime))
         {
             break;
         }
     }
 
+    numIterations = iteration;
+
     /*
      * Move statistics: for debug purpose
     */
 
     std::cout<<"No of effective best state no updates: "<<noUpdateIterations<<std::endl;
     std::cout<<"Convergence temperature: "<<temperature<<std::endl;
+    std::cout<<"Iterations used: "<<numIterations<<" (termination reason "<<terminationReason<<")"<<std::endl;
     std::cout<<std::endl;
 
     std::cout<<"Optimization complete"<<std::endl<<std::endl;
@@ -1538,3 +1614,141 @@ float SimulatedAnnealing::optimize(MCMCParserStateType & state)
     state = bestState;
     return bestEnergy;
 }
+
+/*
+ * Simulated annealing on the bitset state. This only supports moves that 
+ * change the state, but it does not allocate memory in the inner loop.
+ */
+float SimulatedAnnealing::optimize(MCMCParserBitsetState & state)
+{
+    std::mt19937 g(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+    std::uniform_real_distribution<float> uniformDist(0,1);
+
+    // Get the temperature
+    SACoolingSchedule & schedule = customCoolingSchedule != 0 ? *customCoolingSchedule : coolingSchedule;
+    schedule.reset();
+    float temperature = schedule.getStartTemperature();
+    
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // Get the current error
+    float currentEnergy = energyFunction.energy(state, moveProbabilities, areas, overlapPairs, overlapArea, partHypotheses);
+    disableListMoves();
+
+    // Keep track on the optimum. The states are only allocated once.
+    float bestEnergy = currentEnergy;
+    MCMCParserBitsetState bestState(state);
+    MCMCParserBitsetState newState(state);
+    
+    MCMCParserStateType initialState;
+    state.toVector(initialState);
+    beginMoves(initialState);
+
+    int iteration = 0;
+    int noUpdateIterations = 0;
+    float plateauEnergy = bestEnergy;
+    int plateauStart = 0;
+    terminationReason = TERMINATION_TEMPERATURE;
+
+    displaySimAnnealParams();
+
+    numIterations = 0;
+    numProposedMoves.assign(moves.size(), 0);
+    numAcceptedMoves.assign(moves.size(), 0);
+
+    while (temperature > schedule.getEndTemperature())
+    {
+        iteration++;
+        temperature = schedule.calcTemperature(iteration, temperature);
+        bool update = false;
+        int innerProposed = 0, innerAccepted = 0;
+        for (int inner = 0; inner < numInnerLoops; inner++)
+        {
+            // Choose a move at random
+            const int randomMove = selectRJMCMCMoveType(uniformDist(g));
+
+            float logAcceptRatio;
+            proposeMove(randomMove, state, newState, logAcceptRatio);
+            numProposedMoves[randomMove]++;
+            innerProposed++;
+
+            // Proposals that leave the state unchanged (e.g. a birth of a 
+            // selected part) are rejected
+            if (!filterChange(state, newState))
+            {
+                continue;
+            }
+
+            // Birth and death are reversible jumps of each other
+            float moveProbfactor = 0.0f;
+            if (randomMove == BIRTH_MOVE_IDX && moveProbabilities.size() > DEATH_MOVE_IDX)
+            {
+                moveProbfactor = std::log((double)moveProbabilities[DEATH_MOVE_IDX]/moveProbabilities[BIRTH_MOVE_IDX]);
+            }
+            else if (randomMove == DEATH_MOVE_IDX)
+            {
+                moveProbfactor = std::log((double)moveProbabilities[BIRTH_MOVE_IDX]/moveProbabilities[DEATH_MOVE_IDX]);
+            }
+
+            const float newEnergy = energyFunction.energy(newState, moveProbabilities, areas, overlapPairs, overlapArea, partHypotheses);
+            disableListMoves();
+            logAcceptRatio += (newEnergy - currentEnergy)/temperature + moveProbfactor;
+
+            // Metropolis-Hastings acceptance
+            if (logAcceptRatio <= 0 || std::log(uniformDist(g)) <= -logAcceptRatio)
+            {
+                currentEnergy = newEnergy;
+                notifyMoves();
+                state.swap(newState);
+                numAcceptedMoves[randomMove]++;
+                innerAccepted++;
+
+                if (currentEnergy < bestEnergy)
+                {
+                    bestEnergy = currentEnergy;
+                    bestState.copyFrom(state);
+                    update = true;
+                }
+            }
+        }
+
+        if (!update)
+        {
+            noUpdateIterations++;
+        }
+        else
+        {
+            noUpdateIterations = 0;
+        }
+        
+        schedule.update(iteration, innerProposed > 0 ? innerAccepted/static_cast<float>(innerProposed) : 0.0f);
+
+        // Call the callback functions
+        int result = 0;
+        for (size_t i = 0; i < callbacks.size(); i++)
+        {
+            result = std::min(result, callbacks[i]->callback(state, currentEnergy, bestState, bestEnergy, iteration, temperature));
+        }
+
+        if (result < 0)
+        {
+            terminationReason = TERMINATION_CALLBACK;
+            break;
+        }
+
+        if (checkTermination(iteration, noUpdateIterations, bestEnergy, plateauEnergy, plateauStart, startTime))
+        {
+            break;
+        }
+    }
+
+    numIterations = iteration;
+
+    std::cout<<"No of effective best state no updates: "<<noUpdateIterations<<std::endl;
+    std::cout<<"Convergence temperature: "<<temperature<<std::endl;
+    std::cout<<"Iterations used: "<<numIterations<<" (termination reason "<<terminationReason<<")"<<std::endl;
+    std::cout<<std::endl;
+
+    state.copyFrom(bestState);
+    return bestEnergy;
+}
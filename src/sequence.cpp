@@ -0,0 +1,212 @@
+#include "parser/sequence.h"
+#include "parser/processing.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace parser;
+
+/**
+ * Edges of the two frames that are at most this many pixels apart match
+ */
+static const int EDGE_MATCH_RADIUS = 2;
+
+/**
+ * Counts the edge pixels of an image that are not covered by the dilated
+ * edges of the other image
+ */
+static int countUnmatchedEdges(const cv::Mat & edges, const cv::Mat & dilatedOther, const cv::Mat & mask, int & numEdges)
+{
+    int numUnmatched = 0;
+    numEdges = 0;
+    for (int i = 0; i < edges.rows; i++)
+    {
+        for (int j = 0; j < edges.cols; j++)
+        {
+            if (edges.at<uchar>(i,j) == 0 || mask.at<uchar>(i,j) == 0)
+            {
+                continue;
+            }
+            numEdges++;
+            if (dilatedOther.at<uchar>(i,j) == 0)
+            {
+                numUnmatched++;
+            }
+        }
+    }
+    return numUnmatched;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// SequenceState
+////////////////////////////////////////////////////////////////////////////////
+
+void SequenceState::reset()
+{
+    edgeImage.release();
+    proposals.clear();
+    parts.clear();
+    numFrames = 0;
+    numWarmFrames = 0;
+    framesSinceKeyframe = 0;
+}
+
+float SequenceState::computeRegionMotion(const Rectangle & currentRegion) const
+{
+    const float diagonal = std::sqrt(currentRegion.getWidth()*currentRegion.getWidth() + currentRegion.getHeight()*currentRegion.getHeight());
+    if (diagonal <= 0)
+    {
+        return 0;
+    }
+
+    float motion = 0;
+    for (int v = 0; v < 4; v++)
+    {
+        motion = std::max(motion, static_cast<float>(cv::norm(currentRegion[v] - region[v])));
+    }
+    return motion/diagonal;
+}
+
+void SequenceState::computeFrameHomography(const Rectangle & currentRegion, int rectifiedSize, cv::Mat & homography) const
+{
+    // Both frames are rectified to the same cabinet front, hence the corners
+    // of the rectified regions correspond
+    Rectangle lastRectified, currentRectified;
+    Processing::computeRectifiedRegionOfInterest(region, rectifiedSize, lastRectified);
+    Processing::computeRectifiedRegionOfInterest(currentRegion, rectifiedSize, currentRectified);
+    Processing::computeHomography(lastRectified, currentRectified, homography);
+}
+
+bool SequenceState::canWarmStart(   const Rectangle & currentRegion,
+                                    const cv::Mat & currentEdgeImage,
+                                    int rectifiedSize,
+                                    std::vector<Rectangle> & trackedProposals,
+                                    std::vector<Part> & trackedParts) const
+{
+    trackedProposals.clear();
+    trackedParts.clear();
+
+    if (!isValid() || framesSinceKeyframe + 1 >= model.keyframeInterval)
+    {
+        return false;
+    }
+
+    if (computeRegionMotion(currentRegion) > model.maxRegionMotion)
+    {
+        return false;
+    }
+
+    cv::Mat homography;
+    computeFrameHomography(currentRegion, rectifiedSize, homography);
+
+    if (computeEdgeChange(edgeImage, currentEdgeImage, homography) > model.maxEdgeChange)
+    {
+        return false;
+    }
+
+    warpRectangles(homography, proposals, trackedProposals);
+
+    std::vector<Rectangle> partRectangles(parts.size()), warpedPartRectangles;
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        partRectangles[p] = parts[p].rect;
+    }
+    warpRectangles(homography, partRectangles, warpedPartRectangles);
+
+    trackedParts = parts;
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        trackedParts[p].rect = warpedPartRectangles[p];
+    }
+
+    return true;
+}
+
+void SequenceState::update( const Rectangle & currentRegion,
+                            const cv::Mat & currentEdgeImage,
+                            const std::vector<Rectangle> & currentProposals,
+                            const std::vector<Part> & currentParts,
+                            bool warm)
+{
+    region = currentRegion;
+    currentEdgeImage.copyTo(edgeImage);
+    proposals = currentProposals;
+    parts = currentParts;
+
+    numFrames++;
+    if (warm)
+    {
+        numWarmFrames++;
+        framesSinceKeyframe++;
+    }
+    else
+    {
+        framesSinceKeyframe = 0;
+    }
+}
+
+void SequenceState::warpRectangles(const cv::Mat & homography, const std::vector<Rectangle> & in, std::vector<Rectangle> & out)
+{
+    out.resize(in.size());
+    if (in.size() == 0)
+    {
+        return;
+    }
+
+    std::vector<cv::Point2f> corners(4*in.size()), warped;
+    for (size_t r = 0; r < in.size(); r++)
+    {
+        for (int v = 0; v < 4; v++)
+        {
+            corners[4*r + v] = cv::Point2f(in[r][v][0], in[r][v][1]);
+        }
+    }
+
+    cv::Mat H;
+    homography.convertTo(H, CV_64F);
+    cv::perspectiveTransform(corners, warped, H);
+
+    for (size_t r = 0; r < in.size(); r++)
+    {
+        const cv::Point2f* p = &warped[4*r];
+
+        // Average the opposite sides in order to get an axis aligned
+        // rectangle again
+        const float x0 = 0.5f*(p[0].x + p[3].x);
+        const float x1 = 0.5f*(p[1].x + p[2].x);
+        const float y0 = 0.5f*(p[0].y + p[1].y);
+        const float y1 = 0.5f*(p[2].y + p[3].y);
+
+        out[r] = Rectangle(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1));
+        out[r].normalize();
+    }
+}
+
+float SequenceState::computeEdgeChange(const cv::Mat & previous, const cv::Mat & current, const cv::Mat & homography)
+{
+    if (previous.empty() || current.empty())
+    {
+        return 1;
+    }
+
+    // Warp the edges of the last frame and mark the pixels that are covered
+    // by the last frame at all
+    cv::Mat warped, mask;
+    cv::warpPerspective(previous, warped, homography, current.size(), cv::INTER_NEAREST);
+    cv::warpPerspective(cv::Mat(previous.size(), CV_8UC1, cv::Scalar(255)), mask, homography, current.size(), cv::INTER_NEAREST);
+
+    const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2*EDGE_MATCH_RADIUS + 1, 2*EDGE_MATCH_RADIUS + 1));
+    cv::Mat dilatedWarped, dilatedCurrent;
+    cv::dilate(warped, dilatedWarped, kernel);
+    cv::dilate(current, dilatedCurrent, kernel);
+
+    int numCurrent, numWarped;
+    const int unmatchedCurrent = countUnmatchedEdges(current, dilatedWarped, mask, numCurrent);
+    const int unmatchedWarped = countUnmatchedEdges(warped, dilatedCurrent, mask, numWarped);
+
+    if (numCurrent + numWarped == 0)
+    {
+        return 0;
+    }
+    return (unmatchedCurrent + unmatchedWarped)/static_cast<float>(numCurrent + numWarped);
+}
@@ -0,0 +1,114 @@
+#include "parser/serialization.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <algorithm>
+
+using namespace parser;
+
+////////////////////////////////////////////////////////////////////////////////
+//// ContentHasher
+////////////////////////////////////////////////////////////////////////////////
+
+void ContentHasher::update(const cv::Mat & mat)
+{
+    updateValue(static_cast<int32_t>(mat.type()));
+    updateValue(static_cast<int32_t>(mat.rows));
+    updateValue(static_cast<int32_t>(mat.cols));
+
+    // The rows are not necessarily continuous
+    const size_t rowSize = mat.cols*mat.elemSize();
+    for (int i = 0; i < mat.rows; i++)
+    {
+        update(mat.ptr(i), rowSize);
+    }
+}
+
+std::string ContentHasher::getHex() const
+{
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << state;
+    return ss.str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// Values and files
+////////////////////////////////////////////////////////////////////////////////
+
+void parser::appendRectangle(std::string & buffer, const Rectangle & rect)
+{
+    for (int v = 0; v < 4; v++)
+    {
+        appendValue(buffer, static_cast<float>(rect[v][0]));
+        appendValue(buffer, static_cast<float>(rect[v][1]));
+    }
+}
+
+bool parser::readRectangle(const std::string & buffer, size_t & offset, Rectangle & rect)
+{
+    for (int v = 0; v < 4; v++)
+    {
+        float x, y;
+        if (!readValue(buffer, offset, x) || !readValue(buffer, offset, y))
+        {
+            return false;
+        }
+        rect[v] = Vec2(x, y);
+    }
+    return true;
+}
+
+void parser::beginFile(std::string & buffer, const char (&magic)[4], uint32_t version)
+{
+    buffer.assign(magic, sizeof(magic));
+    appendValue(buffer, version);
+}
+
+bool parser::finishFile(const std::string & file, std::string & buffer)
+{
+    // The checksum detects truncated and corrupted files
+    ContentHasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    appendValue(buffer, hasher.getHash());
+
+    std::ofstream os(file, std::ios::binary);
+    if (!os.is_open())
+    {
+        return false;
+    }
+    os.write(buffer.data(), buffer.size());
+    return static_cast<bool>(os);
+}
+
+bool parser::readFile(const std::string & file, const char (&magic)[4], uint32_t version, std::string & buffer, size_t & offset)
+{
+    std::ifstream is(file, std::ios::binary);
+    if (!is.is_open())
+    {
+        return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+
+    // Verify the checksum
+    if (buffer.size() < sizeof(magic) + sizeof(uint32_t) + sizeof(uint64_t) || !std::equal(magic, magic + sizeof(magic), buffer.begin()))
+    {
+        return false;
+    }
+    const size_t payloadSize = buffer.size() - sizeof(uint64_t);
+    ContentHasher hasher;
+    hasher.update(buffer.data(), payloadSize);
+    uint64_t checksum;
+    offset = payloadSize;
+    readValue(buffer, offset, checksum);
+    if (checksum != hasher.getHash())
+    {
+        return false;
+    }
+    buffer.resize(payloadSize);
+
+    offset = sizeof(magic);
+    uint32_t fileVersion;
+    return readValue(buffer, offset, fileVersion) && fileVersion == version;
+}
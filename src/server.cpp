@@ -0,0 +1,560 @@
+#include "parser/server.h"
+#include "parser/serialization.h"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace parser;
+
+/**
+ * The interval in milliseconds in which the accept loop checks whether the
+ * server shall stop
+ */
+static const int ACCEPT_POLL_INTERVAL = 200;
+
+/**
+ * The time in seconds in which a frame has to arrive completely once it has
+ * started. The sockets of the server have a receive timeout, so the reads 
+ * are retried until then.
+ */
+static const int FRAME_TIMEOUT = 30;
+
+/**
+ * Reads exactly size bytes from the socket. Returns false if the deadline 
+ * passes before.
+ */
+static bool readFully(int fd, char* buffer, size_t size, const std::chrono::steady_clock::time_point & deadline)
+{
+    while (size > 0)
+    {
+        const ssize_t n = ::recv(fd, buffer, size, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && std::chrono::steady_clock::now() < deadline)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Writes exactly size bytes to the socket
+ */
+static bool writeFully(int fd, const char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t n = ::send(fd, buffer, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * Appends an image to the payload
+ */
+static void appendImage(std::string & payload, const cv::Mat & _image)
+{
+    cv::Mat image = _image.isContinuous() ? _image : _image.clone();
+    appendValue(payload, static_cast<int32_t>(image.rows));
+    appendValue(payload, static_cast<int32_t>(image.cols));
+    appendValue(payload, static_cast<int32_t>(image.type()));
+    payload.append(reinterpret_cast<const char*>(image.data), image.total()*image.elemSize());
+}
+
+/**
+ * Reads an image from the payload
+ */
+static bool extractImage(const std::string & payload, size_t & offset, cv::Mat & image)
+{
+    int32_t rows, cols, type;
+    if (!readValue(payload, offset, rows) || !readValue(payload, offset, cols) || !readValue(payload, offset, type))
+    {
+        return false;
+    }
+    if (rows < 0 || cols < 0 || type < 0 || type > CV_MAT_TYPE_MASK || CV_MAT_DEPTH(type) > CV_64F)
+    {
+        return false;
+    }
+
+    // Check the size before allocating the image. The remaining payload is
+    // divided instead of multiplying the dimensions, which could overflow.
+    const size_t elemSize = CV_ELEM_SIZE(type);
+    const size_t available = payload.size() - offset;
+    if (cols != 0 && static_cast<size_t>(rows) > available/static_cast<size_t>(cols)/elemSize)
+    {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(rows)*static_cast<size_t>(cols)*elemSize;
+
+    image.create(rows, cols, type);
+    std::memcpy(image.data, payload.data() + offset, size);
+    offset += size;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseProtocol
+////////////////////////////////////////////////////////////////////////////////
+
+const uint8_t ParseProtocol::MESSAGE_PARSE_REQUEST;
+const uint8_t ParseProtocol::MESSAGE_PARSE_RESPONSE;
+const uint8_t ParseProtocol::MESSAGE_ERROR;
+const uint32_t ParseProtocol::MAX_PAYLOAD_SIZE;
+
+bool ParseProtocol::writeFrame(int fd, uint8_t type, const std::string & payload)
+{
+    if (payload.size() > MAX_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+
+    std::string header;
+    appendValue(header, static_cast<uint32_t>(payload.size()));
+    appendValue(header, type);
+    return writeFully(fd, header.data(), header.size()) && writeFully(fd, payload.data(), payload.size());
+}
+
+bool ParseProtocol::readFrame(int fd, uint8_t & type, std::string & payload)
+{
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(FRAME_TIMEOUT);
+    char header[sizeof(uint32_t) + sizeof(uint8_t)];
+    if (!readFully(fd, header, sizeof(header), deadline))
+    {
+        return false;
+    }
+
+    uint32_t size;
+    std::memcpy(&size, header, sizeof(uint32_t));
+    std::memcpy(&type, header + sizeof(uint32_t), sizeof(uint8_t));
+    if (size > MAX_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+
+    payload.resize(size);
+    return size == 0 || readFully(fd, &payload[0], size, deadline);
+}
+
+void ParseProtocol::encodeRequest(const cv::Mat & image, const cv::Mat & imageDepth, const Rectangle & region, std::string & payload)
+{
+    payload.clear();
+    appendRectangle(payload, region);
+    appendImage(payload, image);
+    appendImage(payload, imageDepth);
+}
+
+bool ParseProtocol::decodeRequest(const std::string & payload, cv::Mat & image, cv::Mat & imageDepth, Rectangle & region)
+{
+    size_t offset = 0;
+    return  readRectangle(payload, offset, region) &&
+            extractImage(payload, offset, image) &&
+            extractImage(payload, offset, imageDepth) &&
+            offset == payload.size();
+}
+
+void ParseProtocol::encodeResponse(const std::vector<Part> & parts, const std::vector< std::pair<std::string, double> > & timings, std::string & payload)
+{
+    payload.clear();
+    appendValue(payload, static_cast<uint32_t>(parts.size()));
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        appendRectangle(payload, parts[p].rect);
+        appendValue(payload, static_cast<int32_t>(parts[p].label));
+        appendValue(payload, static_cast<float>(parts[p].posterior));
+    }
+
+    appendValue(payload, static_cast<uint32_t>(timings.size()));
+    for (size_t t = 0; t < timings.size(); t++)
+    {
+        appendValue(payload, static_cast<uint16_t>(timings[t].first.size()));
+        payload.append(timings[t].first);
+        appendValue(payload, timings[t].second);
+    }
+}
+
+bool ParseProtocol::decodeResponse(const std::string & payload, std::vector<Part> & parts, std::vector< std::pair<std::string, double> > & timings)
+{
+    size_t offset = 0;
+
+    uint32_t numParts;
+    if (!readValue(payload, offset, numParts))
+    {
+        return false;
+    }
+    parts.clear();
+    for (uint32_t p = 0; p < numParts; p++)
+    {
+        Part part;
+        int32_t label;
+        float posterior;
+        if (!readRectangle(payload, offset, part.rect) || !readValue(payload, offset, label) || !readValue(payload, offset, posterior))
+        {
+            return false;
+        }
+        part.label = label;
+        part.posterior = posterior;
+        parts.push_back(part);
+    }
+
+    uint32_t numTimings;
+    if (!readValue(payload, offset, numTimings))
+    {
+        return false;
+    }
+    timings.clear();
+    for (uint32_t t = 0; t < numTimings; t++)
+    {
+        uint16_t length;
+        if (!readValue(payload, offset, length) || offset + length > payload.size())
+        {
+            return false;
+        }
+        const std::string name = payload.substr(offset, length);
+        offset += length;
+
+        double seconds;
+        if (!readValue(payload, offset, seconds))
+        {
+            return false;
+        }
+        timings.push_back(std::make_pair(name, seconds));
+    }
+
+    return offset == payload.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseServer
+////////////////////////////////////////////////////////////////////////////////
+
+ParseServer::~ParseServer()
+{
+    if (listenFd >= 0)
+    {
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+bool ParseServer::listen(const std::string & _socketPath)
+{
+    sockaddr_un address;
+    if (_socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cout << "Socket path too long: " << _socketPath << std::endl;
+        return false;
+    }
+
+    listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        std::cout << "Could not create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, _socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    ::unlink(_socketPath.c_str());
+    if (::bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listenFd, SOMAXCONN) < 0)
+    {
+        std::cout << "Could not listen on " << _socketPath << ": " << std::strerror(errno) << std::endl;
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    socketPath = _socketPath;
+    return true;
+}
+
+void ParseServer::run()
+{
+    std::vector<std::thread> workers;
+    for (int w = 0; w < std::max(1, model.numWorkers); w++)
+    {
+        workers.push_back(std::thread(&ParseServer::work, this));
+    }
+
+    while (!stopped)
+    {
+        pollfd request;
+        request.fd = listenFd;
+        request.events = POLLIN;
+        if (::poll(&request, 1, ACCEPT_POLL_INTERVAL) <= 0)
+        {
+            continue;
+        }
+
+        const int fd = ::accept(listenFd, 0, 0);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        bool rejected = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (static_cast<int>(pending.size()) >= model.maxPendingConnections)
+            {
+                rejected = true;
+            }
+            else
+            {
+                pending.push_back(fd);
+            }
+        }
+
+        if (rejected)
+        {
+            numRejected++;
+            ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_ERROR, "server busy");
+            ::close(fd);
+        }
+        else
+        {
+            condition.notify_one();
+        }
+    }
+
+    condition.notify_all();
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        workers[w].join();
+    }
+
+    // Close the connections that have not been served
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        ::close(pending[i]);
+    }
+    pending.clear();
+}
+
+void ParseServer::work()
+{
+    // Every worker has its own parser such that the instrumentation records
+    // do not interfere, the models loaded at server start are shared
+    CabinetParser worker;
+    worker.shareModels(parser);
+    worker.getInstrumentation().setEnabled(true);
+
+#ifdef _OPENMP
+    // The number of threads applies to the parallel regions started by this
+    // thread only
+    int numThreads = model.numThreadsPerWorker;
+    if (numThreads <= 0)
+    {
+        numThreads = std::max(1, omp_get_num_procs()/std::max(1, model.numWorkers));
+    }
+    omp_set_num_threads(numThreads);
+#endif
+
+    while (true)
+    {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopped || !pending.empty(); });
+            if (stopped)
+            {
+                return;
+            }
+            fd = pending.front();
+            pending.pop_front();
+        }
+
+        serveConnection(worker, fd);
+        ::close(fd);
+    }
+}
+
+void ParseServer::serveConnection(CabinetParser & worker, int fd)
+{
+    // Do not block the shutdown forever on idle connections
+    timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string payload;
+    while (!stopped)
+    {
+        pollfd request;
+        request.fd = fd;
+        request.events = POLLIN;
+        const int ready = ::poll(&request, 1, ACCEPT_POLL_INTERVAL);
+        if (ready == 0)
+        {
+            continue;
+        }
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        uint8_t type;
+        if (ready < 0 || !ParseProtocol::readFrame(fd, type, payload))
+        {
+            return;
+        }
+
+        // Decoding allocates the images, hence an exception must not leave
+        // the worker thread
+        std::vector<Part> parts;
+        try
+        {
+            cv::Mat image, imageDepth;
+            Rectangle region;
+            if (type != ParseProtocol::MESSAGE_PARSE_REQUEST || !ParseProtocol::decodeRequest(payload, image, imageDepth, region))
+            {
+                numErrors++;
+                ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_ERROR, "malformed request");
+                return;
+            }
+
+            worker.parse(image, imageDepth, region, parts);
+        }
+        catch (const std::exception & e)
+        {
+            numErrors++;
+            if (!ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_ERROR, e.what()))
+            {
+                return;
+            }
+            continue;
+        }
+        catch (...)
+        {
+            numErrors++;
+            if (!ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_ERROR, "parse failed"))
+            {
+                return;
+            }
+            continue;
+        }
+
+        numRequests++;
+        ParseProtocol::encodeResponse(parts, worker.getInstrumentation().getRecord().timings, payload);
+        if (!ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_PARSE_RESPONSE, payload))
+        {
+            return;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// ParseClient
+////////////////////////////////////////////////////////////////////////////////
+
+bool ParseClient::connect(const std::string & socketPath)
+{
+    close();
+
+    sockaddr_un address;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ParseClient::close()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool ParseClient::parse(const cv::Mat & image,
+                        const cv::Mat & imageDepth,
+                        const Rectangle & region,
+                        std::vector<Part> & parts,
+                        std::vector< std::pair<std::string, double> > & timings,
+                        std::string & error)
+{
+    if (fd < 0)
+    {
+        error = "not connected";
+        return false;
+    }
+
+    std::string payload;
+    ParseProtocol::encodeRequest(image, imageDepth, region, payload);
+    if (!ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_PARSE_REQUEST, payload))
+    {
+        error = "connection lost";
+        close();
+        return false;
+    }
+
+    uint8_t type;
+    if (!ParseProtocol::readFrame(fd, type, payload))
+    {
+        error = "connection lost";
+        close();
+        return false;
+    }
+
+    if (type == ParseProtocol::MESSAGE_ERROR)
+    {
+        error = payload;
+        return false;
+    }
+    if (type != ParseProtocol::MESSAGE_PARSE_RESPONSE || !ParseProtocol::decodeResponse(payload, parts, timings))
+    {
+        error = "malformed response";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+#include "parser/shape_prior.h"
+#include "parser/serialization.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace parser;
+
+/**
+ * The file header and the version of the shape prior format
+ */
+static const char PRIOR_MAGIC[4] = {'P', 'S', 'H', 'P'};
+static const uint32_t PRIOR_VERSION = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+//// LinearShapePrior
+////////////////////////////////////////////////////////////////////////////////
+
+void LinearShapePrior::reduceSVM(const CvSVM & svm, Eigen::VectorXf & weights, float & bias)
+{
+    const int F = svm.get_var_count();
+    cv::Mat sample = cv::Mat::zeros(1, F, CV_32FC1);
+
+    bias = svm.predict(sample, true);
+    weights.resize(F);
+    for (int f = 0; f < F; f++)
+    {
+        sample.at<float>(0, f) = 1;
+        weights(f) = svm.predict(sample, true) - bias;
+        sample.at<float>(0, f) = 0;
+    }
+}
+
+bool LinearShapePrior::loadSVMs(const std::vector<std::string> & files)
+{
+    Eigen::MatrixXf newWeights;
+    Eigen::VectorXf newBiases(files.size());
+
+    for (size_t l = 0; l < files.size(); l++)
+    {
+        CvSVM svm;
+        svm.load(files[l].c_str());
+        if (svm.get_var_count() <= 0)
+        {
+            return false;
+        }
+
+        Eigen::VectorXf w;
+        float b;
+        reduceSVM(svm, w, b);
+        if (l == 0)
+        {
+            newWeights.resize(w.size(), files.size());
+        }
+        else if (w.size() != newWeights.rows())
+        {
+            return false;
+        }
+        newWeights.col(l) = w;
+        newBiases(l) = b;
+    }
+
+    weights.swap(newWeights);
+    biases.swap(newBiases);
+    return true;
+}
+
+bool LinearShapePrior::save(const std::string & file) const
+{
+    std::string buffer;
+    beginFile(buffer, PRIOR_MAGIC, PRIOR_VERSION);
+    appendValue(buffer, static_cast<uint32_t>(getNumFeatures()));
+    appendValue(buffer, static_cast<uint32_t>(getNumLabels()));
+    for (int l = 0; l < getNumLabels(); l++)
+    {
+        for (int f = 0; f < getNumFeatures(); f++)
+        {
+            appendValue(buffer, weights(f, l));
+        }
+        appendValue(buffer, biases(l));
+    }
+
+    return finishFile(file, buffer);
+}
+
+bool LinearShapePrior::load(const std::string & file)
+{
+    std::string buffer;
+    size_t offset;
+    if (!readFile(file, PRIOR_MAGIC, PRIOR_VERSION, buffer, offset))
+    {
+        return false;
+    }
+
+    uint32_t numFeatures, numLabels;
+    if (!readValue(buffer, offset, numFeatures) || !readValue(buffer, offset, numLabels) ||
+        offset + static_cast<size_t>(numFeatures + 1)*numLabels*sizeof(float) != buffer.size())
+    {
+        return false;
+    }
+
+    weights.resize(numFeatures, numLabels);
+    biases.resize(numLabels);
+    for (uint32_t l = 0; l < numLabels; l++)
+    {
+        for (uint32_t f = 0; f < numFeatures; f++)
+        {
+            readValue(buffer, offset, weights(f, l));
+        }
+        readValue(buffer, offset, biases(l));
+    }
+    return true;
+}
+
+void LinearShapePrior::computeDecisionValues(const Eigen::MatrixXf & features, Eigen::MatrixXf & values) const
+{
+    values.noalias() = features*weights;
+    values.rowwise() += biases.transpose();
+}
+
+void LinearShapePrior::computePriors(const Eigen::MatrixXf & features, float steepness, Eigen::MatrixXf & priors) const
+{
+    computeDecisionValues(features, priors);
+    priors = (1 - 1/(1 + (-steepness*priors.array()).exp())).matrix();
+}
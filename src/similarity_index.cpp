@@ -0,0 +1,193 @@
+#include "parser/similarity_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace parser;
+
+/**
+ * The maximum number of grid cells per dimension
+ */
+static const int MAX_GRID_CELLS = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+//// SimilarityIndex
+////////////////////////////////////////////////////////////////////////////////
+
+float SimilarityIndex::calcOverlapScore(const float* bounds1, const float* bounds2)
+{
+    // Same computation as RectangleUtil::calcIntersection and getArea
+    float x1 = std::max(bounds1[0], bounds2[0]);
+    float x2 = std::min(bounds1[2], bounds2[2]);
+    float y1 = std::max(bounds1[1], bounds2[1]);
+    float y2 = std::min(bounds1[3], bounds2[3]);
+
+    if (x1 >= x2 || y1 >= y2)
+    {
+        x1 = x2 = y1 = y2 = 0;
+    }
+
+    const float area1 = (bounds1[2] - bounds1[0])*(bounds1[3] - bounds1[1]);
+    const float area2 = (bounds2[2] - bounds2[0])*(bounds2[3] - bounds2[1]);
+    return (x2 - x1)*(y2 - y1)/std::min(area1, area2);
+}
+
+void SimilarityIndex::build(const PartHypothesisTable & hypotheses, float minOverlap, float maxOverlap)
+{
+    const int numHypotheses = hypotheses.size();
+    const int numRectangles = hypotheses.getNumRectangles();
+
+    offsets.assign(1, 0);
+    neighbors.clear();
+
+    if (numHypotheses == 0)
+    {
+        return;
+    }
+
+    // Group the hypotheses by their rectangle and gather the bounds
+    std::vector<int> rectangleOffsets(numRectangles + 1, 0);
+    std::vector<float> bounds(4*numRectangles);
+    for (int h = 0; h < numHypotheses; h++)
+    {
+        const int r = hypotheses.getRectangleIndex(h);
+        rectangleOffsets[r + 1]++;
+        bounds[4*r] = hypotheses.getMinX(h);
+        bounds[4*r + 1] = hypotheses.getMinY(h);
+        bounds[4*r + 2] = hypotheses.getMaxX(h);
+        bounds[4*r + 3] = hypotheses.getMaxY(h);
+    }
+    for (int r = 0; r < numRectangles; r++)
+    {
+        rectangleOffsets[r + 1] += rectangleOffsets[r];
+    }
+    std::vector<int> rectangleHypotheses(numHypotheses);
+    {
+        std::vector<int> fill(rectangleOffsets.begin(), rectangleOffsets.end() - 1);
+        for (int h = 0; h < numHypotheses; h++)
+        {
+            rectangleHypotheses[fill[hypotheses.getRectangleIndex(h)]++] = h;
+        }
+    }
+
+    // Set up the grid. The cell size is the mean rectangle size such that
+    // every rectangle covers only a few cells.
+    float gridMinX = bounds[0], gridMinY = bounds[1], gridMaxX = bounds[2], gridMaxY = bounds[3];
+    float meanWidth = 0, meanHeight = 0;
+    for (int r = 0; r < numRectangles; r++)
+    {
+        gridMinX = std::min(gridMinX, bounds[4*r]);
+        gridMinY = std::min(gridMinY, bounds[4*r + 1]);
+        gridMaxX = std::max(gridMaxX, bounds[4*r + 2]);
+        gridMaxY = std::max(gridMaxY, bounds[4*r + 3]);
+        meanWidth += bounds[4*r + 2] - bounds[4*r];
+        meanHeight += bounds[4*r + 3] - bounds[4*r + 1];
+    }
+    meanWidth /= numRectangles;
+    meanHeight /= numRectangles;
+
+    const int numCellsX = std::max(1, std::min(MAX_GRID_CELLS, static_cast<int>(std::ceil((gridMaxX - gridMinX)/std::max(meanWidth, 1e-6f)))));
+    const int numCellsY = std::max(1, std::min(MAX_GRID_CELLS, static_cast<int>(std::ceil((gridMaxY - gridMinY)/std::max(meanHeight, 1e-6f)))));
+    const float cellWidth = std::max((gridMaxX - gridMinX)/numCellsX, 1e-6f);
+    const float cellHeight = std::max((gridMaxY - gridMinY)/numCellsY, 1e-6f);
+
+    // Returns the cell range covered by a rectangle
+    auto cellRange = [&](int r, int & x0, int & y0, int & x1, int & y1) {
+        x0 = std::min(numCellsX - 1, static_cast<int>((bounds[4*r] - gridMinX)/cellWidth));
+        y0 = std::min(numCellsY - 1, static_cast<int>((bounds[4*r + 1] - gridMinY)/cellHeight));
+        x1 = std::min(numCellsX - 1, static_cast<int>((bounds[4*r + 2] - gridMinX)/cellWidth));
+        y1 = std::min(numCellsY - 1, static_cast<int>((bounds[4*r + 3] - gridMinY)/cellHeight));
+    };
+
+    // Insert the rectangles into the cells (counting sort)
+    std::vector<int> cellOffsets(numCellsX*numCellsY + 1, 0);
+    for (int r = 0; r < numRectangles; r++)
+    {
+        int x0, y0, x1, y1;
+        cellRange(r, x0, y0, x1, y1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                cellOffsets[y*numCellsX + x + 1]++;
+            }
+        }
+    }
+    for (size_t c = 1; c < cellOffsets.size(); c++)
+    {
+        cellOffsets[c] += cellOffsets[c - 1];
+    }
+    std::vector<int> cells(cellOffsets.back());
+    {
+        std::vector<int> fill(cellOffsets.begin(), cellOffsets.end() - 1);
+        for (int r = 0; r < numRectangles; r++)
+        {
+            int x0, y0, x1, y1;
+            cellRange(r, x0, y0, x1, y1);
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    cells[fill[y*numCellsX + x]++] = r;
+                }
+            }
+        }
+    }
+
+    // Find the similar rectangles. Rectangles with a positive intersection
+    // share at least one cell.
+    std::vector<int> similarOffsets(numRectangles + 1, 0);
+    std::vector<int> similar;
+    std::vector<int> visited(numRectangles, -1);
+    for (int r = 0; r < numRectangles; r++)
+    {
+        const size_t first = similar.size();
+        visited[r] = r;
+
+        int x0, y0, x1, y1;
+        cellRange(r, x0, y0, x1, y1);
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int x = x0; x <= x1; x++)
+            {
+                const int c = y*numCellsX + x;
+                for (int i = cellOffsets[c]; i < cellOffsets[c + 1]; i++)
+                {
+                    const int s = cells[i];
+                    if (visited[s] == r)
+                    {
+                        continue;
+                    }
+                    visited[s] = r;
+
+                    const float score = calcOverlapScore(&bounds[4*r], &bounds[4*s]);
+                    if (score > minOverlap && score < maxOverlap)
+                    {
+                        similar.push_back(s);
+                    }
+                }
+            }
+        }
+
+        std::sort(similar.begin() + first, similar.end());
+        similarOffsets[r + 1] = static_cast<int>(similar.size());
+    }
+
+    // Expand the rectangles to hypotheses
+    offsets.resize(numHypotheses + 1);
+    for (int h = 0; h < numHypotheses; h++)
+    {
+        const int r = hypotheses.getRectangleIndex(h);
+        const size_t first = neighbors.size();
+
+        neighbors.push_back(h);
+        for (int i = similarOffsets[r]; i < similarOffsets[r + 1]; i++)
+        {
+            const int s = similar[i];
+            neighbors.insert(neighbors.end(), rectangleHypotheses.begin() + rectangleOffsets[s], rectangleHypotheses.begin() + rectangleOffsets[s + 1]);
+        }
+
+        std::sort(neighbors.begin() + first, neighbors.end());
+        offsets[h + 1] = static_cast<int>(neighbors.size());
+    }
+}
@@ -0,0 +1,338 @@
+#include "parser/synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace parser;
+
+/**
+ * The depth values (8 bit, larger is further away) of the scene elements
+ */
+static const int DEPTH_BACKGROUND = 220;
+static const int DEPTH_CARCASS = 120;
+static const int DEPTH_FRONT = 105;
+static const int DEPTH_HANDLE = 95;
+static const int DEPTH_SHELF = 160;
+
+/**
+ * Maps the axis aligned box [x0,x1]x[y0,y1] on the unit square to the image
+ * using the given homography. The corners are returned in clockwise order
+ * starting at the top left corner.
+ */
+static void warpBox(const cv::Mat & homography, double x0, double y0, double x1, double y1, std::vector<cv::Point2f> & result)
+{
+    std::vector<cv::Point2f> corners(4);
+    corners[0] = cv::Point2f(x0, y0);
+    corners[1] = cv::Point2f(x1, y0);
+    corners[2] = cv::Point2f(x1, y1);
+    corners[3] = cv::Point2f(x0, y1);
+    cv::perspectiveTransform(corners, result, homography);
+}
+
+/**
+ * Fills the box [x0,x1]x[y0,y1] on the unit square in the image
+ */
+static void fillBox(const cv::Mat & homography, double x0, double y0, double x1, double y1, cv::Mat & image, const cv::Scalar & color)
+{
+    std::vector<cv::Point2f> warped;
+    warpBox(homography, x0, y0, x1, y1, warped);
+
+    std::vector<cv::Point> polygon(warped.size());
+    for (size_t i = 0; i < warped.size(); i++)
+    {
+        polygon[i] = cv::Point(cvRound(warped[i].x), cvRound(warped[i].y));
+    }
+    cv::fillConvexPoly(image, polygon, color, CV_AA);
+}
+
+/**
+ * Converts warped corners to a normalized rectangle
+ */
+static Rectangle toRectangle(const std::vector<cv::Point2f> & corners)
+{
+    Rectangle rect;
+    for (int i = 0; i < 4; i++)
+    {
+        rect[i][0] = corners[i].x;
+        rect[i][1] = corners[i].y;
+    }
+    rect.normalize();
+    return rect;
+}
+
+/**
+ * Adds gaussian noise to the image
+ */
+static void addNoise(cv::Mat & image, double sigma, unsigned int seed)
+{
+    if (sigma <= 0)
+    {
+        return;
+    }
+
+    cv::RNG rng(seed);
+    cv::Mat floatImage, noise(image.rows, image.cols, CV_32FC(image.channels()));
+    rng.fill(noise, cv::RNG::NORMAL, 0, sigma);
+    image.convertTo(floatImage, CV_32FC(image.channels()));
+    floatImage += noise;
+    floatImage.convertTo(image, image.type());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//// SyntheticSceneGenerator
+////////////////////////////////////////////////////////////////////////////////
+
+void SyntheticSceneGenerator::generateLayout(int numParts, std::vector<Rectangle> & parts, std::vector<int> & labels)
+{
+    parts.clear();
+    labels.clear();
+    if (numParts <= 0)
+    {
+        return;
+    }
+
+    std::uniform_real_distribution<double> weightDist(0.7, 1.3);
+    std::uniform_real_distribution<double> shelfDist(0, 1);
+
+    // Cabinets are usually wider than the parts are high, hence we use
+    // roughly twice as many rows as columns
+    const int numColumns = std::max(1, std::min(numParts, static_cast<int>(std::round(std::sqrt(numParts/2.0)))));
+    const double frame = model.frameWidth;
+
+    // Determine the column widths
+    std::vector<double> columnWidths(numColumns);
+    double totalWeight = 0;
+    for (int c = 0; c < numColumns; c++)
+    {
+        columnWidths[c] = weightDist(g);
+        totalWeight += columnWidths[c];
+    }
+    const double usableWidth = 1 - (numColumns + 1)*frame;
+
+    double x = frame;
+    for (int c = 0; c < numColumns; c++)
+    {
+        const double width = columnWidths[c]/totalWeight*usableWidth;
+
+        // Distribute the parts evenly over the columns
+        const int numRows = numParts/numColumns + (c < numParts % numColumns ? 1 : 0);
+
+        std::vector<double> rowHeights(numRows);
+        double totalRowWeight = 0;
+        for (int r = 0; r < numRows; r++)
+        {
+            rowHeights[r] = weightDist(g);
+            totalRowWeight += rowHeights[r];
+        }
+        const double usableHeight = 1 - (numRows + 1)*frame;
+
+        double y = frame;
+        for (int r = 0; r < numRows; r++)
+        {
+            const double height = rowHeights[r]/totalRowWeight*usableHeight;
+
+            Rectangle part;
+            part[0] = Vec2(x, y);
+            part[1] = Vec2(x + width, y);
+            part[2] = Vec2(x + width, y + height);
+            part[3] = Vec2(x, y + height);
+            parts.push_back(part);
+
+            // Tall parts are doors, flat parts are drawers
+            if (shelfDist(g) < model.shelfProbability)
+            {
+                labels.push_back(2);
+            }
+            else if (height >= width)
+            {
+                labels.push_back(0);
+            }
+            else
+            {
+                labels.push_back(1);
+            }
+
+            y += height + frame;
+        }
+
+        x += width + frame;
+    }
+}
+
+void SyntheticSceneGenerator::generate(int numParts, cv::Mat & image, Segmentation & segmentation, cv::Mat & imageDepth)
+{
+    std::vector<cv::Point2f> roiCorners;
+    chooseRegionOfInterest(roiCorners);
+    renderScene(numParts, roiCorners, image, segmentation, imageDepth);
+}
+
+void SyntheticSceneGenerator::generateSequence( int numParts,
+                                                int numFrames,
+                                                double motion,
+                                                std::vector<cv::Mat> & images,
+                                                std::vector<Segmentation> & segmentations,
+                                                std::vector<cv::Mat> & depthImages)
+{
+    images.resize(numFrames);
+    segmentations.resize(numFrames);
+    depthImages.resize(numFrames);
+
+    std::vector<cv::Point2f> roiCorners;
+    chooseRegionOfInterest(roiCorners);
+    const double roiWidth = roiCorners[1].x - roiCorners[0].x;
+    const double roiHeight = roiCorners[3].y - roiCorners[0].y;
+
+    // Every frame shows the same scene, hence the scene is always rendered
+    // from the same state of the random number generator
+    std::uniform_int_distribution<unsigned int> seedDist;
+    std::mt19937 motionGenerator(seedDist(g));
+    const std::mt19937 sceneState = g;
+
+    std::uniform_real_distribution<double> jitterX(-motion*roiWidth, motion*roiWidth);
+    std::uniform_real_distribution<double> jitterY(-motion*roiHeight, motion*roiHeight);
+
+    for (int f = 0; f < numFrames; f++)
+    {
+        // The camera moves a bit between the frames
+        if (f > 0)
+        {
+            for (size_t i = 0; i < roiCorners.size(); i++)
+            {
+                roiCorners[i].x = std::max(0.0f, std::min(static_cast<float>(model.imageWidth - 1), static_cast<float>(roiCorners[i].x + jitterX(motionGenerator))));
+                roiCorners[i].y = std::max(0.0f, std::min(static_cast<float>(model.imageHeight - 1), static_cast<float>(roiCorners[i].y + jitterY(motionGenerator))));
+            }
+        }
+
+        g = sceneState;
+        renderScene(numParts, roiCorners, images[f], segmentations[f], depthImages[f]);
+    }
+}
+
+void SyntheticSceneGenerator::chooseRegionOfInterest(std::vector<cv::Point2f> & roiCorners)
+{
+    std::uniform_real_distribution<double> unitDist(0, 1);
+
+    const double size = model.minROISize + unitDist(g)*(model.maxROISize - model.minROISize);
+    const double roiWidth = size*model.imageWidth;
+    const double roiHeight = size*model.imageHeight;
+    const double left = unitDist(g)*(model.imageWidth - roiWidth);
+    const double top = unitDist(g)*(model.imageHeight - roiHeight);
+
+    std::uniform_real_distribution<double> jitterX(-model.perspective*roiWidth, model.perspective*roiWidth);
+    std::uniform_real_distribution<double> jitterY(-model.perspective*roiHeight, model.perspective*roiHeight);
+
+    roiCorners.resize(4);
+    roiCorners[0] = cv::Point2f(left + jitterX(g), top + jitterY(g));
+    roiCorners[1] = cv::Point2f(left + roiWidth + jitterX(g), top + jitterY(g));
+    roiCorners[2] = cv::Point2f(left + roiWidth + jitterX(g), top + roiHeight + jitterY(g));
+    roiCorners[3] = cv::Point2f(left + jitterX(g), top + roiHeight + jitterY(g));
+
+    // Keep the cabinet inside the image
+    for (size_t i = 0; i < roiCorners.size(); i++)
+    {
+        roiCorners[i].x = std::max(0.0f, std::min(static_cast<float>(model.imageWidth - 1), roiCorners[i].x));
+        roiCorners[i].y = std::max(0.0f, std::min(static_cast<float>(model.imageHeight - 1), roiCorners[i].y));
+    }
+}
+
+void SyntheticSceneGenerator::renderScene(  int numParts,
+                                            const std::vector<cv::Point2f> & roiCorners,
+                                            cv::Mat & image,
+                                            Segmentation & segmentation,
+                                            cv::Mat & imageDepth)
+{
+    std::uniform_int_distribution<int> colorDist(60, 230);
+
+    std::vector<cv::Point2f> unitCorners(4);
+    unitCorners[0] = cv::Point2f(0, 0);
+    unitCorners[1] = cv::Point2f(1, 0);
+    unitCorners[2] = cv::Point2f(1, 1);
+    unitCorners[3] = cv::Point2f(0, 1);
+
+    const cv::Mat homography = cv::getPerspectiveTransform(unitCorners, roiCorners);
+
+    // Render the wall and the carcass
+    const cv::Scalar wallColor(colorDist(g), colorDist(g), colorDist(g));
+    const cv::Scalar carcassColor(colorDist(g), colorDist(g), colorDist(g));
+    cv::Scalar frontColor;
+    do {
+        frontColor = cv::Scalar(colorDist(g), colorDist(g), colorDist(g));
+    } while (cv::norm(frontColor - carcassColor) < 40);
+
+    image = cv::Mat(model.imageHeight, model.imageWidth, CV_8UC3, wallColor);
+    imageDepth = cv::Mat(model.imageHeight, model.imageWidth, CV_8UC3, cv::Scalar::all(DEPTH_BACKGROUND));
+    fillBox(homography, 0, 0, 1, 1, image, carcassColor);
+    fillBox(homography, 0, 0, 1, 1, imageDepth, cv::Scalar::all(DEPTH_CARCASS));
+
+    // Render the parts
+    std::vector<Rectangle> parts;
+    std::vector<int> labels;
+    generateLayout(numParts, parts, labels);
+
+    segmentation = Segmentation();
+    segmentation.regionOfInterest = toRectangle(roiCorners);
+    segmentation.file = "synthetic";
+    segmentation.id = "synthetic";
+
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        renderPart(homography, parts[p], labels[p], frontColor, image, imageDepth);
+
+        std::vector<cv::Point2f> warped;
+        warpBox(homography, parts[p].minX(), parts[p].minY(), parts[p].maxX(), parts[p].maxY(), warped);
+        segmentation.parts.push_back(toRectangle(warped));
+        segmentation.labels.push_back(labels[p]);
+    }
+
+    // The sensors are not perfect
+    std::uniform_int_distribution<unsigned int> seedDist;
+    addNoise(image, model.noise, seedDist(g));
+    cv::GaussianBlur(imageDepth, imageDepth, cv::Size(3, 3), 0);
+    addNoise(imageDepth, model.noise/3, seedDist(g));
+}
+
+void SyntheticSceneGenerator::renderPart(const cv::Mat & homography, const Rectangle & part, int label, const cv::Scalar & color, cv::Mat & image, cv::Mat & imageDepth)
+{
+    const double x0 = part.minX();
+    const double y0 = part.minY();
+    const double x1 = part.maxX();
+    const double y1 = part.maxY();
+    const double width = x1 - x0;
+    const double height = y1 - y0;
+    const cv::Scalar handleColor(40, 40, 40);
+
+    switch (label)
+    {
+        case 0:
+        {
+            // Door: vertical handle close to one of the sides
+            fillBox(homography, x0, y0, x1, y1, image, color);
+            fillBox(homography, x0, y0, x1, y1, imageDepth, cv::Scalar::all(DEPTH_FRONT));
+
+            const double hx = (std::uniform_int_distribution<int>(0, 1)(g) == 0) ? x0 + 0.08*width : x1 - 0.12*width;
+            fillBox(homography, hx, y0 + 0.4*height, hx + 0.04*width, y0 + 0.6*height, image, handleColor);
+            fillBox(homography, hx, y0 + 0.4*height, hx + 0.04*width, y0 + 0.6*height, imageDepth, cv::Scalar::all(DEPTH_HANDLE));
+            break;
+        }
+        case 1:
+        {
+            // Drawer: horizontal handle in the upper center
+            fillBox(homography, x0, y0, x1, y1, image, color);
+            fillBox(homography, x0, y0, x1, y1, imageDepth, cv::Scalar::all(DEPTH_FRONT));
+
+            fillBox(homography, x0 + 0.35*width, y0 + 0.2*height, x1 - 0.35*width, y0 + 0.3*height, image, handleColor);
+            fillBox(homography, x0 + 0.35*width, y0 + 0.2*height, x1 - 0.35*width, y0 + 0.3*height, imageDepth, cv::Scalar::all(DEPTH_HANDLE));
+            break;
+        }
+        case 2:
+        {
+            // Shelf: dark interior with a board in the middle
+            fillBox(homography, x0, y0, x1, y1, image, color*0.3);
+            fillBox(homography, x0, y0, x1, y1, imageDepth, cv::Scalar::all(DEPTH_SHELF));
+
+            fillBox(homography, x0, y0 + 0.48*height, x1, y0 + 0.52*height, image, color*0.8);
+            fillBox(homography, x0, y0 + 0.48*height, x1, y0 + 0.52*height, imageDepth, cv::Scalar::all(DEPTH_CARCASS));
+            break;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+
+#include "parser/bitset_state.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests insert, remove and contains
+ */
+TEST(MCMCParserBitsetState, insertRemove)
+{
+    MCMCParserBitsetState state(130);
+    
+    ASSERT_TRUE(state.insert(3));
+    ASSERT_TRUE(state.insert(64));
+    ASSERT_TRUE(state.insert(129));
+    ASSERT_FALSE(state.insert(64));
+    ASSERT_EQ(state.size(), 3);
+    
+    ASSERT_TRUE(state.contains(3));
+    ASSERT_TRUE(state.contains(64));
+    ASSERT_TRUE(state.contains(129));
+    ASSERT_FALSE(state.contains(4));
+    
+    ASSERT_TRUE(state.remove(3));
+    ASSERT_FALSE(state.remove(3));
+    ASSERT_FALSE(state.contains(3));
+    ASSERT_EQ(state.size(), 2);
+    
+    // The active list only contains the selected parts
+    for (size_t i = 0; i < state.size(); i++)
+    {
+        ASSERT_TRUE(state.contains(state[i]));
+    }
+    
+    state.clear();
+    ASSERT_EQ(state.size(), 0);
+    ASSERT_FALSE(state.contains(129));
+    ASSERT_EQ(state.getHash(), 0);
+}
+
+/**
+ * Tests if the hash only depends on the set of selected parts
+ */
+TEST(MCMCParserBitsetState, hash)
+{
+    MCMCParserBitsetState a(100), b(100);
+    
+    a.insert(1);
+    a.insert(50);
+    a.insert(99);
+    b.insert(99);
+    b.insert(7);
+    b.insert(1);
+    b.insert(50);
+    ASSERT_NE(a.getHash(), b.getHash());
+    
+    b.remove(7);
+    ASSERT_EQ(a.getHash(), b.getHash());
+    ASSERT_TRUE(a == b);
+}
+
+/**
+ * Tests copying and swapping
+ */
+TEST(MCMCParserBitsetState, copyFrom)
+{
+    MCMCParserBitsetState a(100), b(100);
+    a.insert(10);
+    a.insert(20);
+    b.insert(30);
+    
+    b.copyFrom(a);
+    ASSERT_TRUE(a == b);
+    ASSERT_FALSE(b.contains(30));
+    
+    // The copy is independent of the original
+    b.remove(10);
+    ASSERT_TRUE(a.contains(10));
+    ASSERT_TRUE(b.contains(20));
+    
+    b.swap(a);
+    ASSERT_EQ(a.size(), 1);
+    ASSERT_EQ(b.size(), 2);
+    
+    std::vector<int> list;
+    b.toVector(list);
+    MCMCParserBitsetState c(100);
+    c.assign(list);
+    ASSERT_TRUE(b == c);
+}
@@ -0,0 +1,95 @@
+
+#include <random>
+#include "parser/detector.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Traces the borders pixel by pixel as done before the index existed
+ */
+static bool traceBorders(const cv::Mat & distanceTransform, float threshold, const Rectangle & r)
+{
+    const int y1 = static_cast<int>(std::round(r[0][1]));
+    const int y2 = static_cast<int>(std::round(r[3][1]));
+    for (float _x = r[0][0]; _x <= r[1][0]; _x += 1)
+    {
+        const int x = static_cast<int>(std::round(_x));
+        if (distanceTransform.at<float>(y1,x) > threshold || distanceTransform.at<float>(y2,x) > threshold)
+        {
+            return false;
+        }
+    }
+    const int x1 = static_cast<int>(std::round(r[0][0]));
+    const int x2 = static_cast<int>(std::round(r[1][0]));
+    for (float _y = r[1][1]; _y <= r[2][1]; _y += 1)
+    {
+        const int y = static_cast<int>(std::round(_y));
+        if (distanceTransform.at<float>(y,x1) > threshold || distanceTransform.at<float>(y,x2) > threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Tests that the index agrees with tracing the borders on random rectangles
+ * inside the image, including fractional corners
+ */
+TEST(BorderSupportIndex, equivalence)
+{
+    std::mt19937 g(0);
+    cv::Mat distanceTransform = cv::Mat::zeros(90, 120, CV_32FC1);
+    std::uniform_int_distribution<int> rowDist(0, distanceTransform.rows - 1);
+    std::uniform_int_distribution<int> colDist(0, distanceTransform.cols - 1);
+    for (int i = 0; i < 40; i++)
+    {
+        distanceTransform.at<float>(rowDist(g), colDist(g)) = 10;
+    }
+
+    const float threshold = 6;
+    BorderSupportIndex index;
+    index.build(distanceTransform, threshold);
+
+    std::uniform_real_distribution<float> xDist(0, distanceTransform.cols - 1.5f);
+    std::uniform_real_distribution<float> yDist(0, distanceTransform.rows - 1.5f);
+    std::uniform_int_distribution<int> fractional(0, 1);
+    int numSupported = 0;
+    for (int i = 0; i < 5000; i++)
+    {
+        float x0 = xDist(g), x1 = xDist(g), y0 = yDist(g), y1 = yDist(g);
+        if (fractional(g) == 0)
+        {
+            x0 = std::floor(x0);
+            x1 = std::floor(x1);
+            y0 = std::floor(y0);
+            y1 = std::floor(y1);
+        }
+        const Rectangle r(Vec2(std::min(x0, x1), std::min(y0, y1)), Vec2(std::max(x0, x1), std::min(y0, y1)),
+                Vec2(std::max(x0, x1), std::max(y0, y1)), Vec2(std::min(x0, x1), std::max(y0, y1)));
+
+        const bool expected = traceBorders(distanceTransform, threshold, r);
+        ASSERT_EQ(index.isSupported(r), expected);
+        ASSERT_EQ(index.getPredicate()(r), expected);
+        numSupported += expected ? 1 : 0;
+    }
+
+    // Both outcomes have been tested
+    ASSERT_GT(numSupported, 0);
+    ASSERT_LT(numSupported, 5000);
+}
+
+/**
+ * Tests that borders outside of the image are not supported
+ */
+TEST(BorderSupportIndex, outside)
+{
+    cv::Mat distanceTransform = cv::Mat::zeros(20, 30, CV_32FC1);
+    BorderSupportIndex index;
+    index.build(distanceTransform, 1);
+
+    ASSERT_TRUE(index.isSupported(Rectangle(Vec2(0, 0), Vec2(29, 0), Vec2(29, 19), Vec2(0, 19))));
+    ASSERT_FALSE(index.isSupported(Rectangle(Vec2(0, 0), Vec2(30, 0), Vec2(30, 19), Vec2(0, 19))));
+    ASSERT_FALSE(index.isSupported(Rectangle(Vec2(-2, 0), Vec2(20, 0), Vec2(20, 10), Vec2(-2, 10))));
+}
@@ -0,0 +1,253 @@
+
+#include <random>
+#include "parser/codebook.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Solves the latent variable problem exactly by enumerating the faces of the
+ * feasible set {pi >= 0, sum(pi) <= 1}
+ */
+static Eigen::VectorXf solveExactly(const Eigen::MatrixXf & gram, const Eigen::VectorXf & b)
+{
+    const int K = static_cast<int>(gram.rows());
+    Eigen::VectorXf best = Eigen::VectorXf::Zero(K);
+    float bestObjective = 0;
+
+    for (int support = 1; support < (1 << K); support++)
+    {
+        std::vector<int> free;
+        for (int k = 0; k < K; k++)
+        {
+            if (support & (1 << k))
+            {
+                free.push_back(k);
+            }
+        }
+        const int F = static_cast<int>(free.size());
+
+        for (int sumActive = 0; sumActive < 2; sumActive++)
+        {
+            // Stationary point on the face (with a multiplier for the sum)
+            Eigen::MatrixXf A = Eigen::MatrixXf::Zero(F + sumActive, F + sumActive);
+            Eigen::VectorXf rhs = Eigen::VectorXf::Zero(F + sumActive);
+            for (int i = 0; i < F; i++)
+            {
+                for (int j = 0; j < F; j++)
+                {
+                    A(i, j) = gram(free[i], free[j]);
+                }
+                rhs(i) = b(free[i]);
+                if (sumActive)
+                {
+                    A(i, F) = 1;
+                    A(F, i) = 1;
+                }
+            }
+            if (sumActive)
+            {
+                rhs(F) = 1;
+            }
+            const Eigen::VectorXf solution = A.fullPivLu().solve(rhs);
+
+            Eigen::VectorXf pi = Eigen::VectorXf::Zero(K);
+            for (int i = 0; i < F; i++)
+            {
+                pi(free[i]) = solution(i);
+            }
+            if (pi.minCoeff() < -1e-6f || pi.sum() > 1 + 1e-6f)
+            {
+                continue;
+            }
+
+            const float objective = 0.5f*pi.dot(gram*pi) - b.dot(pi);
+            if (objective < bestObjective)
+            {
+                bestObjective = objective;
+                best = pi;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * Creates a random non-negative matrix
+ */
+static Eigen::MatrixXf createRandomMatrix(int rows, int cols, std::mt19937 & g)
+{
+    std::uniform_real_distribution<float> dist(0, 1);
+    Eigen::MatrixXf result(rows, cols);
+    for (int i = 0; i < rows; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            result(i, j) = dist(g);
+        }
+    }
+    return result;
+}
+
+/**
+ * Tests the projection onto the feasible set
+ */
+TEST(CodebookScorer, project)
+{
+    Eigen::VectorXf pi(3);
+    pi << 0.2f, -0.5f, 0.3f;
+    CodebookScorer::project(pi);
+    ASSERT_FLOAT_EQ(pi(0), 0.2f);
+    ASSERT_FLOAT_EQ(pi(1), 0);
+    ASSERT_FLOAT_EQ(pi(2), 0.3f);
+
+    pi << 1.0f, 0.5f, -1.0f;
+    CodebookScorer::project(pi);
+    ASSERT_FLOAT_EQ(pi(0), 0.75f);
+    ASSERT_FLOAT_EQ(pi(1), 0.25f);
+    ASSERT_FLOAT_EQ(pi(2), 0);
+}
+
+/**
+ * Tests the batched solution against the exact solution of every column
+ */
+TEST(CodebookScorer, latentVariables)
+{
+    std::mt19937 g(0);
+    CodebookScorer scorer;
+
+    for (int K = 1; K <= 5; K++)
+    {
+        const Eigen::MatrixXf codebook = createRandomMatrix(20, K, g);
+        // Scale the descriptors such that some solutions are inside the
+        // simplex and some are on its border
+        Eigen::MatrixXf descriptors = createRandomMatrix(20, 50, g);
+        for (int n = 0; n < descriptors.cols(); n++)
+        {
+            descriptors.col(n) *= 0.1f*(n % 20);
+        }
+
+        Eigen::MatrixXf pis;
+        scorer.determineLatentVariables(codebook, descriptors, pis);
+        ASSERT_EQ(pis.rows(), K);
+        ASSERT_EQ(pis.cols(), descriptors.cols());
+
+        const Eigen::MatrixXf gram = codebook.transpose()*codebook;
+        for (int n = 0; n < descriptors.cols(); n++)
+        {
+            const Eigen::VectorXf b = codebook.transpose()*descriptors.col(n);
+            const Eigen::VectorXf expected = solveExactly(gram, b);
+            const float expectedObjective = 0.5f*expected.dot(gram*expected) - b.dot(expected);
+            const float objective = 0.5f*pis.col(n).dot(gram*pis.col(n)) - b.dot(pis.col(n));
+            ASSERT_GE(pis.col(n).minCoeff(), 0);
+            ASSERT_LE(pis.col(n).sum(), 1 + 1e-5f);
+            ASSERT_NEAR(objective, expectedObjective, 1e-4f*(1 + std::abs(expectedObjective)));
+        }
+    }
+}
+
+/**
+ * Tests that the batched errors equal the residuals of single descriptors
+ */
+TEST(CodebookScorer, errors)
+{
+    std::mt19937 g(1);
+    CodebookScorer scorer;
+
+    std::vector<Eigen::MatrixXf> codebooks;
+    codebooks.push_back(createRandomMatrix(30, 4, g));
+    codebooks.push_back(createRandomMatrix(30, 2, g));
+    codebooks.push_back(createRandomMatrix(30, 8, g));
+    const Eigen::MatrixXf descriptors = createRandomMatrix(30, 40, g);
+
+    Eigen::MatrixXf errors;
+    scorer.calcErrors(codebooks, 3, descriptors, errors);
+    ASSERT_EQ(errors.rows(), descriptors.cols());
+    ASSERT_EQ(errors.cols(), 3);
+
+    for (int l = 0; l < 3; l++)
+    {
+        for (int n = 0; n < descriptors.cols(); n++)
+        {
+            Eigen::MatrixXf pi;
+            scorer.determineLatentVariables(codebooks[l], descriptors.col(n), pi);
+            const float expected = std::sqrt((descriptors.col(n) - codebooks[l]*pi).squaredNorm()/descriptors.rows());
+            ASSERT_NEAR(errors(n, l), expected, 1e-4f);
+        }
+    }
+}
+
+/**
+ * Tests that the codebook update satisfies the optimality conditions of the
+ * non-negative least squares problem
+ */
+TEST(CodebookLearner, updateCodebook)
+{
+    std::mt19937 g(2);
+    CodebookLearner learner;
+    learner.model.maxUpdateIterations = 5000;
+
+    const Eigen::MatrixXf descriptors = createRandomMatrix(40, 60, g);
+    Eigen::MatrixXf pis = createRandomMatrix(5, 60, g);
+    for (int n = 0; n < pis.cols(); n++)
+    {
+        CodebookScorer::project(pis.col(n));
+    }
+    // Start from a matrix with negative entries
+    Eigen::MatrixXf codebook = createRandomMatrix(40, 5, g).array() - 0.5f;
+    learner.updateCodebook(descriptors, pis, codebook);
+
+    ASSERT_GE(codebook.minCoeff(), 0);
+    const Eigen::MatrixXf gradient = codebook*pis*pis.transpose() - descriptors*pis.transpose();
+    const float scale = gradient.cwiseAbs().maxCoeff() + descriptors.cwiseAbs().maxCoeff();
+    for (int d = 0; d < codebook.rows(); d++)
+    {
+        for (int k = 0; k < codebook.cols(); k++)
+        {
+            if (codebook(d, k) > 1e-4f)
+            {
+                ASSERT_NEAR(gradient(d, k), 0, 1e-3f*scale);
+            }
+            else
+            {
+                ASSERT_GE(gradient(d, k), -1e-3f*scale);
+            }
+        }
+    }
+}
+
+/**
+ * Tests that the learned codebook reconstructs descriptors that have been 
+ * generated from a known codebook about as well as the known codebook
+ */
+TEST(CodebookLearner, learn)
+{
+    std::mt19937 g(3);
+    const int K = 4;
+    const Eigen::MatrixXf truth = createRandomMatrix(100, K, g);
+    Eigen::MatrixXf pis = createRandomMatrix(K, 300, g);
+    for (int n = 0; n < pis.cols(); n++)
+    {
+        pis.col(n) /= pis.col(n).sum();
+    }
+    const Eigen::MatrixXf descriptors = truth*pis + 0.01f*createRandomMatrix(100, 300, g);
+
+    // The error of the known codebook with optimal weights
+    CodebookScorer scorer;
+    Eigen::MatrixXf truthPis;
+    scorer.determineLatentVariables(truth, descriptors, truthPis);
+    const float truthError = (descriptors - truth*truthPis).norm();
+
+    CodebookLearner learner;
+    Eigen::MatrixXf codebook;
+    const float error = learner.learn(descriptors, K, codebook);
+    ASSERT_EQ(codebook.rows(), 100);
+    ASSERT_EQ(codebook.cols(), K);
+    ASSERT_GE(codebook.minCoeff(), 0);
+    ASSERT_LE(error, 1.05f*truthError);
+
+    // The result does not depend on the scheduling of the runs
+    Eigen::MatrixXf codebook2;
+    ASSERT_FLOAT_EQ(learner.learn(descriptors, K, codebook2), error);
+    ASSERT_TRUE(codebook == codebook2);
+}
@@ -0,0 +1,38 @@
+
+#include "parser/rjmcmc_sa.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests the shape of the target acceptance rate curve
+ */
+TEST(AdaptiveCoolingSchedule, getTargetAcceptanceRate)
+{
+    AdaptiveCoolingSchedule schedule;
+    schedule.setMaxIterations(1000);
+    
+    ASSERT_NEAR(schedule.getTargetAcceptanceRate(0), 1.0f, 1e-5);
+    ASSERT_NEAR(schedule.getTargetAcceptanceRate(150), 0.44f, 1e-5);
+    ASSERT_NEAR(schedule.getTargetAcceptanceRate(400), 0.44f, 1e-5);
+    ASSERT_NEAR(schedule.getTargetAcceptanceRate(1000), 0.001f, 1e-5);
+}
+
+/**
+ * Tests if the schedule cools faster when too many moves are accepted and 
+ * terminates after the maximum number of iterations
+ */
+TEST(AdaptiveCoolingSchedule, calcTemperature)
+{
+    AdaptiveCoolingSchedule schedule;
+    schedule.setMaxIterations(1000);
+    
+    schedule.update(400, 0.9f);
+    const float hot = schedule.calcTemperature(400, 10);
+    schedule.update(400, 0.1f);
+    const float cold = schedule.calcTemperature(400, 10);
+    
+    ASSERT_LT(hot, cold);
+    ASSERT_LT(hot, 10);
+    ASSERT_FLOAT_EQ(schedule.calcTemperature(1000, 10), schedule.getEndTemperature());
+}
@@ -0,0 +1,96 @@
+
+#include "parser/hypothesis_table.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Creates a part with the given geometry and label
+ */
+static Part createPart(float x0, float y0, float x1, float y1, int label, float posterior)
+{
+    Part part;
+    part.rect = Rectangle(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1));
+    part.label = label;
+    part.posterior = posterior;
+    part.likelihood = posterior/2;
+    part.shapePrior = 0.5f;
+    part.meanDepth = x1 - x0;
+    part.projProf.push_back(static_cast<int>(x0) + 1);
+    part.projProfTyp.push_back(static_cast<int>(y0));
+    part.projProfTyp.push_back(static_cast<int>(y1));
+    return part;
+}
+
+/**
+ * Tests that the table reproduces the parts and shares the geometry of
+ * consecutive hypotheses of the same rectangle
+ */
+TEST(PartHypothesisTable, assign)
+{
+    std::vector<Part> parts;
+    for (int l = 0; l < 3; l++)
+    {
+        parts.push_back(createPart(0, 0, 10, 20, l, 0.1f*(l + 1)));
+    }
+    for (int l = 0; l < 3; l++)
+    {
+        parts.push_back(createPart(5, 5, 30, 15, l, 0.2f*(l + 1)));
+    }
+
+    PartHypothesisTable table;
+    table.assign(parts);
+
+    ASSERT_EQ(table.size(), 6);
+    ASSERT_EQ(table.getNumRectangles(), 2);
+    ASSERT_EQ(table.getRectangleIndex(2), 0);
+    ASSERT_EQ(table.getRectangleIndex(3), 1);
+
+    for (int h = 0; h < table.size(); h++)
+    {
+        ASSERT_EQ(table.getLabel(h), parts[h].label);
+        ASSERT_FLOAT_EQ(table.getPosterior(h), parts[h].posterior);
+        ASSERT_FLOAT_EQ(table.getLikelihood(h), parts[h].likelihood);
+        ASSERT_FLOAT_EQ(table.getShapePrior(h), parts[h].shapePrior);
+        ASSERT_FLOAT_EQ(table.getMeanDepth(h), parts[h].meanDepth);
+        ASSERT_FLOAT_EQ(table.getWidth(h), parts[h].rect.getWidth());
+        ASSERT_FLOAT_EQ(table.getHeight(h), parts[h].rect.getHeight());
+
+        Part part;
+        table.getPart(h, part);
+        for (int v = 0; v < 4; v++)
+        {
+            ASSERT_FLOAT_EQ(part.rect[v][0], parts[h].rect[v][0]);
+            ASSERT_FLOAT_EQ(part.rect[v][1], parts[h].rect[v][1]);
+        }
+        ASSERT_EQ(part.projProf, parts[h].projProf);
+    }
+}
+
+/**
+ * Tests that parts with different profiles do not share the geometry
+ */
+TEST(PartHypothesisTable, profiles)
+{
+    PartHypothesisTable table;
+    Part part = createPart(0, 0, 10, 20, 1, 0.5f);
+    table.add(createPart(0, 0, 10, 20, 0, 0.5f));
+    part.projProfTyp[0] = 7;
+    table.add(part);
+
+    ASSERT_EQ(table.getNumRectangles(), 2);
+
+    std::vector<Part> parts;
+    table.toParts(parts);
+    ASSERT_EQ(parts.size(), 2);
+
+    PartHypothesisTable::ProfileView profile = table.getProjProfTyp(1);
+    ASSERT_EQ(profile.size(), 2);
+    ASSERT_EQ(profile[0], 7);
+    ASSERT_EQ(profile[1], 20);
+    ASSERT_EQ(std::vector<int>(profile.begin(), profile.end()), parts[1].projProfTyp);
+
+    table.clear();
+    ASSERT_EQ(table.size(), 0);
+    ASSERT_EQ(table.getNumRectangles(), 0);
+}
@@ -0,0 +1,104 @@
+
+#include <sstream>
+#include <iostream>
+
+#include "parser/instrumentation.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests if nothing is recorded while the instrumentation is disabled
+ */
+TEST(Instrumentation, disabled)
+{
+    Instrumentation instrumentation;
+    instrumentation.beginRecord();
+    {
+        ScopedTimer timer(instrumentation, "canny");
+    }
+    instrumentation.setCounter("proposals", 10);
+    
+    ASSERT_EQ(instrumentation.getRecord().timings.size(), 0);
+    ASSERT_EQ(instrumentation.getRecord().counters.size(), 0);
+}
+
+/**
+ * Tests if timers accumulate per stage and counters are kept per record
+ */
+TEST(Instrumentation, record)
+{
+    Instrumentation instrumentation;
+    instrumentation.setEnabled(true);
+    instrumentation.beginRecord();
+    {
+        ScopedTimer timer(instrumentation, "canny");
+    }
+    {
+        ScopedTimer timer(instrumentation, "canny");
+    }
+    instrumentation.setCounter("proposals", 10);
+    instrumentation.addCounter("proposals", 5);
+    
+    ASSERT_EQ(instrumentation.getRecord().timings.size(), 1);
+    ASSERT_GE(instrumentation.getTime("canny"), 0);
+    ASSERT_EQ(instrumentation.getCounter("proposals"), 15);
+    ASSERT_EQ(instrumentation.getCounter("hypotheses"), 0);
+    
+    instrumentation.beginRecord();
+    ASSERT_EQ(instrumentation.getCounter("proposals"), 0);
+}
+
+/**
+ * Tests if the record is written as a single JSON line
+ */
+TEST(Instrumentation, writeRecord)
+{
+    Instrumentation instrumentation;
+    instrumentation.setEnabled(true);
+    instrumentation.beginRecord();
+    instrumentation.setCounter("proposals", 10);
+    instrumentation.setCounter("sa_iterations", 3);
+    
+    std::stringstream ss;
+    instrumentation.writeRecord(ss);
+    
+    ASSERT_EQ(ss.str(), "{\"id\":\"\",\"timings\":{},\"counters\":{\"proposals\":10,\"sa_iterations\":3}}\n");
+}
+
+/**
+ * Tests if the id is escaped such that every record stays valid JSON
+ */
+TEST(Instrumentation, escapeId)
+{
+    Instrumentation instrumentation;
+    instrumentation.setEnabled(true);
+    instrumentation.beginRecord();
+    
+    std::stringstream ss;
+    std::streambuf* previous = std::cout.rdbuf(ss.rdbuf());
+    instrumentation.emitRecord("a\"b\\c\n\x01");
+    std::cout.rdbuf(previous);
+    
+    ASSERT_EQ(ss.str(), "{\"id\":\"a\\\"b\\\\c\\n\\u0001\",\"timings\":{},\"counters\":{}}\n");
+}
+
+/**
+ * Tests if the records of parallel parsers are summed up
+ */
+TEST(Instrumentation, addRecord)
+{
+    InstrumentationRecord other;
+    other.timings.push_back(std::make_pair("canny", 0.5));
+    other.counters.push_back(std::make_pair("proposals", 4.0));
+    
+    Instrumentation instrumentation;
+    instrumentation.setEnabled(true);
+    instrumentation.beginRecord();
+    instrumentation.setCounter("proposals", 10);
+    instrumentation.addRecord(other);
+    instrumentation.addRecord(other);
+    
+    ASSERT_DOUBLE_EQ(instrumentation.getTime("canny"), 1.0);
+    ASSERT_EQ(instrumentation.getCounter("proposals"), 18);
+}
@@ -0,0 +1,200 @@
+
+#include <random>
+#include "parser/kde.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+typedef KernelDistribution<float, float, 2> KDE;
+
+/**
+ * Creates a distribution from random samples in the unit square. If h is 
+ * positive, it replaces the estimated bandwidth.
+ */
+static KDE createRandomKDE(int numSamples, float h, std::mt19937 & g)
+{
+    std::normal_distribution<float> dist(0.5f, 0.2f);
+    std::vector<KDE::Vec> samples;
+    for (int n = 0; n < numSamples; n++)
+    {
+        samples.push_back(KDE::Vec(dist(g), dist(g)));
+    }
+
+    KDE::Model model;
+    model.estimate(samples);
+    if (h > 0)
+    {
+        model.h.at<float>(0,0) = h;
+        model.h.at<float>(1,0) = 0.7f*h;
+    }
+    return KDE(model);
+}
+
+/**
+ * Tests that the lattice evaluation stays within its error bound
+ */
+TEST(KernelDistribution, evalGrid)
+{
+    std::mt19937 g(0);
+    const float bandwidths[] = {0, 0.15f, 0.6f};
+    const float tolerances[] = {1e-2f, 1e-3f};
+
+    for (int b = 0; b < 3; b++)
+    {
+        for (int t = 0; t < 2; t++)
+        {
+            KDE kde = createRandomKDE(300, bandwidths[b], g);
+
+            cv::Mat lattice;
+            const float bound = kde.evalGrid(KDE::Vec(0, 0), KDE::Vec(0.02f, 0.02f), cv::Size(51, 41), lattice, tolerances[t]);
+            ASSERT_EQ(lattice.rows, 41);
+            ASSERT_EQ(lattice.cols, 51);
+            ASSERT_LE(bound, tolerances[t]*300*kde.normalizationConstant*1.0001f);
+
+            for (int y = 0; y < lattice.rows; y++)
+            {
+                for (int x = 0; x < lattice.cols; x++)
+                {
+                    const float expected = kde.eval(KDE::Vec(0.02f*x, 0.02f*y));
+                    ASSERT_NEAR(lattice.at<double>(y, x), expected, bound + 1e-5f*expected);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Tests that the direct and the spectral convolution agree
+ */
+TEST(KernelDistribution, convolveRows)
+{
+    std::mt19937 g(1);
+    std::uniform_real_distribution<double> dist(0, 1);
+    cv::Mat in(5, 37, CV_64FC1);
+    for (int y = 0; y < in.rows; y++)
+    {
+        for (int x = 0; x < in.cols; x++)
+        {
+            in.at<double>(y, x) = dist(g);
+        }
+    }
+    std::vector<double> kernel(21);
+    for (int j = -10; j <= 10; j++)
+    {
+        kernel[j + 10] = std::exp(-0.02*j*j);
+    }
+
+    cv::Mat direct, spectral;
+    KDE::convolveRows(in, kernel, 3, 4, 9, direct, false);
+    KDE::convolveRows(in, kernel, 3, 4, 9, spectral, true);
+    for (int y = 0; y < in.rows; y++)
+    {
+        for (int k = 0; k < 9; k++)
+        {
+            double expected = 0;
+            for (int x = 0; x < in.cols; x++)
+            {
+                const int j = 3 + 4*k - x;
+                if (std::abs(j) <= 10)
+                {
+                    expected += in.at<double>(y, x)*kernel[j + 10];
+                }
+            }
+            ASSERT_NEAR(direct.at<double>(y, k), expected, 1e-9);
+            ASSERT_NEAR(spectral.at<double>(y, k), expected, 1e-9);
+        }
+    }
+}
+
+/**
+ * Tests that the closed form normalization integrates to one over the unit
+ * box and that a stored constant is used as is
+ */
+TEST(KernelDistribution, normalizeUnitBox)
+{
+    std::mt19937 g(2);
+    KDE kde = createRandomKDE(200, 0, g);
+    ASSERT_GT(kde.model.normalization, 0);
+    kde.normalizeUnitBox();
+    ASSERT_DOUBLE_EQ(kde.normalizationConstant, static_cast<float>(kde.model.normalization));
+
+    // Midpoint rule
+    const int steps = 400;
+    double integral = 0;
+    for (int y = 0; y < steps; y++)
+    {
+        for (int x = 0; x < steps; x++)
+        {
+            integral += kde.eval(KDE::Vec((x + 0.5f)/steps, (y + 0.5f)/steps));
+        }
+    }
+    integral /= steps*steps;
+    ASSERT_NEAR(integral, 1, 1e-3);
+
+    KDE::Model model = kde.model;
+    model.normalization = 123;
+    KDE stored(model);
+    stored.normalizeUnitBox();
+    ASSERT_FLOAT_EQ(stored.normalizationConstant, 123);
+}
+
+typedef ConditionalDistribution<KDE, KDE::Model, float, float, 2> ConditionalKDE;
+
+/**
+ * Tests the lookup with the dense array and with the hash table
+ */
+TEST(ConditionalDistribution, lookup)
+{
+    std::mt19937 g(3);
+    std::vector< std::vector<int> > denseConditions = {{0}, {1}, {2}};
+    std::vector< std::vector<int> > sparseConditions = {{0}, {1, 2}, {-300, 7000}, {5, 5, 5, 5}, {}};
+
+    const std::vector< std::vector<int> >* conditionSets[] = {&denseConditions, &sparseConditions};
+    for (int s = 0; s < 2; s++)
+    {
+        const std::vector< std::vector<int> > & conditions = *conditionSets[s];
+        ConditionalKDE::Model model;
+        std::vector<KDE::Model> models;
+        std::uniform_real_distribution<float> dist(0, 1);
+        for (size_t c = 0; c < conditions.size(); c++)
+        {
+            std::vector<KDE::Vec> samples;
+            for (int n = 0; n < 20; n++)
+            {
+                samples.push_back(KDE::Vec(dist(g), dist(g)));
+            }
+            model.estimate(samples, conditions[c]);
+            models.push_back(KDE::Model());
+            models.back().estimate(samples);
+        }
+        ConditionalKDE conditional(model);
+
+        for (size_t c = 0; c < conditions.size(); c++)
+        {
+            KDE expected(models[c]);
+            const KDE::Vec x(dist(g), dist(g));
+            ASSERT_FLOAT_EQ(conditional.eval(x, conditions[c]), expected.eval(x));
+            ASSERT_FLOAT_EQ(conditional.getDistribution(conditions[c]).eval(x), expected.eval(x));
+        }
+
+        ASSERT_THROW(conditional.eval(KDE::Vec(0, 0), std::vector<int>({3})), std::out_of_range);
+        ASSERT_THROW(conditional.eval(KDE::Vec(0, 0), std::vector<int>({1, 3})), std::out_of_range);
+        ASSERT_THROW(conditional.eval(KDE::Vec(0, 0), std::vector<int>({100000})), std::out_of_range);
+    }
+}
+
+/**
+ * Tests that different conditions are packed into different keys
+ */
+TEST(ConditionalDistribution, packKey)
+{
+    uint64_t a, b;
+    ASSERT_TRUE(ConditionalKDE::packKey({0}, a));
+    ASSERT_TRUE(ConditionalKDE::packKey({0, 0}, b));
+    ASSERT_NE(a, b);
+    ASSERT_TRUE(ConditionalKDE::packKey({-1}, a));
+    ASSERT_TRUE(ConditionalKDE::packKey({1}, b));
+    ASSERT_NE(a, b);
+    ASSERT_FALSE(ConditionalKDE::packKey({1 << 14}, a));
+    ASSERT_FALSE(ConditionalKDE::packKey({0, 0, 0, 0, 0}, a));
+}
@@ -0,0 +1,108 @@
+
+#include "parser/detector.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Runs the line detection with the full hough transform and an increasing
+ * minimum length as it was done by CabinetParser::detectLines
+ */
+static void detectLinesIteratively(const cv::Mat & image, std::vector<LineSegment> & resultH, std::vector<LineSegment> & resultV)
+{
+    LineDetector detector;
+    do {
+        resultH.clear();
+        resultV.clear();
+        detector.detectLines(image, resultH, true);
+        detector.detectLines(image, resultV, false);
+        detector.model.minLength += 10;
+    } while(resultH.size() + resultV.size() > 30);
+}
+
+/**
+ * Checks that both line sets are identical including their order
+ */
+static void expectEqualLines(const std::vector<LineSegment> & expected, const std::vector<LineSegment> & actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t l = 0; l < expected.size(); l++)
+    {
+        for (int p = 0; p < 2; p++)
+        {
+            EXPECT_EQ(expected[l][p][0], actual[l][p][0]);
+            EXPECT_EQ(expected[l][p][1], actual[l][p][1]);
+        }
+    }
+}
+
+/**
+ * Compares both detectors on the given edge image
+ */
+static void expectEquivalent(const cv::Mat & image)
+{
+    std::vector<LineSegment> expectedH, expectedV;
+    detectLinesIteratively(image, expectedH, expectedV);
+
+    AxisAlignedLineDetector detector;
+    std::vector<LineSegment> actualH, actualV;
+    detector.detectLines(image, actualH, actualV);
+
+    expectEqualLines(expectedH, actualH);
+    expectEqualLines(expectedV, actualV);
+}
+
+/**
+ * Tests an image with a few cabinet parts
+ */
+TEST(AxisAlignedLineDetector, parts)
+{
+    cv::Mat image = cv::Mat::zeros(240, 180, CV_8UC1);
+    cv::rectangle(image, cv::Point(10, 10), cv::Point(170, 80), cv::Scalar(255));
+    cv::rectangle(image, cv::Point(10, 90), cv::Point(85, 230), cv::Scalar(255));
+    cv::rectangle(image, cv::Point(95, 90), cv::Point(170, 230), cv::Scalar(255));
+    // A handle and a double edge
+    cv::line(image, cv::Point(60, 40), cv::Point(120, 40), cv::Scalar(255));
+    cv::line(image, cv::Point(10, 81), cv::Point(170, 81), cv::Scalar(255));
+
+    expectEquivalent(image);
+}
+
+/**
+ * Tests an image with too many lines such that the minimum length has to be
+ * increased several times
+ */
+TEST(AxisAlignedLineDetector, minLength)
+{
+    cv::Mat image = cv::Mat::zeros(300, 260, CV_8UC1);
+    for (int l = 0; l < 28; l++)
+    {
+        cv::line(image, cv::Point(5, 5 + 10*l), cv::Point(45 + 7*l, 5 + 10*l), cv::Scalar(255));
+    }
+    for (int l = 0; l < 20; l++)
+    {
+        cv::line(image, cv::Point(60 + 10*l, 290), cv::Point(60 + 10*l, 250 - 9*l), cv::Scalar(255));
+    }
+
+    AxisAlignedLineDetector detector;
+    std::vector<LineSegment> resultH, resultV;
+    const double minLength = detector.detectLines(image, resultH, resultV);
+    EXPECT_GT(minLength, detector.model.minLength);
+    EXPECT_LE(resultH.size() + resultV.size(), 30u);
+
+    expectEquivalent(image);
+}
+
+/**
+ * Tests that an empty image does not contain lines
+ */
+TEST(AxisAlignedLineDetector, empty)
+{
+    cv::Mat image = cv::Mat::zeros(100, 120, CV_8UC1);
+
+    AxisAlignedLineDetector detector;
+    std::vector<LineSegment> resultH, resultV;
+    EXPECT_EQ(detector.detectLines(image, resultH, resultV), detector.model.minLength);
+    EXPECT_EQ(resultH.size(), 0u);
+    EXPECT_EQ(resultV.size(), 0u);
+}
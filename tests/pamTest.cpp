@@ -0,0 +1,141 @@
+
+#include <random>
+#include <algorithm>
+#include <limits>
+#include "parser/pam.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Creates the distance matrix of random points in the plane that are
+ * scattered around the given number of centers
+ */
+static Eigen::MatrixXf createDistances(int N, int numCenters, float spread, std::mt19937 & g)
+{
+    std::uniform_real_distribution<float> centerDist(0, 100);
+    std::normal_distribution<float> noise(0, spread);
+    std::vector<Eigen::Vector2f> centers(numCenters);
+    for (int c = 0; c < numCenters; c++)
+    {
+        centers[c] = Eigen::Vector2f(centerDist(g), centerDist(g));
+    }
+
+    std::vector<Eigen::Vector2f> points(N);
+    for (int n = 0; n < N; n++)
+    {
+        points[n] = centers[n % numCenters] + Eigen::Vector2f(noise(g), noise(g));
+    }
+
+    Eigen::MatrixXf distances(N, N);
+    for (int i = 0; i < N; i++)
+    {
+        for (int j = 0; j < N; j++)
+        {
+            distances(i, j) = (points[i] - points[j]).norm();
+        }
+    }
+    return distances;
+}
+
+/**
+ * Computes the objective by enumerating the assignments
+ */
+static float computeObjective(const Eigen::MatrixXf & distances, const std::vector<int> & medoids)
+{
+    std::vector<int> assignments;
+    return KMedoids::computeAssignments(distances, medoids, assignments);
+}
+
+/**
+ * Asserts that no single swap improves the objective of the medoids
+ */
+static void assertLocallyOptimal(const Eigen::MatrixXf & distances, const std::vector<int> & medoids, float objective)
+{
+    const int K = static_cast<int>(medoids.size());
+    ASSERT_NEAR(objective, computeObjective(distances, medoids), 1e-3f);
+
+    for (int k = 0; k < K; k++)
+    {
+        for (int c = 0; c < distances.rows(); c++)
+        {
+            if (std::find(medoids.begin(), medoids.end(), c) != medoids.end())
+            {
+                continue;
+            }
+            std::vector<int> swapped = medoids;
+            swapped[k] = c;
+            ASSERT_GE(computeObjective(distances, swapped), objective*(1 - 1e-5f));
+        }
+    }
+}
+
+/**
+ * Tests that no single swap improves the result, both after the
+ * initialization and when starting from arbitrary medoids
+ */
+TEST(KMedoids, locallyOptimal)
+{
+    std::mt19937 g(0);
+    KMedoids kmedoids;
+
+    for (int K = 1; K <= 6; K++)
+    {
+        const Eigen::MatrixXf distances = createDistances(40, 4, 20, g);
+        std::vector<int> medoids;
+        const float objective = kmedoids.cluster(distances, K, medoids);
+        ASSERT_EQ(static_cast<int>(medoids.size()), K);
+        ASSERT_TRUE(std::is_sorted(medoids.begin(), medoids.end()));
+        assertLocallyOptimal(distances, medoids, objective);
+
+        for (int k = 0; k < K; k++)
+        {
+            medoids[k] = k;
+        }
+        assertLocallyOptimal(distances, medoids, kmedoids.swap(distances, medoids));
+    }
+}
+
+/**
+ * Tests that well separated clusters are found, i.e. the result equals the
+ * optimum over all subsets
+ */
+TEST(KMedoids, optimal)
+{
+    std::mt19937 g(1);
+    KMedoids kmedoids;
+    const Eigen::MatrixXf distances = createDistances(14, 3, 2, g);
+
+    std::vector<int> medoids;
+    const float objective = kmedoids.cluster(distances, 3, medoids);
+
+    float optimum = std::numeric_limits<float>::max();
+    for (int a = 0; a < 14; a++)
+    {
+        for (int b = a + 1; b < 14; b++)
+        {
+            for (int c = b + 1; c < 14; c++)
+            {
+                optimum = std::min(optimum, computeObjective(distances, {a, b, c}));
+            }
+        }
+    }
+    ASSERT_NEAR(objective, optimum, 1e-4f*optimum);
+}
+
+/**
+ * Tests the degenerate numbers of clusters
+ */
+TEST(KMedoids, degenerate)
+{
+    std::mt19937 g(2);
+    KMedoids kmedoids;
+    const Eigen::MatrixXf distances = createDistances(5, 2, 1, g);
+
+    std::vector<int> medoids;
+    ASSERT_FLOAT_EQ(kmedoids.cluster(distances, 8, medoids), 0);
+    ASSERT_EQ(medoids, std::vector<int>({0, 1, 2, 3, 4}));
+
+    ASSERT_FLOAT_EQ(kmedoids.cluster(distances, 0, medoids), 0);
+    ASSERT_TRUE(medoids.empty());
+}
@@ -0,0 +1,244 @@
+
+#include <ctime>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "parser/parse_cache.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Creates a part with the given geometry and label
+ */
+static Part createPart(float x0, float y0, float x1, float y1, int label, float posterior)
+{
+    Part part;
+    part.rect = Rectangle(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1));
+    part.label = label;
+    part.posterior = posterior;
+    part.likelihood = posterior/2;
+    part.shapePrior = 0.25f;
+    part.meanDepth = 100;
+    return part;
+}
+
+/**
+ * Creates an empty temporary cache directory
+ */
+static std::string createCacheDirectory()
+{
+    const boost::filesystem::path directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("parse_cache_%%%%%%%%");
+    boost::filesystem::create_directories(directory);
+    return directory.string();
+}
+
+/**
+ * Sets the last use of an entry
+ */
+static void setEntryTime(const std::string & directory, const std::string & key, std::time_t time)
+{
+    boost::filesystem::last_write_time(boost::filesystem::path(directory) / (key + ".parse"), time);
+}
+
+/**
+ * Tests that entries are written and read back exactly and that corrupted
+ * entries are rejected
+ */
+TEST(ParseCache, entries)
+{
+    const std::string directory = createCacheDirectory();
+    const std::string file = directory + "/entry.parse";
+
+    std::vector<Part> parts;
+    parts.push_back(createPart(10, 20, 110, 220, 0, 0.9f));
+    parts.push_back(createPart(110, 20, 210, 120, 1, 0.75f));
+    parts.push_back(createPart(110, 120, 210, 220, 2, 0.5f));
+    ASSERT_TRUE(ParseCache::writeEntry(file, "abc", parts));
+
+    std::vector<Part> result;
+    ASSERT_TRUE(ParseCache::readEntry(file, "abc", result));
+    ASSERT_EQ(result.size(), parts.size());
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        for (int v = 0; v < 4; v++)
+        {
+            ASSERT_EQ(result[p].rect[v][0], parts[p].rect[v][0]);
+            ASSERT_EQ(result[p].rect[v][1], parts[p].rect[v][1]);
+        }
+        ASSERT_EQ(result[p].label, parts[p].label);
+        ASSERT_EQ(result[p].posterior, parts[p].posterior);
+        ASSERT_EQ(result[p].likelihood, parts[p].likelihood);
+        ASSERT_EQ(result[p].shapePrior, parts[p].shapePrior);
+        ASSERT_EQ(result[p].meanDepth, parts[p].meanDepth);
+    }
+
+    // The entry belongs to a different key
+    ASSERT_FALSE(ParseCache::readEntry(file, "abd", result));
+
+    // Flip a byte
+    {
+        std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(20);
+        fs.put('x');
+    }
+    ASSERT_FALSE(ParseCache::readEntry(file, "abc", result));
+
+    boost::filesystem::remove_all(directory);
+}
+
+/**
+ * Tests that an entry with trailing bytes is rejected and leaves the output
+ * untouched
+ */
+TEST(ParseCache, trailingBytes)
+{
+    const std::string directory = createCacheDirectory();
+    const std::string file = directory + "/entry.parse";
+
+    std::vector<Part> parts(1, createPart(10, 20, 110, 220, 0, 0.9f));
+    ASSERT_TRUE(ParseCache::writeEntry(file, "abc", parts));
+
+    // Insert bytes before the checksum and fix the checksum
+    std::string buffer;
+    {
+        std::ifstream is(file, std::ios::binary);
+        buffer.assign((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    }
+    buffer.resize(buffer.size() - sizeof(uint64_t));
+    buffer.append(4, 'x');
+    ContentHasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    const uint64_t checksum = hasher.getHash();
+    buffer.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    {
+        std::ofstream os(file, std::ios::binary);
+        os.write(buffer.data(), buffer.size());
+    }
+
+    std::vector<Part> result(2, createPart(0, 0, 50, 50, 2, 0.5f));
+    ASSERT_FALSE(ParseCache::readEntry(file, "abc", result));
+    ASSERT_EQ(result.size(), 2);
+    ASSERT_EQ(result[0].label, 2);
+
+    boost::filesystem::remove_all(directory);
+}
+
+/**
+ * Tests that an entry claiming more parts than it contains is rejected
+ */
+TEST(ParseCache, numParts)
+{
+    const std::string directory = createCacheDirectory();
+    const std::string file = directory + "/entry.parse";
+
+    std::vector<Part> parts(1, createPart(10, 20, 110, 220, 0, 0.9f));
+    ASSERT_TRUE(ParseCache::writeEntry(file, "abc", parts));
+
+    // Overwrite the number of parts behind the magic, the version and the
+    // key and fix the checksum
+    std::string buffer;
+    {
+        std::ifstream is(file, std::ios::binary);
+        buffer.assign((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    }
+    buffer.resize(buffer.size() - sizeof(uint64_t));
+    const uint32_t numParts = 0xffffffff;
+    buffer.replace(4 + sizeof(uint32_t) + sizeof(uint32_t) + 3, sizeof(numParts), reinterpret_cast<const char*>(&numParts), sizeof(numParts));
+    ContentHasher hasher;
+    hasher.update(buffer.data(), buffer.size());
+    const uint64_t checksum = hasher.getHash();
+    buffer.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    {
+        std::ofstream os(file, std::ios::binary);
+        os.write(buffer.data(), buffer.size());
+    }
+
+    std::vector<Part> result;
+    ASSERT_FALSE(ParseCache::readEntry(file, "abc", result));
+    ASSERT_TRUE(result.empty());
+
+    boost::filesystem::remove_all(directory);
+}
+
+/**
+ * Tests the counters and that the least recently used entry is evicted
+ */
+TEST(ParseCache, eviction)
+{
+    const std::string directory = createCacheDirectory();
+
+    ParseCache cache;
+    ASSERT_TRUE(cache.open(directory));
+    cache.setMaxEntries(2);
+
+    std::vector<Part> parts(1, createPart(0, 0, 50, 50, 1, 0.5f));
+    std::vector<Part> result;
+
+    ASSERT_FALSE(cache.lookup("a", result));
+    cache.store("a", parts);
+    cache.store("b", parts);
+    ASSERT_EQ(cache.getNumEvictions(), 0);
+
+    // a is older than b but has been used recently
+    const std::time_t now = std::time(0);
+    setEntryTime(directory, "a", now - 100);
+    setEntryTime(directory, "b", now - 50);
+    ASSERT_TRUE(cache.lookup("a", result));
+    ASSERT_EQ(result.size(), 1);
+
+    cache.store("c", parts);
+    ASSERT_EQ(cache.getNumEvictions(), 1);
+    ASSERT_TRUE(cache.contains("a"));
+    ASSERT_FALSE(cache.contains("b"));
+    ASSERT_TRUE(cache.contains("c"));
+
+    std::vector<std::string> keys;
+    cache.listKeys(keys);
+    ASSERT_EQ(keys, std::vector<std::string>({"a", "c"}));
+
+    ASSERT_EQ(cache.getNumHits(), 1);
+    ASSERT_EQ(cache.getNumMisses(), 1);
+
+    boost::filesystem::remove_all(directory);
+}
+
+/**
+ * Tests that the index of a reopened cache evicts by the last use on disk
+ */
+TEST(ParseCache, reopen)
+{
+    const std::string directory = createCacheDirectory();
+    std::vector<Part> parts(1, createPart(0, 0, 50, 50, 1, 0.5f));
+
+    {
+        ParseCache cache;
+        ASSERT_TRUE(cache.open(directory));
+        cache.store("a", parts);
+        cache.store("b", parts);
+        cache.store("c", parts);
+    }
+
+    // b has been used least recently
+    const std::time_t now = std::time(0);
+    setEntryTime(directory, "a", now - 50);
+    setEntryTime(directory, "b", now - 100);
+    setEntryTime(directory, "c", now - 10);
+
+    ParseCache cache;
+    ASSERT_TRUE(cache.open(directory));
+    cache.setMaxEntries(3);
+    cache.store("d", parts);
+    ASSERT_EQ(cache.getNumEvictions(), 1);
+    ASSERT_FALSE(cache.contains("b"));
+
+    // The size bound is enforced from the index as well
+    cache.setMaxBytes(1);
+    cache.evict();
+    ASSERT_EQ(cache.getNumEvictions(), 4);
+
+    std::vector<std::string> keys;
+    cache.listKeys(keys);
+    ASSERT_TRUE(keys.empty());
+
+    boost::filesystem::remove_all(directory);
+}
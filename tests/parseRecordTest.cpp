@@ -0,0 +1,133 @@
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include "parser/parse_record.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Creates an axis aligned rectangle
+ */
+static Rectangle createRectangle(float x0, float y0, float x1, float y1)
+{
+    return Rectangle(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1));
+}
+
+/**
+ * Creates a record with three proposals and two ground truth parts. The
+ * third proposal does not overlap the ground truth.
+ */
+static void createRecord(ParseRecord & record)
+{
+    record.clear();
+    record.id = "cabinet";
+    record.rectangles.push_back(createRectangle(0, 0, 10, 10));
+    record.rectangles.push_back(createRectangle(20, 0, 30, 10));
+    record.rectangles.push_back(createRectangle(0, 20, 10, 30));
+
+    const int rectangles[] = {0, 1, 1, 2};
+    const int labels[] = {0, 2, 1, 0};
+    const float posteriors[] = {0.9f, 0.4f, 0.3f, 0.8f};
+    record.hypothesisRectangles.assign(rectangles, rectangles + 4);
+    record.hypothesisLabels.assign(labels, labels + 4);
+    record.hypothesisPosteriors.assign(posteriors, posteriors + 4);
+
+    record.bestState.push_back(0);
+    record.bestState.push_back(1);
+    record.bestState.push_back(3);
+
+    record.groundTruth.push_back(createRectangle(0, 0, 10, 10));
+    record.groundTruth.push_back(createRectangle(20, 0, 30, 10));
+    record.groundTruthLabels.push_back(0);
+    record.groundTruthLabels.push_back(1);
+}
+
+/**
+ * Tests that records are stored exactly and corrupted files are rejected
+ */
+TEST(ParseRecord, roundtrip)
+{
+    const boost::filesystem::path file = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("parse_record_%%%%%%%%.record");
+
+    ParseRecord record;
+    createRecord(record);
+    ASSERT_TRUE(ParseRecord::write(file.string(), record));
+
+    ParseRecord loaded;
+    ASSERT_TRUE(ParseRecord::read(file.string(), loaded));
+    ASSERT_EQ(loaded.id, record.id);
+    ASSERT_EQ(loaded.rectangles.size(), record.rectangles.size());
+    for (size_t r = 0; r < record.rectangles.size(); r++)
+    {
+        ASSERT_EQ(loaded.rectangles[r][2][0], record.rectangles[r][2][0]);
+        ASSERT_EQ(loaded.rectangles[r][2][1], record.rectangles[r][2][1]);
+    }
+    ASSERT_EQ(loaded.hypothesisRectangles, record.hypothesisRectangles);
+    ASSERT_EQ(loaded.hypothesisLabels, record.hypothesisLabels);
+    ASSERT_EQ(loaded.hypothesisPosteriors, record.hypothesisPosteriors);
+    ASSERT_EQ(loaded.bestState, record.bestState);
+    ASSERT_EQ(loaded.groundTruth.size(), record.groundTruth.size());
+    ASSERT_EQ(loaded.groundTruthLabels, record.groundTruthLabels);
+
+    // Flip a single byte
+    {
+        std::fstream fs(file.string(), std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(12);
+        fs.put('x');
+    }
+    ASSERT_FALSE(ParseRecord::read(file.string(), loaded));
+
+    boost::filesystem::remove(file);
+    ASSERT_FALSE(ParseRecord::read(file.string(), loaded));
+}
+
+/**
+ * Tests the statistics for known threshold combinations
+ */
+TEST(ParseRecordEvaluator, evaluate)
+{
+    ParseRecord record;
+    createRecord(record);
+
+    ParseRecordEvaluator evaluator;
+    evaluator.add(record);
+
+    // All selected parts and proposals
+    PrecisionRecallPoint point;
+    evaluator.evaluate(0.5f, 0, 0, point);
+    ASSERT_EQ(point.numGroundTruth, 2);
+    ASSERT_EQ(point.numDetected, 3);
+    ASSERT_EQ(point.numTrueDetected, 2);
+    ASSERT_EQ(point.numFound, 2);
+    ASSERT_EQ(point.numLabelCorrect, 1);
+    ASSERT_EQ(point.numProposals, 3);
+    ASSERT_EQ(point.numProposalsFound, 2);
+    ASSERT_FLOAT_EQ(point.getPrecision(), 2/3.0f);
+    ASSERT_FLOAT_EQ(point.getRecall(), 1);
+    ASSERT_FLOAT_EQ(point.getLabelAccuracy(), 0.5f);
+
+    // The second proposal is discarded by both thresholds
+    evaluator.evaluate(0.5f, 0.5f, 0.5f, point);
+    ASSERT_EQ(point.numDetected, 2);
+    ASSERT_EQ(point.numTrueDetected, 1);
+    ASSERT_EQ(point.numFound, 1);
+    ASSERT_EQ(point.numLabelCorrect, 1);
+    ASSERT_EQ(point.numProposals, 2);
+    ASSERT_EQ(point.numProposalsFound, 1);
+
+    // The sweep evaluates every combination
+    std::vector<float> acceptanceThresholds(1, 0.5f);
+    std::vector<float> thresholds;
+    thresholds.push_back(0);
+    thresholds.push_back(0.5f);
+    std::vector<PrecisionRecallPoint> points;
+    evaluator.sweep(acceptanceThresholds, thresholds, thresholds, points);
+    ASSERT_EQ(points.size(), 4u);
+    ASSERT_EQ(points[1].posteriorThreshold, 0);
+    ASSERT_EQ(points[1].pruningThreshold, 0.5f);
+    ASSERT_EQ(points[1].numFound, 2);
+    ASSERT_EQ(points[1].numProposalsFound, 1);
+    ASSERT_EQ(points[3].numDetected, point.numDetected);
+    ASSERT_EQ(points[3].numFound, point.numFound);
+}
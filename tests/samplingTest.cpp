@@ -0,0 +1,148 @@
+
+#include <random>
+#include "parser/sampling.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Draws many samples and returns the empirical distribution
+ */
+template <class Sampler>
+static std::vector<double> histogram(const Sampler & sampler, int n, int numSamples)
+{
+    std::mt19937 g(0);
+    std::uniform_real_distribution<float> dist(0, 1);
+    std::vector<double> result(n, 0);
+    for (int s = 0; s < numSamples; s++)
+    {
+        const int i = sampler.sample(dist(g));
+        EXPECT_GE(i, 0);
+        EXPECT_LT(i, n);
+        result[i] += 1.0/numSamples;
+    }
+    return result;
+}
+
+/**
+ * Tests that the alias table reproduces the distribution
+ */
+TEST(AliasTable, distribution)
+{
+    std::vector<float> weights = {0.2f, 0.0f, 0.5f, 0.02f, 0.28f};
+
+    AliasTable table;
+    table.build(weights);
+    ASSERT_EQ(table.size(), 5);
+
+    std::vector<double> frequencies = histogram(table, 5, 200000);
+    for (int i = 0; i < 5; i++)
+    {
+        ASSERT_NEAR(frequencies[i], weights[i], 0.01);
+    }
+    ASSERT_EQ(frequencies[1], 0);
+
+    // Zero weights give a uniform distribution
+    table.build(std::vector<float>(4, 0.0f));
+    frequencies = histogram(table, 4, 100000);
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_NEAR(frequencies[i], 0.25, 0.01);
+    }
+}
+
+/**
+ * Tests weight updates of the Fenwick tree
+ */
+TEST(FenwickSampler, updates)
+{
+    FenwickSampler sampler;
+    sampler.reset(7);
+    ASSERT_EQ(sampler.sample(0.5f), -1);
+
+    sampler.set(2, 1.0);
+    sampler.set(6, 3.0);
+    ASSERT_DOUBLE_EQ(sampler.total(), 4.0);
+    ASSERT_DOUBLE_EQ(sampler.prefixSum(3), 1.0);
+    ASSERT_EQ(sampler.sample(0.0f), 2);
+    ASSERT_EQ(sampler.sample(0.2f), 2);
+    ASSERT_EQ(sampler.sample(0.3f), 6);
+    ASSERT_EQ(sampler.sample(0.9999f), 6);
+
+    sampler.set(6, 0.0);
+    sampler.set(4, 1.0);
+    std::vector<double> frequencies = histogram(sampler, 7, 100000);
+    ASSERT_NEAR(frequencies[2], 0.5, 0.01);
+    ASSERT_NEAR(frequencies[4], 0.5, 0.01);
+    ASSERT_EQ(frequencies[6], 0);
+}
+
+/**
+ * Tests that the state sampler follows births and deaths
+ */
+TEST(StateWeightSampler, update)
+{
+    std::vector<float> weights(10, 0.0f);
+    weights[1] = 1.0f;
+    weights[3] = 3.0f;
+    weights[5] = 1.0f;
+
+    StateWeightSampler sampler;
+    sampler.reset(weights);
+
+    std::vector<int> state = {5, 3};
+    sampler.assign(state);
+    std::vector<double> frequencies = histogram(sampler, 10, 100000);
+    ASSERT_NEAR(frequencies[5], 0.25, 0.01);
+    ASSERT_NEAR(frequencies[3], 0.75, 0.01);
+
+    // Part 3 dies, parts 1 and 7 are born
+    sampler.remove(3);
+    sampler.insert(1);
+    sampler.insert(7);
+    frequencies = histogram(sampler, 10, 100000);
+    ASSERT_NEAR(frequencies[1], 0.5, 0.01);
+    ASSERT_NEAR(frequencies[5], 0.5, 0.01);
+    ASSERT_EQ(frequencies[3], 0);
+    ASSERT_EQ(frequencies[7], 0);
+
+    // A part that is in the state twice only dies with its last copy
+    sampler.insert(5);
+    sampler.remove(5);
+    frequencies = histogram(sampler, 10, 100000);
+    ASSERT_NEAR(frequencies[5], 0.5, 0.01);
+
+    // Hypotheses without a weight (e.g. created by splits) are ignored
+    sampler.insert(12);
+    sampler.remove(12);
+
+    // Only parts with zero weight
+    state = {7};
+    sampler.assign(state);
+    ASSERT_EQ(sampler.sample(0.5f), -1);
+}
+
+/**
+ * Tests that the sampler finds parts after the state changed
+ */
+TEST(StateWeightSampler, locate)
+{
+    std::vector<float> weights(10, 1.0f);
+
+    StateWeightSampler sampler;
+    sampler.reset(weights);
+
+    std::vector<int> state = {4, 2, 8};
+    ASSERT_EQ(sampler.locate(state, 2), 1);
+    ASSERT_EQ(sampler.locate(state, 8), 2);
+    ASSERT_EQ(sampler.locate(state, 6), -1);
+
+    // Replacing and erasing move parts around
+    state[1] = 6;
+    ASSERT_EQ(sampler.locate(state, 6), 1);
+    ASSERT_EQ(sampler.locate(state, 2), -1);
+    state.erase(state.begin());
+    ASSERT_EQ(sampler.locate(state, 8), 1);
+    ASSERT_EQ(sampler.locate(state, 6), 0);
+    ASSERT_EQ(sampler.locate(state, 12), -1);
+}
@@ -0,0 +1,147 @@
+
+#include "parser/sequence.h"
+#include "parser/synthetic.h"
+#include "parser/processing.h"
+#include "parser/util.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * The size of the rectified images in the tests
+ */
+static const int RECTIFIED_SIZE = 500;
+
+/**
+ * Rectifies the ground truth parts of a frame
+ */
+static void rectifyParts(const Segmentation & segmentation, std::vector<Rectangle> & result)
+{
+    Rectangle destination;
+    Processing::computeRectifiedRegionOfInterest(segmentation.regionOfInterest, RECTIFIED_SIZE, destination);
+    cv::Mat homography;
+    Processing::computeHomography(segmentation.regionOfInterest, destination, homography);
+
+    result.resize(segmentation.parts.size());
+    for (size_t p = 0; p < segmentation.parts.size(); p++)
+    {
+        RectangleUtil::applyHomography(homography, segmentation.parts[p], result[p]);
+        result[p].normalize();
+    }
+}
+
+/**
+ * Computes the canny edges of the rectified region of interest of a frame
+ */
+static void computeRectifiedEdges(const cv::Mat & image, const Segmentation & segmentation, cv::Mat & edges)
+{
+    cv::Mat gray, rectified;
+    cv::cvtColor(image, gray, CV_BGR2GRAY);
+    Processing::rectifyRegion(gray, segmentation.regionOfInterest, RECTIFIED_SIZE, rectified);
+    Processing::computeCannyEdges(rectified, edges);
+}
+
+/**
+ * Tests that the parts of the last frame are mapped onto the parts of the
+ * current frame
+ */
+TEST(SequenceState, warpRectangles)
+{
+    SyntheticSceneGenerator generator(3);
+    std::vector<cv::Mat> images, depthImages;
+    std::vector<Segmentation> segmentations;
+    generator.generateSequence(6, 5, 0.01, images, segmentations, depthImages);
+    ASSERT_EQ(segmentations.size(), 5);
+
+    for (size_t f = 1; f < segmentations.size(); f++)
+    {
+        ASSERT_EQ(segmentations[f].labels, segmentations[0].labels);
+
+        SequenceState sequence;
+        sequence.region = segmentations[f - 1].regionOfInterest;
+
+        cv::Mat homography;
+        sequence.computeFrameHomography(segmentations[f].regionOfInterest, RECTIFIED_SIZE, homography);
+
+        std::vector<Rectangle> lastParts, currentParts, warpedParts;
+        rectifyParts(segmentations[f - 1], lastParts);
+        rectifyParts(segmentations[f], currentParts);
+        SequenceState::warpRectangles(homography, lastParts, warpedParts);
+
+        ASSERT_EQ(warpedParts.size(), currentParts.size());
+        for (size_t p = 0; p < currentParts.size(); p++)
+        {
+            ASSERT_GT(RectangleUtil::calcIOU(warpedParts[p], currentParts[p]), 0.9f);
+        }
+    }
+}
+
+/**
+ * Tests that consecutive frames are detected as similar and unrelated scenes
+ * as different
+ */
+TEST(SequenceState, computeEdgeChange)
+{
+    SyntheticSceneGenerator generator(5);
+    generator.model.noise = 0;
+    std::vector<cv::Mat> images, depthImages;
+    std::vector<Segmentation> segmentations;
+    generator.generateSequence(8, 2, 0.01, images, segmentations, depthImages);
+
+    cv::Mat lastEdges, currentEdges;
+    computeRectifiedEdges(images[0], segmentations[0], lastEdges);
+    computeRectifiedEdges(images[1], segmentations[1], currentEdges);
+
+    SequenceState sequence;
+    sequence.region = segmentations[0].regionOfInterest;
+    cv::Mat homography;
+    sequence.computeFrameHomography(segmentations[1].regionOfInterest, RECTIFIED_SIZE, homography);
+
+    const float consecutiveChange = SequenceState::computeEdgeChange(lastEdges, currentEdges, homography);
+    ASSERT_LT(consecutiveChange, sequence.model.maxEdgeChange);
+
+    // A different cabinet
+    SyntheticSceneGenerator otherGenerator(6);
+    otherGenerator.model.noise = 0;
+    cv::Mat otherImage, otherDepth, otherEdges;
+    Segmentation otherSegmentation;
+    otherGenerator.generate(3, otherImage, otherSegmentation, otherDepth);
+    computeRectifiedEdges(otherImage, otherSegmentation, otherEdges);
+
+    const float unrelatedChange = SequenceState::computeEdgeChange(lastEdges, otherEdges, homography);
+    ASSERT_GT(unrelatedChange, 2*consecutiveChange);
+}
+
+/**
+ * Tests the region motion and the fallback to a full parse
+ */
+TEST(SequenceState, canWarmStart)
+{
+    SequenceState sequence;
+    sequence.region = Rectangle(Vec2(0, 0), Vec2(300, 0), Vec2(300, 400), Vec2(0, 400));
+
+    const Rectangle moved(Vec2(0, 100), Vec2(300, 100), Vec2(300, 500), Vec2(0, 500));
+    ASSERT_NEAR(sequence.computeRegionMotion(moved), 0.2f, 1e-5f);
+    ASSERT_NEAR(sequence.computeRegionMotion(sequence.region), 0, 1e-5f);
+
+    // There is no last frame yet
+    std::vector<Rectangle> trackedProposals;
+    std::vector<Part> trackedParts;
+    cv::Mat edges(RECTIFIED_SIZE, RECTIFIED_SIZE, CV_8UC1, cv::Scalar(0));
+    ASSERT_FALSE(sequence.canWarmStart(sequence.region, edges, RECTIFIED_SIZE, trackedProposals, trackedParts));
+
+    cv::rectangle(edges, cv::Point(50, 50), cv::Point(200, 300), cv::Scalar(255));
+    std::vector<Rectangle> proposals(1, Rectangle(Vec2(50, 50), Vec2(200, 50), Vec2(200, 300), Vec2(50, 300)));
+    sequence.update(sequence.region, edges, proposals, std::vector<Part>(), false);
+    ASSERT_TRUE(sequence.canWarmStart(sequence.region, edges, RECTIFIED_SIZE, trackedProposals, trackedParts));
+    ASSERT_EQ(trackedProposals.size(), 1);
+    ASSERT_NEAR(trackedProposals[0][0][0], 50, 0.5f);
+    ASSERT_NEAR(trackedProposals[0][2][1], 300, 0.5f);
+
+    // The camera moved too much
+    ASSERT_FALSE(sequence.canWarmStart(moved, edges, RECTIFIED_SIZE, trackedProposals, trackedParts));
+
+    // A keyframe is due
+    sequence.framesSinceKeyframe = sequence.model.keyframeInterval;
+    ASSERT_FALSE(sequence.canWarmStart(sequence.region, edges, RECTIFIED_SIZE, trackedProposals, trackedParts));
+}
@@ -0,0 +1,229 @@
+
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "parser/server.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests that requests and responses are transferred exactly
+ */
+TEST(ParseProtocol, roundtrip)
+{
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    cv::Mat image(48, 64, CV_8UC3), imageDepth(48, 64, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::randu(imageDepth, cv::Scalar::all(0), cv::Scalar::all(255));
+    const Rectangle region(Vec2(1, 2), Vec2(60, 3), Vec2(61, 40), Vec2(2, 41));
+
+    std::string payload;
+    ParseProtocol::encodeRequest(image, imageDepth, region, payload);
+    ASSERT_TRUE(ParseProtocol::writeFrame(sockets[0], ParseProtocol::MESSAGE_PARSE_REQUEST, payload));
+
+    uint8_t type;
+    std::string received;
+    ASSERT_TRUE(ParseProtocol::readFrame(sockets[1], type, received));
+    ASSERT_EQ(type, ParseProtocol::MESSAGE_PARSE_REQUEST);
+
+    cv::Mat decodedImage, decodedDepth;
+    Rectangle decodedRegion;
+    ASSERT_TRUE(ParseProtocol::decodeRequest(received, decodedImage, decodedDepth, decodedRegion));
+    ASSERT_EQ(decodedImage.type(), image.type());
+    ASSERT_EQ(cv::norm(decodedImage, image, cv::NORM_L1), 0);
+    ASSERT_EQ(cv::norm(decodedDepth, imageDepth, cv::NORM_L1), 0);
+    for (int v = 0; v < 4; v++)
+    {
+        ASSERT_EQ(decodedRegion[v][0], region[v][0]);
+        ASSERT_EQ(decodedRegion[v][1], region[v][1]);
+    }
+
+    // Truncated requests are rejected
+    ASSERT_FALSE(ParseProtocol::decodeRequest(received.substr(0, received.size() - 1), decodedImage, decodedDepth, decodedRegion));
+
+    std::vector<Part> parts(2);
+    parts[0].rect = Rectangle(Vec2(0, 0), Vec2(10, 0), Vec2(10, 20), Vec2(0, 20));
+    parts[0].label = 0;
+    parts[0].posterior = 0.75f;
+    parts[1].rect = Rectangle(Vec2(10, 0), Vec2(30, 0), Vec2(30, 20), Vec2(10, 20));
+    parts[1].label = 2;
+    parts[1].posterior = 0.5f;
+    std::vector< std::pair<std::string, double> > timings;
+    timings.push_back(std::make_pair("total", 1.5));
+    timings.push_back(std::make_pair("annealing", 0.25));
+
+    ParseProtocol::encodeResponse(parts, timings, payload);
+    ASSERT_TRUE(ParseProtocol::writeFrame(sockets[1], ParseProtocol::MESSAGE_PARSE_RESPONSE, payload));
+    ASSERT_TRUE(ParseProtocol::readFrame(sockets[0], type, received));
+    ASSERT_EQ(type, ParseProtocol::MESSAGE_PARSE_RESPONSE);
+
+    std::vector<Part> decodedParts;
+    std::vector< std::pair<std::string, double> > decodedTimings;
+    ASSERT_TRUE(ParseProtocol::decodeResponse(received, decodedParts, decodedTimings));
+    ASSERT_EQ(decodedParts.size(), parts.size());
+    for (size_t p = 0; p < parts.size(); p++)
+    {
+        ASSERT_EQ(decodedParts[p].label, parts[p].label);
+        ASSERT_EQ(decodedParts[p].posterior, parts[p].posterior);
+        ASSERT_EQ(decodedParts[p].rect[2][0], parts[p].rect[2][0]);
+        ASSERT_EQ(decodedParts[p].rect[2][1], parts[p].rect[2][1]);
+    }
+    ASSERT_EQ(decodedTimings, timings);
+
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
+
+/**
+ * Tests that oversized frames and closed connections are detected
+ */
+TEST(ParseProtocol, invalidFrames)
+{
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    char header[5];
+    const uint32_t size = ParseProtocol::MAX_PAYLOAD_SIZE + 1;
+    std::memcpy(header, &size, sizeof(size));
+    header[4] = ParseProtocol::MESSAGE_PARSE_REQUEST;
+    ASSERT_EQ(::write(sockets[0], header, sizeof(header)), static_cast<ssize_t>(sizeof(header)));
+
+    uint8_t type;
+    std::string payload;
+    ASSERT_FALSE(ParseProtocol::readFrame(sockets[1], type, payload));
+
+    ::close(sockets[0]);
+    ASSERT_FALSE(ParseProtocol::readFrame(sockets[1], type, payload));
+    ::close(sockets[1]);
+}
+
+/**
+ * Tests that a frame arriving slower than the receive timeout of the socket
+ * is still read completely
+ */
+TEST(ParseProtocol, slowFrame)
+{
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 50000;
+    ASSERT_EQ(::setsockopt(sockets[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)), 0);
+
+    char header[5];
+    const uint32_t size = 3;
+    std::memcpy(header, &size, sizeof(size));
+    header[4] = ParseProtocol::MESSAGE_PARSE_REQUEST;
+    ASSERT_EQ(::write(sockets[0], header, sizeof(header)), static_cast<ssize_t>(sizeof(header)));
+
+    std::thread writer([&sockets]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        ASSERT_EQ(::write(sockets[0], "abc", 3), 3);
+    });
+
+    uint8_t type;
+    std::string payload;
+    ASSERT_TRUE(ParseProtocol::readFrame(sockets[1], type, payload));
+    ASSERT_EQ(type, ParseProtocol::MESSAGE_PARSE_REQUEST);
+    ASSERT_EQ(payload, "abc");
+
+    writer.join();
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
+
+/**
+ * Encodes a request whose image header claims a size that overflows when the
+ * dimensions are multiplied
+ */
+static std::string createOverflowingRequest()
+{
+    std::string payload(8*sizeof(float), '\0');
+    const int32_t header[3] = {1 << 30, 1 << 30, CV_MAKETYPE(CV_64F, CV_CN_MAX)};
+    payload.append(reinterpret_cast<const char*>(header), sizeof(header));
+    return payload;
+}
+
+/**
+ * Tests that image headers with huge dimensions are rejected before 
+ * allocating the image
+ */
+TEST(ParseProtocol, overflowingImage)
+{
+    cv::Mat image, imageDepth;
+    Rectangle region;
+    ASSERT_FALSE(ParseProtocol::decodeRequest(createOverflowingRequest(), image, imageDepth, region));
+
+    // An invalid type
+    std::string payload(8*sizeof(float), '\0');
+    const int32_t header[3] = {1, 1, 1 << 20};
+    payload.append(reinterpret_cast<const char*>(header), sizeof(header));
+    payload.append(64, '\0');
+    ASSERT_FALSE(ParseProtocol::decodeRequest(payload, image, imageDepth, region));
+}
+
+/**
+ * Connects a raw socket to the server
+ */
+static int connectTo(const std::string & socketPath)
+{
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Tests that malformed requests are answered with an error and the server
+ * keeps serving
+ */
+TEST(ParseServer, malformedRequest)
+{
+    CabinetParser parser;
+    ParseServer server(parser);
+    server.model.numWorkers = 1;
+    const std::string socketPath = "/tmp/parser_server_test_" + std::to_string(::getpid()) + ".sock";
+    ASSERT_TRUE(server.listen(socketPath));
+    std::thread thread(&ParseServer::run, &server);
+
+    // The second connection is only answered if the server survived the
+    // first one
+    int numAnswered = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        const int fd = connectTo(socketPath);
+        uint8_t type;
+        std::string payload;
+        if (fd >= 0 &&
+                ParseProtocol::writeFrame(fd, ParseProtocol::MESSAGE_PARSE_REQUEST, createOverflowingRequest()) &&
+                ParseProtocol::readFrame(fd, type, payload) &&
+                type == ParseProtocol::MESSAGE_ERROR)
+        {
+            numAnswered++;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+
+    server.stop();
+    thread.join();
+    ASSERT_EQ(numAnswered, 2);
+    ASSERT_EQ(server.getNumErrors(), 2);
+}
@@ -0,0 +1,126 @@
+
+#include <random>
+#include <cstdio>
+#include <fstream>
+#include "parser/shape_prior.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Trains a linear SVM on random points that are labeled by a random plane
+ */
+static void trainRandomSVM(CvSVM & svm, int numFeatures, std::mt19937 & g)
+{
+    std::uniform_real_distribution<float> dist(0, 1);
+    std::vector<float> normal(numFeatures);
+    for (int f = 0; f < numFeatures; f++)
+    {
+        normal[f] = dist(g) - 0.5f;
+    }
+
+    cv::Mat data(200, numFeatures, CV_32FC1);
+    cv::Mat labels(200, 1, CV_32FC1);
+    for (int n = 0; n < data.rows; n++)
+    {
+        float projection = 0;
+        for (int f = 0; f < numFeatures; f++)
+        {
+            data.at<float>(n, f) = dist(g);
+            projection += normal[f]*(data.at<float>(n, f) - 0.5f);
+        }
+        labels.at<float>(n, 0) = projection > 0 ? 1 : -1;
+    }
+
+    CvSVMParams params;
+    params.svm_type = CvSVM::C_SVC;
+    params.kernel_type = CvSVM::LINEAR;
+    params.term_crit = cvTermCriteria(CV_TERMCRIT_ITER+CV_TERMCRIT_EPS, 1000, FLT_EPSILON);
+    svm.train(data, labels, cv::Mat(), cv::Mat(), params);
+}
+
+/**
+ * Tests that the reduced SVMs reproduce the decision values of CvSVM
+ */
+TEST(LinearShapePrior, decisionValues)
+{
+    std::mt19937 g(0);
+    const int numFeatures = 7;
+    std::vector<std::string> files;
+    std::vector<CvSVM*> svms;
+    for (int l = 0; l < 3; l++)
+    {
+        svms.push_back(new CvSVM());
+        trainRandomSVM(*svms[l], numFeatures, g);
+        files.push_back("shapePriorTest" + std::to_string(l) + ".xml");
+        svms[l]->save(files[l].c_str());
+    }
+
+    LinearShapePrior prior;
+    ASSERT_TRUE(prior.loadSVMs(files));
+    ASSERT_EQ(prior.getNumFeatures(), numFeatures);
+    ASSERT_EQ(prior.getNumLabels(), 3);
+
+    std::uniform_real_distribution<float> dist(0, 1.5f);
+    Eigen::MatrixXf features(100, numFeatures);
+    for (int n = 0; n < features.rows(); n++)
+    {
+        for (int f = 0; f < numFeatures; f++)
+        {
+            features(n, f) = dist(g);
+        }
+    }
+
+    Eigen::MatrixXf values, priors;
+    prior.computeDecisionValues(features, values);
+    prior.computePriors(features, 2.0f, priors);
+    ASSERT_EQ(values.rows(), features.rows());
+    ASSERT_EQ(values.cols(), 3);
+
+    for (int n = 0; n < features.rows(); n++)
+    {
+        cv::Mat sample(1, numFeatures, CV_32FC1);
+        for (int f = 0; f < numFeatures; f++)
+        {
+            sample.at<float>(0, f) = features(n, f);
+        }
+        for (int l = 0; l < 3; l++)
+        {
+            const float expected = svms[l]->predict(sample, true);
+            ASSERT_NEAR(values(n, l), expected, 1e-4f*(1 + std::abs(expected)));
+            ASSERT_NEAR(priors(n, l), 1 - (1.0 / (1.0 + exp(-2.0f*expected))), 1e-4f);
+        }
+    }
+
+    for (int l = 0; l < 3; l++)
+    {
+        delete svms[l];
+        std::remove(files[l].c_str());
+    }
+}
+
+/**
+ * Tests writing and reading the model file
+ */
+TEST(LinearShapePrior, io)
+{
+    LinearShapePrior prior;
+    prior.weights = Eigen::MatrixXf::Random(5, 3);
+    prior.biases = Eigen::VectorXf::Random(3);
+    ASSERT_TRUE(prior.save("shapePriorTest.dat"));
+
+    LinearShapePrior loaded;
+    ASSERT_TRUE(loaded.load("shapePriorTest.dat"));
+    ASSERT_TRUE(loaded.weights == prior.weights);
+    ASSERT_TRUE(loaded.biases == prior.biases);
+
+    // Corrupt a weight
+    {
+        std::fstream fs("shapePriorTest.dat", std::ios::in | std::ios::out | std::ios::binary);
+        fs.seekp(20);
+        fs.put('x');
+    }
+    ASSERT_FALSE(loaded.load("shapePriorTest.dat"));
+    ASSERT_FALSE(loaded.load("shapePriorTestMissing.dat"));
+    std::remove("shapePriorTest.dat");
+}
@@ -0,0 +1,68 @@
+
+#include <random>
+#include "parser/similarity_index.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests that the grid based index finds the same neighbors as the all pairs
+ * comparison
+ */
+TEST(SimilarityIndex, allPairs)
+{
+    std::mt19937 g(0);
+    std::uniform_real_distribution<float> posDist(0, 400);
+    std::uniform_real_distribution<float> sizeDist(5, 120);
+
+    PartHypothesisTable table;
+    std::vector<int> projProf;
+    for (int r = 0; r < 150; r++)
+    {
+        float x0 = posDist(g), y0 = posDist(g);
+        float x1 = x0 + sizeDist(g), y1 = y0 + sizeDist(g);
+
+        // Create some nested rectangles
+        if (r % 5 == 1)
+        {
+            x0 = table.getMinX(table.size() - 1) + 2;
+            y0 = table.getMinY(table.size() - 1) + 2;
+            x1 = table.getMaxX(table.size() - 1);
+            y1 = table.getMaxY(table.size() - 1) - 1;
+        }
+
+        const int rect = table.addRectangle(Rectangle(Vec2(x0, y0), Vec2(x1, y0), Vec2(x1, y1), Vec2(x0, y1)), 0, projProf, projProf);
+        for (int l = 0; l < 3; l++)
+        {
+            table.addHypothesis(rect, l, 0, 0, 0);
+        }
+    }
+
+    SimilarityIndex index;
+    index.build(table, 0.7f, 1.0f);
+    ASSERT_EQ(index.size(), table.size());
+
+    for (int n = 0; n < table.size(); n++)
+    {
+        const float boundsN[4] = {table.getMinX(n), table.getMinY(n), table.getMaxX(n), table.getMaxY(n)};
+
+        std::vector<int> expected;
+        for (int m = 0; m < table.size(); m++)
+        {
+            const float boundsM[4] = {table.getMinX(m), table.getMinY(m), table.getMaxX(m), table.getMaxY(m)};
+            const float score = SimilarityIndex::calcOverlapScore(boundsN, boundsM);
+            if (m == n || (score > 0.7f && score < 1.0f))
+            {
+                expected.push_back(m);
+            }
+        }
+
+        std::vector<int> actual;
+        for (int k = 0; k < index.getNumNeighbors(n); k++)
+        {
+            actual.push_back(index.getNeighbor(n, k));
+        }
+
+        ASSERT_EQ(actual, expected);
+    }
+}
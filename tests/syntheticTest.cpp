@@ -0,0 +1,69 @@
+
+#include "parser/synthetic.h"
+#include "gtest/gtest.h"
+
+using namespace parser;
+
+/**
+ * Tests if the layout contains the requested number of non overlapping parts
+ * on the unit square
+ */
+TEST(SyntheticSceneGenerator, generateLayout)
+{
+    SyntheticSceneGenerator generator(42);
+    
+    std::vector<Rectangle> parts;
+    std::vector<int> labels;
+    generator.generateLayout(13, parts, labels);
+    
+    ASSERT_EQ(parts.size(), 13);
+    ASSERT_EQ(labels.size(), 13);
+    
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        ASSERT_GE(parts[i].minX(), 0);
+        ASSERT_GE(parts[i].minY(), 0);
+        ASSERT_LE(parts[i].maxX(), 1);
+        ASSERT_LE(parts[i].maxY(), 1);
+        ASSERT_GE(labels[i], 0);
+        ASSERT_LE(labels[i], 2);
+        
+        for (size_t j = i + 1; j < parts.size(); j++)
+        {
+            const bool disjoint = parts[i].maxX() <= parts[j].minX() || parts[j].maxX() <= parts[i].minX() ||
+                                  parts[i].maxY() <= parts[j].minY() || parts[j].maxY() <= parts[i].minY();
+            ASSERT_TRUE(disjoint);
+        }
+    }
+}
+
+/**
+ * Tests if the generated scene is consistent and reproducible
+ */
+TEST(SyntheticSceneGenerator, generate)
+{
+    cv::Mat image1, depth1, image2, depth2;
+    Segmentation segmentation1, segmentation2;
+    
+    SyntheticSceneGenerator generator1(7);
+    generator1.generate(8, image1, segmentation1, depth1);
+    SyntheticSceneGenerator generator2(7);
+    generator2.generate(8, image2, segmentation2, depth2);
+    
+    ASSERT_EQ(image1.type(), CV_8UC3);
+    ASSERT_EQ(depth1.type(), CV_8UC3);
+    ASSERT_EQ(segmentation1.parts.size(), 8);
+    ASSERT_EQ(segmentation1.labels.size(), 8);
+    ASSERT_EQ(cv::norm(image1, image2, cv::NORM_L1), 0);
+    ASSERT_EQ(cv::norm(depth1, depth2, cv::NORM_L1), 0);
+    
+    // All parts lie within the region of interest
+    const Rectangle & roi = segmentation1.regionOfInterest;
+    for (size_t i = 0; i < segmentation1.parts.size(); i++)
+    {
+        ASSERT_GE(segmentation1.parts[i].minX(), roi.minX());
+        ASSERT_GE(segmentation1.parts[i].minY(), roi.minY());
+        ASSERT_LE(segmentation1.parts[i].maxX(), roi.maxX());
+        ASSERT_LE(segmentation1.parts[i].maxY(), roi.maxY());
+    }
+}